@@ -0,0 +1,94 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      adapt.h
+#
+# Purpose:   Adaptive number of workers.
+#
+#            A run starts with a few
+#            workers. Every interval the
+#            throughput (input bytes done)
+#            and the I/O pressure of the
+#            system (PSI, the share of
+#            time tasks stalled on I/O)
+#            are measured:
+#
+#            - a worker is added and kept
+#              if the throughput grew,
+#              retired if the device is
+#              saturated. The next probe
+#              waits a while.
+#            - under pressure no worker
+#              is added, one is retired
+#              if the throughput drops
+#              (other I/O competes).
+#
+#            An interval lasts until a
+#            few pieces are done, the
+#            counter grows by pieces.
+#
+#            Workers are retired between
+#            two tracks (chunks), they
+#            wait until they are wanted
+#            again or the run ends.
+#
+#==========================================
+*/
+#ifndef ADAPT_H_
+#define ADAPT_H_
+
+#include <stdint.h>
+
+#include "waver.h"
+
+#define ADAPT_START     2       /* workers at the start */
+#define ADAPT_INTERVAL  500     /* ms between two looks at the counters */
+#define ADAPT_MIN_BYTES ( 4L * BLOCK_SIZE )  /* of a measurement, */
+#define ADAPT_MAX_TIME  4.0                  /* unless it takes longer (s) */
+#define ADAPT_GAIN      0.05    /* an added worker stays above this growth */
+#define ADAPT_PRESSURE  0.40    /* stalled share of time, no worker is added */
+#define ADAPT_SETTLE    6       /* intervals without a probe after a retire */
+#define ADAPT_PSI_FILE  "/proc/pressure/io"
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  int32_t  max;         /* workers at most */
+  int32_t  wanted;      /* workers that take tracks */
+  uint64_t bytes;       /* input bytes done at the last measurement */
+  uint64_t stalled;     /* us of the "some" stall, ditto */
+  double   time;        /* s, ditto */
+  uint8_t  has_psi;     /* kernels before 4.20 or without CONFIG_PSI */
+  uint8_t  probing;     /* a worker was added, its gain is measured next */
+  uint32_t settle;      /* intervals until the next probe */
+  double   base_rate;   /* MB/s before the last worker was added */
+  double   rate;        /* MB/s of the last interval */
+  double   pressure;    /* stalled share of the last interval */
+
+} adapt_t;
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+void adapt_init( adapt_t* ad, int32_t max, uint64_t bytes );
+int32_t adapt_step( adapt_t* ad, uint64_t bytes );
+
+/* ****************************************************************** */
+#endif /* ADAPT_H_ */
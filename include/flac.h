@@ -0,0 +1,102 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      flac.h
+#
+# Purpose:   Native FLAC encoder for the
+#            16 bit stereo DAO payload.
+#
+#            Frames are made of a fixed
+#            number of whole sectors, so
+#            every BLOCK_SIZE chunk of a
+#            track can be encoded on its
+#            own by any worker thread.
+#
+#==========================================
+*/
+#ifndef FLAC_H_
+#define FLAC_H_
+
+#include <stdint.h>
+
+#include "waver.h"
+
+/*
+ * One FLAC frame holds 7 sectors (7 * 588 = 4116 samples).
+ * This keeps the frames within the FLAC subset (<= 4608 samples
+ * at 44.1 kHz) and BLOCK_SIZE (14266 sectors) is an exact
+ * multiple of it: 14266 = 7 * 2038. Thus chunks of BLOCK_SIZE
+ * never split a frame.
+ */
+#define FLAC_SECTORS_PER_FRAME  7
+#define FLAC_BLOCKSIZE          ( ( SECTOR_LEN / EFFECTIVE_BYTES ) * \
+                                  FLAC_SECTORS_PER_FRAME )
+#define FLAC_FRAME_BYTES        ( SECTOR_LEN * FLAC_SECTORS_PER_FRAME )
+
+#define FLAC_MAX_LPC_ORDER      8
+#define FLAC_QLP_PRECISION     14
+
+#define FLAC_STREAMINFO_LEN    34
+#define FLAC_HEADER_LEN        ( 4 + 4 + FLAC_STREAMINFO_LEN ) /* "fLaC" +
+                                                                  block header +
+                                                                  STREAMINFO */
+#define FLAC_EXTENSION     ".flac"
+
+/*
+ * Worst case size of one encoded frame. A subframe is never
+ * larger than its verbatim encoding (side channel: 17 bit
+ * per sample), plus frame header and footer.
+ */
+#define FLAC_MAX_FRAME_LEN      ( 2 * ( 2 + ( ( BITS_PER_SAMPLE + 1 ) * \
+                                              FLAC_BLOCKSIZE + 7 ) / 8 ) + 32 )
+
+#if ( BLOCK_SIZE % FLAC_FRAME_BYTES ) != 0
+#error "BLOCK_SIZE must be a multiple of FLAC_FRAME_BYTES"
+#endif
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  uint32_t min_blocksize;
+  uint32_t max_blocksize;
+  uint32_t min_framesize;
+  uint32_t max_framesize;
+  uint64_t total_samples;
+  uint8_t  md5[ 16 ];
+
+} flac_streaminfo_t;
+
+
+/* opaque encoder state (work buffers), not shared between threads */
+typedef struct flac_encoder flac_encoder_t;
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+flac_encoder_t* flac_encoder_create( void );
+void flac_encoder_destroy( flac_encoder_t* encoder );
+uint32_t flac_encode_block( flac_encoder_t* encoder, const char* pcm, uint32_t pcm_len,
+                            uint32_t first_frame_no, uint8_t* out,
+                            uint32_t* min_framesize, uint32_t* max_framesize );
+void flac_stream_header( uint8_t buf[ FLAC_HEADER_LEN ],
+                         const flac_streaminfo_t* info );
+
+/* ****************************************************************** */
+#endif /* FLAC_H_ */
@@ -0,0 +1,95 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      journal.h
+#
+# Purpose:   Persisted job journal to skip
+#            finished tracks and resume
+#            partial ones after a crash.
+#
+#            The journal is a text file,
+#            one record per line:
+#
+#            WAVER-JOURNAL 1 <job key>
+#            C <track> <chunk> <end> <len> <sum>
+#            D <track> <file size>
+#
+#            A chunk record is appended
+#            only after the chunk is on
+#            the device (fdatasync), <end>
+#            is the output file offset up
+#            to which the track is durable.
+#            The job key identifies bin,
+#            cue and options. A journal
+#            with another key is discarded.
+#
+#==========================================
+*/
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "libwaver.h"
+
+#define JOURNAL_MAGIC    "WAVER-JOURNAL 1"
+#define JOURNAL_KEY_LEN  256
+
+#define ADLER_MOD   65521
+#define ADLER_NMAX  5552  /* max bytes before the sums must be reduced */
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  uint8_t  done;       /* a "D" record exists */
+  uint64_t file_size;  /* size of the complete output file */
+  uint32_t chunks;     /* durable chunks (contiguous from chunk 0) */
+  uint64_t end;        /* output file offset up to which it is durable */
+  uint32_t last_len;  /* length of the last durable chunk */
+  uint32_t last_sum;  /* checksum of the last durable chunk */
+
+} journal_track_t;
+
+
+typedef struct
+{
+
+  int              fd;
+  pthread_mutex_t  lock;
+  journal_track_t* tracks;
+  uint8_t          tracks_len;
+
+} journal_t;
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+waver_status_t journal_open( journal_t* journal, const char* path,
+                             const char* key, uint8_t tracks_len );
+waver_status_t journal_close( journal_t* journal );
+waver_status_t journal_chunk( journal_t* journal, uint8_t track_no, uint32_t chunk_no,
+                              uint64_t end, uint32_t len, uint32_t sum );
+waver_status_t journal_done( journal_t* journal, uint8_t track_no, uint64_t file_size );
+void journal_forget( journal_t* journal, uint8_t track_no );
+uint32_t journal_checksum( uint32_t sum, const void* data, uint32_t len );
+
+/* ****************************************************************** */
+#endif /* JOURNAL_H_ */
@@ -0,0 +1,57 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      kernel.h
+#
+# Purpose:   Payload kernels. One pass
+#            over a piece of payload that
+#            swaps the bytes of the audio
+#            samples and sums the journal
+#            checksum, as needed.
+#
+#            Every combination of the
+#            options is its own function,
+#            specialized at compile time,
+#            and chosen once per track.
+#            The loops never test options.
+#
+#            Sample kernels widen the 16
+#            bit samples to the sample
+#            format of the output in the
+#            same pass.
+#
+#==========================================
+*/
+#ifndef KERNEL_H_
+#define KERNEL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "waver.h"
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+payload_kernel_t payload_kernel( uint8_t swap, uint8_t checksum );
+uint32_t payload_generic( char* buf, uint32_t len, uint8_t swap, uint8_t checksum );
+sample_kernel_t sample_kernel( uint8_t format, uint8_t swap, uint8_t checksum );
+uint8_t sample_len( uint8_t format );
+uint32_t payload_kernel_bench( FILE* log, waver_calibration_t* cal );
+
+/* ****************************************************************** */
+#endif /* KERNEL_H_ */
@@ -0,0 +1,345 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      libwaver.h
+#
+# Purpose:   Public interface of libwaver.
+#
+#            All state of a conversion
+#            lives in a context object,
+#            so any number of discs can be
+#            converted concurrently in one
+#            process. Errors are reported
+#            as status codes, the library
+#            never terminates the process.
+#
+#            Typical use:
+#
+#              waver_ctx_t* ctx;
+#              waver_input_t in;
+#              waver_output_t out;
+#
+#              waver_create( &ctx );
+#              waver_input_file( &in, "foo.bin" );
+#              waver_output_files( &out, "bar" );
+#              waver_set_input( ctx, &in );
+#              waver_set_output( ctx, &out );
+#              waver_set_cue_file( ctx, "foo.cue" );
+#              waver_set_swap( ctx, 1 );
+#              if( waver_run( ctx ) != WAVER_OK )
+#                puts( waver_error_message( ctx ) );
+#              waver_destroy( ctx );
+#
+#==========================================
+*/
+#ifndef LIBWAVER_H_
+#define LIBWAVER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* output formats */
+#define WAVER_FORMAT_WAV   0
+#define WAVER_FORMAT_FLAC  1
+
+/* sector layouts of the input */
+#define WAVER_SECTORS_AUTO    0  /* raw if the size only fits raw sectors */
+#define WAVER_SECTORS_COOKED  1  /* 2352 bytes per sector */
+#define WAVER_SECTORS_RAW     2  /* 3234 bytes per sector, with c2 and
+                                    subchannel data (cdrdao --read-raw) */
+
+/* gap policies, see waver_set_gaps */
+#define WAVER_GAPS_OMIT       0  /* pregaps are dropped */
+#define WAVER_GAPS_APPEND     1  /* a pregap ends the previous track */
+#define WAVER_GAPS_PREPEND    2  /* a pregap starts its track */
+#define WAVER_GAPS_HTOA       3  /* append, hidden audio before track 01
+                                    becomes track 00 */
+
+/* sample formats of wav outputs, see waver_set_sample_format */
+#define WAVER_SAMPLES_S16  0  /* as on the disc */
+#define WAVER_SAMPLES_S24  1
+#define WAVER_SAMPLES_S32  2
+#define WAVER_SAMPLES_F32  3  /* IEEE float, -1.0 .. 1.0 */
+
+/* sample rates of wav outputs, see waver_set_sample_rate */
+#define WAVER_RATE_MIN    8000
+#define WAVER_RATE_MAX  192000
+
+/* preallocation of the outputs, see waver_set_preallocate */
+#define WAVER_PREALLOC_NONE   0
+#define WAVER_PREALLOC_TRACK  1  /* when the track is opened */
+#define WAVER_PREALLOC_ALL    2  /* every track before the first one
+                                    is written */
+
+/* loudness analysis of the audio tracks, see waver_set_loudness */
+#define WAVER_LOUDNESS_OFF    0
+#define WAVER_LOUDNESS_ONLY   1  /* measured, see waver_track_info */
+#define WAVER_LOUDNESS_JSON   2  /* and written to <base>_loudness.json */
+#define WAVER_LOUDNESS_CUE    3  /* or to <base>_loudness.cue (REPLAYGAIN REMs) */
+
+/* kinds of waver_output_container */
+#define WAVER_CONTAINER_TAR  0
+#define WAVER_CONTAINER_ZIP  1
+
+/* i/o classes of the workers, see waver_set_priority */
+#define WAVER_IOPRIO_NONE  0  /* as the calling thread */
+#define WAVER_IOPRIO_BE    2  /* best effort, with a level 0 .. 7 */
+#define WAVER_IOPRIO_IDLE  3  /* only when no one else uses the device */
+
+/* ****************************************************************** */
+
+
+typedef enum
+{
+
+  WAVER_OK = 0,
+  WAVER_ERR_ARG,      /* invalid argument or option combination */
+  WAVER_ERR_NOMEM,    /* memory allocation failure */
+  WAVER_ERR_OPEN,     /* failed to open a file */
+  WAVER_ERR_READ,     /* failed to read the input */
+  WAVER_ERR_WRITE,    /* failed to write an output */
+  WAVER_ERR_SEEK,     /* failed to seek, e. g. on a pipe */
+  WAVER_ERR_SYNC,     /* failed to commit data to the device */
+  WAVER_ERR_CUE,      /* malformed cue sheet */
+  WAVER_ERR_THREAD,   /* thread or lock creation failed */
+  WAVER_ERR_JOURNAL,  /* failed to read or write the journal */
+  WAVER_ERR_CANCELED  /* the run was canceled (waver_cancel) */
+
+} waver_status_t;
+
+
+/* opaque conversion context */
+typedef struct waver_ctx waver_ctx_t;
+
+
+/*
+ * input: the DAO data stream.
+ * read has pread semantics and is called concurrently
+ * by the worker threads. it returns the number of bytes
+ * read or a negative value on errors. close is optional.
+ * waver_input_compressed reads a zstd or xz archive of
+ * the bin, if the library is built with HAVE_ZSTD or
+ * HAVE_LZMA (WAVER_ERR_ARG otherwise).
+ */
+typedef struct
+{
+
+  void*   handle;
+  int64_t ( *size )( void* handle );
+  int64_t ( *read )( void* handle, void* buf, uint64_t len, uint64_t offset );
+  void    ( *close )( void* handle );
+
+} waver_input_t;
+
+
+/*
+ * output: one stream per track.
+ * open creates the stream of a track, extension is
+ * ".wav", ".flac", ".iso" (data track) or ".sub"
+ * (subchannel sidecar), resume is set when the content must
+ * be kept (journal). write has pwrite semantics. sync
+ * commits the stream to the device, only its data if
+ * data_only is set. the callbacks of different tracks
+ * are called concurrently, the callbacks of one stream
+ * never. release (optional) frees the handle.
+ * layout (optional) is called before the first open
+ * with the number, extension and stream length of every
+ * track (track 00 is the hidden track of the htoa policy),
+ * outputs that need it only work with the wav format.
+ * zero (optional) makes a range of a stream read as zeros
+ * without writing it (a hole), on -1 the zeros are written.
+ * clone (optional) shares the extents of len bytes of fd at
+ * src_offset with the stream (reflink), offsets and len are
+ * block aligned, on -1 the bytes are written.
+ * reserve (optional) allocates len bytes of storage for a
+ * new stream without changing its length, where the device
+ * can't it does nothing. -1 (no space) is an error.
+ * map (optional) gives the memory behind len bytes of a
+ * stream at offset, or NULL. the payload is then made there
+ * and write is called with that memory.
+ */
+typedef struct
+{
+
+  void*   handle;
+  int     ( *layout )( void* handle, const uint8_t* numbers, const char** extensions,
+                       const uint64_t* sizes, uint8_t sizes_len );
+  int     ( *open )( void* handle, uint8_t track_no, const char* extension,
+                     uint8_t resume, void** stream );
+  int64_t ( *write )( void* stream, const void* buf, uint64_t len, uint64_t offset );
+  int     ( *zero )( void* stream, uint64_t len, uint64_t offset );
+  int     ( *clone )( void* stream, int fd, uint64_t len, uint64_t src_offset,
+                      uint64_t offset );
+  int     ( *reserve )( void* stream, uint64_t len );
+  void*   ( *map )( void* stream, uint64_t offset, uint64_t len );
+  int     ( *sync )( void* stream, uint8_t data_only );
+  int     ( *close )( void* stream );
+  void    ( *release )( void* handle );
+
+} waver_output_t;
+
+
+/*
+ * throughput model of the dry run (waver_plan), MB/s of
+ * 16 bit input through one worker, read and write of the
+ * device. 0 is not measured. waver -B measures it.
+ */
+typedef struct
+{
+
+  double read;      /* bin file, sequential */
+  double write;     /* outputs, sequential */
+  double kernel;    /* payload kernel (byte swap) */
+  double convert;   /* sample kernel (wider samples) */
+  double resample;  /* sample rate conversion */
+  double flac;      /* flac encoder */
+
+} waver_calibration_t;
+
+
+/* growable buffer of the memory output, data is owned by the caller */
+typedef struct
+{
+
+  uint8_t* data;
+  uint64_t len;
+  uint64_t cap;
+
+} waver_buffer_t;
+
+
+/*
+ * loudness of a track or the album (EBU R128 integrated loudness,
+ * -HUGE_VAL for silence), the ReplayGain 2.0 gain to -18 LUFS and
+ * the peaks, 1.0 is full scale. valid is 0 if it wasn't measured.
+ */
+typedef struct
+{
+
+  uint8_t  valid;
+  double   integrated;
+  double   gain;
+  double   sample_peak;
+  double   true_peak;
+
+} waver_loudness_t;
+
+
+/*
+ * byte range of a track in the input, size_byte is the payload.
+ * after waver_run: zero bytes of the payload (in blocks of 4 KiB,
+ * digital silence of audio tracks), their runs and the bytes of
+ * them left as holes (sparse output).
+ */
+typedef struct
+{
+
+  uint8_t  number;
+  uint8_t  is_audio;
+  uint32_t startbyte;
+  uint32_t endbyte;
+  uint32_t size_byte;
+  uint64_t zero_bytes;
+  uint32_t zero_runs;
+  uint64_t hole_bytes;
+  uint64_t bytes_done;
+  waver_loudness_t loudness;
+
+} waver_track_info_t;
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+
+/* context */
+waver_status_t waver_create( waver_ctx_t** ctx );
+void waver_destroy( waver_ctx_t* ctx );
+
+/* options */
+waver_status_t waver_set_threads( waver_ctx_t* ctx, int32_t n_threads );
+waver_status_t waver_set_adaptive( waver_ctx_t* ctx, uint8_t adaptive );
+waver_status_t waver_set_swap( waver_ctx_t* ctx, uint8_t swap_bytes );
+waver_status_t waver_set_format( waver_ctx_t* ctx, uint8_t format );
+waver_status_t waver_set_journal( waver_ctx_t* ctx, const char* path );
+waver_status_t waver_set_sector_layout( waver_ctx_t* ctx, uint8_t layout );
+waver_status_t waver_set_subchannel( waver_ctx_t* ctx, uint8_t sidecar );
+waver_status_t waver_set_gaps( waver_ctx_t* ctx, uint8_t gaps );
+waver_status_t waver_set_offset( waver_ctx_t* ctx, int32_t samples );
+waver_status_t waver_set_sparse( waver_ctx_t* ctx, uint8_t sparse );
+waver_status_t waver_set_reflink( waver_ctx_t* ctx, uint8_t reflink );
+waver_status_t waver_set_readahead( waver_ctx_t* ctx, uint64_t window );
+waver_status_t waver_set_preallocate( waver_ctx_t* ctx, uint8_t mode );
+waver_status_t waver_set_sample_format( waver_ctx_t* ctx, uint8_t format );
+waver_status_t waver_set_sample_rate( waver_ctx_t* ctx, uint32_t rate );
+waver_status_t waver_set_loudness( waver_ctx_t* ctx, uint8_t mode );
+waver_status_t waver_set_throttle( waver_ctx_t* ctx, uint64_t read_rate,
+                                   uint64_t write_rate, uint32_t iops );
+waver_status_t waver_set_priority( waver_ctx_t* ctx, uint8_t io_class, uint8_t io_level,
+                                   int8_t nice );
+waver_status_t waver_set_progress( waver_ctx_t* ctx, FILE* tty, int status_fd );
+waver_status_t waver_select_track( waver_ctx_t* ctx, uint8_t number );
+waver_status_t waver_select_range( waver_ctx_t* ctx, uint8_t number, uint32_t from,
+                                   uint32_t to );
+void waver_set_log( waver_ctx_t* ctx, FILE* log, uint8_t verbose );
+
+/* cue sheet, input and output */
+waver_status_t waver_set_cue_file( waver_ctx_t* ctx, const char* path );
+waver_status_t waver_set_cue_buffer( waver_ctx_t* ctx, const char* text, size_t len );
+waver_status_t waver_set_input( waver_ctx_t* ctx, const waver_input_t* input );
+waver_status_t waver_set_output( waver_ctx_t* ctx, const waver_output_t* output );
+
+/* built in inputs and outputs */
+waver_status_t waver_input_file( waver_input_t* input, const char* path );
+waver_status_t waver_input_fd( waver_input_t* input, int fd );
+waver_status_t waver_input_memory( waver_input_t* input, const void* buf, uint64_t len );
+waver_status_t waver_input_compressed( waver_input_t* input, const char* path );
+waver_status_t waver_output_files( waver_output_t* output, const char* base_name );
+waver_status_t waver_output_mapped( waver_output_t* output, const char* base_name );
+waver_status_t waver_output_fds( waver_output_t* output, const int* fds, uint8_t fds_len );
+waver_status_t waver_output_memory( waver_output_t* output,
+                                    waver_buffer_t* bufs, uint8_t bufs_len );
+waver_status_t waver_output_container( waver_output_t* output, uint8_t kind,
+                                       const char* path, const char* base_name );
+waver_status_t waver_output_container_fd( waver_output_t* output, uint8_t kind,
+                                          int fd, const char* base_name );
+
+/* conversion */
+waver_status_t waver_run( waver_ctx_t* ctx );
+waver_status_t waver_plan( waver_ctx_t* ctx, const waver_calibration_t* cal, FILE* out );
+void waver_cancel( waver_ctx_t* ctx );
+void waver_progress( const waver_ctx_t* ctx, uint64_t* done, uint64_t* total );
+uint8_t waver_track_count( const waver_ctx_t* ctx );
+waver_status_t waver_track_info( const waver_ctx_t* ctx, uint8_t idx,
+                                 waver_track_info_t* info );
+waver_status_t waver_album_loudness( const waver_ctx_t* ctx, waver_loudness_t* loudness );
+
+/* errors */
+const char* waver_strerror( waver_status_t status );
+const char* waver_error_message( const waver_ctx_t* ctx );
+
+/* ****************************************************************** */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBWAVER_H_ */
@@ -0,0 +1,95 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      loudness.h
+#
+# Purpose:   Loudness and peaks of the
+#            audio tracks, measured on
+#            the samples of the disc
+#            while they are converted:
+#
+#            - sample peak
+#            - true peak, 4 times
+#              oversampled
+#            - integrated loudness of
+#              EBU R128 (ITU-R BS.1770),
+#              the ReplayGain 2.0 gain is
+#              -18 LUFS minus it.
+#
+#            The gating blocks are kept
+#            as a histogram of 0.1 LU,
+#            the histograms of the tracks
+#            add up to the one of the
+#            album.
+#
+#==========================================
+*/
+#ifndef LOUDNESS_H_
+#define LOUDNESS_H_
+
+#include <stdint.h>
+
+#include "libwaver.h"
+
+#define LOUDNESS_RATE        44100
+#define LOUDNESS_STEP        ( LOUDNESS_RATE / 10 )  /* frames of 100 ms */
+#define LOUDNESS_STEPS       4      /* of a gating block (400 ms) */
+#define LOUDNESS_FLOOR       -70.0  /* absolute gate, LUFS */
+#define LOUDNESS_CEIL        30.0
+#define LOUDNESS_BINS        1000   /* of the histogram, 0.1 LU each */
+#define LOUDNESS_RELATIVE    -10.0  /* relative gate, LU */
+#define LOUDNESS_REFERENCE   -18.0  /* LUFS of a ReplayGain of 0 dB */
+#define TRUE_PEAK_PHASES     4      /* oversampling */
+#define TRUE_PEAK_TAPS       12     /* per phase */
+#define TRUE_PEAK_BLOCK      1024   /* frames checked at a time */
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  /* k-weighting, two biquads per channel */
+  double   state[ 2 ][ 4 ];
+  double   step_energy;        /* of the frames of the current step */
+  uint32_t step_frames;
+  double   steps[ LOUDNESS_STEPS - 1 ];  /* energies of the steps before */
+  uint32_t steps_len;
+
+  /* oversampling, the last input frames of both channels */
+  float    history[ 2 ][ TRUE_PEAK_TAPS - 1 ];
+
+  /* gating blocks, by loudness */
+  uint64_t block_count[ LOUDNESS_BINS ];
+  double   block_energy[ LOUDNESS_BINS ];
+
+  double   sample_peak;        /* full scale is 1.0 */
+  double   true_peak;
+
+} loudness_t;
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+void loudness_init( loudness_t* ln );
+void loudness_add( loudness_t* ln, const char* buf, uint32_t len, uint8_t swap );
+void loudness_finish( loudness_t* ln );
+void loudness_merge( loudness_t* album, const loudness_t* track );
+double loudness_integrated( const loudness_t* ln );
+
+/* ****************************************************************** */
+#endif /* LOUDNESS_H_ */
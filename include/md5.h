@@ -0,0 +1,54 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      md5.h
+#
+# Purpose:   MD5 message digest (RFC 1321).
+#            Needed for the signature of
+#            the unencoded audio data in
+#            the FLAC STREAMINFO block.
+#
+#==========================================
+*/
+#ifndef MD5_H_
+#define MD5_H_
+
+#include <stdint.h>
+
+#define MD5_DIGEST_LEN 16
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  uint32_t state[ 4 ];
+  uint64_t len;          /* total number of bytes processed */
+  uint8_t  buf[ 64 ];    /* pending bytes of an incomplete block */
+
+} md5_ctx_t;
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+void md5_init( md5_ctx_t* ctx );
+void md5_update( md5_ctx_t* ctx, const void* data, uint64_t len );
+void md5_final( md5_ctx_t* ctx, uint8_t digest[ MD5_DIGEST_LEN ] );
+
+/* ****************************************************************** */
+#endif /* MD5_H_ */
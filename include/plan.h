@@ -0,0 +1,66 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      plan.h
+#
+# Purpose:   Dry run of a conversion.
+#
+#            The tracks of the cue sheet
+#            are laid out and handed to
+#            the workers as the pool of a
+#            run would, on a clock of the
+#            throughput model instead of
+#            real I/O. The plan lists the
+#            byte ranges, the work of
+#            every worker and the runtime
+#            the model predicts.
+#
+#            The model is measured by the
+#            benchmark (waver -B) and kept
+#            in a calibration file of
+#            "<name> <MB/s>" lines:
+#            $WAVER_CALIBRATION, else
+#            ~/.config/waver/calibration
+#
+#==========================================
+*/
+#ifndef PLAN_H_
+#define PLAN_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "waver.h"
+
+#define CALIBRATION_ENV    "WAVER_CALIBRATION"
+#define CALIBRATION_DIR    ".config/waver"       /* in $HOME */
+#define CALIBRATION_FILE   "calibration"
+#define BENCH_FILE         "waver_bench.tmp"     /* scratch file of the storage, */
+#define BENCH_IO_PIECES    8                     /* BLOCK_SIZE each */
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+uint8_t calibration_path( char* path, size_t len );
+waver_status_t calibration_load( waver_calibration_t* cal, const char* path );
+waver_status_t calibration_save( const waver_calibration_t* cal, const char* path );
+void calibration_bench( FILE* log, waver_calibration_t* cal );
+void plan_print( const waver_ctx_t* ctx, const waver_calibration_t* cal,
+                 int32_t n_threads, FILE* out );
+
+/* ****************************************************************** */
+#endif /* PLAN_H_ */
@@ -0,0 +1,104 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      progress.h
+#
+# Purpose:   Progress of a run, reported
+#            by a thread of its own.
+#
+#            The workers only add the
+#            input bytes of a piece to a
+#            counter of the track and of
+#            the run (relaxed atomics).
+#            Every PROGRESS_INTERVAL the
+#            reporter reads them, smooths
+#            the throughput and draws a
+#            bar on a terminal:
+#
+#            [######......]  48.3%
+#            87.2 MB/s  ETA 0:15  5/12
+#
+#            and every STATUS_INTERVAL
+#            writes a line of JSON to the
+#            status fd:
+#
+#            {"state":"running",
+#             "time":1.25,"done":..,
+#             "total":..,"rate":..,
+#             "eta":..,"idle":..,
+#             "tracks":[{"number":1,
+#               "done":..,"total":..},..]}
+#
+#            rate is bytes/s, eta and idle
+#            (since the counter last
+#            moved) are seconds, eta is
+#            null while no rate is known.
+#            The last line has the state
+#            done, failed or canceled and
+#            on errors the message.
+#
+#==========================================
+*/
+#ifndef PROGRESS_H_
+#define PROGRESS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "libwaver.h"
+
+#define PROGRESS_INTERVAL  250    /* ms between two reports on the terminal */
+#define STATUS_INTERVAL    1000   /* ms between two lines of the status fd */
+#define PROGRESS_SMOOTH    0.3    /* weight of the last interval in the rate */
+#define PROGRESS_STALL     5.0    /* s without progress the bar shows */
+#define PROGRESS_BAR_LEN   24
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  FILE*           tty;         /* progress bar, NULL = none */
+  int             fd;          /* JSON lines, < 0 = none */
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  wake;
+  uint8_t         running;     /* the thread was started */
+  uint8_t         stop;        /* under lock */
+
+  /* owned by the reporter */
+  double          start;       /* s, monotonic */
+  double          last_time;
+  double          last_status;
+  double          moved;       /* the counter last grew */
+  uint64_t        last_done;
+  double          rate;        /* bytes/s, smoothed */
+
+} progress_t;
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+waver_status_t progress_init( progress_t* pr );
+void progress_destroy( progress_t* pr );
+waver_status_t progress_start( progress_t* pr, waver_ctx_t* ctx );
+void progress_stop( progress_t* pr, waver_ctx_t* ctx, waver_status_t status );
+
+/* ****************************************************************** */
+#endif /* PROGRESS_H_ */
@@ -0,0 +1,73 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      readahead.h
+#
+# Purpose:   Readahead of the bin file
+#            along the track schedule.
+#
+#            The tracks are read in the
+#            order of the pool. Up to
+#            <window> bytes behind the
+#            lowest position any worker
+#            still has to read are
+#            advised to the kernel
+#            (POSIX_FADV_WILLNEED), as
+#            few large ranges: adjacent
+#            tracks are merged. So the
+#            device reads the image in
+#            order, however many workers
+#            consume it.
+#
+#==========================================
+*/
+#ifndef READAHEAD_H_
+#define READAHEAD_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "libwaver.h"
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  int              fd;          /* < 0: no readahead */
+  uint64_t         window;
+  uint64_t*        starts;      /* input range of every track, */
+  uint64_t*        ends;        /* in the order of the pool */
+  uint64_t*        consumed;    /* bytes of a track read (or skipped) */
+  uint8_t          tracks_len;
+  uint64_t         issued;      /* advised up to, in schedule bytes */
+  pthread_mutex_t  lock;
+
+} readahead_t;
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+waver_status_t readahead_open( readahead_t* ra, int fd, uint64_t window,
+                               const uint64_t* starts, const uint64_t* ends,
+                               uint8_t tracks_len );
+void readahead_close( readahead_t* ra );
+void readahead_consumed( readahead_t* ra, uint8_t idx, uint64_t len );
+
+/* ****************************************************************** */
+#endif /* READAHEAD_H_ */
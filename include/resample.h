@@ -0,0 +1,98 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      resample.h
+#
+# Purpose:   Sample rate conversion of
+#            the audio of wav outputs
+#            (44.1 kHz to 48 or 96 kHz,
+#            or any other rate of a
+#            small ratio up/down).
+#
+#            A polyphase FIR: the bank
+#            holds one row of taps per
+#            phase of the upsampled
+#            grid, a kaiser windowed
+#            sinc, computed once per
+#            run. Every output sample
+#            is one dot product of a row
+#            and the input around it.
+#
+#            A track is converted piece
+#            by piece by its worker, the
+#            state keeps the input the
+#            next outputs still need.
+#            The track starts and ends
+#            in silence.
+#
+#==========================================
+*/
+#ifndef RESAMPLE_H_
+#define RESAMPLE_H_
+
+#include <stdint.h>
+
+#include "libwaver.h"
+
+#define RESAMPLE_TAPS        64       /* per phase, a multiple of 8 */
+#define RESAMPLE_MAX_PHASES  1024     /* up of the reduced ratio */
+#define RESAMPLE_CUTOFF      0.4535   /* of the lower rate, 20 kHz of 44.1 kHz */
+#define RESAMPLE_BETA        9.0      /* kaiser window, ~90 dB stop band */
+#define RESAMPLE_BLOCK       65536    /* input frames of one call */
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  uint32_t up;       /* output rate / gcd */
+  uint32_t down;     /* input rate / gcd */
+  float*   taps;     /* [ up ][ RESAMPLE_TAPS ] */
+
+} resample_bank_t;
+
+
+typedef struct
+{
+
+  const resample_bank_t* bank;
+  float*   left;       /* input frames of the channels */
+  float*   right;
+  uint32_t len;        /* frames in left and right */
+  int64_t  first;      /* input frame of left[ 0 ] */
+  uint64_t next;       /* next output frame */
+  uint64_t total;      /* output frames of the track */
+
+} resample_state_t;
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+waver_status_t resample_bank_init( resample_bank_t* bank, uint32_t in_rate,
+                                   uint32_t out_rate );
+void resample_bank_release( resample_bank_t* bank );
+uint64_t resample_frames( const resample_bank_t* bank, uint64_t in_frames );
+uint32_t resample_max_out( const resample_bank_t* bank );
+waver_status_t resample_open( resample_state_t* state, const resample_bank_t* bank,
+                              uint64_t in_frames );
+void resample_close( resample_state_t* state );
+uint32_t resample_run( resample_state_t* state, const char* src, uint32_t frames,
+                       uint8_t last, char* dst, uint8_t format );
+
+/* ****************************************************************** */
+#endif /* RESAMPLE_H_ */
@@ -0,0 +1,92 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      server.h
+#
+# Purpose:   Server mode of the waver
+#            program. Conversion jobs
+#            are queued over a local
+#            UNIX socket and run one
+#            after another (or a few at
+#            once) in one process, by
+#            priority.
+#
+#            One request per connection,
+#            one line of text, answered
+#            with one or more lines:
+#
+#            SUBMIT bin=<f> cue=<f>
+#                   name=<base> [prio=<n>]
+#                   [format=wav|flac]
+#                   [samples=s16|s24|s32|f32]
+#                   [rate=<Hz>]
+#                   [loudness=json|cue]
+#                   [swap=1]
+#                   [threads=<n>|auto]
+#                   [gaps=<policy>]
+#                   [offset=<samples>]
+#                   [sparse=1] [reflink=1]
+#                   [read=<MB/s>] [write=<MB/s>]
+#                   [iops=<n>]
+#                   [ioprio=idle|be[:<n>]]
+#                   [nice=<n>]
+#                              -> OK <id>
+#            CANCEL <id>       -> OK
+#            STATUS [<id>]     -> JOB ...
+#                                 END
+#            SHUTDOWN          -> OK
+#
+#            A bin ending in .zst or .xz
+#            is read from the archive.
+#
+#            Errors are answered with
+#            ERR <message>.
+#
+#==========================================
+*/
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <stdint.h>
+
+#include "waver.h"
+
+#define SERVER_MAX_JOBS     256   /* queued, running and finished */
+#define SERVER_MAX_RUNNERS  16    /* jobs run at once */
+#define SERVER_LINE_LEN     4096
+#define SERVER_TIMEOUT      5     /* seconds a client may take to send */
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  int32_t  n_threads;  /* workers of a job, unless the job sets them */
+  uint8_t  adaptive;   /* ditto, n_threads is the most (-t auto) */
+  uint8_t  runners;    /* jobs run at once */
+  uint8_t  verbose;
+
+} server_options_t;
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+int serve( const char* socket_path, const server_options_t* options );
+
+/* ****************************************************************** */
+#endif /* SERVER_H_ */
@@ -0,0 +1,99 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      throttle.h
+#
+# Purpose:   Limits and priorities of a
+#            run that shares the machine
+#            with other services.
+#
+#            Read and write bandwidth and
+#            the requests per second are
+#            token buckets, shared by all
+#            workers. A throttled run
+#            reads and writes in requests
+#            of THROTTLE_CHUNK bytes, a
+#            worker takes the tokens of a
+#            request before it is issued
+#            and sleeps off the debt, so
+#            the device sees an even flow
+#            instead of bursts of pieces.
+#
+#            The I/O class (ioprio_set)
+#            and the nice value are set
+#            per worker thread. Buffered
+#            writes are written back by
+#            the kernel flusher, which
+#            ignores the I/O class of the
+#            worker: only the write limit
+#            paces them.
+#
+#==========================================
+*/
+#ifndef THROTTLE_H_
+#define THROTTLE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "libwaver.h"
+
+#define THROTTLE_CHUNK  ( 1024L * 1024 )  /* bytes of a request of a throttled run */
+#define THROTTLE_BURST  0.1               /* s of its rate a bucket holds */
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  double          rate;    /* per second, 0 = unlimited */
+  double          tokens;  /* below 0 a debt the next taker sleeps off */
+  double          last;    /* s, of the last refill */
+  pthread_mutex_t lock;
+
+} bucket_t;
+
+
+typedef struct
+{
+
+  bucket_t read;       /* bytes of the bin */
+  bucket_t write;      /* bytes of the outputs */
+  bucket_t requests;   /* reads and writes */
+  uint8_t  active;     /* one of the buckets has a rate */
+  uint8_t  io_class;   /* WAVER_IOPRIO_*, of the workers */
+  uint8_t  io_level;   /* 0 (highest) .. 7, best effort only */
+  int8_t   nice;       /* added to the nice value of the workers */
+
+} throttle_t;
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+waver_status_t throttle_init( throttle_t* th );
+void throttle_destroy( throttle_t* th );
+void throttle_set( throttle_t* th, uint64_t read_rate, uint64_t write_rate,
+                   uint32_t iops );
+void throttle_start( throttle_t* th );
+void throttle_read( throttle_t* th, uint64_t len );
+void throttle_write( throttle_t* th, uint64_t len );
+uint8_t throttle_shared( const throttle_t* th );
+int throttle_priority( const throttle_t* th );
+
+/* ****************************************************************** */
+#endif /* THROTTLE_H_ */
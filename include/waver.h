@@ -50,6 +50,18 @@
 #define _GNU_SOURCE
 
 #include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "libwaver.h"
+#include "md5.h"
+#include "journal.h"
+#include "readahead.h"
+#include "throttle.h"
+#include "progress.h"
+#include "resample.h"
+#include "loudness.h"
 
 /* 
  * We always assume a sampling rate of 44100 Hz (T = 0.000022676 s)
@@ -75,7 +87,17 @@
 #define SAMPLING_RATE     44100  /* sampling rate in Hz */
 
 #define WAV_HEADER_LEN       44  /* WAV header length in bytes */
+#define WAV_EXT_HEADER_LEN   68  /* with a WAVE_FORMAT_EXTENSIBLE fmt chunk */
+#define FACT_CHUNK_LEN       12  /* sample count, float formats need it */
+#define WAVE_FORMAT_EXTENSIBLE  0xFFFE
+#define SPEAKER_FRONT_LEFT      0x1
+#define SPEAKER_FRONT_RIGHT     0x2
+/* the GUID of the sub format, the first two bytes are the format tag */
+#define KSDATAFORMAT_SUBTYPE    "\x01\x00\x00\x00\x00\x00\x10\x00" \
+                                "\x80\x00\x00\xaa\x00\x38\x9b\x71"
+#define JUNK_CHUNK_LEN        8  /* header of the RIFF padding chunk */
 #define WAV_EXTENSION    ".wav"
+#define ISO_EXTENSION    ".iso"  /* user data of data tracks */
 
 #define FRAMES_PER_SEC       75
 #define SECTOR_LEN         2352  /* payload data bytes of one sector */
@@ -91,14 +113,41 @@
  */
 #define SECTOR_RAW_LEN     3234 
 
+/*
+ * layout of a raw sector: the 2352 bytes of the sector
+ * first, c2 error pointers and block error bytes in
+ * between (dropped), the 96 subchannel bytes (P-W,
+ * interleaved) at the end.
+ */
+#define SUBCHANNEL_LEN       96
+#define RAW_SUB_OFFSET     ( SECTOR_RAW_LEN - SUBCHANNEL_LEN )
+#define SUB_EXTENSION    ".sub"  /* subchannel sidecar, deinterleaved P-W */
+#define LOUDNESS_JSON_EXTENSION  "_loudness.json"  /* album sidecars, behind the */
+#define LOUDNESS_CUE_EXTENSION   "_loudness.cue"   /* base name */
+
 /* several modes on the disc ... */
 #define MODE1_2352 "MODE1/2352"
-#define MODE2_2352 "MODE2/2352" /* subcategorize in raw, 
-                                   psxtruncate and normal 
-                                   when implementing this mode.*/
+#define MODE2_2352 "MODE2/2352"
 #define MODE2_2336 "MODE2/2336"
+#define MODE1_2048 "MODE1/2048"
 #define MODE_AUDIO "AUDIO"
 
+/*
+ * layout of the data sectors. of every sector only the
+ * user data is extracted, the ISO image gets 2048 bytes
+ * per sector (MODE2: form 1).
+ *
+ * MODE1/2352: 12 sync, 4 header, 2048 user data, 288 ecc
+ * MODE2/2352: 12 sync, 4 header, 8 subheader, 2048 user data, ...
+ * MODE2/2336: 8 subheader, 2048 user data, ... (no sync and header)
+ * MODE1/2048: user data only
+ */
+#define USER_DATA_LEN          2048
+#define MODE1_2352_OFFSET        16
+#define MODE2_2352_OFFSET        24
+#define MODE2_2336_OFFSET         8
+#define SECTOR_MODE2_2336_LEN  2336
+
 /* 
  * Block size for processing files located on a filesystem.
  * BLOCK_SIZE is read or written at once.
@@ -107,27 +156,115 @@
  */
 #define BLOCK_SIZE ( SECTOR_LEN * 14266L ) /* ~ 32 MiB */
 
+/* sectors read at once, BLOCK_SIZE of payload for audio tracks */
+#define PIECE_SECTORS ( BLOCK_SIZE / SECTOR_LEN )
+
 /* Multithreading defines */
 #define MAX_THREADS 64
 
+/*
+ * the payload is scanned for zeros in blocks aligned to the
+ * output offset, runs of at least SPARSE_MIN_LEN become holes
+ */
+#define ZERO_BLOCK_LEN  4096
+#define SPARSE_MIN_LEN  ( 16 * ZERO_BLOCK_LEN )
+
+/*
+ * extents are cloned in blocks of the file system, the payload
+ * of a cloned track has the same offset in the block as in the bin
+ */
+#define CLONE_ALIGN  4096
+
+/*
+ * mapped outputs are written back and faulted in by windows,
+ * see waver_output_mapped
+ */
+#define MAP_WINDOW  ( 64L * 1024 * 1024 )
+
+/* readahead window of the bin file make bench measures, runs default to none */
+#define READAHEAD_WINDOW  ( 4 * BLOCK_SIZE )
+#define READAHEAD_MAX_MIB 4096  /* of the -w option */
+
+/* read offsets beyond one second are not drive offsets */
+#define MAX_OFFSET SAMPLING_RATE
+
+/* output formats */
+#define FORMAT_WAV   WAVER_FORMAT_WAV
+#define FORMAT_FLAC  WAVER_FORMAT_FLAC
+
+/* "private" defines */
+#define PATH_LEN  1024
+#define NAME_LEN   256
+
+#define LINE_LEN  1024
+#define MAX_LINES 1024
+
+/* of a cue sheet, as on a disc (red book) */
+#define MAX_TRACKS   99
+#define MAX_INDEXES  64   /* of one track */
+
+#define ERRMSG_LEN 512
+
+/* state of a track according to the job journal */
+#define TRACK_FRESH   0  /* process from scratch */
+#define TRACK_RESUME  1  /* continue behind the last durable chunk */
+#define TRACK_SKIP    2  /* output is complete and up to date */
+
 /* ****************************************************************** */
 
 
+/*
+ * one pass over a piece of payload (byte swap, journal checksum),
+ * returns the checksum. see kernel.h
+ */
+typedef uint32_t ( *payload_kernel_t )( char* buf, uint32_t len );
+
+/*
+ * the same pass, converting len bytes of 16 bit samples of src
+ * to the wider samples of dst. see kernel.h
+ */
+typedef uint32_t ( *sample_kernel_t )( const char* src, char* dst, uint32_t len );
+
+
 typedef struct
 {
   
-  uint8_t  number;
+  uint8_t  number;    /* 0 is the hidden track (HTOA) */
+  uint8_t  idx;       /* position in the tracks of the context */
   
+  uint32_t gapframe;  /* first index, INDEX 00 if there is a pregap */
+  uint32_t gapbyte;
+
   uint32_t startframe;
   uint32_t endframe;
   
   uint32_t startbyte;
   uint32_t endbyte;
-  uint32_t size_byte;
+  uint32_t size_byte;  /* payload: audio samples or user data */
+
+  payload_kernel_t kernel; /* chosen for the options of the track */
+  sample_kernel_t  convert;  /* NULL: samples are written as read */
+  uint8_t  sample_len;     /* bytes of an output sample, 2 as in the bin */
+  uint8_t  resample;       /* audio is converted to the rate of the context */
+  loudness_t* loudness;    /* NULL: not measured */
+  uint32_t data_len;       /* payload of the output */
+
+  uint32_t header_len;     /* of the WAV output, padded for clones */
+  uint8_t  clone;          /* payload is cloned from the bin */
+  uint8_t  reserved;       /* output was preallocated before the workers */
+
+  uint32_t run_startbyte;  /* the run of audio tracks this one belongs */
+  uint32_t run_endbyte;    /* to, zeros outside (offset correction) */
+
+  uint64_t zero_bytes;     /* payload in zero blocks (silence) */
+  uint32_t zero_runs;
+  uint64_t hole_bytes;     /* not written, holes of a sparse output */
+  uint64_t bytes_done;     /* input bytes, read by the reporter */
   
-  uint32_t offset;    /* byte start offset for some modes */
-  uint32_t subsize;   /* in some modes a sector has another
-                         size than the SECTOR_LEN */
+  uint32_t sector_len; /* length of one sector in the input */
+  uint32_t offset;     /* start of the user data in a sector */
+  uint32_t subsize;    /* length of the user data of a sector,
+                          sector_len for audio tracks */
 
   uint8_t  is_audio;
   char     mode[ 16 ];
@@ -141,24 +278,159 @@ typedef struct
   char    title[ 16 ];
   char    no[ 8 ];
   char    mode[ 16 ];
-  char*   index_str[ 64 ];
+  char*   index_no[ MAX_INDEXES ];
+  char*   index_str[ MAX_INDEXES ];
   uint8_t index_cnt;
 
 } cueentry_t;
 
 
+/* a track of the selection, to = 0 is the whole track */
+typedef struct
+{
+
+  uint8_t  on;
+  uint32_t from;   /* frames from the start of the track */
+  uint32_t to;
+
+} selection_t;
+
+
 typedef struct
 {
 
   track_t** tracks;
   uint8_t   tracks_len;
   uint8_t   cur_top;
+  uint32_t  cur_chunk;  /* next chunk of the top track (chunked modes) */
 
 } track_pool_t;
 
+
+/*
+ * state of one FLAC output file. chunks of a track are
+ * encoded by any worker, but written in stream order.
+ * chunks_done is the number of the next chunk to be written.
+ */
+typedef struct
+{
+
+  track_t*        track;
+  void*           out;       /* output stream, opened with the first chunk */
+  void*           sub_out;   /* subchannel sidecar (raw input) */
+  uint32_t        chunks_total;
+  uint32_t        chunks_done;
+  uint32_t        min_framesize;
+  uint32_t        max_framesize;
+  uint64_t        bytes_written;
+  md5_ctx_t       md5;
+  pthread_mutex_t lock;
+  pthread_cond_t  turn;
+
+} flac_stream_t;
+
+typedef struct
+{
+
+  waver_ctx_t* ctx;
+  uint32_t     tid;
+  pthread_t    thread;
+
+} worker_t;
+
+
+/* everything a conversion needs, see libwaver.h */
+struct waver_ctx
+{
+
+  /* options */
+  uint8_t         swap_bytes;
+  uint8_t         verbose;
+  uint8_t         output_format;
+  int32_t         n_threads;
+  uint8_t         use_journal;
+  char            journalfile[ PATH_LEN ];
+  uint8_t         sector_layout;
+  uint8_t         subchannel;
+  uint8_t         gaps;
+  int32_t         offset;      /* read offset correction in samples */
+  uint8_t         sparse;      /* zero runs become holes */
+  uint8_t         reflink;     /* clone the payload from the bin */
+  uint64_t        readahead_window;  /* 0 = no readahead */
+  uint8_t         prealloc;    /* WAVER_PREALLOC_* */
+  uint8_t         sample_format;  /* WAVER_SAMPLES_* of wav outputs */
+  uint32_t        sample_rate;    /* of wav outputs, SAMPLING_RATE as on the disc */
+  resample_bank_t resampler;      /* taps of the conversion, NULL as on the disc */
+  uint8_t         loudness;       /* WAVER_LOUDNESS_* */
+  throttle_t      throttle;       /* limits and priorities of the workers */
+  progress_t      progress;       /* bar and status fd of a run */
+  selection_t     selection[ MAX_TRACKS + 1 ];  /* by number, see waver_select_track */
+  uint8_t         selecting;      /* 0: every track */
+  FILE*           log;
+
+  /* cue sheet, input and output */
+  char*           cue_text;
+  size_t          cue_len;
+  waver_input_t   input;
+  waver_output_t  output;
+  uint8_t         input_set;
+  uint8_t         output_set;
+
+  /* state of a run */
+  uint8_t         raw_input;   /* sectors of SECTOR_RAW_LEN */
+  int32_t         n_workers;   /* n_threads of the run, 0 resolved */
+  uint32_t        piece_len;   /* input bytes of PIECE_SECTORS sectors (max),
+                                  plus one sector for the offset correction */
+  track_t**       tracks;
+  uint8_t         tracks_len;
+  track_pool_t    track_pool;
+  flac_stream_t*  flac_streams;
+  journal_t       journal;
+  readahead_t     readahead;
+  loudness_t      album;       /* the measured tracks, merged under lock */
+  struct timespec bin_mtime;
+  pthread_mutex_t lock;
+  worker_t        workers[ MAX_THREADS ];
+  uint8_t         adaptive;    /* n_threads is the most, see adapt.h */
+  int32_t         wanted;      /* workers that take tracks, under lock */
+  int32_t         exited;      /* workers done with the run, ditto */
+  pthread_cond_t  workers_cond;  /* wanted changed or a worker exited */
+
+  /* input bytes of a run, done is read by other threads */
+  uint64_t        bytes_done;
+  uint64_t        bytes_total;
+
+  /* first error of a run, stops all workers */
+  waver_status_t  status;
+  char            errmsg[ ERRMSG_LEN ];
+  uint8_t         canceled;    /* waver_cancel, stays set */
+
+};
+
 /* ****************************************************************** */
 
-/* "public" function prototypes */
+/* "internal" function prototypes, shared by the library sources */
+
+/* libwaver.c */
+waver_status_t set_error( waver_ctx_t* ctx, waver_status_t status, const char* fmt, ... )
+  __attribute__( ( format( printf, 3, 4 ) ) );
+uint64_t track_output_size( const waver_ctx_t* ctx, const track_t* track );
+const char* track_extension( const waver_ctx_t* ctx, const track_t* track );
+
+/* cue.c */
+waver_status_t create_track_metadata( waver_ctx_t* ctx );
+waver_status_t select_tracks( waver_ctx_t* ctx );
+void release_track_metadata( waver_ctx_t* ctx );
+
+/* io.c */
+uint8_t is_fd_input( const waver_input_t* input );
+int input_fd( const waver_input_t* input );
+uint8_t is_file_output( const waver_output_t* output );
+void file_output_sidecar_name( const waver_output_t* output, const char* extension,
+                               char* out_name );
+void file_output_name( const waver_output_t* output, uint8_t track_no,
+                       const char* extension, char* out_name );
+int file_output_truncate( void* stream, uint64_t len );
 
 /* ****************************************************************** */
 #endif /* WAVER_H_ */
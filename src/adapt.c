@@ -0,0 +1,143 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    adapt.c
+# Purpose: number of workers that follows
+#          the measured throughput
+#
+#==========================================
+*/
+
+#include "adapt.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static double now( void );
+static uint8_t read_stalled( uint64_t* stalled );
+
+/* ****************************************************************** */
+
+
+static double now( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return ( double )ts.tv_sec + ( double )ts.tv_nsec / 1e9;
+}
+
+
+/* total us some task stalled on I/O, "some avg10=.. avg60=.. avg300=.. total=.." */
+static uint8_t read_stalled( uint64_t* stalled )
+{
+  FILE* psi = NULL;
+  char line[ 128 ];
+  unsigned long long total;
+  uint8_t found = 0;
+
+  if( ( psi = fopen( ADAPT_PSI_FILE, "r" ) ) == NULL )
+  {
+    return 0;
+  }
+  while( !found && fgets( line, sizeof( line ), psi ) != NULL )
+  {
+    found = ( strncmp( line, "some ", 5 ) == 0 &&
+              sscanf( line, "some avg10=%*f avg60=%*f avg300=%*f total=%llu",
+                      &total ) == 1 );
+  }
+  fclose( psi );
+
+  if( found )
+  {
+    *stalled = ( uint64_t )total;
+  }
+
+  return found;
+}
+
+
+void adapt_init( adapt_t* ad, int32_t max, uint64_t bytes )
+{
+  memset( ad, 0, sizeof( adapt_t ) );
+
+  ad->max     = ( max > 0 ) ? max : 1;
+  ad->wanted  = ( ADAPT_START < ad->max ) ? ADAPT_START : ad->max;
+  ad->bytes   = bytes;
+  ad->time    = now();
+  ad->has_psi = read_stalled( &ad->stalled );
+}
+
+
+/* one measurement, bytes is the input done so far. gives the workers wanted */
+int32_t adapt_step( adapt_t* ad, uint64_t bytes )
+{
+  double t = now();
+  double dt = t - ad->time;
+  uint64_t stalled = ad->stalled;
+  double last_rate = ad->rate;
+
+  if( dt <= 0.0 || ( ( bytes - ad->bytes ) < ADAPT_MIN_BYTES && dt < ADAPT_MAX_TIME ) )
+  {
+    return ad->wanted;
+  }
+
+  ad->rate = ( double )( bytes - ad->bytes ) / 1e6 / dt;
+  ad->pressure = 0.0;
+  if( ad->has_psi && read_stalled( &stalled ) )
+  {
+    ad->pressure = ( double )( stalled - ad->stalled ) / 1e6 / dt;
+  }
+  ad->bytes   = bytes;
+  ad->stalled = stalled;
+  ad->time    = t;
+
+  if( ad->pressure > ADAPT_PRESSURE && ad->wanted > 1 &&
+      ad->rate < last_rate * ( 1.0 - ADAPT_GAIN ) )
+  {
+    ad->wanted--;
+    ad->probing = 0;
+    ad->settle  = ADAPT_SETTLE;
+  }
+  else if( ad->probing )
+  {
+    /* the device is saturated, the added worker only queues */
+    ad->probing = 0;
+    if( ad->rate < ad->base_rate * ( 1.0 + ADAPT_GAIN ) )
+    {
+      ad->wanted--;
+      ad->settle = ADAPT_SETTLE;
+    }
+  }
+  else if( ad->settle > 0 )
+  {
+    ad->settle--;
+  }
+  else if( ad->wanted < ad->max && ad->pressure <= ADAPT_PRESSURE )
+  {
+    ad->base_rate = ad->rate;
+    ad->wanted++;
+    ad->probing = 1;
+  }
+
+  return ad->wanted;
+}
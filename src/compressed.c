@@ -0,0 +1,730 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    compressed.c
+# Purpose: input of a bin file from a
+#          zstd (.bin.zst) or xz
+#          (.bin.xz) archive, without an
+#          uncompressed copy on disk.
+#
+#          the frames (zstd) or blocks
+#          (xz) of the archive are
+#          indexed when it is opened,
+#          every read decodes only the
+#          frames its range covers, so
+#          the workers decode their
+#          tracks in parallel. the last
+#          frame a decoder touched is
+#          kept for the next piece.
+#
+#          archives of one big frame
+#          (plain zstd, single threaded
+#          xz) or without sizes in the
+#          frame headers are decoded once
+#          into memory.
+#
+#          zstd needs a build with
+#          HAVE_ZSTD=1, xz with
+#          HAVE_LZMA=1 (see Makefile).
+#
+#==========================================
+*/
+
+#include "waver.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+/* "private" defines */
+#define COMPRESSED_ZSTD       1
+#define COMPRESSED_XZ         2
+#define COMPRESSED_MAGIC_LEN  6
+#define COMPRESSED_MAX_FRAME  ( 64 * 1024 * 1024 )  /* bigger: decoded into memory */
+
+/* ****************************************************************** */
+
+#if defined( HAVE_ZSTD ) || defined( HAVE_LZMA )
+
+typedef struct
+{
+
+  uint64_t src;      /* offset of the frame in the archive */
+  uint64_t src_len;
+  uint64_t dst;      /* offset of its content in the bin */
+  uint64_t dst_len;
+
+} frame_t;
+
+
+typedef struct decoder
+{
+
+  struct decoder* next;
+  void*           dctx;    /* zstd: decompression context */
+  uint8_t*        buf;     /* content of the cached frame */
+  int64_t         cached;  /* frame in buf, -1 = none */
+
+} decoder_t;
+
+
+typedef struct
+{
+
+  uint8_t          kind;
+  const uint8_t*   map;        /* the archive */
+  uint64_t         map_len;
+  frame_t*         frames;     /* sorted by dst, no empty frames */
+  uint32_t         frames_len;
+  uint32_t         frames_cap;
+  uint64_t         max_frame;  /* longest content of a frame */
+  uint64_t         size;       /* of the bin */
+  uint8_t*         plain;      /* the whole bin, archives without index */
+  decoder_t*       idle;       /* decoders not in use */
+  pthread_mutex_t  lock;
+#ifdef HAVE_LZMA
+  lzma_check       check;      /* of the xz stream */
+#endif
+
+} compressed_t;
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static int add_frame( compressed_t* in, uint64_t src, uint64_t src_len, uint64_t dst_len );
+static int grow_plain( compressed_t* in, uint64_t* cap, uint64_t need );
+static decoder_t* take_decoder( compressed_t* in, uint32_t frame );
+static void give_decoder( compressed_t* in, decoder_t* dec );
+static void free_decoder( decoder_t* dec );
+static int decode_frame( compressed_t* in, decoder_t* dec, uint32_t frame, uint8_t* out );
+static int64_t compressed_size( void* handle );
+static int64_t compressed_read( void* handle, void* buf, uint64_t len, uint64_t offset );
+static void compressed_close( void* handle );
+#ifdef HAVE_ZSTD
+static int index_zstd( compressed_t* in );
+static int decode_zstd( compressed_t* in );
+#endif
+#ifdef HAVE_LZMA
+static int index_xz( compressed_t* in );
+static int decode_xz( compressed_t* in );
+#endif
+
+/* ****************************************************************** */
+
+
+static int add_frame( compressed_t* in, uint64_t src, uint64_t src_len, uint64_t dst_len )
+{
+  frame_t* frames = NULL;
+
+  if( dst_len == 0 )
+  {
+    return 0;
+  }
+  if( in->frames_len == in->frames_cap )
+  {
+    in->frames_cap = ( in->frames_cap == 0 ) ? 64 : ( in->frames_cap * 2 );
+    if( ( frames = ( frame_t* )realloc( in->frames,
+                                        in->frames_cap * sizeof( frame_t ) ) ) == NULL )
+    {
+      return (-1);
+    }
+    in->frames = frames;
+  }
+
+  ( in->frames + in->frames_len )->src     = src;
+  ( in->frames + in->frames_len )->src_len = src_len;
+  ( in->frames + in->frames_len )->dst     = in->size;
+  ( in->frames + in->frames_len )->dst_len = dst_len;
+  in->frames_len++;
+  in->size += dst_len;
+  if( dst_len > in->max_frame )
+  {
+    in->max_frame = dst_len;
+  }
+
+  return 0;
+}
+
+
+/* room for need more bytes after in->size in the plain buffer */
+static int grow_plain( compressed_t* in, uint64_t* cap, uint64_t need )
+{
+  uint8_t* plain = NULL;
+  uint64_t len = *cap;
+
+  if( in->size + need <= len )
+  {
+    return 0;
+  }
+  while( in->size + need > len )
+  {
+    len = ( len == 0 ) ? ( in->map_len * 2 + need ) : ( len * 2 );
+  }
+  if( ( plain = ( uint8_t* )realloc( in->plain, len ) ) == NULL )
+  {
+    return (-1);
+  }
+  in->plain = plain;
+  *cap = len;
+
+  return 0;
+}
+
+
+/* an idle decoder, one that holds the frame if there is one */
+static decoder_t* take_decoder( compressed_t* in, uint32_t frame )
+{
+  decoder_t* dec = NULL;
+  decoder_t** prev = NULL;
+
+  pthread_mutex_lock( &in->lock );
+  for( prev = &in->idle; *prev != NULL; prev = &( *prev )->next )
+  {
+    if( ( *prev )->cached == ( int64_t )frame )
+    {
+      break;
+    }
+  }
+  if( *prev == NULL )
+  {
+    prev = &in->idle;
+  }
+  if( ( dec = *prev ) != NULL )
+  {
+    *prev = dec->next;
+  }
+  pthread_mutex_unlock( &in->lock );
+
+  if( dec != NULL )
+  {
+    return dec;
+  }
+
+  if( ( dec = ( decoder_t* )calloc( 1, sizeof( decoder_t ) ) ) == NULL )
+  {
+    return NULL;
+  }
+  dec->cached = (-1);
+#ifdef HAVE_ZSTD
+  if( in->kind == COMPRESSED_ZSTD && ( dec->dctx = ZSTD_createDCtx() ) == NULL )
+  {
+    free( dec );
+    return NULL;
+  }
+#endif
+
+  return dec;
+}
+
+
+static void give_decoder( compressed_t* in, decoder_t* dec )
+{
+  pthread_mutex_lock( &in->lock );
+  dec->next = in->idle;
+  in->idle = dec;
+  pthread_mutex_unlock( &in->lock );
+}
+
+
+static void free_decoder( decoder_t* dec )
+{
+#ifdef HAVE_ZSTD
+  ZSTD_freeDCtx( ( ZSTD_DCtx* )dec->dctx );
+#endif
+  free( dec->buf );
+  free( dec );
+}
+
+
+/* the whole content of a frame into out */
+static int decode_frame( compressed_t* in, decoder_t* dec, uint32_t frame, uint8_t* out )
+{
+  frame_t* f = in->frames + frame;
+#ifdef HAVE_ZSTD
+  size_t n;
+#endif
+#ifdef HAVE_LZMA
+  lzma_filter filters[ LZMA_FILTERS_MAX + 1 ];
+  lzma_block block;
+  lzma_ret ret;
+  size_t in_pos = 0;
+  size_t out_pos = 0;
+  int i;
+#endif
+
+#ifdef HAVE_ZSTD
+  if( in->kind == COMPRESSED_ZSTD )
+  {
+    n = ZSTD_decompressDCtx( ( ZSTD_DCtx* )dec->dctx, out, f->dst_len,
+                             ( in->map + f->src ), f->src_len );
+    return ( ZSTD_isError( n ) || n != f->dst_len ) ? (-1) : 0;
+  }
+#endif
+#ifdef HAVE_LZMA
+  if( in->kind == COMPRESSED_XZ )
+  {
+    memset( &block, 0, sizeof( lzma_block ) );
+    block.version = 1;
+    block.check = in->check;
+    block.filters = filters;
+    block.header_size = lzma_block_header_size_decode( *( in->map + f->src ) );
+    if( block.header_size > f->src_len ||
+        lzma_block_header_decode( &block, NULL, ( in->map + f->src ) ) != LZMA_OK )
+    {
+      return (-1);
+    }
+    in_pos = block.header_size;
+    ret = lzma_block_buffer_decode( &block, NULL, ( in->map + f->src ), &in_pos, f->src_len,
+                                    out, &out_pos, f->dst_len );
+    for( i = 0; filters[ i ].id != LZMA_VLI_UNKNOWN; i++ )
+    {
+      free( filters[ i ].options );
+    }
+    return ( ret == LZMA_OK && out_pos == f->dst_len ) ? 0 : (-1);
+  }
+#endif
+
+  return (-1);
+}
+
+
+static int64_t compressed_size( void* handle )
+{
+  return ( int64_t )( ( compressed_t* )handle )->size;
+}
+
+
+static int64_t compressed_read( void* handle, void* buf, uint64_t len, uint64_t offset )
+{
+  compressed_t* in = ( compressed_t* )handle;
+  decoder_t* dec = NULL;
+  frame_t* f = NULL;
+  uint32_t frame = 0;
+  uint32_t lo;
+  uint32_t hi;
+  uint64_t done = 0;
+  uint64_t skip;
+  uint64_t n;
+  int failed;
+
+  if( offset >= in->size )
+  {
+    return 0;
+  }
+  if( len > in->size - offset )
+  {
+    len = in->size - offset;
+  }
+
+  if( in->plain != NULL )
+  {
+    memcpy( buf, ( in->plain + offset ), len );
+    return ( int64_t )len;
+  }
+
+  /* the frame that holds offset */
+  lo = 0;
+  hi = in->frames_len - 1;
+  while( lo < hi )
+  {
+    frame = lo + ( hi - lo + 1 ) / 2;
+    if( ( in->frames + frame )->dst <= offset )
+    {
+      lo = frame;
+    }
+    else
+    {
+      hi = frame - 1;
+    }
+  }
+
+  for( frame = lo; done < len; frame++ )
+  {
+    f = in->frames + frame;
+    skip = offset + done - f->dst;
+    n = f->dst_len - skip;
+    if( n > len - done )
+    {
+      n = len - done;
+    }
+
+    if( ( dec = take_decoder( in, frame ) ) == NULL )
+    {
+      return (-1);
+    }
+    if( n == f->dst_len && dec->cached != ( int64_t )frame )
+    {
+      /* the piece covers the frame, no copy */
+      failed = decode_frame( in, dec, frame, ( ( uint8_t* )buf + done ) );
+    }
+    else
+    {
+      failed = 0;
+      if( dec->cached != ( int64_t )frame )
+      {
+        if( dec->buf == NULL &&
+            ( dec->buf = ( uint8_t* )malloc( in->max_frame ) ) == NULL )
+        {
+          failed = (-1);
+        }
+        else
+        {
+          failed = decode_frame( in, dec, frame, dec->buf );
+          dec->cached = failed ? (-1) : ( int64_t )frame;
+        }
+      }
+      if( !failed )
+      {
+        memcpy( ( ( uint8_t* )buf + done ), ( dec->buf + skip ), n );
+      }
+    }
+    give_decoder( in, dec );
+
+    if( failed )
+    {
+      return (-1);
+    }
+    done += n;
+  }
+
+  return ( int64_t )done;
+}
+
+
+static void compressed_close( void* handle )
+{
+  compressed_t* in = ( compressed_t* )handle;
+  decoder_t* dec = NULL;
+
+  while( ( dec = in->idle ) != NULL )
+  {
+    in->idle = dec->next;
+    free_decoder( dec );
+  }
+  if( in->map != NULL )
+  {
+    munmap( ( void* )in->map, in->map_len );
+  }
+  pthread_mutex_destroy( &in->lock );
+  free( in->frames );
+  free( in->plain );
+  free( in );
+}
+
+/* ****************************************************************** */
+
+#ifdef HAVE_ZSTD
+
+/* the frame headers, fails if a frame does not tell its size */
+static int index_zstd( compressed_t* in )
+{
+  uint64_t pos = 0;
+  uint32_t magic;
+  size_t n;
+  unsigned long long content;
+
+  while( pos < in->map_len )
+  {
+    n = ZSTD_findFrameCompressedSize( ( in->map + pos ), ( in->map_len - pos ) );
+    if( ZSTD_isError( n ) || in->map_len - pos < 4 )
+    {
+      return (-1);
+    }
+    magic = ( uint32_t )*( in->map + pos )
+            | ( ( uint32_t )*( in->map + pos + 1 ) << 8 )
+            | ( ( uint32_t )*( in->map + pos + 2 ) << 16 )
+            | ( ( uint32_t )*( in->map + pos + 3 ) << 24 );
+
+    /* skippable frames (e. g. the seek table) hold no content */
+    if( ( magic & ZSTD_MAGIC_SKIPPABLE_MASK ) != ZSTD_MAGIC_SKIPPABLE_START )
+    {
+      content = ZSTD_getFrameContentSize( ( in->map + pos ), ( in->map_len - pos ) );
+      if( content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR ||
+          add_frame( in, pos, n, content ) != 0 )
+      {
+        return (-1);
+      }
+    }
+    pos += n;
+  }
+
+  return 0;
+}
+
+
+static int decode_zstd( compressed_t* in )
+{
+  ZSTD_DStream* stream = NULL;
+  ZSTD_inBuffer src = { in->map, in->map_len, 0 };
+  ZSTD_outBuffer dst;
+  uint64_t cap = 0;
+  size_t ret = 1;
+
+  if( ( stream = ZSTD_createDStream() ) == NULL )
+  {
+    return (-1);
+  }
+
+  for( ;; )
+  {
+    if( grow_plain( in, &cap, ZSTD_DStreamOutSize() ) != 0 )
+    {
+      ret = 1;
+      break;
+    }
+    dst.dst = in->plain + in->size;
+    dst.size = cap - in->size;
+    dst.pos = 0;
+    ret = ZSTD_decompressStream( stream, &dst, &src );
+    if( ZSTD_isError( ret ) )
+    {
+      break;
+    }
+    in->size += dst.pos;
+    if( src.pos == src.size && dst.pos < dst.size )
+    {
+      break;
+    }
+  }
+  ZSTD_freeDStream( stream );
+
+  /* 0: the last frame is complete */
+  return ( ret == 0 ) ? 0 : (-1);
+}
+
+#endif /* HAVE_ZSTD */
+
+/* ****************************************************************** */
+
+#ifdef HAVE_LZMA
+
+/* the index of the stream, fails on concatenated streams */
+static int index_xz( compressed_t* in )
+{
+  lzma_stream_flags header;
+  lzma_stream_flags footer;
+  lzma_index* index = NULL;
+  lzma_index_iter iter;
+  uint64_t memlimit = UINT64_MAX;
+  uint64_t end = in->map_len;
+  size_t pos;
+  int status = 0;
+
+  /* stream padding, 4 null bytes each */
+  while( end >= 4 && *( in->map + end - 1 ) == 0 && *( in->map + end - 2 ) == 0 &&
+         *( in->map + end - 3 ) == 0 && *( in->map + end - 4 ) == 0 )
+  {
+    end -= 4;
+  }
+  if( end < 2 * LZMA_STREAM_HEADER_SIZE ||
+      lzma_stream_header_decode( &header, in->map ) != LZMA_OK ||
+      lzma_stream_footer_decode( &footer, ( in->map + end - LZMA_STREAM_HEADER_SIZE ) ) != LZMA_OK ||
+      lzma_stream_flags_compare( &header, &footer ) != LZMA_OK ||
+      footer.backward_size > end - 2 * LZMA_STREAM_HEADER_SIZE )
+  {
+    return (-1);
+  }
+
+  pos = end - LZMA_STREAM_HEADER_SIZE - footer.backward_size;
+  if( lzma_index_buffer_decode( &index, &memlimit, NULL, in->map, &pos,
+                                end - LZMA_STREAM_HEADER_SIZE ) != LZMA_OK )
+  {
+    return (-1);
+  }
+  if( lzma_index_stream_size( index ) != end )
+  {
+    lzma_index_end( index, NULL );
+    return (-1);
+  }
+
+  in->check = header.check;
+  lzma_index_iter_init( &iter, index );
+  while( status == 0 && !lzma_index_iter_next( &iter, LZMA_INDEX_ITER_NONEMPTY_BLOCK ) )
+  {
+    status = add_frame( in, iter.block.compressed_file_offset, iter.block.total_size,
+                        iter.block.uncompressed_size );
+  }
+  lzma_index_end( index, NULL );
+
+  return status;
+}
+
+
+static int decode_xz( compressed_t* in )
+{
+  lzma_stream stream = LZMA_STREAM_INIT;
+  lzma_ret ret;
+  uint64_t cap = 0;
+
+  if( lzma_stream_decoder( &stream, UINT64_MAX, LZMA_CONCATENATED ) != LZMA_OK )
+  {
+    return (-1);
+  }
+  stream.next_in = in->map;
+  stream.avail_in = in->map_len;
+
+  do
+  {
+    if( grow_plain( in, &cap, BUFSIZ ) != 0 )
+    {
+      ret = LZMA_MEM_ERROR;
+      break;
+    }
+    stream.next_out = in->plain + in->size;
+    stream.avail_out = cap - in->size;
+    ret = lzma_code( &stream, LZMA_FINISH );
+    in->size = cap - stream.avail_out;
+  } while( ret == LZMA_OK );
+  lzma_end( &stream );
+
+  return ( ret == LZMA_STREAM_END ) ? 0 : (-1);
+}
+
+#endif /* HAVE_LZMA */
+
+#endif /* HAVE_ZSTD || HAVE_LZMA */
+
+/* ****************************************************************** */
+
+
+waver_status_t waver_input_compressed( waver_input_t* input, const char* path )
+{
+#if defined( HAVE_ZSTD ) || defined( HAVE_LZMA )
+  static const uint8_t zstd_magic[ 4 ] = { 0x28, 0xb5, 0x2f, 0xfd };
+  static const uint8_t xz_magic[ COMPRESSED_MAGIC_LEN ] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+  compressed_t* handle = NULL;
+  struct stat buf;
+  void* map = NULL;
+  uint8_t kind = 0;
+  int indexed = (-1);
+  int fd;
+
+  if( input == NULL || path == NULL )
+  {
+    return WAVER_ERR_ARG;
+  }
+  if( ( fd = open( path, O_RDONLY ) ) < 0 )
+  {
+    return WAVER_ERR_OPEN;
+  }
+  if( fstat( fd, &buf ) != 0 || buf.st_size < COMPRESSED_MAGIC_LEN ||
+      ( map = mmap( NULL, ( size_t )buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0 ) ) == MAP_FAILED )
+  {
+    close( fd );
+    return WAVER_ERR_OPEN;
+  }
+  close( fd );
+
+#ifdef HAVE_ZSTD
+  if( memcmp( map, zstd_magic, sizeof( zstd_magic ) ) == 0 )
+  {
+    kind = COMPRESSED_ZSTD;
+  }
+#endif
+#ifdef HAVE_LZMA
+  if( memcmp( map, xz_magic, sizeof( xz_magic ) ) == 0 )
+  {
+    kind = COMPRESSED_XZ;
+  }
+#endif
+  ( void )zstd_magic;
+  ( void )xz_magic;
+
+  /* not an archive this build reads */
+  if( kind == 0 )
+  {
+    munmap( map, ( size_t )buf.st_size );
+    return WAVER_ERR_ARG;
+  }
+
+  if( ( handle = ( compressed_t* )calloc( 1, sizeof( compressed_t ) ) ) == NULL ||
+      pthread_mutex_init( &handle->lock, NULL ) != 0 )
+  {
+    free( handle );
+    munmap( map, ( size_t )buf.st_size );
+    return WAVER_ERR_NOMEM;
+  }
+  handle->kind = kind;
+  handle->map = ( const uint8_t* )map;
+  handle->map_len = ( uint64_t )buf.st_size;
+
+#ifdef HAVE_ZSTD
+  if( kind == COMPRESSED_ZSTD )
+  {
+    indexed = index_zstd( handle );
+  }
+#endif
+#ifdef HAVE_LZMA
+  if( kind == COMPRESSED_XZ )
+  {
+    indexed = index_xz( handle );
+  }
+#endif
+
+  /* no usable index, the whole bin is decoded now */
+  if( indexed != 0 || handle->max_frame > COMPRESSED_MAX_FRAME )
+  {
+    free( handle->frames );
+    handle->frames = NULL;
+    handle->frames_len = 0;
+    handle->size = 0;
+#ifdef HAVE_ZSTD
+    if( kind == COMPRESSED_ZSTD )
+    {
+      indexed = decode_zstd( handle );
+    }
+#endif
+#ifdef HAVE_LZMA
+    if( kind == COMPRESSED_XZ )
+    {
+      indexed = decode_xz( handle );
+    }
+#endif
+    if( indexed != 0 )
+    {
+      compressed_close( handle );
+      return WAVER_ERR_READ;
+    }
+    munmap( map, ( size_t )buf.st_size );
+    handle->map = NULL;
+  }
+
+  input->handle = handle;
+  input->size   = compressed_size;
+  input->read   = compressed_read;
+  input->close  = compressed_close;
+
+  return WAVER_OK;
+#else
+  ( void )input;
+  ( void )path;
+
+  /* built without HAVE_ZSTD and HAVE_LZMA */
+  return WAVER_ERR_ARG;
+#endif
+}
@@ -0,0 +1,728 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    container.c
+# Purpose: output of all tracks into one
+#          tar or ZIP (stored) container.
+#
+#          the sizes of the tracks are
+#          known before the workers start
+#          (layout), so every track has a
+#          fixed place in the container and
+#          is written with pwrite. a pipe
+#          gets the tracks one after the
+#          other.
+#
+#==========================================
+*/
+
+#include "waver.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* "private" defines */
+#define TAR_BLOCK_LEN       512
+#define TAR_NAME_LEN        100
+
+#define ZIP_LOCAL_LEN        30  /* local file header without name */
+#define ZIP_DESCRIPTOR_LEN   16  /* data descriptor with signature */
+#define ZIP_CENTRAL_LEN      46  /* central directory header without name */
+#define ZIP_END_LEN          22  /* end of central directory record */
+#define ZIP_VERSION          20  /* 2.0, stored entries with data descriptor */
+#define ZIP_FLAG_DESCRIPTOR  0x0008
+
+#define CONTAINER_NAME_LEN  ( TAR_NAME_LEN - 1 )
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  char     name[ TAR_NAME_LEN ];
+  uint8_t  number;      /* track number */
+  uint64_t header_off;  /* offset of the entry header */
+  uint64_t data_off;    /* offset of the track stream */
+  uint64_t size;        /* length of the track stream */
+  uint64_t end;         /* written up to (track stream offset) */
+  uint32_t crc;         /* zip: crc-32 of the written part */
+
+} container_entry_t;
+
+
+typedef struct
+{
+
+  int                fd;
+  uint8_t            owned;     /* opened by us, closed by us */
+  uint8_t            seekable;
+  uint8_t            kind;
+  char               base_name[ TAR_NAME_LEN ];
+  uint64_t           base;      /* offset of the container in the fd */
+  uint64_t           pos;       /* pipe: bytes written */
+  uint64_t           end_off;   /* offset of the trailer */
+  time_t             mtime;
+  container_entry_t* entries;
+  uint8_t            entries_len;
+  uint8_t            closed;    /* entries completed */
+  uint8_t            failed;    /* an entry was left incomplete */
+  pthread_mutex_t    lock;
+  pthread_cond_t     turn;      /* pipe: next entry may start */
+
+} container_t;
+
+
+typedef struct
+{
+
+  container_t*       container;
+  container_entry_t* entry;
+  uint8_t            idx;
+
+} container_stream_t;
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static void init_crc32_table( void );
+static uint32_t crc32_update( uint32_t crc, const uint8_t* buf, uint64_t len );
+static void put16( uint8_t* buf, uint16_t val );
+static void put32( uint8_t* buf, uint32_t val );
+static void dos_time( time_t mtime, uint16_t* time_val, uint16_t* date_val );
+static int container_pwrite( container_t* container, const void* buf,
+                             uint64_t len, uint64_t offset );
+static int write_zeros( container_t* container, uint64_t len, uint64_t offset );
+static int write_tar_header( container_t* container, container_entry_t* entry );
+static int write_zip_header( container_t* container, container_entry_t* entry );
+static int write_trailer( container_t* container );
+static int container_layout( void* handle, const uint8_t* numbers, const char** extensions,
+                             const uint64_t* sizes, uint8_t sizes_len );
+static int container_open( void* handle, uint8_t track_no, const char* extension,
+                           uint8_t resume, void** stream );
+static int64_t container_write( void* stream, const void* buf, uint64_t len, uint64_t offset );
+static int container_sync( void* stream, uint8_t data_only );
+static int container_close( void* stream );
+static void container_release( void* handle );
+static waver_status_t new_container( waver_output_t* output, uint8_t kind, int fd,
+                                     uint8_t owned, const char* base_name );
+
+/* ****************************************************************** */
+
+/* globals */
+static uint32_t crc32_table[ 256 ];
+
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+/* ****************************************************************** */
+
+
+static void init_crc32_table( void )
+{
+  uint32_t i;
+  uint32_t j;
+  uint32_t c;
+
+  /* CRC-32 as in zip, reflected polynomial 0xEDB88320 */
+  for( i = 0; i < 256; i++ )
+  {
+    c = i;
+    for( j = 0; j < 8; j++ )
+    {
+      c = ( c & 1 ) ? ( ( c >> 1 ) ^ 0xEDB88320 ) : ( c >> 1 );
+    }
+    crc32_table[ i ] = c;
+  }
+}
+
+
+static uint32_t crc32_update( uint32_t crc, const uint8_t* buf, uint64_t len )
+{
+  uint64_t i;
+
+  crc = ~crc;
+  for( i = 0; i < len; i++ )
+  {
+    crc = crc32_table[ ( crc ^ *( buf + i ) ) & 0xFF ] ^ ( crc >> 8 );
+  }
+
+  return ~crc;
+}
+
+
+static void put16( uint8_t* buf, uint16_t val )
+{
+  *( buf + 0 ) = ( uint8_t )( val );
+  *( buf + 1 ) = ( uint8_t )( val >> 8 );
+}
+
+
+static void put32( uint8_t* buf, uint32_t val )
+{
+  *( buf + 0 ) = ( uint8_t )( val );
+  *( buf + 1 ) = ( uint8_t )( val >> 8 );
+  *( buf + 2 ) = ( uint8_t )( val >> 16 );
+  *( buf + 3 ) = ( uint8_t )( val >> 24 );
+}
+
+
+static void dos_time( time_t mtime, uint16_t* time_val, uint16_t* date_val )
+{
+  struct tm tm;
+
+  localtime_r( &mtime, &tm );
+  if( tm.tm_year < 80 )
+  {
+    tm.tm_year = 80; tm.tm_mon = 0; tm.tm_mday = 1;
+    tm.tm_hour = 0;  tm.tm_min = 0; tm.tm_sec = 0;
+  }
+  *time_val = ( uint16_t )( ( tm.tm_hour << 11 ) | ( tm.tm_min << 5 ) | ( tm.tm_sec / 2 ) );
+  *date_val = ( uint16_t )( ( ( tm.tm_year - 80 ) << 9 ) | ( ( tm.tm_mon + 1 ) << 5 ) |
+                            tm.tm_mday );
+}
+
+
+/*
+ * write at a container offset. a pipe only accepts the
+ * offset where the last write ended.
+ */
+static int container_pwrite( container_t* container, const void* buf,
+                             uint64_t len, uint64_t offset )
+{
+  uint64_t done = 0;
+  ssize_t bytes_written;
+
+  if( !container->seekable && offset != container->pos )
+  {
+    errno = ESPIPE;
+    return (-1);
+  }
+
+  while( done < len )
+  {
+    if( container->seekable )
+    {
+      bytes_written = pwrite( container->fd, ( ( const char* )buf + done ), ( len - done ),
+                              ( off_t )( container->base + offset + done ) );
+    }
+    else
+    {
+      bytes_written = write( container->fd, ( ( const char* )buf + done ), ( len - done ) );
+    }
+    if( bytes_written < 0 && errno == EINTR )
+    {
+      continue;
+    }
+    if( bytes_written <= 0 )
+    {
+      return (-1);
+    }
+    done += ( uint64_t )bytes_written;
+  }
+
+  if( !container->seekable )
+  {
+    container->pos = offset + done;
+  }
+
+  return 0;
+}
+
+
+static int write_zeros( container_t* container, uint64_t len, uint64_t offset )
+{
+  uint8_t zeros[ 2 * TAR_BLOCK_LEN ] = { 0 };
+
+  return container_pwrite( container, zeros, len, offset );
+}
+
+
+/* ustar header, the checksum is computed with blanks in its field */
+static int write_tar_header( container_t* container, container_entry_t* entry )
+{
+  char buf[ TAR_BLOCK_LEN ];
+  uint32_t sum = 0;
+  uint32_t i;
+  size_t name_len = strlen( entry->name );
+
+  /* the name field needs no terminator */
+  name_len = ( name_len < CONTAINER_NAME_LEN ) ? name_len : CONTAINER_NAME_LEN;
+  memset( buf, 0x00, TAR_BLOCK_LEN );
+  memcpy( ( buf + 0 ), entry->name, name_len );
+  snprintf( ( buf + 100 ), 8, "%07o", 0644 );
+  snprintf( ( buf + 108 ), 8, "%07o", 0 );
+  snprintf( ( buf + 116 ), 8, "%07o", 0 );
+  snprintf( ( buf + 124 ), 12, "%011llo", ( unsigned long long )entry->size );
+  snprintf( ( buf + 136 ), 12, "%011llo", ( unsigned long long )container->mtime );
+  memset( ( buf + 148 ), ' ', 8 );
+  buf[ 156 ] = '0';
+  memcpy( ( buf + 257 ), "ustar", 6 );
+  memcpy( ( buf + 263 ), "00", 2 );
+
+  for( i = 0; i < TAR_BLOCK_LEN; i++ )
+  {
+    sum += ( uint8_t )buf[ i ];
+  }
+  snprintf( ( buf + 148 ), 8, "%06o", sum );
+  buf[ 155 ] = ' ';
+
+  return container_pwrite( container, buf, TAR_BLOCK_LEN, entry->header_off );
+}
+
+
+/*
+ * local file header. in a file the crc is filled in when the
+ * entry is closed, a pipe gets it in a data descriptor.
+ */
+static int write_zip_header( container_t* container, container_entry_t* entry )
+{
+  uint8_t buf[ ZIP_LOCAL_LEN + TAR_NAME_LEN ];
+  uint16_t name_len = ( uint16_t )strlen( entry->name );
+  uint16_t time_val;
+  uint16_t date_val;
+
+  dos_time( container->mtime, &time_val, &date_val );
+
+  memset( buf, 0x00, sizeof( buf ) );
+  put32( ( buf +  0 ), 0x04034b50 );
+  put16( ( buf +  4 ), ZIP_VERSION );
+  put16( ( buf +  6 ), container->seekable ? 0 : ZIP_FLAG_DESCRIPTOR );
+  put16( ( buf +  8 ), 0 );  /* stored */
+  put16( ( buf + 10 ), time_val );
+  put16( ( buf + 12 ), date_val );
+  if( container->seekable )
+  {
+    put32( ( buf + 18 ), ( uint32_t )entry->size );
+    put32( ( buf + 22 ), ( uint32_t )entry->size );
+  }
+  put16( ( buf + 26 ), name_len );
+  memcpy( ( buf + ZIP_LOCAL_LEN ), entry->name, name_len );
+
+  return container_pwrite( container, buf, ( ZIP_LOCAL_LEN + name_len ), entry->header_off );
+}
+
+
+/* tar: two zero blocks. zip: central directory and its end record */
+static int write_trailer( container_t* container )
+{
+  container_entry_t* entry = NULL;
+  uint8_t buf[ ZIP_CENTRAL_LEN + TAR_NAME_LEN ];
+  uint64_t offset = container->end_off;
+  uint16_t name_len;
+  uint16_t time_val;
+  uint16_t date_val;
+  uint8_t i;
+
+  if( container->kind == WAVER_CONTAINER_TAR )
+  {
+    return write_zeros( container, ( 2 * TAR_BLOCK_LEN ), offset );
+  }
+
+  dos_time( container->mtime, &time_val, &date_val );
+
+  for( i = 0; i < container->entries_len; i++ )
+  {
+    entry = ( container->entries + i );
+    name_len = ( uint16_t )strlen( entry->name );
+
+    memset( buf, 0x00, sizeof( buf ) );
+    put32( ( buf +  0 ), 0x02014b50 );
+    put16( ( buf +  4 ), ( 3 << 8 ) | ZIP_VERSION );  /* made by unix */
+    put16( ( buf +  6 ), ZIP_VERSION );
+    put16( ( buf +  8 ), container->seekable ? 0 : ZIP_FLAG_DESCRIPTOR );
+    put16( ( buf + 10 ), 0 );
+    put16( ( buf + 12 ), time_val );
+    put16( ( buf + 14 ), date_val );
+    put32( ( buf + 16 ), entry->crc );
+    put32( ( buf + 20 ), ( uint32_t )entry->size );
+    put32( ( buf + 24 ), ( uint32_t )entry->size );
+    put16( ( buf + 28 ), name_len );
+    put32( ( buf + 38 ), ( uint32_t )( 0100644 ) << 16 );
+    put32( ( buf + 42 ), ( uint32_t )entry->header_off );
+    memcpy( ( buf + ZIP_CENTRAL_LEN ), entry->name, name_len );
+
+    if( container_pwrite( container, buf, ( ZIP_CENTRAL_LEN + name_len ), offset ) != 0 )
+    {
+      return (-1);
+    }
+    offset += ZIP_CENTRAL_LEN + name_len;
+  }
+
+  memset( buf, 0x00, sizeof( buf ) );
+  put32( ( buf +  0 ), 0x06054b50 );
+  put16( ( buf +  8 ), container->entries_len );
+  put16( ( buf + 10 ), container->entries_len );
+  put32( ( buf + 12 ), ( uint32_t )( offset - container->end_off ) );
+  put32( ( buf + 16 ), ( uint32_t )container->end_off );
+
+  return container_pwrite( container, buf, ZIP_END_LEN, offset );
+}
+
+
+/* place every track in the order given, entries are named by track number */
+static int container_layout( void* handle, const uint8_t* numbers, const char** extensions,
+                             const uint64_t* sizes, uint8_t sizes_len )
+{
+  container_t* container = ( container_t* )handle;
+  container_entry_t* entry = NULL;
+  uint64_t offset = 0;
+  uint8_t i;
+
+  free( container->entries );
+  if( ( container->entries = ( container_entry_t* )calloc( sizes_len,
+                                                          sizeof( container_entry_t ) ) ) == NULL )
+  {
+    errno = ENOMEM;
+    return (-1);
+  }
+  container->entries_len = sizes_len;
+  container->closed      = 0;
+  container->failed      = 0;
+
+  for( i = 0; i < sizes_len; i++ )
+  {
+    entry = ( container->entries + i );
+    snprintf( entry->name, TAR_NAME_LEN, "%.89s_%02d%.6s",
+              container->base_name, *( numbers + i ), *( extensions + i ) );
+    entry->number     = *( numbers + i );
+    entry->size       = *( sizes + i );
+    entry->header_off = offset;
+
+    if( container->kind == WAVER_CONTAINER_TAR )
+    {
+      entry->data_off = offset + TAR_BLOCK_LEN;
+      offset = entry->data_off +
+               ( ( entry->size + TAR_BLOCK_LEN - 1 ) / TAR_BLOCK_LEN ) * TAR_BLOCK_LEN;
+    }
+    else
+    {
+      entry->data_off = offset + ZIP_LOCAL_LEN + strlen( entry->name );
+      offset = entry->data_off + entry->size +
+               ( container->seekable ? 0 : ZIP_DESCRIPTOR_LEN );
+    }
+  }
+  container->end_off = offset;
+
+  /* no zip64, sizes and offsets are 32 bit */
+  if( container->kind == WAVER_CONTAINER_ZIP && offset > UINT32_MAX )
+  {
+    errno = EFBIG;
+    return (-1);
+  }
+
+  return 0;
+}
+
+
+static int container_open( void* handle, uint8_t track_no, const char* extension,
+                           uint8_t resume, void** stream )
+{
+  container_t* container = ( container_t* )handle;
+  container_stream_t* out = NULL;
+  uint8_t idx = 0;
+  int result = 0;
+
+  while( idx < container->entries_len && ( container->entries + idx )->number != track_no )
+  {
+    idx++;
+  }
+
+  if( idx == container->entries_len || resume )
+  {
+    errno = EINVAL;
+    return (-1);
+  }
+
+  /* a pipe takes the entries in order */
+  pthread_mutex_lock( &container->lock );
+  while( !container->seekable && container->closed != idx && !container->failed )
+  {
+    pthread_cond_wait( &container->turn, &container->lock );
+  }
+  if( container->failed )
+  {
+    errno = EPIPE;
+    result = (-1);
+  }
+  pthread_mutex_unlock( &container->lock );
+
+  if( result != 0 )
+  {
+    return result;
+  }
+
+  if( ( out = ( container_stream_t* )calloc( 1, sizeof( container_stream_t ) ) ) == NULL )
+  {
+    return (-1);
+  }
+  out->container = container;
+  out->entry     = ( container->entries + idx );
+  out->idx       = idx;
+  out->entry->end = 0;
+  out->entry->crc = 0;
+
+  if( container->kind == WAVER_CONTAINER_TAR )
+  {
+    result = write_tar_header( container, out->entry );
+  }
+  else
+  {
+    result = write_zip_header( container, out->entry );
+  }
+
+  if( result != 0 )
+  {
+    /* let the waiting entries fail */
+    pthread_mutex_lock( &container->lock );
+    container->failed = 1;
+    pthread_cond_broadcast( &container->turn );
+    pthread_mutex_unlock( &container->lock );
+    free( out );
+    return (-1);
+  }
+
+  *stream = out;
+
+  return 0;
+}
+
+
+/* the zip checksum needs the writes of an entry in order */
+static int64_t container_write( void* stream, const void* buf, uint64_t len, uint64_t offset )
+{
+  container_stream_t* out = ( container_stream_t* )stream;
+  container_entry_t* entry = out->entry;
+
+  if( offset + len > entry->size )
+  {
+    errno = EINVAL;
+    return (-1);
+  }
+
+  if( out->container->kind == WAVER_CONTAINER_ZIP )
+  {
+    if( offset != entry->end )
+    {
+      errno = ESPIPE;
+      return (-1);
+    }
+    entry->crc = crc32_update( entry->crc, ( const uint8_t* )buf, len );
+  }
+
+  if( container_pwrite( out->container, buf, len, entry->data_off + offset ) != 0 )
+  {
+    return (-1);
+  }
+  if( offset + len > entry->end )
+  {
+    entry->end = offset + len;
+  }
+
+  return ( int64_t )len;
+}
+
+
+/*
+ * the container is committed to the device once,
+ * when its last entry is closed.
+ */
+static int container_sync( void* stream, uint8_t data_only )
+{
+  return 0;
+}
+
+
+static int container_close( void* stream )
+{
+  container_stream_t* out = ( container_stream_t* )stream;
+  container_t* container = out->container;
+  container_entry_t* entry = out->entry;
+  uint8_t tail[ ZIP_DESCRIPTOR_LEN ];
+  uint8_t last = 0;
+  int result = 0;
+
+  if( entry->end != entry->size )
+  {
+    errno = EIO;
+    result = (-1);
+  }
+  else if( container->kind == WAVER_CONTAINER_TAR )
+  {
+    result = write_zeros( container,
+                          ( TAR_BLOCK_LEN - ( entry->size % TAR_BLOCK_LEN ) ) % TAR_BLOCK_LEN,
+                          entry->data_off + entry->size );
+  }
+  else if( container->seekable )
+  {
+    put32( tail, entry->crc );
+    result = container_pwrite( container, tail, 4, entry->header_off + 14 );
+  }
+  else
+  {
+    put32( ( tail +  0 ), 0x08074b50 );
+    put32( ( tail +  4 ), entry->crc );
+    put32( ( tail +  8 ), ( uint32_t )entry->size );
+    put32( ( tail + 12 ), ( uint32_t )entry->size );
+    result = container_pwrite( container, tail, ZIP_DESCRIPTOR_LEN,
+                               entry->data_off + entry->size );
+  }
+
+  pthread_mutex_lock( &container->lock );
+  if( result != 0 )
+  {
+    container->failed = 1;
+  }
+  else
+  {
+    container->closed++;
+    last = ( container->closed == container->entries_len );
+  }
+  pthread_cond_broadcast( &container->turn );
+  pthread_mutex_unlock( &container->lock );
+
+  if( last )
+  {
+    result = write_trailer( container );
+    if( result == 0 && container->seekable )
+    {
+      result = fdatasync( container->fd );
+    }
+  }
+
+  free( out );
+
+  return result;
+}
+
+
+static void container_release( void* handle )
+{
+  container_t* container = ( container_t* )handle;
+
+  if( container->owned )
+  {
+    close( container->fd );
+  }
+  pthread_mutex_destroy( &container->lock );
+  pthread_cond_destroy( &container->turn );
+  free( container->entries );
+  free( container );
+}
+
+
+static waver_status_t new_container( waver_output_t* output, uint8_t kind, int fd,
+                                     uint8_t owned, const char* base_name )
+{
+  container_t* container = NULL;
+  off_t base;
+
+  if( ( container = ( container_t* )calloc( 1, sizeof( container_t ) ) ) == NULL )
+  {
+    return WAVER_ERR_NOMEM;
+  }
+
+  pthread_once( &crc32_once, init_crc32_table );
+
+  container->fd    = fd;
+  container->owned = owned;
+  container->kind  = kind;
+  container->mtime = time( NULL );
+  strncpy( container->base_name, base_name, CONTAINER_NAME_LEN );
+
+  /* a seekable fd gets the container at its current position */
+  base = lseek( fd, 0, SEEK_CUR );
+  container->seekable = ( base != (-1) );
+  container->base     = container->seekable ? ( uint64_t )base : 0;
+
+  pthread_mutex_init( &container->lock, NULL );
+  pthread_cond_init( &container->turn, NULL );
+
+  output->handle  = container;
+  output->layout  = container_layout;
+  output->open    = container_open;
+  output->write   = container_write;
+  output->zero    = NULL;  /* zip entries need the crc of every byte */
+  output->clone   = NULL;
+  output->reserve = NULL;
+  output->map     = NULL;
+  output->sync    = container_sync;
+  output->close   = container_close;
+  output->release = container_release;
+
+  return WAVER_OK;
+}
+
+
+/* ...::: public interface :::... */
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+/* the entries are named <base name>_<track no>.wav (.iso) */
+waver_status_t waver_output_container( waver_output_t* output, uint8_t kind,
+                                       const char* path, const char* base_name )
+{
+  waver_status_t status;
+  int fd;
+
+  if( output == NULL || path == NULL )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  if( ( fd = open( path, O_WRONLY | O_CREAT | O_TRUNC,
+                   S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH ) ) < 0 )
+  {
+    return WAVER_ERR_OPEN;
+  }
+
+  if( ( status = waver_output_container_fd( output, kind, fd, base_name ) ) != WAVER_OK )
+  {
+    close( fd );
+    return status;
+  }
+  ( ( container_t* )output->handle )->owned = 1;
+
+  return WAVER_OK;
+}
+
+
+/* fd may be a pipe (e. g. stdout), the caller keeps ownership of it */
+waver_status_t waver_output_container_fd( waver_output_t* output, uint8_t kind,
+                                          int fd, const char* base_name )
+{
+  if( output == NULL || base_name == NULL || fd < 0 ||
+      ( kind != WAVER_CONTAINER_TAR && kind != WAVER_CONTAINER_ZIP ) )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  /* <base name>_NNN.wav must fit into a tar name field */
+  if( strlen( base_name ) > ( CONTAINER_NAME_LEN - 10 ) )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  return new_container( output, kind, fd, 0, base_name );
+}
+
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
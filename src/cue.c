@@ -0,0 +1,872 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    cue.c
+# Purpose: cue sheet parser, computes
+#          the byte ranges of the tracks
+#
+#==========================================
+*/
+
+#include "waver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+/* mm of an mm:ss:ff time, far beyond any disc */
+#define MAX_MINUTES 999
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static waver_status_t time_to_frames( waver_ctx_t* ctx, char* timestr, uint32_t* frames );
+static waver_status_t try_strtol( waver_ctx_t* ctx, char* str, int64_t* val );
+static void tokenize( char* str, const char* del, char** tokens, uint32_t exp_tokens );
+static char* keyword( char* line, const char* word );
+static void release_lines( char** lines, uint16_t lines_cnt );
+static waver_status_t set_track_mode( waver_ctx_t* ctx, track_t* track, const char* mode );
+static waver_status_t apply_gaps( waver_ctx_t* ctx, int64_t last_bin_byte );
+static waver_status_t check_tracks( waver_ctx_t* ctx, int64_t last_bin_byte );
+static void set_payload_size( track_t* track );
+
+/* ****************************************************************** */
+
+
+static waver_status_t time_to_frames( waver_ctx_t* ctx, char* timestr, uint32_t* frames )
+{
+  char timestrcpy[ 32 + 1 ] = { '\0' };
+  const char del[ 2 ] = ":";
+  char* tokens[ 3 ] = { NULL };
+  uint8_t cnt = 0;
+
+  int64_t msf[ 3 ];
+
+
+  strncpy( timestrcpy, timestr, 32 );
+
+  tokenize( timestrcpy, del, tokens, 3 );
+
+  if( tokens[ 0 ] == NULL ||
+      tokens[ 1 ] == NULL ||
+      tokens[ 2 ] == NULL )
+  {
+    return set_error( ctx, WAVER_ERR_CUE, "Failed to tokenize time value" );
+  }
+
+  for( cnt = 0; cnt < 3; cnt++ )
+  {
+    if( try_strtol( ctx, tokens[ cnt ], &msf[ cnt ] ) != WAVER_OK )
+    {
+      return ctx->status;
+    }
+  }
+
+  if( msf[ 0 ] < 0 || msf[ 0 ] > MAX_MINUTES || msf[ 1 ] < 0 || msf[ 1 ] >= 60 ||
+      msf[ 2 ] < 0 || msf[ 2 ] >= FRAMES_PER_SEC )
+  {
+    return set_error( ctx, WAVER_ERR_CUE, "Time value %.32s out of range", timestr );
+  }
+
+  *frames = ( uint32_t )(   msf[ 0 ] * 60 * FRAMES_PER_SEC
+                          + msf[ 1 ] * FRAMES_PER_SEC
+                          + msf[ 2 ] );
+
+  return WAVER_OK;
+}
+
+
+/* strtok_r keeps the parser reentrant, several contexts may parse at once */
+static void tokenize( char* str, const char* del, char** tokens, uint32_t exp_tokens )
+{
+  uint32_t cnt = 0;
+  char* saveptr = NULL;
+
+  *( tokens + cnt )  = strtok_r( str, del, &saveptr );
+  cnt++;
+
+  while( tokens != NULL && cnt < exp_tokens )
+  {
+    *( tokens + cnt ) = strtok_r( NULL, del, &saveptr );
+    cnt++;
+  }
+}
+
+
+/*
+ * the keyword of a cue sheet line is its first word, "TRACK" in
+ * a TITLE or FILE name is none. gives the keyword in the line.
+ */
+static char* keyword( char* line, const char* word )
+{
+  size_t len = strlen( word );
+
+  while( isspace( ( unsigned char )*line ) )
+  {
+    line++;
+  }
+
+  if( strncasecmp( line, word, len ) != 0 ||
+      ( *( line + len ) != '\0' && !isspace( ( unsigned char )*( line + len ) ) ) )
+  {
+    return NULL;
+  }
+
+  return line;
+}
+
+
+static waver_status_t try_strtol( waver_ctx_t* ctx, char* str, int64_t* val )
+{
+  char* endptr;
+
+  errno = 0;
+
+  *val = strtol( str, &endptr, 10 );
+
+  /* Check for various possible errors */
+  if( ( errno == ERANGE &&
+        ( *val == LONG_MAX || *val == LONG_MIN ) )
+      || ( errno != 0 && *val == 0 ) )
+  {
+    return set_error( ctx, WAVER_ERR_CUE, "strtol failed" );
+  }
+
+  if( endptr == str )
+  {
+    return set_error( ctx, WAVER_ERR_CUE, "No digits were found" );
+  }
+
+  return WAVER_OK;
+}
+
+
+static void release_lines( char** lines, uint16_t lines_cnt )
+{
+  uint16_t i;
+
+  if( lines == NULL )
+  {
+    return;
+  }
+
+  for( i = 0; i < lines_cnt; i++ )
+  {
+    free( *( lines + i ) );
+    *( lines + i ) = NULL;
+  }
+  free( lines );
+}
+
+
+/* sector layout of a track according to its mode */
+static waver_status_t set_track_mode( waver_ctx_t* ctx, track_t* track, const char* mode )
+{
+  strncpy( track->mode, mode, 15 );
+  track->sector_len = SECTOR_LEN;
+  track->offset     = 0;
+  track->subsize    = USER_DATA_LEN;
+  track->is_audio   = 0;
+
+  if( strcasecmp( mode, MODE_AUDIO ) == 0 )
+  {
+    track->subsize  = SECTOR_LEN;
+    track->is_audio = 1;
+  }
+  else if( ctx->raw_input && ( strcasecmp( mode, MODE1_2352 ) == 0 ||
+                                 strcasecmp( mode, MODE1_2048 ) == 0 ) )
+  {
+    /* raw sectors hold the whole 2352 bytes of every mode */
+    track->offset = MODE1_2352_OFFSET;
+  }
+  else if( ctx->raw_input && ( strcasecmp( mode, MODE2_2352 ) == 0 ||
+                                 strcasecmp( mode, MODE2_2336 ) == 0 ) )
+  {
+    track->offset = MODE2_2352_OFFSET;
+  }
+  else if( strcasecmp( mode, MODE1_2352 ) == 0 )
+  {
+    track->offset = MODE1_2352_OFFSET;
+  }
+  else if( strcasecmp( mode, MODE2_2352 ) == 0 )
+  {
+    track->offset = MODE2_2352_OFFSET;
+  }
+  else if( strcasecmp( mode, MODE2_2336 ) == 0 )
+  {
+    track->sector_len = SECTOR_MODE2_2336_LEN;
+    track->offset     = MODE2_2336_OFFSET;
+  }
+  else if( strcasecmp( mode, MODE1_2048 ) == 0 )
+  {
+    track->sector_len = USER_DATA_LEN;
+  }
+  else
+  {
+    return set_error( ctx, WAVER_ERR_CUE, "Unsupported mode %s of track %d",
+                      mode, track->number );
+  }
+
+  if( ctx->raw_input )
+  {
+    track->sector_len = SECTOR_RAW_LEN;
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * sets the byte ranges of the tracks according to the gap policy.
+ * gaps only move between audio tracks, data tracks omit them.
+ *
+ * omit:    INDEX 01 up to the first index of the next track
+ * append:  INDEX 01 up to INDEX 01 of the next track
+ * prepend: first index up to the first index of the next track
+ * htoa:    append, the audio before INDEX 01 of the first
+ *          track (hidden track one audio) becomes track 00
+ */
+static waver_status_t apply_gaps( waver_ctx_t* ctx, int64_t last_bin_byte )
+{
+  track_t** tracks = ctx->tracks;
+  track_t* track = NULL;
+  track_t* next = NULL;
+  track_t* hidden = NULL;
+  uint8_t i;
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( tracks + i );
+    next  = ( ( i + 1 ) < ctx->tracks_len ) ? *( tracks + ( i + 1 ) ) : NULL;
+
+    if( next == NULL )
+    {
+      track->endbyte  = last_bin_byte;
+      track->endframe = track->gapframe +
+                        ( uint32_t )( ( last_bin_byte - track->gapbyte ) / track->sector_len );
+    }
+    else if( track->is_audio && next->is_audio &&
+             ( ctx->gaps == WAVER_GAPS_APPEND || ctx->gaps == WAVER_GAPS_HTOA ) )
+    {
+      track->endbyte  = next->startbyte;
+      track->endframe = next->startframe;
+    }
+    else
+    {
+      track->endbyte  = next->gapbyte;
+      track->endframe = next->gapframe;
+    }
+  }
+
+  for( i = 0; i < ctx->tracks_len && ctx->gaps == WAVER_GAPS_PREPEND; i++ )
+  {
+    track = *( tracks + i );
+    if( track->is_audio && ( i == 0 || ( *( tracks + ( i - 1 ) ) )->is_audio ) )
+    {
+      track->startbyte  = track->gapbyte;
+      track->startframe = track->gapframe;
+    }
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( tracks + i );
+    if( track->endbyte < track->startbyte )
+    {
+      return set_error( ctx, WAVER_ERR_CUE, "Track %d ends before it starts",
+                        track->number );
+    }
+  }
+
+  /* the hidden track is inserted in front of track 01 */
+  track = *( tracks + 0 );
+  if( ctx->gaps == WAVER_GAPS_HTOA && track->is_audio && track->gapbyte < track->startbyte )
+  {
+    if( ( hidden = ( track_t* )calloc( 1, sizeof( track_t ) ) ) == NULL ||
+        ( tracks = ( track_t** )realloc( ctx->tracks, sizeof( track_t* ) *
+                                         ( ctx->tracks_len + 1 ) ) ) == NULL )
+    {
+      free( hidden );
+      return set_error( ctx, WAVER_ERR_NOMEM, "memory allocation failure" );
+    }
+    ctx->tracks = tracks;
+
+    *hidden = *track;
+    hidden->number     = 0;
+    hidden->startframe = track->gapframe;
+    hidden->startbyte  = track->gapbyte;
+    hidden->endframe   = track->startframe;
+    hidden->endbyte    = track->startbyte;
+
+    memmove( ( tracks + 1 ), tracks, sizeof( track_t* ) * ctx->tracks_len );
+    *( tracks + 0 ) = hidden;
+    ctx->tracks_len++;
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    ( *( tracks + i ) )->idx = i;
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * the payload of cooked audio is the whole byte range, else the
+ * user data of all complete sectors.
+ */
+static void set_payload_size( track_t* track )
+{
+  track->size_byte = track->endbyte - track->startbyte;
+  if( track->sector_len != track->subsize )
+  {
+    track->size_byte = ( track->size_byte / track->sector_len ) * track->subsize;
+  }
+}
+
+
+/*
+ * invariants of the byte ranges the workers rely on, whatever
+ * the cue sheet was: every range lies in the input and ends
+ * where the next one (or its dropped pregap) starts, the last
+ * one at the end of the input, and holds whole sectors but at
+ * the end of the input. the payload fits the range.
+ */
+static waver_status_t check_tracks( waver_ctx_t* ctx, int64_t last_bin_byte )
+{
+  const track_t* track = NULL;
+  const track_t* next = NULL;
+  uint8_t i;
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    next  = ( ( i + 1 ) < ctx->tracks_len ) ? *( ctx->tracks + ( i + 1 ) ) : NULL;
+
+    if( track->startbyte > track->endbyte || ( int64_t )track->endbyte > last_bin_byte ||
+        track->startbyte < track->run_startbyte || track->endbyte > track->run_endbyte )
+    {
+      return set_error( ctx, WAVER_ERR_CUE, "Track %d has an invalid range %u - %u",
+                        track->number, track->startbyte, track->endbyte );
+    }
+    if( ( next == NULL && ( int64_t )track->endbyte != last_bin_byte ) ||
+        ( next != NULL && track->endbyte != next->startbyte &&
+          track->endbyte != next->gapbyte ) )
+    {
+      return set_error( ctx, WAVER_ERR_CUE, "Track %d doesn't end where %s", track->number,
+                        ( next == NULL ) ? "the input ends" : "the next track starts" );
+    }
+    if( next != NULL && ( track->endbyte - track->startbyte ) % track->sector_len != 0 )
+    {
+      return set_error( ctx, WAVER_ERR_CUE, "Track %d doesn't hold whole sectors",
+                        track->number );
+    }
+    if( track->size_byte > ( track->endbyte - track->startbyte ) )
+    {
+      return set_error( ctx, WAVER_ERR_CUE, "Track %d has a payload larger than its range",
+                        track->number );
+    }
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * parses the cue sheet of the context and sets up the tracks.
+ * the size of the input determines the end of the last track.
+ */
+waver_status_t create_track_metadata( waver_ctx_t* ctx )
+{
+  uint16_t i;
+
+  track_t** tracks = NULL;
+  track_t* cur_track = NULL;
+  track_t* prev_track = NULL;
+  uint8_t* track_cnt = &ctx->tracks_len;
+
+  FILE* cue_fs = NULL;
+
+  char** lines = NULL;
+  uint16_t lines_cnt = 0;
+
+  char* cur_line = NULL;
+
+  char* newline_pos = NULL;
+  char* search_pos = NULL;
+
+  cueentry_t cue_entries[ MAX_TRACKS ];
+
+  const char del[ 4 ] = " \t\r";
+  char* tokens[ 3 ] = { NULL };
+
+  uint8_t index_cnt = 0;
+
+  int64_t last_bin_byte;
+
+  uint32_t first_frame = 0;
+  uint8_t j;
+  uint8_t index1;
+  uint32_t seg_frame = 0;
+  uint64_t seg_byte = 0;
+
+  waver_status_t status = WAVER_OK;
+
+  *track_cnt = 0;
+  memset( cue_entries, 0x00, sizeof( cue_entries ) );
+
+  /* the size of the input tells raw sectors apart */
+  if( ( last_bin_byte = ctx->input.size( ctx->input.handle ) ) < 0 )
+  {
+    return set_error( ctx, WAVER_ERR_SEEK, "Failed to get the size of the input" );
+  }
+
+  /* byte positions of the tracks are 32 bit */
+  if( last_bin_byte > UINT32_MAX )
+  {
+    return set_error( ctx, WAVER_ERR_CUE, "Input of %lld bytes is larger than a disc",
+                      ( long long )last_bin_byte );
+  }
+
+  ctx->raw_input = ( ctx->sector_layout == WAVER_SECTORS_RAW ) ||
+                   ( ctx->sector_layout == WAVER_SECTORS_AUTO &&
+                     ( last_bin_byte % SECTOR_RAW_LEN ) == 0 &&
+                     ( last_bin_byte % SECTOR_LEN ) != 0 );
+
+  if( ctx->raw_input && ctx->sector_layout == WAVER_SECTORS_AUTO && ctx->log != NULL )
+  {
+    fprintf( ctx->log, "input holds raw sectors of %d bytes ...\n", SECTOR_RAW_LEN );
+  }
+
+  /* the cue sheet is parsed from the copy in memory */
+  if( ( cue_fs = fmemopen( ctx->cue_text, ctx->cue_len, "r" ) ) == NULL )
+  {
+    return set_error( ctx, WAVER_ERR_CUE, "Failed to open cue sheet" );
+  }
+
+  /* ...::: parse the cue file :::... */
+  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+  /* we assume a cue file does not have more lines than MAX_LINES */
+  if(
+      ( ( lines = ( char** )malloc( sizeof( char* ) * MAX_LINES ) ) == NULL ) ||
+      ( ( *( lines + 0 ) = ( char* )malloc( sizeof( char ) * LINE_LEN ) ) == NULL )
+    )
+  {
+    fclose( cue_fs );
+    free( lines );
+    return set_error( ctx, WAVER_ERR_NOMEM, "Memory allocation failure" );
+  }
+  lines_cnt++;
+
+  /* first of all read all lines of the cue file and store them in lines */
+  i = 0;
+  while(
+         ( i < ( MAX_LINES - 1 ) ) &&
+         ( ( fgets( ( cur_line = *( lines + i ) ), ( LINE_LEN - 1 ), cue_fs ) ) != NULL )
+       )
+  {
+    /* terminate line with a null byte */
+    *( cur_line + ( LINE_LEN - 1 ) ) = '\0';
+
+    /* remove '\n'-character in parsed line */
+    if( ( newline_pos = strchr( cur_line, '\n' ) ) != NULL )
+    {
+      *newline_pos = '\0';
+      newline_pos = NULL;
+    }
+
+
+    /* track was found */
+    if( ( search_pos = keyword( cur_line, "TRACK" ) ) != NULL )
+    {
+      if( *track_cnt >= MAX_TRACKS )
+      {
+        status = set_error( ctx, WAVER_ERR_CUE, "More than %d tracks in the cue sheet",
+                            MAX_TRACKS );
+        break;
+      }
+
+      /* set the index count of previous track. */
+      if( *track_cnt > 0 )
+      {
+        cue_entries[ *track_cnt - 1 ].index_cnt = index_cnt;
+        index_cnt = 0;
+      }
+
+      /* handle new track */
+      tokenize( search_pos, del, tokens, 3 );
+      if( tokens[ 1 ] == NULL || tokens[ 2 ] == NULL )
+      {
+        status = set_error( ctx, WAVER_ERR_CUE, "Malformed TRACK in line %u", ( i + 1 ) );
+        break;
+      }
+      strncpy( cue_entries[ *track_cnt ].title, tokens[ 0 ], 15 );
+      strncpy( cue_entries[ *track_cnt ].no, tokens[ 1 ], 7 );
+      strncpy( cue_entries[ *track_cnt ].mode, tokens[ 2 ], 15 );
+
+      memset( tokens, 0x00, sizeof( char* ) * 3 );
+      search_pos = NULL;
+      ( *track_cnt )++;
+    }
+
+    /* index was found */
+    if( ( search_pos = keyword( cur_line, "INDEX" ) ) != NULL )
+    {
+      tokenize( search_pos, del, tokens, 3 );
+      if( *track_cnt == 0 || tokens[ 1 ] == NULL || tokens[ 2 ] == NULL )
+      {
+        status = set_error( ctx, WAVER_ERR_CUE, "Malformed INDEX in line %u%s", ( i + 1 ),
+                            ( *track_cnt == 0 ) ? ", before the first TRACK" : "" );
+        break;
+      }
+      if( index_cnt >= MAX_INDEXES )
+      {
+        status = set_error( ctx, WAVER_ERR_CUE, "More than %d indexes in track %d",
+                            MAX_INDEXES, *track_cnt );
+        break;
+      }
+      cue_entries[ *track_cnt - 1 ].index_no[ index_cnt ]  = tokens[ 1 ];
+      cue_entries[ *track_cnt - 1 ].index_str[ index_cnt ] = tokens[ 2 ];
+
+      memset( tokens, 0x00, sizeof( char* ) * 3 );
+      search_pos = NULL;
+      index_cnt++;
+    }
+
+    /* allocate space for next line */
+    if( ( *( lines + ( i + 1 ) ) = ( char* )malloc( sizeof( char ) * LINE_LEN ) ) == NULL )
+    {
+      status = set_error( ctx, WAVER_ERR_NOMEM, "Memory allocation failure" );
+      break;
+    }
+    lines_cnt++;
+
+    i++;
+  }
+
+  /* lines beyond MAX_LINES would drop tracks without a word */
+  if( status == WAVER_OK && i == ( MAX_LINES - 1 ) &&
+      fgets( *( lines + i ), ( LINE_LEN - 1 ), cue_fs ) != NULL )
+  {
+    status = set_error( ctx, WAVER_ERR_CUE, "More than %d lines in the cue sheet",
+                        ( MAX_LINES - 1 ) );
+  }
+
+  fclose( cue_fs );
+  cue_fs = NULL;
+
+  if( status == WAVER_OK && *track_cnt == 0 )
+  {
+    status = set_error( ctx, WAVER_ERR_CUE, "No tracks found in the cue sheet" );
+  }
+
+  if( status != WAVER_OK )
+  {
+    release_lines( lines, lines_cnt );
+    *track_cnt = 0;
+    return status;
+  }
+
+  /* set index count of the last track ... */
+  cue_entries[ *track_cnt - 1 ].index_cnt = index_cnt;
+  index_cnt = 0;
+
+  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+  /* ...::: set up the tracks metadata :::... */
+  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+  if( ( tracks = ( track_t** )calloc( *track_cnt, sizeof( track_t* ) ) ) == NULL )
+  {
+    release_lines( lines, lines_cnt );
+    *track_cnt = 0;
+    return set_error( ctx, WAVER_ERR_NOMEM, "memory allocation failure" );
+  }
+  ctx->tracks = tracks;
+
+  for( i = 0; i < *track_cnt && status == WAVER_OK; i++ )
+  {
+    if( ( *( tracks + i ) = ( track_t* )calloc( 1, sizeof( track_t ) ) ) == NULL )
+    {
+      status = set_error( ctx, WAVER_ERR_NOMEM, "memory allocation failure" );
+      break;
+    }
+
+    if( i > 0 )
+    {
+      prev_track = cur_track;
+      cur_track = NULL;
+    }
+
+    cur_track = *( tracks + i );
+
+    cur_track->number = ( i + 1 );
+
+    if( ( status = set_track_mode( ctx, cur_track, cue_entries[ i ].mode ) ) != WAVER_OK )
+    {
+      break;
+    }
+
+    /*
+     * the first index (INDEX 00 if there is a pregap) starts the
+     * gap, INDEX 01 the track. without INDEX 01 the last index
+     * starts the track.
+     */
+    if( cue_entries[ i ].index_cnt == 0 )
+    {
+      status = set_error( ctx, WAVER_ERR_CUE, "Track %d has no INDEX", cur_track->number );
+      break;
+    }
+    status = time_to_frames( ctx, cue_entries[ i ].index_str[ 0 ], &first_frame );
+    index1 = ( cue_entries[ i ].index_cnt - 1 );
+    for( j = 0; j < cue_entries[ i ].index_cnt; j++ )
+    {
+      if( cue_entries[ i ].index_no[ j ] != NULL &&
+          strtol( cue_entries[ i ].index_no[ j ], NULL, 10 ) == 1 )
+      {
+        index1 = j;
+        break;
+      }
+    }
+    if( status == WAVER_OK )
+    {
+      status = time_to_frames( ctx, cue_entries[ i ].index_str[ index1 ],
+                               &cur_track->startframe );
+    }
+    if( status == WAVER_OK && cur_track->startframe < first_frame )
+    {
+      status = set_error( ctx, WAVER_ERR_CUE, "INDEX 01 before the first index of track %d",
+                          cur_track->number );
+    }
+    if( status != WAVER_OK )
+    {
+      break;
+    }
+
+    /*
+     * the sectors from the first index of a track up to the
+     * first index of the next one have the sector length of
+     * the track, the byte positions add up segment by segment.
+     */
+    if( i > 0 && first_frame < seg_frame )
+    {
+      status = set_error( ctx, WAVER_ERR_CUE, "Track %d starts before track %d",
+                          cur_track->number, prev_track->number );
+      break;
+    }
+    if( i == 0 )
+    {
+      seg_byte = ( uint64_t )first_frame * cur_track->sector_len;
+    }
+    else
+    {
+      seg_byte += ( uint64_t )( first_frame - seg_frame ) * prev_track->sector_len;
+    }
+    seg_frame = first_frame;
+
+    if( ( seg_byte + ( uint64_t )( cur_track->startframe - first_frame ) *
+                     cur_track->sector_len ) > ( uint64_t )last_bin_byte )
+    {
+      status = set_error( ctx, WAVER_ERR_CUE, "Track %d starts behind the end of the input",
+                          cur_track->number );
+      break;
+    }
+
+    cur_track->gapframe  = first_frame;
+    cur_track->gapbyte   = ( uint32_t )seg_byte;
+    cur_track->startbyte = ( uint32_t )( seg_byte + ( uint64_t )( cur_track->startframe -
+                                                                 first_frame ) *
+                                                    cur_track->sector_len );
+  }
+
+  release_lines( lines, lines_cnt );
+  lines = NULL;
+
+  if( status != WAVER_OK )
+  {
+    release_track_metadata( ctx );
+    return status;
+  }
+
+  if( ( status = apply_gaps( ctx, last_bin_byte ) ) != WAVER_OK )
+  {
+    release_track_metadata( ctx );
+    return status;
+  }
+  tracks = ctx->tracks;
+
+  /*
+   * the payload of cooked audio is the whole byte range, else the
+   * user data of all complete sectors.
+   */
+  for( i = 0; i < *track_cnt; i++ )
+  {
+    cur_track = *( tracks + i );
+    cur_track->header_len = cur_track->is_audio ? WAV_HEADER_LEN : 0;
+    set_payload_size( cur_track );
+  }
+
+  /*
+   * a run of audio tracks is bounded by the disc edges or
+   * data tracks, the offset correction does not read beyond.
+   */
+  for( i = 0; i < *track_cnt; i++ )
+  {
+    cur_track = *( tracks + i );
+    prev_track = ( i > 0 ) ? *( tracks + ( i - 1 ) ) : NULL;
+    if( prev_track != NULL && prev_track->is_audio && cur_track->is_audio )
+    {
+      cur_track->run_startbyte = prev_track->run_startbyte;
+    }
+    else
+    {
+      cur_track->run_startbyte = ( cur_track->gapbyte < cur_track->startbyte ) ?
+                                 cur_track->gapbyte : cur_track->startbyte;
+    }
+  }
+  for( i = *track_cnt; i > 0; i-- )
+  {
+    cur_track = *( tracks + ( i - 1 ) );
+    prev_track = ( i < *track_cnt ) ? *( tracks + i ) : NULL;
+    if( prev_track != NULL && prev_track->is_audio && cur_track->is_audio )
+    {
+      cur_track->run_endbyte = prev_track->run_endbyte;
+    }
+    else
+    {
+      cur_track->run_endbyte = cur_track->endbyte;
+    }
+  }
+
+  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+  if( ( status = check_tracks( ctx, last_bin_byte ) ) != WAVER_OK )
+  {
+    release_track_metadata( ctx );
+    return status;
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * keeps the tracks of the selection (waver_select_track) and cuts
+ * the ranges of waver_select_range out of them, in whole sectors
+ * from the start of the track. the rest is never read. the bounds
+ * of the audio runs stay, the offset correction reads the samples
+ * next to a range as on the whole disc.
+ */
+waver_status_t select_tracks( waver_ctx_t* ctx )
+{
+  track_t* track = NULL;
+  const selection_t* sel = NULL;
+  uint32_t frames;
+  uint8_t found[ MAX_TRACKS + 1 ] = { 0 };
+  uint8_t kept = 0;
+  uint8_t i;
+  uint16_t number;
+
+  if( !ctx->selecting )
+  {
+    return WAVER_OK;
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    sel = &ctx->selection[ track->number ];
+    frames = ( track->endbyte - track->startbyte ) / track->sector_len;
+    found[ track->number ] = 1;
+    if( sel->on && sel->to > 0 && sel->from >= ( ( sel->to < frames ) ? sel->to : frames ) )
+    {
+      return set_error( ctx, WAVER_ERR_ARG, "Range %u - %u is not in track %02u of %u frames",
+                        sel->from, sel->to, track->number, frames );
+    }
+  }
+  for( number = 0; number <= MAX_TRACKS; number++ )
+  {
+    if( ctx->selection[ number ].on && !found[ number ] )
+    {
+      return set_error( ctx, WAVER_ERR_ARG, "Track %02u is not in the cue sheet", number );
+    }
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    sel = &ctx->selection[ track->number ];
+    *( ctx->tracks + i ) = NULL;
+
+    if( !sel->on )
+    {
+      free( track );
+      continue;
+    }
+    *( ctx->tracks + kept ) = track;
+    track->idx = kept;
+    kept++;
+
+    if( sel->to > 0 )
+    {
+      /* a range up to the end keeps the partial sector at the end of the bin */
+      frames = ( track->endbyte - track->startbyte ) / track->sector_len;
+      if( sel->to < frames )
+      {
+        track->endbyte  = track->startbyte + sel->to * track->sector_len;
+        track->endframe = track->startframe + sel->to;
+      }
+      track->startbyte  += sel->from * track->sector_len;
+      track->startframe += sel->from;
+      track->gapbyte     = track->startbyte;
+      track->gapframe    = track->startframe;
+      set_payload_size( track );
+    }
+  }
+  ctx->tracks_len = kept;
+
+  return WAVER_OK;
+}
+
+
+void release_track_metadata( waver_ctx_t* ctx )
+{
+  uint8_t i;
+
+  if( ctx->tracks == NULL )
+  {
+    return;
+  }
+
+  /* a cue sheet that failed leaves the tracks behind it unset */
+  for( i = 0; i < ctx->tracks_len && *( ctx->tracks + i ) != NULL; i++ )
+  {
+    free( ( *( ctx->tracks + i ) )->loudness );
+    free( *( ctx->tracks + i ) );
+    *( ctx->tracks + i ) = NULL;
+  }
+
+  free( ctx->tracks );
+  ctx->tracks = NULL;
+  ctx->tracks_len = 0;
+}
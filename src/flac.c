@@ -0,0 +1,983 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    flac.c
+# Purpose: FLAC frame encoder
+#          (fixed and LPC predictors,
+#          partitioned Rice coding)
+#
+#==========================================
+*/
+
+#include "flac.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+/* "private" defines */
+#define SUBFRAME_CONSTANT  0
+#define SUBFRAME_VERBATIM  1
+#define SUBFRAME_FIXED     2
+#define SUBFRAME_LPC       3
+
+#define MAX_FIXED_ORDER      4
+#define MAX_PARTITION_ORDER  8
+#define MAX_RICE_PARAM      30  /* 5 bit parameters (coding method 1) */
+#define MAX_RICE4_PARAM     14  /* 4 bit parameters (coding method 0) */
+
+/* channel assignments of the frame header */
+#define CH_INDEPENDENT  1
+#define CH_LEFT_SIDE    8
+#define CH_RIGHT_SIDE   9
+#define CH_MID_SIDE    10
+
+/* candidate channels of one frame */
+#define CAND_LEFT   0
+#define CAND_RIGHT  1
+#define CAND_MID    2
+#define CAND_SIDE   3
+#define CAND_CNT    4
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  uint8_t* buf;
+  uint32_t len;    /* bytes completely written */
+  uint64_t acc;    /* pending bits, right aligned */
+  uint32_t nbits;  /* number of pending bits, always < 8 between calls */
+
+} bitwriter_t;
+
+
+typedef struct
+{
+
+  uint8_t  type;
+  uint8_t  order;
+  uint8_t  bps;
+  uint8_t  shift;
+  int32_t  qlp[ FLAC_MAX_LPC_ORDER ];
+  uint8_t  part_order;
+  uint8_t  params[ 1 << MAX_PARTITION_ORDER ];
+  uint64_t bits;
+  int32_t* residual;  /* residual[ i ] belongs to sample order + i */
+
+} subframe_t;
+
+
+/* work buffers of one encoder, see flac_encoder_create */
+struct flac_encoder
+{
+
+  int32_t*   chan[ CAND_CNT ];
+  int32_t*   residual[ CAND_CNT ];
+  int32_t*   scratch;
+  double*    window;
+  double*    windowed;
+  subframe_t sub[ CAND_CNT ];
+
+};
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static void init_crc_tables( void );
+static void bw_put( bitwriter_t* bw, uint32_t val, uint32_t bits );
+static void bw_put_signed( bitwriter_t* bw, int32_t val, uint32_t bits );
+static void bw_put_utf8( bitwriter_t* bw, uint32_t val );
+static void bw_align( bitwriter_t* bw );
+static uint64_t rice_partition( const int32_t* residual, uint32_t blocksize,
+                                uint8_t order, subframe_t* sub );
+static uint64_t try_fixed( const int32_t* x, uint32_t n, uint8_t bps,
+                           subframe_t* sub, int32_t* residual );
+static uint64_t try_lpc( const int32_t* x, uint32_t n, uint8_t bps,
+                         const double* lp, uint8_t order,
+                         subframe_t* sub, int32_t* residual );
+static void lpc_coefficients( const int32_t* x, uint32_t n, flac_encoder_t* work,
+                              double lp[ FLAC_MAX_LPC_ORDER ][ FLAC_MAX_LPC_ORDER ],
+                              double err[ FLAC_MAX_LPC_ORDER ] );
+static void analyze_channel( const int32_t* x, uint32_t n, uint8_t bps,
+                             flac_encoder_t* work, uint8_t cand );
+static void write_subframe( bitwriter_t* bw, const int32_t* x, uint32_t n,
+                            const subframe_t* sub );
+static uint32_t encode_frame( flac_encoder_t* work, uint32_t n,
+                              uint32_t frame_no, uint8_t* out );
+
+/* ****************************************************************** */
+
+/* globals */
+static uint8_t  crc8_table[ 256 ];
+static uint16_t crc16_table[ 256 ];
+
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+/* ****************************************************************** */
+
+
+static void init_crc_tables( void )
+{
+  uint32_t i;
+  uint32_t j;
+  uint8_t  c8;
+  uint16_t c16;
+
+  /* CRC-8, polynomial x^8 + x^2 + x^1 + x^0 */
+  /* CRC-16, polynomial x^16 + x^15 + x^2 + x^0 */
+  for( i = 0; i < 256; i++ )
+  {
+    c8  = ( uint8_t )i;
+    c16 = ( uint16_t )( i << 8 );
+    for( j = 0; j < 8; j++ )
+    {
+      c8  = ( c8 & 0x80 ) ? ( uint8_t )( ( c8 << 1 ) ^ 0x07 ) : ( uint8_t )( c8 << 1 );
+      c16 = ( c16 & 0x8000 ) ? ( uint16_t )( ( c16 << 1 ) ^ 0x8005 ) : ( uint16_t )( c16 << 1 );
+    }
+    crc8_table[ i ]  = c8;
+    crc16_table[ i ] = c16;
+  }
+}
+
+
+static void bw_put( bitwriter_t* bw, uint32_t val, uint32_t bits )
+{
+  if( bits == 0 )
+  {
+    return;
+  }
+  if( bits < 32 )
+  {
+    val &= ( ( uint32_t )1 << bits ) - 1;
+  }
+
+  bw->acc = ( bw->acc << bits ) | val;
+  bw->nbits += bits;
+
+  while( bw->nbits >= 8 )
+  {
+    bw->nbits -= 8;
+    *( bw->buf + bw->len ) = ( uint8_t )( bw->acc >> bw->nbits );
+    bw->len++;
+  }
+}
+
+
+static void bw_put_signed( bitwriter_t* bw, int32_t val, uint32_t bits )
+{
+  bw_put( bw, ( uint32_t )val, bits );
+}
+
+
+/* frame numbers are coded like UTF-8 characters (up to 31 bit) */
+static void bw_put_utf8( bitwriter_t* bw, uint32_t val )
+{
+  uint8_t cont;
+  int8_t i;
+
+  if( val < 0x80 )
+  {
+    bw_put( bw, val, 8 );
+    return;
+  }
+
+  if( val < 0x800 )
+  {
+    cont = 1;
+    bw_put( bw, 0xC0 | ( val >> 6 ), 8 );
+  }
+  else if( val < 0x10000 )
+  {
+    cont = 2;
+    bw_put( bw, 0xE0 | ( val >> 12 ), 8 );
+  }
+  else if( val < 0x200000 )
+  {
+    cont = 3;
+    bw_put( bw, 0xF0 | ( val >> 18 ), 8 );
+  }
+  else if( val < 0x4000000 )
+  {
+    cont = 4;
+    bw_put( bw, 0xF8 | ( val >> 24 ), 8 );
+  }
+  else
+  {
+    cont = 5;
+    bw_put( bw, 0xFC | ( val >> 30 ), 8 );
+  }
+
+  for( i = ( int8_t )( cont - 1 ); i >= 0; i-- )
+  {
+    bw_put( bw, 0x80 | ( ( val >> ( 6 * i ) ) & 0x3F ), 8 );
+  }
+}
+
+
+static void bw_align( bitwriter_t* bw )
+{
+  if( bw->nbits > 0 )
+  {
+    bw_put( bw, 0, 8 - bw->nbits );
+  }
+}
+
+
+/*
+ * choose the partition order and the Rice parameters for a residual.
+ * returns the exact number of bits of the residual section.
+ */
+static uint64_t rice_partition( const int32_t* residual, uint32_t blocksize,
+                                uint8_t order, subframe_t* sub )
+{
+  uint64_t sums[ 1 << MAX_PARTITION_ORDER ];
+  uint8_t  params[ 1 << MAX_PARTITION_ORDER ];
+  uint64_t best_bits = UINT64_MAX;
+  uint64_t bits;
+  uint64_t cost;
+  uint64_t cost_k;
+  uint64_t mean;
+  uint32_t max_order = 0;
+  uint32_t parts;
+  uint32_t part_len;
+  uint32_t n;
+  uint32_t i;
+  uint32_t j;
+  uint32_t u;
+  const int32_t* res;
+  int32_t p;
+  uint8_t k;
+  uint8_t method;
+
+  /* highest partition order the block size can be divided into */
+  while( max_order < MAX_PARTITION_ORDER &&
+         ( blocksize % ( 1U << ( max_order + 1 ) ) ) == 0 &&
+         ( blocksize >> ( max_order + 1 ) ) > order )
+  {
+    max_order++;
+  }
+
+  /* sums of the folded residual per partition of the highest order */
+  parts = 1U << max_order;
+  part_len = blocksize >> max_order;
+  res = residual;
+  for( j = 0; j < parts; j++ )
+  {
+    n = ( j == 0 ) ? ( part_len - order ) : part_len;
+    sums[ j ] = 0;
+    for( i = 0; i < n; i++ )
+    {
+      sums[ j ] += ( ( uint32_t )res[ i ] << 1 ) ^ ( uint32_t )( res[ i ] >> 31 );
+    }
+    res += n;
+  }
+
+  /* estimate the cost of every order, merging partitions pairwise */
+  for( p = ( int32_t )max_order; p >= 0; p-- )
+  {
+    parts = 1U << p;
+    part_len = blocksize >> p;
+    bits = 0;
+    method = 0;
+
+    for( j = 0; j < parts; j++ )
+    {
+      n = ( j == 0 ) ? ( part_len - order ) : part_len;
+      mean = ( n > 0 ) ? ( sums[ j ] / n ) : 0;
+
+      k = 0;
+      while( k < MAX_RICE_PARAM && ( ( uint64_t )1 << ( k + 1 ) ) <= mean )
+      {
+        k++;
+      }
+      cost = ( uint64_t )n * ( k + 1 ) + ( sums[ j ] >> k );
+      if( k < MAX_RICE_PARAM )
+      {
+        cost_k = ( uint64_t )n * ( k + 2 ) + ( sums[ j ] >> ( k + 1 ) );
+        if( cost_k < cost )
+        {
+          cost = cost_k;
+          k++;
+        }
+      }
+      if( k > MAX_RICE4_PARAM )
+      {
+        method = 1;
+      }
+      params[ j ] = k;
+      bits += cost;
+    }
+    bits += ( uint64_t )parts * ( method ? 5 : 4 );
+
+    if( bits < best_bits )
+    {
+      best_bits = bits;
+      sub->part_order = ( uint8_t )p;
+      memcpy( sub->params, params, parts );
+    }
+
+    /* merge for the next lower order */
+    for( j = 0; j < ( parts >> 1 ); j++ )
+    {
+      sums[ j ] = sums[ 2 * j ] + sums[ 2 * j + 1 ];
+    }
+  }
+
+  /* exact cost of the chosen partitioning */
+  parts = 1U << sub->part_order;
+  part_len = blocksize >> sub->part_order;
+  res = residual;
+  bits = 2 + 4;
+  method = 0;
+  for( j = 0; j < parts; j++ )
+  {
+    n = ( j == 0 ) ? ( part_len - order ) : part_len;
+    k = sub->params[ j ];
+    if( k > MAX_RICE4_PARAM )
+    {
+      method = 1;
+    }
+    bits += ( uint64_t )n * ( k + 1 );
+    for( i = 0; i < n; i++ )
+    {
+      u = ( ( uint32_t )res[ i ] << 1 ) ^ ( uint32_t )( res[ i ] >> 31 );
+      bits += u >> k;
+    }
+    res += n;
+  }
+  bits += ( uint64_t )parts * ( method ? 5 : 4 );
+
+  return bits;
+}
+
+
+static uint64_t try_fixed( const int32_t* x, uint32_t n, uint8_t bps,
+                           subframe_t* sub, int32_t* residual )
+{
+  uint64_t err[ MAX_FIXED_ORDER + 1 ] = { 0 };
+  int64_t e0, e1, e2, e3, e4;
+  uint32_t i;
+  uint8_t order = 0;
+  uint8_t o;
+
+  /* pick the order with the smallest sum of absolute residuals */
+  for( i = MAX_FIXED_ORDER; i < n; i++ )
+  {
+    e0 = x[ i ];
+    e1 = e0 - x[ i - 1 ];
+    e2 = e1 - ( ( int64_t )x[ i - 1 ] - x[ i - 2 ] );
+    e3 = e2 - ( ( int64_t )x[ i - 1 ] - 2 * ( int64_t )x[ i - 2 ] + x[ i - 3 ] );
+    e4 = e3 - ( ( int64_t )x[ i - 1 ] - 3 * ( int64_t )x[ i - 2 ]
+                + 3 * ( int64_t )x[ i - 3 ] - x[ i - 4 ] );
+    err[ 0 ] += ( e0 < 0 ) ? -e0 : e0;
+    err[ 1 ] += ( e1 < 0 ) ? -e1 : e1;
+    err[ 2 ] += ( e2 < 0 ) ? -e2 : e2;
+    err[ 3 ] += ( e3 < 0 ) ? -e3 : e3;
+    err[ 4 ] += ( e4 < 0 ) ? -e4 : e4;
+  }
+  for( o = 1; o <= MAX_FIXED_ORDER && o < n; o++ )
+  {
+    if( err[ o ] < err[ order ] )
+    {
+      order = o;
+    }
+  }
+
+  for( i = order; i < n; i++ )
+  {
+    switch( order )
+    {
+      case 0:
+        residual[ i ] = x[ i ];
+        break;
+      case 1:
+        residual[ i - order ] = x[ i ] - x[ i - 1 ];
+        break;
+      case 2:
+        residual[ i - order ] = x[ i ] - 2 * x[ i - 1 ] + x[ i - 2 ];
+        break;
+      case 3:
+        residual[ i - order ] = x[ i ] - 3 * x[ i - 1 ] + 3 * x[ i - 2 ] - x[ i - 3 ];
+        break;
+      default:
+        residual[ i - order ] = x[ i ] - 4 * x[ i - 1 ] + 6 * x[ i - 2 ]
+                                - 4 * x[ i - 3 ] + x[ i - 4 ];
+        break;
+    }
+  }
+
+  sub->type = SUBFRAME_FIXED;
+  sub->order = order;
+  sub->bps = bps;
+  sub->residual = residual;
+  sub->bits = 8 + ( uint64_t )order * bps + rice_partition( residual, n, order, sub );
+
+  return sub->bits;
+}
+
+
+static uint64_t try_lpc( const int32_t* x, uint32_t n, uint8_t bps,
+                         const double* lp, uint8_t order,
+                         subframe_t* sub, int32_t* residual )
+{
+  const int32_t qmax = ( 1 << ( FLAC_QLP_PRECISION - 1 ) ) - 1;
+  const int32_t qmin = -( 1 << ( FLAC_QLP_PRECISION - 1 ) );
+  double cmax = 0.0;
+  double error = 0.0;
+  double q;
+  int64_t sum;
+  int64_t r;
+  int32_t shift;
+  int log2cmax;
+  uint32_t i;
+  uint8_t j;
+
+  if( order >= n )
+  {
+    return UINT64_MAX;
+  }
+
+  /* quantize the coefficients */
+  for( j = 0; j < order; j++ )
+  {
+    if( fabs( lp[ j ] ) > cmax )
+    {
+      cmax = fabs( lp[ j ] );
+    }
+  }
+  if( cmax <= 0.0 )
+  {
+    return UINT64_MAX;
+  }
+
+  frexp( cmax, &log2cmax );
+  shift = ( FLAC_QLP_PRECISION - 1 ) - log2cmax;
+  if( shift > 15 )
+  {
+    shift = 15;
+  }
+  if( shift < 0 )
+  {
+    return UINT64_MAX;
+  }
+
+  for( j = 0; j < order; j++ )
+  {
+    error += lp[ j ] * ( 1 << shift );
+    q = round( error );
+    if( q > qmax )
+    {
+      q = qmax;
+    }
+    else if( q < qmin )
+    {
+      q = qmin;
+    }
+    error -= q;
+    sub->qlp[ j ] = ( int32_t )q;
+  }
+
+  /* residual, rejected if it does not fit into 31 bits */
+  for( i = order; i < n; i++ )
+  {
+    sum = 0;
+    for( j = 0; j < order; j++ )
+    {
+      sum += ( int64_t )sub->qlp[ j ] * x[ i - j - 1 ];
+    }
+    r = x[ i ] - ( sum >> shift );
+    if( r > ( INT32_MAX >> 1 ) || r < ( INT32_MIN >> 1 ) )
+    {
+      return UINT64_MAX;
+    }
+    residual[ i - order ] = ( int32_t )r;
+  }
+
+  sub->type = SUBFRAME_LPC;
+  sub->order = order;
+  sub->bps = bps;
+  sub->shift = ( uint8_t )shift;
+  sub->residual = residual;
+  sub->bits = 8 + ( uint64_t )order * bps + 4 + 5
+              + ( uint64_t )order * FLAC_QLP_PRECISION
+              + rice_partition( residual, n, order, sub );
+
+  return sub->bits;
+}
+
+
+/*
+ * linear prediction coefficients of all orders up to FLAC_MAX_LPC_ORDER.
+ * the signal is windowed (tukey 0.5) before the autocorrelation.
+ * lp[ o - 1 ] holds the o coefficients for the order o.
+ */
+static void lpc_coefficients( const int32_t* x, uint32_t n, flac_encoder_t* work,
+                              double lp[ FLAC_MAX_LPC_ORDER ][ FLAC_MAX_LPC_ORDER ],
+                              double err[ FLAC_MAX_LPC_ORDER ] )
+{
+  double autoc[ FLAC_MAX_LPC_ORDER + 1 ];
+  double a[ FLAC_MAX_LPC_ORDER ] = { 0.0 };
+  double tmp[ FLAC_MAX_LPC_ORDER ];
+  double e;
+  double acc;
+  double k;
+  uint32_t taper = n / 4;
+  uint32_t i;
+  uint32_t j;
+
+  for( i = 0; i < n; i++ )
+  {
+    if( i < taper )
+    {
+      *( work->window + i ) = 0.5 - 0.5 * cos( M_PI * i / taper );
+    }
+    else if( i >= n - taper )
+    {
+      *( work->window + i ) = 0.5 - 0.5 * cos( M_PI * ( n - 1 - i ) / taper );
+    }
+    else
+    {
+      *( work->window + i ) = 1.0;
+    }
+    *( work->windowed + i ) = x[ i ] * *( work->window + i );
+  }
+
+  for( j = 0; j <= FLAC_MAX_LPC_ORDER; j++ )
+  {
+    acc = 0.0;
+    for( i = j; i < n; i++ )
+    {
+      acc += *( work->windowed + i ) * *( work->windowed + i - j );
+    }
+    autoc[ j ] = acc;
+  }
+
+  /* levinson-durbin recursion */
+  e = autoc[ 0 ];
+  for( i = 0; i < FLAC_MAX_LPC_ORDER; i++ )
+  {
+    if( e <= 0.0 )
+    {
+      /* perfectly predictable, keep the previous solution */
+      for( j = i; j < FLAC_MAX_LPC_ORDER; j++ )
+      {
+        memcpy( lp[ j ], a, sizeof( a ) );
+        err[ j ] = 0.0;
+      }
+      return;
+    }
+
+    acc = autoc[ i + 1 ];
+    for( j = 0; j < i; j++ )
+    {
+      acc -= a[ j ] * autoc[ i - j ];
+    }
+    k = acc / e;
+
+    for( j = 0; j < i; j++ )
+    {
+      tmp[ j ] = a[ j ] - k * a[ i - 1 - j ];
+    }
+    memcpy( a, tmp, sizeof( double ) * i );
+    a[ i ] = k;
+    e *= ( 1.0 - k * k );
+
+    memcpy( lp[ i ], a, sizeof( a ) );
+    err[ i ] = e;
+  }
+}
+
+
+/* find the cheapest subframe for one candidate channel */
+static void analyze_channel( const int32_t* x, uint32_t n, uint8_t bps,
+                             flac_encoder_t* work, uint8_t cand )
+{
+  double lp[ FLAC_MAX_LPC_ORDER ][ FLAC_MAX_LPC_ORDER ];
+  double err[ FLAC_MAX_LPC_ORDER ];
+  double est;
+  double best_est = 0.0;
+  subframe_t* best = &work->sub[ cand ];
+  subframe_t trial;
+  int32_t* tmp;
+  uint32_t i;
+  uint8_t best_order = 0;
+  uint8_t order;
+
+  /* constant */
+  for( i = 1; i < n && x[ i ] == x[ 0 ]; i++ )
+    ;
+  if( i == n )
+  {
+    best->type = SUBFRAME_CONSTANT;
+    best->bps = bps;
+    best->bits = 8 + bps;
+    return;
+  }
+
+  /* verbatim is the upper bound for every other subframe type */
+  best->type = SUBFRAME_VERBATIM;
+  best->bps = bps;
+  best->bits = 8 + ( uint64_t )n * bps;
+
+  /* fixed predictor */
+  if( try_fixed( x, n, bps, &trial, work->scratch ) < best->bits )
+  {
+    *best = trial;
+    tmp = work->residual[ cand ];
+    work->residual[ cand ] = work->scratch;
+    work->scratch = tmp;
+  }
+
+  /* lpc, the order with the best expected bits and the maximum order */
+  if( n <= FLAC_MAX_LPC_ORDER * 2 )
+  {
+    return;
+  }
+  lpc_coefficients( x, n, work, lp, err );
+  for( order = 1; order <= FLAC_MAX_LPC_ORDER; order++ )
+  {
+    est = ( err[ order - 1 ] > 0.0 )
+          ? ( 0.5 * log2( err[ order - 1 ] / n ) * ( n - order ) ) : 0.0;
+    est += ( double )order * ( bps + FLAC_QLP_PRECISION );
+    if( order == 1 || est < best_est )
+    {
+      best_est = est;
+      best_order = order;
+    }
+  }
+
+  for( order = best_order; order <= FLAC_MAX_LPC_ORDER;
+       order = ( order < FLAC_MAX_LPC_ORDER ) ? FLAC_MAX_LPC_ORDER : ( order + 1 ) )
+  {
+    if( try_lpc( x, n, bps, lp[ order - 1 ], order, &trial, work->scratch ) < best->bits )
+    {
+      *best = trial;
+      tmp = work->residual[ cand ];
+      work->residual[ cand ] = work->scratch;
+      work->scratch = tmp;
+    }
+  }
+}
+
+
+static void write_subframe( bitwriter_t* bw, const int32_t* x, uint32_t n,
+                            const subframe_t* sub )
+{
+  const int32_t* res;
+  uint32_t parts;
+  uint32_t part_len;
+  uint32_t cnt;
+  uint32_t i;
+  uint32_t j;
+  uint32_t u;
+  uint32_t q;
+  uint8_t method = 0;
+  uint8_t k;
+
+  switch( sub->type )
+  {
+    case SUBFRAME_CONSTANT:
+    {
+      bw_put( bw, 0x00, 8 );
+      bw_put_signed( bw, x[ 0 ], sub->bps );
+      return;
+    }
+    case SUBFRAME_VERBATIM:
+    {
+      bw_put( bw, 0x02, 8 );
+      for( i = 0; i < n; i++ )
+      {
+        bw_put_signed( bw, x[ i ], sub->bps );
+      }
+      return;
+    }
+    case SUBFRAME_FIXED:
+    {
+      bw_put( bw, ( 0x08 | sub->order ) << 1, 8 );
+      for( i = 0; i < sub->order; i++ )
+      {
+        bw_put_signed( bw, x[ i ], sub->bps );
+      }
+      break;
+    }
+    default:
+    {
+      bw_put( bw, ( 0x20 | ( sub->order - 1 ) ) << 1, 8 );
+      for( i = 0; i < sub->order; i++ )
+      {
+        bw_put_signed( bw, x[ i ], sub->bps );
+      }
+      bw_put( bw, FLAC_QLP_PRECISION - 1, 4 );
+      bw_put( bw, sub->shift, 5 );
+      for( i = 0; i < sub->order; i++ )
+      {
+        bw_put_signed( bw, sub->qlp[ i ], FLAC_QLP_PRECISION );
+      }
+      break;
+    }
+  }
+
+  /* residual */
+  parts = 1U << sub->part_order;
+  part_len = n >> sub->part_order;
+  for( j = 0; j < parts; j++ )
+  {
+    if( sub->params[ j ] > MAX_RICE4_PARAM )
+    {
+      method = 1;
+    }
+  }
+  bw_put( bw, method, 2 );
+  bw_put( bw, sub->part_order, 4 );
+
+  res = sub->residual;
+  for( j = 0; j < parts; j++ )
+  {
+    k = sub->params[ j ];
+    bw_put( bw, k, method ? 5 : 4 );
+    cnt = ( j == 0 ) ? ( part_len - sub->order ) : part_len;
+    for( i = 0; i < cnt; i++ )
+    {
+      u = ( ( uint32_t )res[ i ] << 1 ) ^ ( uint32_t )( res[ i ] >> 31 );
+      q = u >> k;
+      if( q + 1 + k <= 32 )
+      {
+        bw_put( bw, ( 1U << k ) | ( u & ( ( 1U << k ) - 1 ) ), q + 1 + k );
+      }
+      else
+      {
+        while( q >= 32 )
+        {
+          bw_put( bw, 0, 32 );
+          q -= 32;
+        }
+        bw_put( bw, 0, q );
+        bw_put( bw, ( 1U << k ) | ( u & ( ( 1U << k ) - 1 ) ), k + 1 );
+      }
+    }
+    res += cnt;
+  }
+}
+
+
+static uint32_t encode_frame( flac_encoder_t* work, uint32_t n,
+                              uint32_t frame_no, uint8_t* out )
+{
+  bitwriter_t bw = { out, 0, 0, 0 };
+  uint64_t cost[ 4 ];
+  uint8_t first[ 4 ]  = { CAND_LEFT, CAND_LEFT, CAND_SIDE, CAND_MID };
+  uint8_t second[ 4 ] = { CAND_RIGHT, CAND_SIDE, CAND_RIGHT, CAND_SIDE };
+  uint8_t assign[ 4 ] = { CH_INDEPENDENT, CH_LEFT_SIDE, CH_RIGHT_SIDE, CH_MID_SIDE };
+  uint8_t best = 0;
+  uint8_t crc8 = 0;
+  uint16_t crc16 = 0;
+  uint32_t i;
+  uint8_t c;
+
+  for( c = 0; c < CAND_CNT; c++ )
+  {
+    analyze_channel( work->chan[ c ], n,
+                     ( c == CAND_SIDE ) ? ( BITS_PER_SAMPLE + 1 ) : BITS_PER_SAMPLE,
+                     work, c );
+  }
+
+  for( c = 0; c < 4; c++ )
+  {
+    cost[ c ] = work->sub[ first[ c ] ].bits + work->sub[ second[ c ] ].bits;
+    if( cost[ c ] < cost[ best ] )
+    {
+      best = c;
+    }
+  }
+
+  /* frame header */
+  bw_put( &bw, 0x3FFE, 14 );
+  bw_put( &bw, 0, 1 );                       /* reserved */
+  bw_put( &bw, 0, 1 );                       /* fixed block size stream */
+  bw_put( &bw, ( n <= 256 ) ? 6 : 7, 4 );    /* block size at the end of header */
+  bw_put( &bw, 9, 4 );                       /* 44.1 kHz */
+  bw_put( &bw, assign[ best ], 4 );
+  bw_put( &bw, 4, 3 );                       /* 16 bits per sample */
+  bw_put( &bw, 0, 1 );                       /* reserved */
+  bw_put_utf8( &bw, frame_no );
+  bw_put( &bw, n - 1, ( n <= 256 ) ? 8 : 16 );
+
+  for( i = 0; i < bw.len; i++ )
+  {
+    crc8 = crc8_table[ crc8 ^ out[ i ] ];
+  }
+  bw_put( &bw, crc8, 8 );
+
+  /* subframes */
+  write_subframe( &bw, work->chan[ first[ best ] ], n, &work->sub[ first[ best ] ] );
+  write_subframe( &bw, work->chan[ second[ best ] ], n, &work->sub[ second[ best ] ] );
+  bw_align( &bw );
+
+  /* frame footer */
+  for( i = 0; i < bw.len; i++ )
+  {
+    crc16 = ( uint16_t )( ( crc16 << 8 ) ^ crc16_table[ ( crc16 >> 8 ) ^ out[ i ] ] );
+  }
+  bw_put( &bw, crc16, 16 );
+
+  return bw.len;
+}
+
+
+/*
+ * encode pcm_len bytes of little endian 16 bit stereo samples
+ * into consecutive frames of FLAC_BLOCKSIZE samples, the last
+ * frame may be shorter. out must hold FLAC_MAX_FRAME_LEN bytes
+ * per frame. returns the number of bytes written to out.
+ */
+uint32_t flac_encode_block( flac_encoder_t* work, const char* pcm, uint32_t pcm_len,
+                            uint32_t first_frame_no, uint8_t* out,
+                            uint32_t* min_framesize, uint32_t* max_framesize )
+{
+  const uint8_t* in = ( const uint8_t* )pcm;
+  uint32_t samples = pcm_len / EFFECTIVE_BYTES;
+  uint32_t frame_no = first_frame_no;
+  uint32_t out_len = 0;
+  uint32_t frame_len;
+  uint32_t n;
+  uint32_t i;
+  int32_t l;
+  int32_t r;
+
+  while( samples > 0 )
+  {
+    n = ( samples < FLAC_BLOCKSIZE ) ? samples : FLAC_BLOCKSIZE;
+
+    /* deinterleave and decorrelate */
+    for( i = 0; i < n; i++ )
+    {
+      l = ( int16_t )( in[ 0 ] | ( in[ 1 ] << 8 ) );
+      r = ( int16_t )( in[ 2 ] | ( in[ 3 ] << 8 ) );
+      in += EFFECTIVE_BYTES;
+      work->chan[ CAND_LEFT ][ i ]  = l;
+      work->chan[ CAND_RIGHT ][ i ] = r;
+      work->chan[ CAND_MID ][ i ]   = ( l + r ) >> 1;
+      work->chan[ CAND_SIDE ][ i ]  = l - r;
+    }
+
+    frame_len = encode_frame( work, n, frame_no, ( out + out_len ) );
+    out_len += frame_len;
+
+    if( frame_len < *min_framesize )
+    {
+      *min_framesize = frame_len;
+    }
+    if( frame_len > *max_framesize )
+    {
+      *max_framesize = frame_len;
+    }
+
+    samples -= n;
+    frame_no++;
+  }
+
+  return out_len;
+}
+
+
+/* one encoder per thread, returns NULL on memory allocation failure */
+flac_encoder_t* flac_encoder_create( void )
+{
+  flac_encoder_t* work = NULL;
+  uint8_t c;
+
+  pthread_once( &crc_once, init_crc_tables );
+
+  if( ( work = ( flac_encoder_t* )calloc( 1, sizeof( flac_encoder_t ) ) ) == NULL )
+  {
+    return NULL;
+  }
+
+  for( c = 0; c < CAND_CNT; c++ )
+  {
+    if( ( work->chan[ c ] = ( int32_t* )malloc( sizeof( int32_t ) * FLAC_BLOCKSIZE ) ) == NULL ||
+        ( work->residual[ c ] = ( int32_t* )malloc( sizeof( int32_t ) * FLAC_BLOCKSIZE ) ) == NULL )
+    {
+      flac_encoder_destroy( work );
+      return NULL;
+    }
+  }
+  if( ( work->scratch = ( int32_t* )malloc( sizeof( int32_t ) * FLAC_BLOCKSIZE ) ) == NULL ||
+      ( work->window = ( double* )malloc( sizeof( double ) * FLAC_BLOCKSIZE ) ) == NULL ||
+      ( work->windowed = ( double* )malloc( sizeof( double ) * FLAC_BLOCKSIZE ) ) == NULL )
+  {
+    flac_encoder_destroy( work );
+    return NULL;
+  }
+
+  return work;
+}
+
+
+void flac_encoder_destroy( flac_encoder_t* work )
+{
+  uint8_t c;
+
+  if( work == NULL )
+  {
+    return;
+  }
+
+  for( c = 0; c < CAND_CNT; c++ )
+  {
+    free( work->chan[ c ] );
+    free( work->residual[ c ] );
+  }
+  free( work->scratch );
+  free( work->window );
+  free( work->windowed );
+  free( work );
+}
+
+
+/* "fLaC" marker and the STREAMINFO metadata block */
+void flac_stream_header( uint8_t buf[ FLAC_HEADER_LEN ],
+                         const flac_streaminfo_t* info )
+{
+  bitwriter_t bw = { buf, 0, 0, 0 };
+  uint8_t i;
+
+  memcpy( buf, "fLaC", 4 );
+  bw.len = 4;
+
+  /* metadata block header: last block, type 0 (STREAMINFO) */
+  bw_put( &bw, 1, 1 );
+  bw_put( &bw, 0, 7 );
+  bw_put( &bw, FLAC_STREAMINFO_LEN, 24 );
+
+  bw_put( &bw, info->min_blocksize, 16 );
+  bw_put( &bw, info->max_blocksize, 16 );
+  bw_put( &bw, info->min_framesize, 24 );
+  bw_put( &bw, info->max_framesize, 24 );
+  bw_put( &bw, SAMPLING_RATE, 20 );
+  bw_put( &bw, CHANNELS - 1, 3 );
+  bw_put( &bw, BITS_PER_SAMPLE - 1, 5 );
+  bw_put( &bw, ( uint32_t )( info->total_samples >> 32 ), 4 );
+  bw_put( &bw, ( uint32_t )info->total_samples, 32 );
+  for( i = 0; i < 16; i++ )
+  {
+    bw_put( &bw, info->md5[ i ], 8 );
+  }
+}
@@ -0,0 +1,948 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    io.c
+# Purpose: built in inputs (file, fd,
+#          memory) and outputs (files,
+#          mapped files, fds, memory
+#          buffers)
+#
+#==========================================
+*/
+
+#include "waver.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+/* not in the headers of older C libraries */
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  int     fd;
+  uint8_t owned;  /* opened by us, closed by us */
+
+} fd_input_t;
+
+
+typedef struct
+{
+
+  const uint8_t* buf;
+  uint64_t       len;
+
+} mem_input_t;
+
+
+typedef struct
+{
+
+  char base_name[ NAME_LEN ];
+
+} file_output_t;
+
+
+typedef struct
+{
+
+  int      fd;
+  uint8_t  owned;     /* opened by us, closed by us */
+  uint8_t  seekable;
+  uint64_t pos;       /* position of sequential writes (pipes) */
+
+} fd_stream_t;
+
+
+typedef struct
+{
+
+  fd_stream_t stream;     /* first, the fd callbacks work on it too */
+  char*       data;       /* the mapping, NULL until reserved */
+  uint64_t    len;
+  uint64_t    end;        /* of the writes */
+  uint64_t    flushed;    /* written back up to here */
+  uint64_t    populated;  /* faulted in up to here */
+  uint8_t     written;    /* only reserved (-p all) if not */
+
+} map_stream_t;
+
+
+typedef struct
+{
+
+  const int* fds;
+  uint8_t    fds_len;
+
+} fds_output_t;
+
+
+typedef struct
+{
+
+  waver_buffer_t* bufs;
+  uint8_t         bufs_len;
+
+} mem_output_t;
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static int64_t fd_input_size( void* handle );
+static int64_t fd_input_read( void* handle, void* buf, uint64_t len, uint64_t offset );
+static void fd_input_close( void* handle );
+static int64_t mem_input_size( void* handle );
+static int64_t mem_input_read( void* handle, void* buf, uint64_t len, uint64_t offset );
+static void mem_input_close( void* handle );
+static fd_stream_t* new_fd_stream( int fd, uint8_t owned, size_t size );
+static void build_file_name( const char* base_name, uint8_t track_no,
+                             const char* extension, char* out_name );
+static int open_file( void* handle, uint8_t track_no, const char* extension,
+                      uint8_t resume, int flags, size_t size, void** stream );
+static int file_output_open( void* handle, uint8_t track_no, const char* extension,
+                             uint8_t resume, void** stream );
+static int mapped_output_open( void* handle, uint8_t track_no, const char* extension,
+                               uint8_t resume, void** stream );
+static int fds_output_open( void* handle, uint8_t track_no, const char* extension,
+                            uint8_t resume, void** stream );
+static int64_t fd_stream_write( void* stream, const void* buf, uint64_t len, uint64_t offset );
+static int fd_stream_zero( void* stream, uint64_t len, uint64_t offset );
+static int fd_stream_clone( void* stream, int fd, uint64_t len, uint64_t src_offset,
+                            uint64_t offset );
+static int fd_stream_reserve( void* stream, uint64_t len );
+static int fd_stream_sync( void* stream, uint8_t data_only );
+static int fd_stream_close( void* stream );
+static int64_t map_stream_write( void* stream, const void* buf, uint64_t len, uint64_t offset );
+static void map_stream_advance( map_stream_t* out );
+static void* map_stream_map( void* stream, uint64_t offset, uint64_t len );
+static int map_stream_reserve( void* stream, uint64_t len );
+static int map_stream_sync( void* stream, uint8_t data_only );
+static int map_stream_close( void* stream );
+static void output_release( void* handle );
+static int mem_output_open( void* handle, uint8_t track_no, const char* extension,
+                            uint8_t resume, void** stream );
+static int64_t mem_stream_write( void* stream, const void* buf, uint64_t len, uint64_t offset );
+static int mem_stream_sync( void* stream, uint8_t data_only );
+static int mem_stream_close( void* stream );
+
+/* ****************************************************************** */
+
+/* ...::: inputs :::... */
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+static int64_t fd_input_size( void* handle )
+{
+  struct stat buf;
+
+  if( fstat( ( ( fd_input_t* )handle )->fd, &buf ) != 0 )
+  {
+    return (-1);
+  }
+  return ( int64_t )buf.st_size;
+}
+
+
+static int64_t fd_input_read( void* handle, void* buf, uint64_t len, uint64_t offset )
+{
+  int fd = ( ( fd_input_t* )handle )->fd;
+  uint64_t done = 0;
+  ssize_t bytes_read;
+
+  while( done < len )
+  {
+    bytes_read = pread( fd, ( ( char* )buf + done ), ( len - done ), ( off_t )( offset + done ) );
+    if( bytes_read < 0 && errno == EINTR )
+    {
+      continue;
+    }
+    if( bytes_read <= 0 )
+    {
+      break;
+    }
+    done += ( uint64_t )bytes_read;
+  }
+
+  return ( int64_t )done;
+}
+
+
+static void fd_input_close( void* handle )
+{
+  fd_input_t* input = ( fd_input_t* )handle;
+
+  if( input->owned )
+  {
+    close( input->fd );
+  }
+  free( input );
+}
+
+
+static int64_t mem_input_size( void* handle )
+{
+  return ( int64_t )( ( mem_input_t* )handle )->len;
+}
+
+
+static int64_t mem_input_read( void* handle, void* buf, uint64_t len, uint64_t offset )
+{
+  mem_input_t* input = ( mem_input_t* )handle;
+
+  if( offset >= input->len )
+  {
+    return 0;
+  }
+  if( len > input->len - offset )
+  {
+    len = input->len - offset;
+  }
+  memcpy( buf, ( input->buf + offset ), len );
+
+  return ( int64_t )len;
+}
+
+
+static void mem_input_close( void* handle )
+{
+  free( handle );
+}
+
+
+waver_status_t waver_input_file( waver_input_t* input, const char* path )
+{
+  int fd;
+  waver_status_t status;
+
+  if( ( fd = open( path, O_RDONLY ) ) < 0 )
+  {
+    return WAVER_ERR_OPEN;
+  }
+
+  if( ( status = waver_input_fd( input, fd ) ) != WAVER_OK )
+  {
+    close( fd );
+    return status;
+  }
+  ( ( fd_input_t* )input->handle )->owned = 1;
+
+  return WAVER_OK;
+}
+
+
+waver_status_t waver_input_fd( waver_input_t* input, int fd )
+{
+  fd_input_t* handle = NULL;
+
+  if( input == NULL || fd < 0 )
+  {
+    return WAVER_ERR_ARG;
+  }
+  if( ( handle = ( fd_input_t* )calloc( 1, sizeof( fd_input_t ) ) ) == NULL )
+  {
+    return WAVER_ERR_NOMEM;
+  }
+  handle->fd = fd;
+
+  input->handle = handle;
+  input->size   = fd_input_size;
+  input->read   = fd_input_read;
+  input->close  = fd_input_close;
+
+  return WAVER_OK;
+}
+
+
+waver_status_t waver_input_memory( waver_input_t* input, const void* buf, uint64_t len )
+{
+  mem_input_t* handle = NULL;
+
+  if( input == NULL || ( buf == NULL && len > 0 ) )
+  {
+    return WAVER_ERR_ARG;
+  }
+  if( ( handle = ( mem_input_t* )calloc( 1, sizeof( mem_input_t ) ) ) == NULL )
+  {
+    return WAVER_ERR_NOMEM;
+  }
+  handle->buf = ( const uint8_t* )buf;
+  handle->len = len;
+
+  input->handle = handle;
+  input->size   = mem_input_size;
+  input->read   = mem_input_read;
+  input->close  = mem_input_close;
+
+  return WAVER_OK;
+}
+
+
+uint8_t is_fd_input( const waver_input_t* input )
+{
+  return ( input->read == fd_input_read );
+}
+
+
+int input_fd( const waver_input_t* input )
+{
+  return ( ( fd_input_t* )input->handle )->fd;
+}
+
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+
+/* ...::: outputs :::... */
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+/* size of the stream struct, which starts with an fd_stream_t */
+static fd_stream_t* new_fd_stream( int fd, uint8_t owned, size_t size )
+{
+  fd_stream_t* stream = NULL;
+
+  if( ( stream = ( fd_stream_t* )calloc( 1, size ) ) == NULL )
+  {
+    return NULL;
+  }
+  stream->fd    = fd;
+  stream->owned = owned;
+  stream->seekable = ( lseek( fd, 0, SEEK_CUR ) != (-1) );
+
+  return stream;
+}
+
+
+/* <base name>_<track no><extension> */
+static void build_file_name( const char* base_name, uint8_t track_no,
+                             const char* extension, char* out_name )
+{
+  snprintf( out_name, PATH_LEN, "%.*s_%02d%s",
+            ( PATH_LEN - 16 ), base_name, track_no, extension );
+}
+
+
+static int open_file( void* handle, uint8_t track_no, const char* extension,
+                      uint8_t resume, int flags, size_t size, void** stream )
+{
+  file_output_t* output = ( file_output_t* )handle;
+  char out_name[ PATH_LEN ];
+  int out_fd;
+
+  build_file_name( output->base_name, track_no, extension, out_name );
+
+  /* a resumed output file keeps its content */
+  out_fd = open( out_name,
+                 flags | O_CREAT | ( resume ? 0 : O_TRUNC ),
+                 S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
+
+  if( out_fd < 0 )
+  {
+    return (-1);
+  }
+
+  if( ( *stream = new_fd_stream( out_fd, 1, size ) ) == NULL )
+  {
+    close( out_fd );
+    return (-1);
+  }
+
+  return 0;
+}
+
+
+static int file_output_open( void* handle, uint8_t track_no, const char* extension,
+                             uint8_t resume, void** stream )
+{
+  return open_file( handle, track_no, extension, resume, O_WRONLY,
+                    sizeof( fd_stream_t ), stream );
+}
+
+
+/* a shared mapping needs an fd that can read */
+static int mapped_output_open( void* handle, uint8_t track_no, const char* extension,
+                               uint8_t resume, void** stream )
+{
+  return open_file( handle, track_no, extension, resume, O_RDWR,
+                    sizeof( map_stream_t ), stream );
+}
+
+
+static int fds_output_open( void* handle, uint8_t track_no, const char* extension,
+                            uint8_t resume, void** stream )
+{
+  fds_output_t* output = ( fds_output_t* )handle;
+
+  if( track_no < 1 || track_no > output->fds_len )
+  {
+    errno = EINVAL;
+    return (-1);
+  }
+
+  if( ( *stream = new_fd_stream( *( output->fds + ( track_no - 1 ) ), 0,
+                                 sizeof( fd_stream_t ) ) ) == NULL )
+  {
+    return (-1);
+  }
+
+  return 0;
+}
+
+
+/*
+ * positional writes, fds which can't seek (pipes, sockets)
+ * are written sequentially and fail on any other offset.
+ */
+static int64_t fd_stream_write( void* stream, const void* buf, uint64_t len, uint64_t offset )
+{
+  fd_stream_t* out = ( fd_stream_t* )stream;
+  uint64_t done = 0;
+  ssize_t bytes_written;
+
+  if( !out->seekable && offset != out->pos )
+  {
+    errno = ESPIPE;
+    return (-1);
+  }
+
+  while( done < len )
+  {
+    if( out->seekable )
+    {
+      bytes_written = pwrite( out->fd, ( ( const char* )buf + done ), ( len - done ),
+                              ( off_t )( offset + done ) );
+    }
+    else
+    {
+      bytes_written = write( out->fd, ( ( const char* )buf + done ), ( len - done ) );
+    }
+    if( bytes_written < 0 && errno == EINTR )
+    {
+      continue;
+    }
+    if( bytes_written <= 0 )
+    {
+      break;
+    }
+    done += ( uint64_t )bytes_written;
+  }
+  out->pos = offset + done;
+
+  return ( int64_t )done;
+}
+
+
+/*
+ * the range reads as zeros without being written: written
+ * data gets a hole punched in, a range behind the end of
+ * the file only extends it.
+ */
+static int fd_stream_zero( void* stream, uint64_t len, uint64_t offset )
+{
+  fd_stream_t* out = ( fd_stream_t* )stream;
+  struct stat out_stat;
+  uint64_t size;
+
+  if( !out->seekable || fstat( out->fd, &out_stat ) != 0 )
+  {
+    return (-1);
+  }
+  size = ( uint64_t )out_stat.st_size;
+
+  if( offset < size &&
+      fallocate( out->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, ( off_t )offset,
+                 ( off_t )( ( ( offset + len ) < size ) ? len : ( size - offset ) ) ) != 0 )
+  {
+    return (-1);
+  }
+  if( ( offset + len ) > size && ftruncate( out->fd, ( off_t )( offset + len ) ) != 0 )
+  {
+    return (-1);
+  }
+
+  return 0;
+}
+
+
+/* reflink, fails on file systems without shared extents (EOPNOTSUPP) */
+static int fd_stream_clone( void* stream, int fd, uint64_t len, uint64_t src_offset,
+                            uint64_t offset )
+{
+  fd_stream_t* out = ( fd_stream_t* )stream;
+  struct file_clone_range range;
+
+  if( !out->seekable )
+  {
+    errno = ESPIPE;
+    return (-1);
+  }
+
+  range.src_fd      = fd;
+  range.src_offset  = src_offset;
+  range.src_length  = len;
+  range.dest_offset = offset;
+
+  return ( ioctl( out->fd, FICLONERANGE, &range ) == 0 ) ? 0 : (-1);
+}
+
+
+/*
+ * the extents of the whole stream are allocated at once, its
+ * length grows with the writes. file systems and fds without
+ * fallocate are written as before.
+ */
+static int fd_stream_reserve( void* stream, uint64_t len )
+{
+  fd_stream_t* out = ( fd_stream_t* )stream;
+
+  if( !out->seekable || len == 0 )
+  {
+    return 0;
+  }
+
+  if( fallocate( out->fd, FALLOC_FL_KEEP_SIZE, 0, ( off_t )len ) != 0 )
+  {
+    return ( errno == ENOSPC || errno == EFBIG || errno == EDQUOT ) ? (-1) : 0;
+  }
+
+  return 0;
+}
+
+
+/*
+ * flush file system buffer to write down
+ * the processed track to persistent device
+ */
+static int fd_stream_sync( void* stream, uint8_t data_only )
+{
+  fd_stream_t* out = ( fd_stream_t* )stream;
+
+  if( !out->seekable )
+  {
+    return 0;
+  }
+
+  return data_only ? fdatasync( out->fd ) : syncfs( out->fd );
+}
+
+
+static int fd_stream_close( void* stream )
+{
+  fd_stream_t* out = ( fd_stream_t* )stream;
+  int result = 0;
+
+  if( out->owned )
+  {
+    result = close( out->fd );
+  }
+  free( out );
+
+  return result;
+}
+
+
+/*
+ * inside the mapping the bytes are copied, unless the payload
+ * was already made there (map). writes the stream isn't mapped
+ * for go to the fd.
+ */
+static int64_t map_stream_write( void* stream, const void* buf, uint64_t len, uint64_t offset )
+{
+  map_stream_t* out = ( map_stream_t* )stream;
+
+  out->written = 1;
+  if( out->data == NULL || ( offset + len ) > out->len )
+  {
+    return fd_stream_write( stream, buf, len, offset );
+  }
+
+  if( ( const char* )buf != ( out->data + offset ) )
+  {
+    memcpy( ( out->data + offset ), buf, len );
+  }
+  if( ( offset + len ) > out->end )
+  {
+    out->end = offset + len;
+  }
+  map_stream_advance( out );
+
+  return ( int64_t )len;
+}
+
+
+/*
+ * the writes of a track go front to back, the mapping follows
+ * them window by window: a full window is handed to writeback,
+ * the one before it (written back by now) leaves the mapping and
+ * the page cache, the next one is faulted in ahead of the writer.
+ */
+static void map_stream_advance( map_stream_t* out )
+{
+  int fd = out->stream.fd;
+  uint64_t len;
+
+  while( ( out->end - out->flushed ) >= MAP_WINDOW )
+  {
+    sync_file_range( fd, ( off_t )out->flushed, MAP_WINDOW, SYNC_FILE_RANGE_WRITE );
+    if( out->flushed >= MAP_WINDOW )
+    {
+      sync_file_range( fd, ( off_t )( out->flushed - MAP_WINDOW ), MAP_WINDOW,
+                       SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                       SYNC_FILE_RANGE_WAIT_AFTER );
+      madvise( ( out->data + out->flushed - MAP_WINDOW ), MAP_WINDOW, MADV_DONTNEED );
+      posix_fadvise( fd, ( off_t )( out->flushed - MAP_WINDOW ), MAP_WINDOW,
+                     POSIX_FADV_DONTNEED );
+    }
+    out->flushed += MAP_WINDOW;
+  }
+
+  /* kernels before 5.14 don't know it (EINVAL), the writes fault then */
+  if( ( out->end + MAP_WINDOW ) > out->populated && out->populated < out->len )
+  {
+    len = out->len - out->populated;
+    len = ( len < MAP_WINDOW ) ? len : MAP_WINDOW;
+    madvise( ( out->data + out->populated ), len, MADV_POPULATE_WRITE );
+    out->populated += len;
+  }
+}
+
+
+static void* map_stream_map( void* stream, uint64_t offset, uint64_t len )
+{
+  map_stream_t* out = ( map_stream_t* )stream;
+
+  if( out->data == NULL || ( offset + len ) > out->len )
+  {
+    return NULL;
+  }
+
+  return ( out->data + offset );
+}
+
+
+/*
+ * the file gets its final length and is mapped. only allocated
+ * storage is mapped, a store to a page the device has no room
+ * for would be a SIGBUS, such streams are written by the fd.
+ */
+static int map_stream_reserve( void* stream, uint64_t len )
+{
+  map_stream_t* out = ( map_stream_t* )stream;
+  struct stat st;
+  uint8_t reserved;
+  void* data;
+
+  if( !out->stream.seekable || len == 0 || out->data != NULL )
+  {
+    return 0;
+  }
+
+  /* reserved before the run (-p all), only the mapping is new */
+  reserved = ( fstat( out->stream.fd, &st ) == 0 && ( uint64_t )st.st_size == len &&
+               ( uint64_t )st.st_blocks * 512 >= len );
+
+  if( !reserved && fallocate( out->stream.fd, FALLOC_FL_KEEP_SIZE, 0, ( off_t )len ) != 0 )
+  {
+    return ( errno == ENOSPC || errno == EFBIG || errno == EDQUOT ) ? (-1) : 0;
+  }
+  if( !reserved && ftruncate( out->stream.fd, ( off_t )len ) != 0 )
+  {
+    return (-1);
+  }
+
+  data = mmap( NULL, len, ( PROT_READ | PROT_WRITE ), MAP_SHARED, out->stream.fd, 0 );
+  if( data != MAP_FAILED )
+  {
+    out->data = ( char* )data;
+    out->len  = len;
+  }
+
+  return 0;
+}
+
+
+static int map_stream_sync( void* stream, uint8_t data_only )
+{
+  map_stream_t* out = ( map_stream_t* )stream;
+
+  if( out->data != NULL && msync( out->data, out->len, MS_SYNC ) != 0 )
+  {
+    return (-1);
+  }
+
+  return fd_stream_sync( stream, data_only );
+}
+
+
+/*
+ * a stream that ends short of its length (failed run) is cut to its
+ * writes. one that was only reserved keeps its length and storage,
+ * the worker of the track opens it again.
+ */
+static int map_stream_close( void* stream )
+{
+  map_stream_t* out = ( map_stream_t* )stream;
+  int result = 0;
+
+  if( out->data != NULL )
+  {
+    result = munmap( out->data, out->len );
+    if( out->written && out->end < out->len && ftruncate( out->stream.fd, ( off_t )out->end ) != 0 )
+    {
+      result = (-1);
+    }
+  }
+
+  return ( fd_stream_close( stream ) != 0 ) ? (-1) : result;
+}
+
+
+static void output_release( void* handle )
+{
+  free( handle );
+}
+
+
+waver_status_t waver_output_files( waver_output_t* output, const char* base_name )
+{
+  file_output_t* handle = NULL;
+
+  if( output == NULL || base_name == NULL || ( strlen( base_name ) + 1 ) > ( NAME_LEN - 4 ) )
+  {
+    return WAVER_ERR_ARG;
+  }
+  if( ( handle = ( file_output_t* )calloc( 1, sizeof( file_output_t ) ) ) == NULL )
+  {
+    return WAVER_ERR_NOMEM;
+  }
+  strncpy( handle->base_name, base_name, ( NAME_LEN - 4 ) );
+
+  output->handle  = handle;
+  output->layout  = NULL;
+  output->open    = file_output_open;
+  output->write   = fd_stream_write;
+  output->zero    = fd_stream_zero;
+  output->clone   = fd_stream_clone;
+  output->reserve = fd_stream_reserve;
+  output->map     = NULL;
+  output->sync    = fd_stream_sync;
+  output->close   = fd_stream_close;
+  output->release = output_release;
+
+  return WAVER_OK;
+}
+
+
+/*
+ * files like waver_output_files, which are mapped when they are
+ * reserved: the payload is made in the page cache, without a
+ * copy through a buffer.
+ */
+waver_status_t waver_output_mapped( waver_output_t* output, const char* base_name )
+{
+  waver_status_t status;
+
+  if( ( status = waver_output_files( output, base_name ) ) != WAVER_OK )
+  {
+    return status;
+  }
+
+  output->open    = mapped_output_open;
+  output->write   = map_stream_write;
+  output->reserve = map_stream_reserve;
+  output->map     = map_stream_map;
+  output->sync    = map_stream_sync;
+  output->close   = map_stream_close;
+
+  return WAVER_OK;
+}
+
+
+/* fds[ i ] receives track i + 1, the caller keeps ownership of the fds */
+waver_status_t waver_output_fds( waver_output_t* output, const int* fds, uint8_t fds_len )
+{
+  fds_output_t* handle = NULL;
+
+  if( output == NULL || fds == NULL )
+  {
+    return WAVER_ERR_ARG;
+  }
+  if( ( handle = ( fds_output_t* )calloc( 1, sizeof( fds_output_t ) ) ) == NULL )
+  {
+    return WAVER_ERR_NOMEM;
+  }
+  handle->fds     = fds;
+  handle->fds_len = fds_len;
+
+  output->handle  = handle;
+  output->layout  = NULL;
+  output->open    = fds_output_open;
+  output->write   = fd_stream_write;
+  output->zero    = fd_stream_zero;
+  output->clone   = fd_stream_clone;
+  output->reserve = fd_stream_reserve;
+  output->map     = NULL;
+  output->sync    = fd_stream_sync;
+  output->close   = fd_stream_close;
+  output->release = output_release;
+
+  return WAVER_OK;
+}
+
+
+static int mem_output_open( void* handle, uint8_t track_no, const char* extension,
+                            uint8_t resume, void** stream )
+{
+  mem_output_t* output = ( mem_output_t* )handle;
+
+  if( track_no < 1 || track_no > output->bufs_len )
+  {
+    errno = EINVAL;
+    return (-1);
+  }
+
+  *stream = ( output->bufs + ( track_no - 1 ) );
+  if( !resume )
+  {
+    ( ( waver_buffer_t* )*stream )->len = 0;
+  }
+
+  return 0;
+}
+
+
+static int64_t mem_stream_write( void* stream, const void* buf, uint64_t len, uint64_t offset )
+{
+  waver_buffer_t* out = ( waver_buffer_t* )stream;
+  uint8_t* data = NULL;
+  uint64_t cap = ( out->cap > 0 ) ? out->cap : BLOCK_SIZE;
+
+  /* grow geometrically, there is only one writer per buffer */
+  if( offset + len > out->cap )
+  {
+    while( cap < offset + len )
+    {
+      cap *= 2;
+    }
+    if( ( data = ( uint8_t* )realloc( out->data, cap ) ) == NULL )
+    {
+      errno = ENOMEM;
+      return (-1);
+    }
+    out->data = data;
+    out->cap  = cap;
+  }
+
+  if( offset > out->len )
+  {
+    memset( ( out->data + out->len ), 0x00, ( offset - out->len ) );
+  }
+  memcpy( ( out->data + offset ), buf, len );
+  if( offset + len > out->len )
+  {
+    out->len = offset + len;
+  }
+
+  return ( int64_t )len;
+}
+
+
+static int mem_stream_sync( void* stream, uint8_t data_only )
+{
+  return 0;
+}
+
+
+static int mem_stream_close( void* stream )
+{
+  return 0;
+}
+
+
+/* bufs[ i ] receives track i + 1, the caller frees bufs[ i ].data */
+waver_status_t waver_output_memory( waver_output_t* output,
+                                    waver_buffer_t* bufs, uint8_t bufs_len )
+{
+  mem_output_t* handle = NULL;
+
+  if( output == NULL || bufs == NULL )
+  {
+    return WAVER_ERR_ARG;
+  }
+  if( ( handle = ( mem_output_t* )calloc( 1, sizeof( mem_output_t ) ) ) == NULL )
+  {
+    return WAVER_ERR_NOMEM;
+  }
+  handle->bufs     = bufs;
+  handle->bufs_len = bufs_len;
+
+  output->handle  = handle;
+  output->layout  = NULL;
+  output->open    = mem_output_open;
+  output->write   = mem_stream_write;
+  output->zero    = NULL;
+  output->clone   = NULL;
+  output->reserve = NULL;
+  output->map     = NULL;
+  output->sync    = mem_stream_sync;
+  output->close   = mem_stream_close;
+  output->release = output_release;
+
+  return WAVER_OK;
+}
+
+
+uint8_t is_file_output( const waver_output_t* output )
+{
+  return ( output->open == file_output_open || output->open == mapped_output_open );
+}
+
+
+void file_output_name( const waver_output_t* output, uint8_t track_no,
+                       const char* extension, char* out_name )
+{
+  build_file_name( ( ( file_output_t* )output->handle )->base_name,
+                   track_no, extension, out_name );
+}
+
+
+/* a file of the album (not of a track), next to the outputs */
+void file_output_sidecar_name( const waver_output_t* output, const char* extension,
+                               char* out_name )
+{
+  snprintf( out_name, PATH_LEN, "%.*s%s", ( PATH_LEN - 32 ),
+            ( ( file_output_t* )output->handle )->base_name, extension );
+}
+
+
+int file_output_truncate( void* stream, uint64_t len )
+{
+  return ftruncate( ( ( fd_stream_t* )stream )->fd, ( off_t )len );
+}
+
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
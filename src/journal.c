@@ -0,0 +1,271 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    journal.c
+# Purpose: persisted job journal
+#
+#==========================================
+*/
+
+#include "journal.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* "private" defines */
+#define RECORD_LEN  128
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static waver_status_t journal_append( journal_t* journal, const char* record );
+static void journal_parse( journal_t* journal, FILE* fs,
+                           const char* key, off_t* valid_len );
+
+/* ****************************************************************** */
+
+
+/* adler-32 as in zlib, continue with the sum of the previous call */
+uint32_t journal_checksum( uint32_t sum, const void* data, uint32_t len )
+{
+  const uint8_t* buf = ( const uint8_t* )data;
+  uint32_t a = sum & 0xFFFF;
+  uint32_t b = sum >> 16;
+  uint32_t n;
+
+  while( len > 0 )
+  {
+    n = ( len < ADLER_NMAX ) ? len : ADLER_NMAX;
+    len -= n;
+    while( n > 0 )
+    {
+      a += *buf;
+      b += a;
+      buf++;
+      n--;
+    }
+    a %= ADLER_MOD;
+    b %= ADLER_MOD;
+  }
+
+  return ( b << 16 ) | a;
+}
+
+
+static waver_status_t journal_append( journal_t* journal, const char* record )
+{
+  ssize_t len = ( ssize_t )strlen( record );
+  waver_status_t status = WAVER_OK;
+
+  /* one write per record, the fd is opened with O_APPEND */
+  pthread_mutex_lock( &journal->lock );
+  if( write( journal->fd, record, len ) != len || fdatasync( journal->fd ) != 0 )
+  {
+    status = WAVER_ERR_JOURNAL;
+  }
+  pthread_mutex_unlock( &journal->lock );
+
+  return status;
+}
+
+
+/*
+ * read the records of an existing journal. valid_len is set to the
+ * length of the well formed part (a crash may leave a torn last line),
+ * or to 0 if the journal belongs to another job.
+ */
+static void journal_parse( journal_t* journal, FILE* fs,
+                           const char* key, off_t* valid_len )
+{
+  char line[ JOURNAL_KEY_LEN + RECORD_LEN ] = { '\0' };
+  char header[ JOURNAL_KEY_LEN + RECORD_LEN ] = { '\0' };
+  journal_track_t* track = NULL;
+  unsigned int track_no;
+  unsigned int chunk_no;
+  unsigned long long end;
+  unsigned long long size;
+  unsigned int len;
+  unsigned int sum;
+  size_t line_len;
+
+  *valid_len = 0;
+
+  snprintf( header, sizeof( header ), "%s %s\n", JOURNAL_MAGIC, key );
+  if( fgets( line, sizeof( line ), fs ) == NULL || strcmp( line, header ) != 0 )
+  {
+    return;
+  }
+  *valid_len = ( off_t )strlen( line );
+
+  while( fgets( line, sizeof( line ), fs ) != NULL )
+  {
+    line_len = strlen( line );
+    if( line_len == 0 || line[ line_len - 1 ] != '\n' )
+    {
+      break;
+    }
+
+    if( sscanf( line, "C %u %u %llu %u %u",
+                &track_no, &chunk_no, &end, &len, &sum ) == 5 )
+    {
+      if( track_no < 1 || track_no > journal->tracks_len )
+      {
+        break;
+      }
+      track = ( journal->tracks + ( track_no - 1 ) );
+
+      /* chunk 0 starts the track over, later chunks must be contiguous */
+      if( chunk_no == 0 )
+      {
+        memset( track, 0x00, sizeof( journal_track_t ) );
+      }
+      if( chunk_no == track->chunks )
+      {
+        track->chunks   = chunk_no + 1;
+        track->end      = end;
+        track->last_len = len;
+        track->last_sum = sum;
+      }
+    }
+    else if( sscanf( line, "D %u %llu", &track_no, &size ) == 2 )
+    {
+      if( track_no < 1 || track_no > journal->tracks_len )
+      {
+        break;
+      }
+      track = ( journal->tracks + ( track_no - 1 ) );
+      track->done      = 1;
+      track->file_size = size;
+    }
+    else
+    {
+      break;
+    }
+
+    *valid_len += ( off_t )line_len;
+  }
+}
+
+
+/* on errors nothing needs to be released */
+waver_status_t journal_open( journal_t* journal, const char* path,
+                             const char* key, uint8_t tracks_len )
+{
+  char header[ JOURNAL_KEY_LEN + RECORD_LEN ] = { '\0' };
+  FILE* fs = NULL;
+  off_t valid_len = 0;
+
+  journal->fd = (-1);
+  journal->tracks_len = tracks_len;
+  if( ( journal->tracks = ( journal_track_t* )calloc( tracks_len,
+                                                      sizeof( journal_track_t ) ) ) == NULL )
+  {
+    return WAVER_ERR_NOMEM;
+  }
+
+  if( pthread_mutex_init( &journal->lock, NULL ) != 0 )
+  {
+    free( journal->tracks );
+    journal->tracks = NULL;
+    return WAVER_ERR_THREAD;
+  }
+
+  if( ( fs = fopen( path, "r" ) ) != NULL )
+  {
+    journal_parse( journal, fs, key, &valid_len );
+    fclose( fs );
+    fs = NULL;
+  }
+
+  if( ( journal->fd = open( path, O_WRONLY | O_CREAT | O_APPEND,
+                            S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH ) ) < 0 )
+  {
+    journal_close( journal );
+    return WAVER_ERR_JOURNAL;
+  }
+
+  /* drop a torn tail or the journal of another job */
+  if( ftruncate( journal->fd, valid_len ) != 0 )
+  {
+    journal_close( journal );
+    return WAVER_ERR_JOURNAL;
+  }
+
+  if( valid_len == 0 )
+  {
+    memset( journal->tracks, 0x00, sizeof( journal_track_t ) * tracks_len );
+    snprintf( header, sizeof( header ), "%s %s\n", JOURNAL_MAGIC, key );
+    if( journal_append( journal, header ) != WAVER_OK )
+    {
+      journal_close( journal );
+      return WAVER_ERR_JOURNAL;
+    }
+  }
+
+  return WAVER_OK;
+}
+
+
+waver_status_t journal_close( journal_t* journal )
+{
+  waver_status_t status = WAVER_OK;
+
+  if( journal->fd >= 0 && close( journal->fd ) != 0 )
+  {
+    status = WAVER_ERR_JOURNAL;
+  }
+  journal->fd = (-1);
+
+  pthread_mutex_destroy( &journal->lock );
+
+  free( journal->tracks );
+  journal->tracks = NULL;
+
+  return status;
+}
+
+
+waver_status_t journal_chunk( journal_t* journal, uint8_t track_no, uint32_t chunk_no,
+                              uint64_t end, uint32_t len, uint32_t sum )
+{
+  char record[ RECORD_LEN ];
+
+  snprintf( record, RECORD_LEN, "C %u %u %llu %u %u\n",
+            track_no, chunk_no, ( unsigned long long )end, len, sum );
+  return journal_append( journal, record );
+}
+
+
+waver_status_t journal_done( journal_t* journal, uint8_t track_no, uint64_t file_size )
+{
+  char record[ RECORD_LEN ];
+
+  snprintf( record, RECORD_LEN, "D %u %llu\n",
+            track_no, ( unsigned long long )file_size );
+  return journal_append( journal, record );
+}
+
+
+/* the output of the track is not usable, it is processed from scratch */
+void journal_forget( journal_t* journal, uint8_t track_no )
+{
+  memset( ( journal->tracks + ( track_no - 1 ) ), 0x00, sizeof( journal_track_t ) );
+}
@@ -0,0 +1,492 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    kernel.c
+# Purpose: specialized payload kernels
+#
+#==========================================
+*/
+
+#include "kernel.h"
+#include "journal.h"
+#include "mtimer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* "private" defines */
+#define BENCH_ROUNDS  8
+
+/* input bytes converted at a time, the output fits one adler block */
+#define SAMPLE_BLOCK  ( ( ADLER_NMAX / 4 ) * 2 )
+
+/* "private" function prototypes */
+static inline void swap_block( char* buf, uint32_t len );
+static inline void sum_block( const char* buf, uint32_t len, uint32_t* a, uint32_t* b );
+static inline uint32_t widen_block( const char* src, char* dst, uint32_t len,
+                                    uint8_t format, uint8_t swap );
+static uint32_t sample_generic( char* buf, char* dst, uint32_t len,
+                                uint8_t format, uint8_t swap, uint8_t checksum );
+
+/* ****************************************************************** */
+
+
+/*
+ * four 16 bit words per 64 bit load, their bytes are exchanged
+ * with two masks. this doesn't depend on the vectorizer (-O2,
+ * other compilers), with it a pass alone is as fast as the
+ * generic one: both are bound by the memory. the gain of the
+ * kernels is the checksum of the block while it is in the cache.
+ */
+static inline void swap_block( char* buf, uint32_t len )
+{
+  uint64_t lanes;
+  uint16_t word;
+  uint32_t i;
+
+  for( i = 0; ( i + 8 ) <= len; i += 8 )
+  {
+    memcpy( &lanes, ( buf + i ), sizeof( uint64_t ) );
+    lanes = ( ( lanes & 0x00FF00FF00FF00FFULL ) << 8 ) |
+            ( ( lanes >> 8 ) & 0x00FF00FF00FF00FFULL );
+    memcpy( ( buf + i ), &lanes, sizeof( uint64_t ) );
+  }
+  for( ; ( i + 1 ) < len; i += 2 )
+  {
+    memcpy( &word, ( buf + i ), sizeof( uint16_t ) );
+    word = __builtin_bswap16( word );
+    memcpy( ( buf + i ), &word, sizeof( uint16_t ) );
+  }
+}
+
+
+/*
+ * adler-32 of at most ADLER_NMAX bytes. the sum of b over the block
+ * is len * a plus the bytes weighted by their distance to the end,
+ * both sums vectorize.
+ */
+static inline void sum_block( const char* buf, uint32_t len, uint32_t* a, uint32_t* b )
+{
+  uint32_t s1 = 0;
+  uint32_t s2 = 0;
+  uint32_t i;
+
+  for( i = 0; i < len; i++ )
+  {
+    s1 += ( uint8_t )*( buf + i );
+    s2 += ( len - i ) * ( uint32_t )( uint8_t )*( buf + i );
+  }
+
+  *b = ( uint32_t )( ( *b + ( uint64_t )len * *a + s2 ) % ADLER_MOD );
+  *a = ( *a + s1 ) % ADLER_MOD;
+}
+
+
+/*
+ * 16 bit samples to the output format, the constant format and swap
+ * are folded into the loop. s24 is the sample in the upper bytes, a
+ * zero byte below. returns the bytes written.
+ */
+static inline uint32_t widen_block( const char* src, char* dst, uint32_t len,
+                                    uint8_t format, uint8_t swap )
+{
+  uint32_t n = len / 2;
+  uint16_t word;
+  int32_t wide;
+  float real;
+  uint32_t i;
+
+  for( i = 0; i < n; i++ )
+  {
+    memcpy( &word, ( src + ( i * 2 ) ), sizeof( uint16_t ) );
+    if( swap )
+    {
+      word = ( uint16_t )( ( word >> 8 ) | ( word << 8 ) );
+    }
+
+    if( format == WAVER_SAMPLES_S24 )
+    {
+      *( dst + ( i * 3 ) )     = 0;
+      *( dst + ( i * 3 ) + 1 ) = ( char )( word & 0xFF );
+      *( dst + ( i * 3 ) + 2 ) = ( char )( word >> 8 );
+    }
+    else if( format == WAVER_SAMPLES_S32 )
+    {
+      wide = ( int32_t )( ( uint32_t )word << 16 );
+      memcpy( ( dst + ( i * 4 ) ), &wide, sizeof( int32_t ) );
+    }
+    else
+    {
+      real = ( float )( int16_t )word * ( 1.0f / 32768.0f );
+      memcpy( ( dst + ( i * 4 ) ), &real, sizeof( float ) );
+    }
+  }
+
+  return n * sample_len( format );
+}
+
+
+/*
+ * one kernel per combination of the options. SWAP and CHECKSUM are
+ * constants in the body, the compiler drops the code of the options
+ * that are off. a block of ADLER_NMAX bytes is swapped and summed
+ * while it is in the cache. the checksum is adler-32 as in
+ * journal_checksum of the swapped bytes, 1 without CHECKSUM.
+ */
+#define DEFINE_PAYLOAD_KERNEL( name, SWAP, CHECKSUM )                      \
+static uint32_t name( char* buf, uint32_t len )                            \
+{                                                                          \
+  uint32_t a = 1;                                                          \
+  uint32_t b = 0;                                                          \
+  uint32_t i;                                                              \
+  uint32_t n;                                                              \
+                                                                           \
+  if( !SWAP && !CHECKSUM )                                                 \
+  {                                                                        \
+    return 1;                                                              \
+  }                                                                        \
+                                                                           \
+  for( i = 0; i < len; i += n )                                            \
+  {                                                                        \
+    n = ( ( len - i ) < ADLER_NMAX ) ? ( len - i ) : ADLER_NMAX;           \
+    if( SWAP )                                                             \
+    {                                                                      \
+      swap_block( ( buf + i ), n );                                        \
+    }                                                                      \
+    if( CHECKSUM )                                                         \
+    {                                                                      \
+      sum_block( ( buf + i ), n, &a, &b );                                 \
+    }                                                                      \
+  }                                                                        \
+                                                                           \
+  return ( b << 16 ) | a;                                                  \
+}
+
+DEFINE_PAYLOAD_KERNEL( kernel_copy,          0, 0 )
+DEFINE_PAYLOAD_KERNEL( kernel_swap,          1, 0 )
+DEFINE_PAYLOAD_KERNEL( kernel_checksum,      0, 1 )
+DEFINE_PAYLOAD_KERNEL( kernel_swap_checksum, 1, 1 )
+
+/* [ swap ][ checksum ] */
+static const payload_kernel_t kernels[ 2 ][ 2 ] =
+{
+  { kernel_copy, kernel_checksum },
+  { kernel_swap, kernel_swap_checksum }
+};
+
+
+/*
+ * the sample kernels convert a block and sum its output while
+ * it is in the cache. the checksum is the one of the output bytes.
+ */
+#define DEFINE_SAMPLE_KERNEL( name, FORMAT, SWAP, CHECKSUM )               \
+static uint32_t name( const char* src, char* dst, uint32_t len )           \
+{                                                                          \
+  uint32_t a = 1;                                                          \
+  uint32_t b = 0;                                                          \
+  uint32_t i;                                                              \
+  uint32_t n;                                                              \
+  uint32_t out;                                                            \
+                                                                           \
+  for( i = 0; i < len; i += n )                                            \
+  {                                                                        \
+    n = ( ( len - i ) < SAMPLE_BLOCK ) ? ( len - i ) : SAMPLE_BLOCK;       \
+    out = widen_block( ( src + i ), dst, n, FORMAT, SWAP );                \
+    if( CHECKSUM )                                                         \
+    {                                                                      \
+      sum_block( dst, out, &a, &b );                                       \
+    }                                                                      \
+    dst += out;                                                            \
+  }                                                                        \
+                                                                           \
+  return ( b << 16 ) | a;                                                  \
+}
+
+DEFINE_SAMPLE_KERNEL( s24_copy,          WAVER_SAMPLES_S24, 0, 0 )
+DEFINE_SAMPLE_KERNEL( s24_checksum,      WAVER_SAMPLES_S24, 0, 1 )
+DEFINE_SAMPLE_KERNEL( s24_swap,          WAVER_SAMPLES_S24, 1, 0 )
+DEFINE_SAMPLE_KERNEL( s24_swap_checksum, WAVER_SAMPLES_S24, 1, 1 )
+DEFINE_SAMPLE_KERNEL( s32_copy,          WAVER_SAMPLES_S32, 0, 0 )
+DEFINE_SAMPLE_KERNEL( s32_checksum,      WAVER_SAMPLES_S32, 0, 1 )
+DEFINE_SAMPLE_KERNEL( s32_swap,          WAVER_SAMPLES_S32, 1, 0 )
+DEFINE_SAMPLE_KERNEL( s32_swap_checksum, WAVER_SAMPLES_S32, 1, 1 )
+DEFINE_SAMPLE_KERNEL( f32_copy,          WAVER_SAMPLES_F32, 0, 0 )
+DEFINE_SAMPLE_KERNEL( f32_checksum,      WAVER_SAMPLES_F32, 0, 1 )
+DEFINE_SAMPLE_KERNEL( f32_swap,          WAVER_SAMPLES_F32, 1, 0 )
+DEFINE_SAMPLE_KERNEL( f32_swap_checksum, WAVER_SAMPLES_F32, 1, 1 )
+
+/* [ format - 1 ][ swap ][ checksum ], s16 needs no conversion */
+static const sample_kernel_t sample_kernels[ 3 ][ 2 ][ 2 ] =
+{
+  { { s24_copy, s24_checksum }, { s24_swap, s24_swap_checksum } },
+  { { s32_copy, s32_checksum }, { s32_swap, s32_swap_checksum } },
+  { { f32_copy, f32_checksum }, { f32_swap, f32_swap_checksum } }
+};
+
+/* ****************************************************************** */
+
+
+payload_kernel_t payload_kernel( uint8_t swap, uint8_t checksum )
+{
+  return kernels[ swap != 0 ][ checksum != 0 ];
+}
+
+
+/* NULL for s16, the payload kernels write the samples as they are */
+sample_kernel_t sample_kernel( uint8_t format, uint8_t swap, uint8_t checksum )
+{
+  if( format == WAVER_SAMPLES_S16 || format > WAVER_SAMPLES_F32 )
+  {
+    return NULL;
+  }
+
+  return sample_kernels[ format - 1 ][ swap != 0 ][ checksum != 0 ];
+}
+
+
+/* bytes of one output sample (of one channel) */
+uint8_t sample_len( uint8_t format )
+{
+  switch( format )
+  {
+    case WAVER_SAMPLES_S24: return 3;
+    case WAVER_SAMPLES_S32: return 4;
+    case WAVER_SAMPLES_F32: return 4;
+    default:                return 2;
+  }
+}
+
+
+/*
+ * the generic path the kernels replace: a pass per option,
+ * the options are tested at run time.
+ */
+uint32_t payload_generic( char* buf, uint32_t len, uint8_t swap, uint8_t checksum )
+{
+  uint32_t i;
+  char tmp_byte;
+
+  for( i = 0; swap && ( i + 1 ) < len; i += 2 )
+  {
+    tmp_byte = *( buf + i );
+    *( buf + i ) = *( buf + i + 1 );
+    *( buf + i + 1 ) = tmp_byte;
+  }
+
+  return checksum ? journal_checksum( 1, buf, len ) : 1;
+}
+
+
+/*
+ * the generic conversion: the swapped samples are widened one by
+ * one, the format is tested for every sample, then summed.
+ */
+static uint32_t sample_generic( char* buf, char* dst, uint32_t len,
+                                uint8_t format, uint8_t swap, uint8_t checksum )
+{
+  uint32_t out_len = ( len / 2 ) * sample_len( format );
+  uint32_t i;
+  int16_t sample;
+  int32_t wide;
+  float real;
+
+  payload_generic( buf, len, swap, 0 );
+
+  for( i = 0; ( i + 1 ) < len; i += 2 )
+  {
+    memcpy( &sample, ( buf + i ), sizeof( int16_t ) );
+    switch( format )
+    {
+      case WAVER_SAMPLES_S24:
+      {
+        *( dst + ( i / 2 ) * 3 ) = 0;
+        memcpy( ( dst + ( i / 2 ) * 3 + 1 ), &sample, sizeof( int16_t ) );
+        break;
+      }
+      case WAVER_SAMPLES_S32:
+      {
+        wide = ( int32_t )sample * 65536;
+        memcpy( ( dst + ( i / 2 ) * 4 ), &wide, sizeof( int32_t ) );
+        break;
+      }
+      default:
+      {
+        real = ( float )sample / 32768.0f;
+        memcpy( ( dst + ( i / 2 ) * 4 ), &real, sizeof( float ) );
+        break;
+      }
+    }
+  }
+
+  return checksum ? journal_checksum( 1, dst, out_len ) : 1;
+}
+
+
+/*
+ * throughput of the kernels and the generic path on one piece.
+ * before it is timed every kernel runs once on a fresh copy of the
+ * input, all of its output must equal the generic path (the whole
+ * widened samples, not only the first len bytes). the rates of the
+ * kernels a run uses go to cal (plan.h). returns the mismatches.
+ */
+uint32_t payload_kernel_bench( FILE* log, waver_calibration_t* cal )
+{
+  static const char* format_names[] = { "s16", "s24", "s32", "f32" };
+  char* src = NULL;
+  char* buf = NULL;
+  char* ref = NULL;
+  char* wide = NULL;
+  uint32_t len = BLOCK_SIZE;
+  uint32_t out_len;
+  uint32_t sum_generic = 0;
+  uint32_t sum_kernel = 0;
+  uint32_t mismatches = 0;
+  uint32_t i;
+  uint8_t swap;
+  uint8_t checksum;
+  uint8_t format;
+  uint8_t round;
+  uint8_t wrong;
+  double t_generic;
+  double t_kernel;
+  ctimer_t timer;
+
+  if( ( src = ( char* )malloc( len ) ) == NULL ||
+      ( buf = ( char* )malloc( len ) ) == NULL ||
+      ( ref = ( char* )malloc( ( uint64_t )len * 2 ) ) == NULL ||
+      ( wide = ( char* )malloc( ( uint64_t )len * 2 ) ) == NULL )
+  {
+    free( src );
+    free( buf );
+    free( ref );
+    fprintf( log, "Failed to allocate memory for the benchmark\n" );
+    return 1;
+  }
+
+  srand( 1 );
+  for( i = 0; i < len; i++ )
+  {
+    *( src + i ) = ( char )( rand() & 0xFF );
+  }
+
+  initCTimer( timer, MONOTONIC );
+  fprintf( log, "payload kernels, %d rounds on %u bytes\n", BENCH_ROUNDS, len );
+  fprintf( log, "swap checksum   generic MB/s   kernel MB/s   speedup\n" );
+
+  for( swap = 0; swap < 2; swap++ )
+  {
+    for( checksum = 0; checksum < 2; checksum++ )
+    {
+      /* without swap and checksum both leave the piece as it is */
+      if( !swap && !checksum )
+      {
+        continue;
+      }
+
+      /* one pass each on the same input, every byte must match */
+      memcpy( ref, src, len );
+      sum_generic = payload_generic( ref, len, swap, checksum );
+      memcpy( buf, src, len );
+      sum_kernel = payload_kernel( swap, checksum )( buf, len );
+      wrong = ( sum_generic != sum_kernel || memcmp( ref, buf, len ) != 0 );
+
+      memcpy( buf, src, len );
+      startCTimer( timer );
+      for( round = 0; round < BENCH_ROUNDS; round++ )
+      {
+        payload_generic( buf, len, swap, checksum );
+      }
+      stopCTimer( timer );
+      t_generic = getCTime( timer );
+
+      memcpy( buf, src, len );
+      startCTimer( timer );
+      for( round = 0; round < BENCH_ROUNDS; round++ )
+      {
+        payload_kernel( swap, checksum )( buf, len );
+      }
+      stopCTimer( timer );
+      t_kernel = getCTime( timer );
+
+      fprintf( log, "%4u %8u %13.1f %13.1f %8.2fx%s\n", swap, checksum,
+               ( ( double )len * BENCH_ROUNDS / 1e6 ) / t_generic,
+               ( ( double )len * BENCH_ROUNDS / 1e6 ) / t_kernel,
+               t_generic / t_kernel, wrong ? "  MISMATCH" : "" );
+      mismatches += wrong;
+      if( swap && !checksum )
+      {
+        cal->kernel = ( ( double )len * BENCH_ROUNDS / 1e6 ) / t_kernel;
+      }
+    }
+  }
+
+  fprintf( log, "\nsample kernels, MB/s of 16 bit input\n" );
+  fprintf( log, "format swap checksum   generic MB/s   kernel MB/s   speedup\n" );
+
+  for( format = WAVER_SAMPLES_S24; format <= WAVER_SAMPLES_F32; format++ )
+  {
+    out_len = ( len / 2 ) * sample_len( format );
+    for( i = 0; i < 3; i++ )
+    {
+      swap = ( i > 0 );
+      checksum = ( i > 1 );
+
+      /* the kernel writes into bytes the reference does not hold */
+      memcpy( buf, src, len );
+      memset( ref, 0xA5, ( uint64_t )len * 2 );
+      sum_generic = sample_generic( buf, ref, len, format, swap, checksum );
+      memset( wide, 0x5A, ( uint64_t )len * 2 );
+      sum_kernel = sample_kernel( format, swap, checksum )( src, wide, len );
+      wrong = ( sum_generic != sum_kernel || memcmp( ref, wide, out_len ) != 0 );
+
+      startCTimer( timer );
+      for( round = 0; round < BENCH_ROUNDS; round++ )
+      {
+        memcpy( buf, src, len );
+        sample_generic( buf, wide, len, format, swap, checksum );
+      }
+      stopCTimer( timer );
+      t_generic = getCTime( timer );
+
+      startCTimer( timer );
+      for( round = 0; round < BENCH_ROUNDS; round++ )
+      {
+        sample_kernel( format, swap, checksum )( src, wide, len );
+      }
+      stopCTimer( timer );
+      t_kernel = getCTime( timer );
+
+      fprintf( log, "%6s %4u %8u %13.1f %13.1f %8.2fx%s\n", format_names[ format ],
+               swap, checksum,
+               ( ( double )len * BENCH_ROUNDS / 1e6 ) / t_generic,
+               ( ( double )len * BENCH_ROUNDS / 1e6 ) / t_kernel,
+               t_generic / t_kernel, wrong ? "  MISMATCH" : "" );
+      mismatches += wrong;
+      if( format == WAVER_SAMPLES_S24 && swap && !checksum )
+      {
+        cal->convert = ( ( double )len * BENCH_ROUNDS / 1e6 ) / t_kernel;
+      }
+    }
+  }
+
+  free( src );
+  free( buf );
+  free( ref );
+  free( wide );
+
+  return mismatches;
+}
@@ -0,0 +1,3128 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    libwaver.c
+# Purpose: conversion engine of libwaver,
+#          context, worker threads, WAV
+#          and FLAC output
+#
+#==========================================
+*/
+
+#include "waver.h"
+#include "flac.h"
+#include "md5.h"
+#include "journal.h"
+#include "kernel.h"
+#include "plan.h"
+#include "adapt.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <pthread.h>
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static waver_status_t get_status( waver_ctx_t* ctx );
+static void add_progress( waver_ctx_t* ctx, track_t* track,
+                          uint32_t from_piece, uint32_t to_piece );
+static waver_status_t read_input( waver_ctx_t* ctx, void* buf, uint32_t len, uint64_t offset );
+static waver_status_t read_input_bounded( waver_ctx_t* ctx, char* buf, uint32_t len,
+                                          int64_t offset, int64_t low, int64_t high );
+static waver_status_t write_output( waver_ctx_t* ctx, track_t* track, void* out,
+                                    const void* buf, uint64_t len, uint64_t offset );
+static waver_status_t open_output( waver_ctx_t* ctx, track_t* track, const char* extension,
+                                   uint8_t resume, void** out );
+static waver_status_t close_output( waver_ctx_t* ctx, track_t* track, void* out,
+                                    waver_status_t status );
+static uint8_t wants_reserve( const waver_ctx_t* ctx, const track_t* track );
+static waver_status_t reserve_output( waver_ctx_t* ctx, track_t* track, void* out );
+static waver_status_t process_wav_header( waver_ctx_t* ctx, void* out, track_t* track );
+static void deinterleave_subchannel( const uint8_t* raw, uint8_t* sub );
+static waver_status_t read_piece( waver_ctx_t* ctx, track_t* track, uint32_t piece_no,
+                                  char* buf, uint8_t* sub, uint32_t* payload_len,
+                                  uint32_t* sub_len, uint32_t* sum );
+static uint8_t is_zero( const char* buf, uint32_t len );
+static waver_status_t write_payload( waver_ctx_t* ctx, track_t* track, void* out,
+                                     const char* buf, uint32_t len, uint64_t offset,
+                                     uint64_t* run_len, uint8_t* holes );
+static waver_status_t clone_piece( waver_ctx_t* ctx, track_t* track, void* out,
+                                   char* buf, uint32_t piece_no, uint32_t header_len );
+static waver_status_t resample_piece( waver_ctx_t* ctx, track_t* track, void* out,
+                                      resample_state_t* state, const char* buf,
+                                      uint32_t payload_len, uint8_t last, char* wide,
+                                      uint64_t* out_pos, uint64_t* run_len, uint8_t* holes );
+static waver_status_t process_payload( waver_ctx_t* ctx, void* out, void* sub_out,
+                                       track_t* track, uint32_t header_len,
+                                       uint32_t first_piece );
+static waver_status_t process_track( waver_ctx_t* ctx, track_t* track );
+static void worker_priority( waver_ctx_t* ctx, const worker_t* worker );
+static void wait_wanted( waver_ctx_t* ctx, const worker_t* worker );
+static void worker_exit( waver_ctx_t* ctx );
+static track_t* get_track_from_pool( waver_ctx_t* ctx );
+static void* write_track( void* arg );
+static waver_status_t build_job_key( waver_ctx_t* ctx, char* key, uint16_t key_len );
+static uint8_t check_journal_track( waver_ctx_t* ctx, track_t* track, const char* extension );
+static waver_status_t process_flac_header( waver_ctx_t* ctx, flac_stream_t* stream,
+                                           uint8_t final );
+static waver_status_t init_flac_streams( waver_ctx_t* ctx );
+static void release_flac_streams( waver_ctx_t* ctx );
+static void wake_flac_streams( waver_ctx_t* ctx );
+static track_t* get_chunk_from_pool( waver_ctx_t* ctx, uint32_t* chunk_no );
+static waver_status_t process_flac_chunk( waver_ctx_t* ctx, track_t* track, uint32_t chunk_no,
+                                          char* buf, uint8_t* sub, uint8_t* frames,
+                                          flac_encoder_t* encoder );
+static void* write_flac_chunks( void* arg );
+static waver_status_t plan_kernels( waver_ctx_t* ctx );
+static void plan_clones( waver_ctx_t* ctx );
+static waver_status_t plan_loudness( waver_ctx_t* ctx );
+static waver_status_t plan_readahead( waver_ctx_t* ctx );
+static waver_status_t reserve_outputs( waver_ctx_t* ctx );
+static waver_status_t check_formats( waver_ctx_t* ctx );
+static int32_t count_workers( const waver_ctx_t* ctx );
+static waver_status_t layout_output( waver_ctx_t* ctx );
+static waver_status_t start_worker( waver_ctx_t* ctx, int32_t tid );
+static void adapt_workers( waver_ctx_t* ctx, int32_t* created );
+static waver_status_t run_workers( waver_ctx_t* ctx );
+static void fill_loudness( const loudness_t* ln, waver_loudness_t* loudness );
+static void write_loudness_json( FILE* out, const waver_loudness_t* ln );
+static waver_status_t write_loudness( waver_ctx_t* ctx );
+
+/* ****************************************************************** */
+
+
+/*
+ * records the first error of a run and its message.
+ * the workers stop as soon as they see the status.
+ */
+waver_status_t set_error( waver_ctx_t* ctx, waver_status_t status, const char* fmt, ... )
+{
+  va_list args;
+
+  pthread_mutex_lock( &ctx->lock );
+  if( ctx->status == WAVER_OK )
+  {
+    va_start( args, fmt );
+    vsnprintf( ctx->errmsg, ERRMSG_LEN, fmt, args );
+    va_end( args );
+    __atomic_store_n( &ctx->status, status, __ATOMIC_RELEASE );
+  }
+  pthread_mutex_unlock( &ctx->lock );
+
+  return status;
+}
+
+
+static waver_status_t get_status( waver_ctx_t* ctx )
+{
+  return __atomic_load_n( &ctx->status, __ATOMIC_ACQUIRE );
+}
+
+
+/*
+ * the input bytes of the pieces [from_piece, to_piece) of a track
+ * are done. only a counter, no ordering with the output is needed.
+ */
+static void add_progress( waver_ctx_t* ctx, track_t* track,
+                          uint32_t from_piece, uint32_t to_piece )
+{
+  uint64_t in_piece = ( uint64_t )PIECE_SECTORS * track->sector_len;
+  uint64_t in_len = track->endbyte - track->startbyte;
+  uint64_t from = ( uint64_t )from_piece * in_piece;
+  uint64_t to = ( uint64_t )to_piece * in_piece;
+
+  from = ( from < in_len ) ? from : in_len;
+  to   = ( to < in_len ) ? to : in_len;
+  if( to > from )
+  {
+    __atomic_fetch_add( &track->bytes_done, ( to - from ), __ATOMIC_RELAXED );
+    __atomic_fetch_add( &ctx->bytes_done, ( to - from ), __ATOMIC_RELAXED );
+  }
+}
+
+
+/* length of a WAV or ISO output, flac lengths are not known in advance */
+uint64_t track_output_size( const waver_ctx_t* ctx, const track_t* track )
+{
+  if( !track->is_audio )
+  {
+    return track->size_byte;
+  }
+
+  return track->header_len + ( uint64_t )track->data_len;
+}
+
+
+const char* track_extension( const waver_ctx_t* ctx, const track_t* track )
+{
+  if( !track->is_audio )
+  {
+    return ISO_EXTENSION;
+  }
+
+  return ( ctx->output_format == FORMAT_FLAC ) ? FLAC_EXTENSION : WAV_EXTENSION;
+}
+
+
+/* a throttled run reads in requests of THROTTLE_CHUNK, see throttle.h */
+static waver_status_t read_input( waver_ctx_t* ctx, void* buf, uint32_t len, uint64_t offset )
+{
+  int64_t bytes_read;
+  uint32_t part = len;
+  uint32_t done = 0;
+  int errsv;
+
+  do
+  {
+    if( ctx->throttle.active )
+    {
+      part = ( ( len - done ) > THROTTLE_CHUNK ) ? THROTTLE_CHUNK : ( len - done );
+      throttle_read( &ctx->throttle, part );
+    }
+    if( ( bytes_read = ctx->input.read( ctx->input.handle, ( ( char* )buf + done ), part,
+                                        ( offset + done ) ) ) != part )
+    {
+      errsv = errno;
+      return set_error( ctx, WAVER_ERR_READ, "Failed to read block of data, "
+                        "read bytes: %lld\n"
+                        "errno: %s", ( long long )bytes_read, strerror( errsv ) );
+    }
+    done += part;
+  }
+  while( done < len );
+
+  return WAVER_OK;
+}
+
+
+/*
+ * read_input of [offset, offset + len), the part outside
+ * of [low, high) is zero filled.
+ */
+static waver_status_t read_input_bounded( waver_ctx_t* ctx, char* buf, uint32_t len,
+                                          int64_t offset, int64_t low, int64_t high )
+{
+  int64_t from = ( offset < low ) ? low : offset;
+  int64_t to = ( ( offset + len ) > high ) ? high : ( offset + len );
+
+  if( to <= from )
+  {
+    memset( buf, 0x00, len );
+    return WAVER_OK;
+  }
+
+  memset( buf, 0x00, ( size_t )( from - offset ) );
+  memset( ( buf + ( to - offset ) ), 0x00, ( size_t )( offset + len - to ) );
+
+  return read_input( ctx, ( buf + ( from - offset ) ), ( uint32_t )( to - from ),
+                     ( uint64_t )from );
+}
+
+
+static waver_status_t write_output( waver_ctx_t* ctx, track_t* track, void* out,
+                                    const void* buf, uint64_t len, uint64_t offset )
+{
+  int64_t bytes_written;
+  uint64_t part = len;
+  uint64_t done = 0;
+  int errsv;
+
+  do
+  {
+    if( ctx->throttle.active )
+    {
+      part = ( ( len - done ) > THROTTLE_CHUNK ) ? THROTTLE_CHUNK : ( len - done );
+      throttle_write( &ctx->throttle, part );
+    }
+    if( ( bytes_written = ctx->output.write( out, ( ( const char* )buf + done ), part,
+                                             ( offset + done ) ) ) != ( int64_t )part )
+    {
+      errsv = errno;
+      return set_error( ctx, WAVER_ERR_WRITE, "Failed to write block of data at %d, "
+                        "bytes written: %lld\n"
+                        "errno: %s", track->number, ( long long )bytes_written,
+                        strerror( errsv ) );
+    }
+    done += part;
+  }
+  while( done < len );
+
+  return WAVER_OK;
+}
+
+
+static waver_status_t open_output( waver_ctx_t* ctx, track_t* track, const char* extension,
+                                   uint8_t resume, void** out )
+{
+  if( ctx->output.open( ctx->output.handle, track->number, extension, resume, out ) != 0 )
+  {
+    return set_error( ctx, WAVER_ERR_OPEN, "Failed to open output file at %d",
+                      track->number );
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * commits a completed track to the device and closes its stream.
+ * on errors of the track the stream is only closed. a run that
+ * shares the machine commits only the data of the track, a sync
+ * of the file system would write back the other services, too.
+ */
+static waver_status_t close_output( waver_ctx_t* ctx, track_t* track, void* out,
+                                    waver_status_t status )
+{
+  if( status == WAVER_OK && ctx->output.sync( out, throttle_shared( &ctx->throttle ) ) != 0 )
+  {
+    status = set_error( ctx, WAVER_ERR_SYNC, "Failed to commit buffer cache to disk" );
+  }
+
+  if( ctx->output.close( out ) != 0 && status == WAVER_OK )
+  {
+    status = set_error( ctx, WAVER_ERR_WRITE, "Failed to close output file at %d",
+                        track->number );
+  }
+
+  return status;
+}
+
+
+/*
+ * the length of wav and iso streams is known in advance. holes
+ * and cloned extents would only give back the storage reserved.
+ * a mapped output is always reserved, that maps it.
+ */
+static uint8_t wants_reserve( const waver_ctx_t* ctx, const track_t* track )
+{
+  return ( ( ctx->prealloc != WAVER_PREALLOC_NONE || ctx->output.map != NULL ) &&
+           ctx->output.reserve != NULL &&
+           ctx->output_format == FORMAT_WAV && !ctx->sparse && !track->clone );
+}
+
+
+static waver_status_t reserve_output( waver_ctx_t* ctx, track_t* track, void* out )
+{
+  if( ctx->output.reserve( out, track_output_size( ctx, track ) ) != 0 )
+  {
+    return set_error( ctx, WAVER_ERR_WRITE, "Failed to preallocate output file at %d, "
+                      "errno: %s", track->number, strerror( errno ) );
+  }
+
+  return WAVER_OK;
+}
+
+
+static waver_status_t process_wav_header( waver_ctx_t* ctx, void* out, track_t* track )
+{
+  uint32_t* uint32_ptr = NULL;
+  uint16_t* uint16_ptr = NULL;
+  char buf[ WAV_HEADER_LEN + JUNK_CHUNK_LEN + CLONE_ALIGN ] = { 0 };
+  uint32_t overall_file_size = track->header_len + track->data_len - 8;
+  uint32_t data_pos = track->header_len - 8;
+  uint32_t bits = track->sample_len * 8;
+  uint32_t chunk_pos = 36;  /* behind the fmt chunk */
+  uint8_t extensible = ( track->sample_len != sample_len( WAVER_SAMPLES_S16 ) );
+
+  /* concatenate the 44 bytes of the WAV header */
+  /* **************************************************************** */
+
+  /*
+   * !!! KEEP IN MIND !!!
+   * we live in a little endian world (x86) ...
+   * verify header with e. g.: hexdump -C -n 44
+   * */
+
+  /* 00 - 03   Marks the file as a riff file */
+  memcpy( ( buf + 0 ), "RIFF", 4 );
+
+  /* 04 - 07   Size of the overall file minus (-) 8 bytes in, bytes */
+  uint32_ptr = ( uint32_t* )&buf[ 4 ];
+  *uint32_ptr = overall_file_size;
+
+  /* 08 - 11   File Type Header */
+  memcpy( ( buf + 8 ), "WAVE", 4 );
+
+  /* 12 - 15   Format chunk marker. Includes trailing null (blank space) */
+  memcpy( ( buf + 12 ), "fmt ", 4 );
+
+  /* 16 - 19   Length of format data as listed above (00-15),
+               40 with the extension of WAVE_FORMAT_EXTENSIBLE */
+  uint32_ptr = ( uint32_t* )&buf[ 16 ];
+  *uint32_ptr = extensible ? 40 : 16;
+
+  /* 20 - 21   Type of format (1 is PCM, 0xFFFE extensible) - 2 byte integer */
+  uint16_ptr = ( uint16_t* )&buf[ 20 ];
+  *uint16_ptr = extensible ? WAVE_FORMAT_EXTENSIBLE : 1;
+
+  /* 22 - 23   Number of Channels - 2 byte integer, 2 = stereo */
+  uint16_ptr = ( uint16_t* )&buf[ 22 ];
+  *uint16_ptr = 2;
+
+  /* 24 - 27   Sampling rate (of the disc, or resampled) */
+  uint32_ptr = ( uint32_t* )&buf[ 24 ];
+  *uint32_ptr = ctx->sample_rate;
+
+  /* 28 - 31   (Sample Rate * BitsPerSample * Channels) / 8 */
+  uint32_ptr = ( uint32_t* )&buf[ 28 ];
+  *uint32_ptr = ( ctx->sample_rate *
+                  bits *
+                  CHANNELS ) / 8;
+
+  /* 32 - 33   Frame size = <Number of channels> *
+                            ( ( <Bits/Sample (of one channel)> + 7 ) / 8 )
+               Caution: (Integer division!!) */
+  uint16_ptr = ( uint16_t* )&buf[ 32 ];
+  *uint16_ptr = ( CHANNELS *
+                  ( uint16_t )( ( bits + 7 ) / 8 ) );
+
+  /* 34 - 35   Bits per sample */
+  uint16_ptr = ( uint16_t* )&buf[ 34 ];
+  *uint16_ptr = ( uint16_t )bits;
+
+  /*
+   * 36 - 59   extension: its length (22), valid bits, the speakers
+               (front left and right) and the sub format GUID, whose
+               first two bytes are the format (1 PCM, 3 IEEE float).
+   * 60 - 71   fact chunk of a float format: number of samples
+   */
+  if( extensible )
+  {
+    uint16_ptr = ( uint16_t* )&buf[ 36 ];
+    *uint16_ptr = 22;
+    uint16_ptr = ( uint16_t* )&buf[ 38 ];
+    *uint16_ptr = ( uint16_t )bits;
+    uint32_ptr = ( uint32_t* )&buf[ 40 ];
+    *uint32_ptr = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT;
+    memcpy( ( buf + 44 ), KSDATAFORMAT_SUBTYPE, 16 );
+    *( buf + 44 ) = ( ctx->sample_format == WAVER_SAMPLES_F32 ) ? 3 : 1;
+    chunk_pos = 60;
+
+    if( ctx->sample_format == WAVER_SAMPLES_F32 )
+    {
+      memcpy( ( buf + 60 ), "fact", 4 );
+      uint32_ptr = ( uint32_t* )&buf[ 64 ];
+      *uint32_ptr = 4;
+      uint32_ptr = ( uint32_t* )&buf[ 68 ];
+      *uint32_ptr = track->data_len / ( track->sample_len * CHANNELS );
+      chunk_pos = 72;
+    }
+  }
+
+  /*
+   * a cloned payload starts at the offset in the block it has
+   * in the bin, a "JUNK" chunk of zeros pads the header.
+   */
+  if( data_pos > chunk_pos )
+  {
+    memcpy( ( buf + chunk_pos ), "JUNK", 4 );
+    uint32_ptr = ( uint32_t* )&buf[ chunk_pos + 4 ];
+    *uint32_ptr = data_pos - chunk_pos - JUNK_CHUNK_LEN;
+  }
+
+  /* 36 - 39   "data" chunk header (behind the padding).
+               Marks the beginning of the data section */
+  memcpy( ( buf + data_pos ), "data", 4 );
+
+  /* 40 - 43   Size of the data section (payload size) */
+  uint32_ptr = ( uint32_t* )&buf[ data_pos + 4 ];
+  *uint32_ptr = track->data_len;
+
+  return write_output( ctx, track, out, buf, track->header_len, 0 );
+}
+
+
+/* one sector of subchannel data, interleaved P-W to 12 bytes per channel */
+static void deinterleave_subchannel( const uint8_t* raw, uint8_t* sub )
+{
+  uint32_t k;
+  uint32_t c;
+
+  memset( sub, 0x00, SUBCHANNEL_LEN );
+  for( k = 0; k < SUBCHANNEL_LEN; k++ )
+  {
+    for( c = 0; c < 8; c++ )
+    {
+      if( *( raw + k ) & ( 0x80 >> c ) )
+      {
+        *( sub + ( c * 12 ) + ( k / 8 ) ) |= ( uint8_t )( 0x80 >> ( k % 8 ) );
+      }
+    }
+  }
+}
+
+
+/*
+ * reads piece piece_no (PIECE_SECTORS sectors) of a track and
+ * leaves its payload at the front of buf. sectors with more than
+ * the payload are cut to it (gather), the subchannel data of raw
+ * sectors goes to sub if it is not NULL.
+ */
+static waver_status_t read_piece( waver_ctx_t* ctx, track_t* track, uint32_t piece_no,
+                                  char* buf, uint8_t* sub, uint32_t* payload_len,
+                                  uint32_t* sub_len, uint32_t* sum )
+{
+  uint32_t in_piece = PIECE_SECTORS * track->sector_len;
+  uint32_t in_len = track->endbyte - track->startbyte;
+  uint64_t start = ( uint64_t )piece_no * in_piece;
+  uint32_t len;
+  uint32_t sectors;
+  uint32_t j;
+  int64_t shift = 0;   /* of the input position */
+  uint32_t skip = 0;   /* payload bytes in front of the shifted start */
+  uint32_t extra = 0;  /* sectors read behind the piece */
+  int64_t k;
+  uint8_t raw_sub[ SUBCHANNEL_LEN ];
+  waver_status_t status;
+
+  *payload_len = 0;
+  *sub_len = 0;
+  *sum = 1;
+
+  /* the empty chunk of an empty track */
+  if( start >= in_len )
+  {
+    return WAVER_OK;
+  }
+
+  len = ( ( in_len - start ) < in_piece ) ? ( uint32_t )( in_len - start ) : in_piece;
+
+  /*
+   * cooked audio is one stream of samples, the shift is
+   * any number of bytes. raw sectors move by whole sectors,
+   * the rest is dropped from the front of the gathered
+   * payload, so one more sector is read.
+   */
+  if( track->is_audio && ctx->offset != 0 )
+  {
+    shift = ( int64_t )ctx->offset * EFFECTIVE_BYTES;
+    if( track->sector_len != track->subsize )
+    {
+      skip  = ( uint32_t )( ( ( shift % SECTOR_LEN ) + SECTOR_LEN ) % SECTOR_LEN );
+      shift = ( ( shift - skip ) / SECTOR_LEN ) * track->sector_len;
+      extra = ( skip > 0 ) ? 1 : 0;
+      len   = ( ( len / track->sector_len ) + extra ) * track->sector_len;
+    }
+
+    status = read_input_bounded( ctx, buf, len,
+                                 ( int64_t )( track->startbyte + start ) + shift,
+                                 track->run_startbyte, track->run_endbyte );
+  }
+  else
+  {
+    status = read_input( ctx, buf, len, track->startbyte + start );
+  }
+  if( status != WAVER_OK )
+  {
+    return status;
+  }
+  readahead_consumed( &ctx->readahead, track->idx, start + in_piece );
+
+  if( track->sector_len == track->subsize )
+  {
+    *payload_len = len;
+  }
+  else
+  {
+    /* a torn last sector is dropped */
+    sectors = ( len / track->sector_len ) - extra;
+
+    /*
+     * the subchannel stays with the sectors of the track, the
+     * few of them outside the shifted sectors are read alone.
+     */
+    if( sub != NULL && ctx->raw_input )
+    {
+      for( j = 0; j < sectors; j++ )
+      {
+        k = ( int64_t )j * track->sector_len - shift;
+        if( k >= 0 && k < ( int64_t )len )
+        {
+          deinterleave_subchannel( ( uint8_t* )( buf + k + RAW_SUB_OFFSET ),
+                                   ( sub + ( j * SUBCHANNEL_LEN ) ) );
+        }
+        else if( ( status = read_input( ctx, raw_sub, SUBCHANNEL_LEN,
+                                        track->startbyte + start +
+                                        ( j * track->sector_len ) +
+                                        RAW_SUB_OFFSET ) ) == WAVER_OK )
+        {
+          deinterleave_subchannel( raw_sub, ( sub + ( j * SUBCHANNEL_LEN ) ) );
+        }
+        else
+        {
+          return status;
+        }
+      }
+      *sub_len = sectors * SUBCHANNEL_LEN;
+    }
+
+    /* payload moves to the front, sector by sector */
+    for( j = 0; j < ( sectors + extra ); j++ )
+    {
+      memmove( ( buf + ( j * track->subsize ) ),
+               ( buf + ( j * track->sector_len ) + track->offset ), track->subsize );
+    }
+    *payload_len = sectors * track->subsize;
+
+    if( skip > 0 )
+    {
+      memmove( buf, ( buf + skip ), *payload_len );
+    }
+  }
+
+  *sum = track->kernel( buf, *payload_len );
+
+  return WAVER_OK;
+}
+
+
+/* a word at a time, the compiler vectorizes the loop */
+static uint8_t is_zero( const char* buf, uint32_t len )
+{
+  uint64_t acc = 0;
+  uint64_t word;
+  uint32_t i;
+
+  for( i = 0; ( i + sizeof( uint64_t ) ) <= len; i += sizeof( uint64_t ) )
+  {
+    memcpy( &word, ( buf + i ), sizeof( uint64_t ) );
+    acc |= word;
+  }
+  for( ; i < len; i++ )
+  {
+    acc |= ( uint8_t )*( buf + i );
+  }
+
+  return ( acc == 0 );
+}
+
+
+/*
+ * writes a piece of payload, blocks of ZERO_BLOCK_LEN (aligned to
+ * the output offset) of zeros are counted per track. with holes
+ * set, zero runs of at least SPARSE_MIN_LEN within the piece are
+ * not written. run_len carries the current zero run to the next
+ * piece, holes is cleared if the output can't make holes.
+ */
+static waver_status_t write_payload( waver_ctx_t* ctx, track_t* track, void* out,
+                                     const char* buf, uint32_t len, uint64_t offset,
+                                     uint64_t* run_len, uint8_t* holes )
+{
+  uint32_t pos = 0;
+  uint32_t data_from = 0;  /* not yet written */
+  uint32_t zero_from = 0;  /* zero run in the piece */
+  uint32_t zero_to;
+  uint32_t blk;
+  uint8_t in_run = 0;
+  waver_status_t status;
+
+  while( pos < len )
+  {
+    blk = ZERO_BLOCK_LEN - ( uint32_t )( ( offset + pos ) % ZERO_BLOCK_LEN );
+    blk = ( blk < ( len - pos ) ) ? blk : ( len - pos );
+
+    if( is_zero( ( buf + pos ), blk ) )
+    {
+      if( *run_len == 0 )
+      {
+        track->zero_runs++;
+      }
+      if( !in_run )
+      {
+        zero_from = pos;
+        in_run = 1;
+      }
+      *run_len += blk;
+      track->zero_bytes += blk;
+      pos += blk;
+
+      /* the run goes on in the next piece */
+      if( pos < len )
+      {
+        continue;
+      }
+      zero_to = pos;
+    }
+    else
+    {
+      *run_len = 0;
+      zero_to = pos;
+      pos += blk;
+      if( !in_run )
+      {
+        continue;
+      }
+    }
+    in_run = 0;
+
+    if( *holes && ( zero_to - zero_from ) >= SPARSE_MIN_LEN )
+    {
+      if( ( status = write_output( ctx, track, out, ( buf + data_from ),
+                                   ( zero_from - data_from ),
+                                   ( offset + data_from ) ) ) != WAVER_OK )
+      {
+        return status;
+      }
+      data_from = zero_from;
+      if( ctx->output.zero( out, ( zero_to - zero_from ), ( offset + zero_from ) ) == 0 )
+      {
+        track->hole_bytes += zero_to - zero_from;
+        data_from = zero_to;
+      }
+      else
+      {
+        *holes = 0;
+      }
+    }
+  }
+
+  return write_output( ctx, track, out, ( buf + data_from ), ( len - data_from ),
+                       ( offset + data_from ) );
+}
+
+
+/*
+ * the payload of a piece shares the extents of the bin, the
+ * partial blocks at both ends are copied. track->clone is
+ * cleared if the output can't clone, the piece is written then.
+ */
+static waver_status_t clone_piece( waver_ctx_t* ctx, track_t* track, void* out,
+                                   char* buf, uint32_t piece_no, uint32_t header_len )
+{
+  uint32_t in_piece = PIECE_SECTORS * track->sector_len;
+  uint64_t start = ( uint64_t )piece_no * in_piece;
+  uint32_t len = ( ( track->endbyte - track->startbyte - start ) < in_piece ) ?
+                 ( uint32_t )( track->endbyte - track->startbyte - start ) : in_piece;
+  uint64_t src = ( uint64_t )( ( int64_t )( track->startbyte + start ) +
+                               ( int64_t )ctx->offset * EFFECTIVE_BYTES );
+  uint64_t dst = header_len + start;
+  uint32_t head = ( CLONE_ALIGN - ( uint32_t )( src % CLONE_ALIGN ) ) % CLONE_ALIGN;
+  uint32_t body;
+  uint32_t tail;
+  waver_status_t status;
+
+  head = ( head < len ) ? head : len;
+  body = ( ( len - head ) / CLONE_ALIGN ) * CLONE_ALIGN;
+  tail = len - head - body;
+
+  if( body > 0 && ctx->output.clone( out, input_fd( &ctx->input ), body,
+                                     ( src + head ), ( dst + head ) ) != 0 )
+  {
+    track->clone = 0;
+    if( ctx->verbose && ctx->log != NULL )
+    {
+      fprintf( ctx->log, "track %02d can't be cloned, copying it ...\n", track->number );
+      fflush( ctx->log );
+    }
+    return WAVER_OK;
+  }
+
+  if( head > 0 &&
+      ( ( status = read_input( ctx, buf, head, src ) ) != WAVER_OK ||
+        ( status = write_output( ctx, track, out, buf, head, dst ) ) != WAVER_OK ) )
+  {
+    return status;
+  }
+  if( tail > 0 &&
+      ( ( status = read_input( ctx, buf, tail, ( src + head + body ) ) ) != WAVER_OK ||
+        ( status = write_output( ctx, track, out, buf, tail,
+                                 ( dst + head + body ) ) ) != WAVER_OK ) )
+  {
+    return status;
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * one piece of a resampled track, block by block through the
+ * resampler. the output frames follow each other at *out_pos.
+ */
+static waver_status_t resample_piece( waver_ctx_t* ctx, track_t* track, void* out,
+                                      resample_state_t* state, const char* buf,
+                                      uint32_t payload_len, uint8_t last, char* wide,
+                                      uint64_t* out_pos, uint64_t* run_len, uint8_t* holes )
+{
+  uint32_t frames = payload_len / EFFECTIVE_BYTES;
+  uint32_t block;
+  uint32_t len;
+  uint32_t i;
+  waver_status_t status;
+
+  /* an empty last piece still flushes the resampler */
+  i = 0;
+  do
+  {
+    block = ( ( frames - i ) > RESAMPLE_BLOCK ) ? RESAMPLE_BLOCK : ( frames - i );
+    len = resample_run( state, ( buf + ( ( size_t )i * EFFECTIVE_BYTES ) ), block,
+                        ( last && ( i + block ) == frames ), wide, ctx->sample_format ) *
+          CHANNELS * track->sample_len;
+
+    if( ( status = write_payload( ctx, track, out, wide, len, *out_pos,
+                                  run_len, holes ) ) != WAVER_OK )
+    {
+      return status;
+    }
+    *out_pos += len;
+    i += block;
+  }
+  while( i < frames );
+
+  return WAVER_OK;
+}
+
+
+/*
+ * pieces before first_piece are already in the output
+ * (resumed from the journal).
+ */
+static waver_status_t process_payload( waver_ctx_t* ctx, void* out, void* sub_out,
+                                       track_t* track, uint32_t header_len,
+                                       uint32_t first_piece )
+{
+  /* buffers on the heap to prevent stack overflows */
+  char* buf = NULL;
+  char* wide = NULL;
+  uint8_t* sub = NULL;
+  uint32_t out_piece = ( PIECE_SECTORS * track->subsize / sample_len( WAVER_SAMPLES_S16 ) ) *
+                       track->sample_len;
+  uint32_t in_piece = PIECE_SECTORS * track->sector_len;
+  uint32_t payload_len;
+  uint32_t sub_len;
+  uint32_t sum;
+  uint32_t pieces_count = 0;
+  uint32_t i;
+  uint32_t len;
+  char* piece = NULL;
+  char* out_buf = NULL;
+  uint64_t out_end = 0;
+  uint64_t out_pos = header_len;
+  uint64_t run_len = 0;
+  uint8_t holes = ( ctx->sparse && ctx->output.zero != NULL );
+  resample_state_t state = { 0 };
+  waver_status_t status = WAVER_OK;
+
+  /* a resampled block is written as it comes out of the resampler */
+  if( track->resample )
+  {
+    out_piece = resample_max_out( &ctx->resampler ) * CHANNELS * track->sample_len;
+  }
+
+  if( ( buf = ( char* )calloc( ctx->piece_len, sizeof( char ) ) ) == NULL ||
+      ( sub_out != NULL &&
+        ( sub = ( uint8_t* )malloc( PIECE_SECTORS * SUBCHANNEL_LEN ) ) == NULL ) ||
+      ( ( track->convert != NULL || track->resample ) &&
+        ( wide = ( char* )malloc( out_piece ) ) == NULL ) ||
+      ( track->resample &&
+        resample_open( &state, &ctx->resampler,
+                       track->size_byte / EFFECTIVE_BYTES ) != WAVER_OK ) )
+  {
+    free( buf );
+    free( sub );
+    free( wide );
+    return set_error( ctx, WAVER_ERR_NOMEM, "Failed to allocate memory for buffer" );
+  }
+
+  /* **************************************************************** */
+
+  pieces_count = ( uint32_t )( ( ( track->endbyte - track->startbyte ) + in_piece - 1 ) /
+                               in_piece );
+
+  /* read block by block and write to output ... */
+  for( i = first_piece; i < pieces_count && status == WAVER_OK; i++ )
+  {
+    /* another worker failed, stop early */
+    if( ( status = get_status( ctx ) ) != WAVER_OK )
+    {
+      break;
+    }
+
+    if( track->clone )
+    {
+      if( ( status = clone_piece( ctx, track, out, buf, i, header_len ) ) != WAVER_OK )
+      {
+        break;
+      }
+      if( track->clone )
+      {
+        add_progress( ctx, track, i, ( i + 1 ) );
+        continue;
+      }
+    }
+
+    /* cooked samples are read (and swapped) right into a mapped output */
+    piece = buf;
+    if( ctx->output.map != NULL && !holes && !track->resample && track->convert == NULL &&
+        track->sector_len == track->subsize )
+    {
+      len = ( ( track->endbyte - track->startbyte - ( uint64_t )i * in_piece ) < in_piece ) ?
+            ( uint32_t )( track->endbyte - track->startbyte - ( uint64_t )i * in_piece ) :
+            in_piece;
+      if( ( out_buf = ( char* )ctx->output.map( out, ( header_len + ( uint64_t )i * out_piece ),
+                                                 len ) ) != NULL )
+      {
+        piece = out_buf;
+      }
+    }
+
+    if( ( status = read_piece( ctx, track, i, piece, sub,
+                               &payload_len, &sub_len, &sum ) ) != WAVER_OK )
+    {
+      break;
+    }
+
+    /* measured while the piece is in the cache, before any conversion */
+    if( track->loudness != NULL )
+    {
+      loudness_add( track->loudness, piece, payload_len,
+                    ( track->convert != NULL && ctx->swap_bytes ) );
+    }
+
+    if( track->resample )
+    {
+      if( ( status = resample_piece( ctx, track, out, &state, buf, payload_len,
+                                     ( ( i + 1 ) == pieces_count ), wide,
+                                     &out_pos, &run_len, &holes ) ) != WAVER_OK )
+      {
+        break;
+      }
+    }
+    else
+    {
+      /* wider samples, payload_len is the length of the output from here on */
+      out_buf = piece;
+      if( track->convert != NULL )
+      {
+        len = ( payload_len / sample_len( WAVER_SAMPLES_S16 ) ) * track->sample_len;
+        out_buf = ( ctx->output.map != NULL && !holes ) ?
+                  ( char* )ctx->output.map( out, ( header_len + ( uint64_t )i * out_piece ),
+                                            len ) : NULL;
+        out_buf = ( out_buf != NULL ) ? out_buf : wide;
+        sum = track->convert( buf, out_buf, payload_len );
+        payload_len = len;
+      }
+
+      out_end = header_len + ( uint64_t )i * out_piece + payload_len;
+      if( ( status = write_payload( ctx, track, out, out_buf, payload_len,
+                                    out_end - payload_len, &run_len, &holes ) ) != WAVER_OK )
+      {
+        break;
+      }
+    }
+    if( sub_out != NULL &&
+        ( status = write_output( ctx, track, sub_out, sub, sub_len,
+                                 ( uint64_t )i * PIECE_SECTORS * SUBCHANNEL_LEN ) ) != WAVER_OK )
+    {
+      break;
+    }
+
+    /*
+     * the piece must be on the device before the journal claims it.
+     * the resampler has no state to resume with, its pieces are not
+     * journaled.
+     */
+    if( ctx->use_journal && !track->resample )
+    {
+      if( ctx->output.sync( out, 1 ) != 0 ||
+          ( sub_out != NULL && ctx->output.sync( sub_out, 1 ) != 0 ) )
+      {
+        status = set_error( ctx, WAVER_ERR_SYNC, "Failed to commit block of data to disk" );
+        break;
+      }
+      if( journal_chunk( &ctx->journal, ( track->idx + 1 ), i, out_end, payload_len,
+                         sum ) != WAVER_OK )
+      {
+        status = set_error( ctx, WAVER_ERR_JOURNAL, "Failed to append to journal" );
+        break;
+      }
+    }
+    add_progress( ctx, track, i, ( i + 1 ) );
+  }
+
+  if( status == WAVER_OK && track->loudness != NULL )
+  {
+    loudness_finish( track->loudness );
+    pthread_mutex_lock( &ctx->lock );
+    loudness_merge( &ctx->album, track->loudness );
+    pthread_mutex_unlock( &ctx->lock );
+  }
+
+  free( buf );
+  buf = NULL;
+  free( wide );
+  wide = NULL;
+  free( sub );
+  sub = NULL;
+  resample_close( &state );
+
+  return status;
+}
+
+
+/*
+ * one track to one WAV (audio) or ISO (data) output,
+ * continues a partial output of the journal.
+ */
+static waver_status_t process_track( waver_ctx_t* ctx, track_t* track )
+{
+  void* out = NULL;
+  void* sub_out = NULL;
+  uint8_t state = TRACK_FRESH;
+  uint32_t first_piece = 0;
+  journal_track_t* journaled = NULL;
+  waver_status_t status;
+
+  if( ctx->use_journal )
+  {
+    state = check_journal_track( ctx, track, track_extension( ctx, track ) );
+    if( state == TRACK_SKIP )
+    {
+      if( ctx->log != NULL )
+      {
+        fprintf( ctx->log, "track %02d is up to date, skipping ...\n", track->number );
+        fflush( ctx->log );
+      }
+      readahead_consumed( &ctx->readahead, track->idx, track->endbyte - track->startbyte );
+      add_progress( ctx, track, 0, UINT32_MAX );
+      return WAVER_OK;
+    }
+    journaled = ( ctx->journal.tracks + track->idx );
+  }
+
+  /* a reserved stream is new, but must keep its allocation */
+  if( ( status = open_output( ctx, track, track_extension( ctx, track ),
+                              ( state == TRACK_RESUME || track->reserved ),
+                              &out ) ) != WAVER_OK )
+  {
+    return status;
+  }
+
+  /* the mapping of a stream reserved before is made again */
+  if( state == TRACK_FRESH && ( !track->reserved || ctx->output.map != NULL ) &&
+      wants_reserve( ctx, track ) )
+  {
+    status = reserve_output( ctx, track, out );
+  }
+
+  /* continue behind the last durable chunk */
+  if( status == WAVER_OK && state == TRACK_RESUME )
+  {
+    first_piece = journaled->chunks;
+    add_progress( ctx, track, 0, first_piece );
+    if( file_output_truncate( out, journaled->end ) != 0 )
+    {
+      status = set_error( ctx, WAVER_ERR_WRITE, "Failed to resume output file at %d",
+                          track->number );
+    }
+    else if( ctx->log != NULL )
+    {
+      fprintf( ctx->log, "track %02d resumes at chunk %u ...\n", track->number, first_piece );
+      fflush( ctx->log );
+    }
+  }
+
+  if( status == WAVER_OK && ctx->subchannel && ctx->raw_input )
+  {
+    status = open_output( ctx, track, SUB_EXTENSION, ( state == TRACK_RESUME ), &sub_out );
+  }
+
+  if( status == WAVER_OK && track->is_audio )
+  {
+    status = process_wav_header( ctx, out, track );
+  }
+  if( status == WAVER_OK )
+  {
+    status = process_payload( ctx, out, sub_out, track, track->header_len, first_piece );
+  }
+
+  if( sub_out != NULL )
+  {
+    status = close_output( ctx, track, sub_out, status );
+  }
+  if( ( status = close_output( ctx, track, out, status ) ) != WAVER_OK )
+  {
+    return status;
+  }
+
+  if( ctx->use_journal &&
+      journal_done( &ctx->journal, ( track->idx + 1 ),
+                    track_output_size( ctx, track ) ) != WAVER_OK )
+  {
+    return set_error( ctx, WAVER_ERR_JOURNAL, "Failed to append to journal" );
+  }
+
+  if( ctx->verbose && ctx->log != NULL && track->zero_bytes > 0 )
+  {
+    fprintf( ctx->log, "track %02d has %.2f s of %s in %u runs, %llu bytes left as holes\n",
+             track->number,
+             ( double )track->zero_bytes / ( ctx->sample_rate * CHANNELS * track->sample_len ),
+             ( track->is_audio ? "digital silence" : "zeros" ), track->zero_runs,
+             ( unsigned long long )track->hole_bytes );
+    fflush( ctx->log );
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * i/o class and nice value of a worker thread. a run that can't
+ * lower (or raise) them still converts, only at the old ones.
+ */
+static void worker_priority( waver_ctx_t* ctx, const worker_t* worker )
+{
+  int errsv;
+
+  if( throttle_priority( &ctx->throttle ) != 0 && ctx->log != NULL )
+  {
+    errsv = errno;
+    fprintf( ctx->log, "worker %02d keeps its priority, errno: %s\n", worker->tid,
+             strerror( errsv ) );
+    fflush( ctx->log );
+  }
+}
+
+
+/*
+ * a worker the controller doesn't want waits between two tracks
+ * (chunks) until it is wanted again or the run ends.
+ */
+static void wait_wanted( waver_ctx_t* ctx, const worker_t* worker )
+{
+  pthread_mutex_lock( &ctx->lock );
+  while( ( int32_t )worker->tid >= ctx->wanted && get_status( ctx ) == WAVER_OK )
+  {
+    pthread_cond_wait( &ctx->workers_cond, &ctx->lock );
+  }
+  pthread_mutex_unlock( &ctx->lock );
+}
+
+
+/*
+ * a worker only leaves on an empty pool or an error, the waiting
+ * ones must leave as well then.
+ */
+static void worker_exit( waver_ctx_t* ctx )
+{
+  pthread_mutex_lock( &ctx->lock );
+  ctx->exited++;
+  ctx->wanted = MAX_THREADS;
+  pthread_cond_broadcast( &ctx->workers_cond );
+  pthread_mutex_unlock( &ctx->lock );
+}
+
+
+static track_t* get_track_from_pool( waver_ctx_t* ctx )
+{
+  track_t* track = NULL;
+  track_pool_t* track_pool = &ctx->track_pool;
+
+  if( track_pool->cur_top < track_pool->tracks_len )
+  {
+    track = *( track_pool->tracks + track_pool->cur_top );
+    track_pool->cur_top++;
+  }
+
+  return track;
+}
+
+
+/* thread function */
+/*
+ * writing to the log stream is threadsafe, so for these operations
+ * we don't need a mutex.
+ */
+static void* write_track( void* arg )
+{
+  worker_t* worker = ( worker_t* )arg;
+  waver_ctx_t* ctx = worker->ctx;
+  track_t* track = NULL;
+
+  if( ctx->log != NULL )
+  {
+    fprintf( ctx->log, "started worker thread with id %02d ...\n", worker->tid );
+    fflush( ctx->log );
+  }
+  worker_priority( ctx, worker );
+
+  while( get_status( ctx ) == WAVER_OK )
+  {
+    wait_wanted( ctx, worker );
+
+    /* critical section. get track from track pool */
+    /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
+    pthread_mutex_lock( &ctx->lock );
+    track = get_track_from_pool( ctx );
+    pthread_mutex_unlock( &ctx->lock );
+    /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
+
+    /* if no more tracks in pool, we can terminate this thread by breaking this loop. */
+    if( track == NULL )
+    {
+      break;
+    }
+
+    if( process_track( ctx, track ) != WAVER_OK )
+    {
+      break;
+    }
+  }
+  worker_exit( ctx );
+
+  if( ctx->log != NULL )
+  {
+    fprintf( ctx->log, "thread with id %d has nothing more to do "
+                       "and will terminate now.\n", worker->tid );
+    fflush( ctx->log );
+  }
+
+  return NULL;
+}
+
+
+/*
+ * identifies the job of a journal: bin file size and mtime,
+ * digest of the cue file contents and the base name, options
+ * that change the output.
+ */
+static waver_status_t build_job_key( waver_ctx_t* ctx, char* key, uint16_t key_len )
+{
+  struct stat bin_stat;
+  md5_ctx_t md5;
+  uint8_t digest[ MD5_DIGEST_LEN ];
+  char digest_str[ ( MD5_DIGEST_LEN * 2 ) + 1 ] = { '\0' };
+  char out_name[ PATH_LEN ];
+  uint8_t i;
+
+  if( fstat( input_fd( &ctx->input ), &bin_stat ) != 0 )
+  {
+    return set_error( ctx, WAVER_ERR_OPEN, "Failed to stat bin file" );
+  }
+  ctx->bin_mtime = bin_stat.st_mtim;
+
+  /* the name of the first output stands for the base name */
+  file_output_name( &ctx->output, 1, "", out_name );
+
+  md5_init( &md5 );
+  md5_update( &md5, ctx->cue_text, ctx->cue_len );
+  md5_update( &md5, out_name, strlen( out_name ) + 1 );
+  if( ctx->selecting )
+  {
+    md5_update( &md5, ctx->selection, sizeof( ctx->selection ) );
+  }
+  md5_final( &md5, digest );
+
+  for( i = 0; i < MD5_DIGEST_LEN; i++ )
+  {
+    sprintf( ( digest_str + ( i * 2 ) ), "%02x", digest[ i ] );
+  }
+
+  snprintf( key, key_len, "%lld %lld.%09ld %s s%u f%u g%u o%d w%u r%u",
+            ( long long )bin_stat.st_size,
+            ( long long )ctx->bin_mtime.tv_sec, ctx->bin_mtime.tv_nsec,
+            digest_str, ctx->swap_bytes, ctx->output_format, ctx->gaps,
+            ( int )ctx->offset, ctx->sample_format, ctx->sample_rate );
+
+  return WAVER_OK;
+}
+
+
+/*
+ * what is left to do for a track according to the journal.
+ * returns TRACK_SKIP, TRACK_RESUME or TRACK_FRESH. tracks with
+ * outputs that were modified or removed are processed from scratch.
+ */
+static uint8_t check_journal_track( waver_ctx_t* ctx, track_t* track, const char* extension )
+{
+  char out_name[ PATH_LEN ];
+  struct stat out_stat;
+  journal_track_t* state = ( ctx->journal.tracks + track->idx );
+  char* buf = NULL;
+  int out_fd = (-1);
+  uint8_t result = TRACK_FRESH;
+
+  file_output_name( &ctx->output, track->number, extension, out_name );
+
+  if( stat( out_name, &out_stat ) != 0 )
+  {
+    journal_forget( &ctx->journal, ( track->idx + 1 ) );
+    return TRACK_FRESH;
+  }
+
+  if( state->done )
+  {
+    /* up to date: complete and not older than the bin file */
+    if( ( uint64_t )out_stat.st_size == state->file_size &&
+        ( out_stat.st_mtim.tv_sec > ctx->bin_mtime.tv_sec ||
+          ( out_stat.st_mtim.tv_sec == ctx->bin_mtime.tv_sec &&
+            out_stat.st_mtim.tv_nsec >= ctx->bin_mtime.tv_nsec ) ) )
+    {
+      return TRACK_SKIP;
+    }
+  }
+  else if( state->chunks > 0 && ( uint64_t )out_stat.st_size >= state->end )
+  {
+    /* verify the last durable chunk before resuming behind it */
+    if( ( buf = ( char* )malloc( state->last_len ) ) != NULL &&
+        ( out_fd = open( out_name, O_RDONLY ) ) >= 0 )
+    {
+      if( pread( out_fd, buf, state->last_len,
+                 ( off_t )( state->end - state->last_len ) ) == state->last_len &&
+          journal_checksum( 1, buf, state->last_len ) == state->last_sum )
+      {
+        result = TRACK_RESUME;
+      }
+      close( out_fd );
+    }
+    free( buf );
+    buf = NULL;
+  }
+
+  if( result == TRACK_FRESH )
+  {
+    journal_forget( &ctx->journal, ( track->idx + 1 ) );
+  }
+
+  return result;
+}
+
+
+/* ...::: flac output :::... */
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+static waver_status_t process_flac_header( waver_ctx_t* ctx, flac_stream_t* stream,
+                                           uint8_t final )
+{
+  uint8_t buf[ FLAC_HEADER_LEN ];
+  flac_streaminfo_t info;
+  uint64_t samples = stream->track->size_byte / EFFECTIVE_BYTES;
+
+  memset( &info, 0x00, sizeof( info ) );
+  info.min_blocksize = ( samples < FLAC_BLOCKSIZE ) ? ( uint32_t )samples : FLAC_BLOCKSIZE;
+  info.max_blocksize = info.min_blocksize;
+  info.total_samples = samples;
+
+  /* frame sizes and signature are only known after the last chunk */
+  if( final )
+  {
+    info.min_framesize = stream->min_framesize;
+    info.max_framesize = stream->max_framesize;
+    md5_final( &stream->md5, info.md5 );
+  }
+
+  flac_stream_header( buf, &info );
+
+  /*
+   * a stream that can't seek keeps the preliminary header,
+   * decoders treat zero frame sizes and signature as unknown.
+   */
+  if( ctx->output.write( stream->out, buf, FLAC_HEADER_LEN, 0 ) != FLAC_HEADER_LEN &&
+      !( final && errno == ESPIPE ) )
+  {
+    return set_error( ctx, WAVER_ERR_WRITE, "Failed to write flac header at %d",
+                      stream->track->number );
+  }
+
+  return WAVER_OK;
+}
+
+
+static waver_status_t init_flac_streams( waver_ctx_t* ctx )
+{
+  uint8_t i;
+  flac_stream_t* stream = NULL;
+
+  if( ( ctx->flac_streams = ( flac_stream_t* )calloc( ctx->tracks_len,
+                                                      sizeof( flac_stream_t ) ) ) == NULL )
+  {
+    return set_error( ctx, WAVER_ERR_NOMEM, "memory allocation failure" );
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    stream = ( ctx->flac_streams + i );
+    stream->track   = *( ctx->tracks + i );
+    stream->out     = NULL;
+    stream->sub_out = NULL;
+
+    /*
+     * an empty track still gets one (empty) chunk for its header.
+     * a data track is one chunk, its worker extracts the whole track.
+     */
+    stream->chunks_total = ( uint32_t )( ( stream->track->size_byte + BLOCK_SIZE - 1 ) /
+                                         BLOCK_SIZE );
+    if( stream->chunks_total == 0 || !stream->track->is_audio )
+    {
+      stream->chunks_total = 1;
+    }
+
+    /*
+     * only complete flac files are journaled, the encoder state
+     * of a partial file is lost. no chunks => nothing to do.
+     */
+    if( ctx->use_journal && stream->track->is_audio &&
+        check_journal_track( ctx, stream->track, FLAC_EXTENSION ) == TRACK_SKIP )
+    {
+      if( ctx->log != NULL )
+      {
+        fprintf( ctx->log, "track %02d is up to date, skipping ...\n", stream->track->number );
+      }
+      stream->chunks_total = 0;
+      add_progress( ctx, stream->track, 0, UINT32_MAX );
+    }
+    stream->min_framesize = UINT32_MAX;
+    stream->max_framesize = 0;
+    md5_init( &stream->md5 );
+
+    pthread_mutex_init( &stream->lock, NULL );
+    pthread_cond_init( &stream->turn, NULL );
+  }
+
+  return WAVER_OK;
+}
+
+
+static void release_flac_streams( waver_ctx_t* ctx )
+{
+  uint8_t i;
+
+  if( ctx->flac_streams == NULL )
+  {
+    return;
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    /* streams left open by an error */
+    if( ( ctx->flac_streams + i )->out != NULL )
+    {
+      ctx->output.close( ( ctx->flac_streams + i )->out );
+    }
+    if( ( ctx->flac_streams + i )->sub_out != NULL )
+    {
+      ctx->output.close( ( ctx->flac_streams + i )->sub_out );
+    }
+    pthread_mutex_destroy( &( ctx->flac_streams + i )->lock );
+    pthread_cond_destroy( &( ctx->flac_streams + i )->turn );
+  }
+
+  free( ctx->flac_streams );
+  ctx->flac_streams = NULL;
+}
+
+
+/* after an error, wake up the workers waiting for their turn */
+static void wake_flac_streams( waver_ctx_t* ctx )
+{
+  uint8_t i;
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    pthread_mutex_lock( &( ctx->flac_streams + i )->lock );
+    pthread_cond_broadcast( &( ctx->flac_streams + i )->turn );
+    pthread_mutex_unlock( &( ctx->flac_streams + i )->lock );
+  }
+}
+
+
+/*
+ * hands out the chunks of all tracks in stream order,
+ * so the earliest unwritten chunk is always being encoded.
+ */
+static track_t* get_chunk_from_pool( waver_ctx_t* ctx, uint32_t* chunk_no )
+{
+  track_t* track = NULL;
+  track_pool_t* track_pool = &ctx->track_pool;
+
+  while( track_pool->cur_top < track_pool->tracks_len )
+  {
+    if( track_pool->cur_chunk < ( ctx->flac_streams + track_pool->cur_top )->chunks_total )
+    {
+      track = *( track_pool->tracks + track_pool->cur_top );
+      *chunk_no = track_pool->cur_chunk;
+      track_pool->cur_chunk++;
+      break;
+    }
+    track_pool->cur_top++;
+    track_pool->cur_chunk = 0;
+  }
+
+  return track;
+}
+
+
+/* read and encode one chunk, append it when it is its turn */
+static waver_status_t process_flac_chunk( waver_ctx_t* ctx, track_t* track, uint32_t chunk_no,
+                                          char* buf, uint8_t* sub, uint8_t* frames,
+                                          flac_encoder_t* encoder )
+{
+  flac_stream_t* stream = ( ctx->flac_streams + track->idx );
+  uint32_t chunk_len;
+  uint32_t sub_len;
+  uint32_t sum;
+  uint32_t frames_len;
+  uint32_t min_framesize = UINT32_MAX;
+  uint32_t max_framesize = 0;
+  waver_status_t status;
+
+  /* a chunk is one piece, BLOCK_SIZE of payload */
+  if( ( status = read_piece( ctx, track, chunk_no, buf, sub,
+                             &chunk_len, &sub_len, &sum ) ) != WAVER_OK )
+  {
+    return status;
+  }
+
+  /* whole samples only */
+  chunk_len -= chunk_len % EFFECTIVE_BYTES;
+
+  frames_len = flac_encode_block( encoder, buf, chunk_len,
+                                  chunk_no * ( BLOCK_SIZE / FLAC_FRAME_BYTES ),
+                                  frames, &min_framesize, &max_framesize );
+
+  /* critical section. append the chunk when it is its turn */
+  /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
+  pthread_mutex_lock( &stream->lock );
+  while( stream->chunks_done != chunk_no &&
+         ( status = get_status( ctx ) ) == WAVER_OK )
+  {
+    pthread_cond_wait( &stream->turn, &stream->lock );
+  }
+
+  if( status == WAVER_OK && chunk_no == 0 )
+  {
+    if( ( status = open_output( ctx, track, FLAC_EXTENSION, 0, &stream->out ) ) == WAVER_OK )
+    {
+      status = process_flac_header( ctx, stream, 0 );
+      stream->bytes_written = FLAC_HEADER_LEN;
+    }
+    if( status == WAVER_OK && sub != NULL )
+    {
+      status = open_output( ctx, track, SUB_EXTENSION, 0, &stream->sub_out );
+    }
+  }
+
+  if( status == WAVER_OK )
+  {
+    md5_update( &stream->md5, buf, chunk_len );
+    status = write_output( ctx, track, stream->out, frames, frames_len, stream->bytes_written );
+  }
+
+  if( status == WAVER_OK && stream->sub_out != NULL )
+  {
+    status = write_output( ctx, track, stream->sub_out, sub, sub_len,
+                           ( uint64_t )chunk_no * PIECE_SECTORS * SUBCHANNEL_LEN );
+  }
+
+  if( status == WAVER_OK )
+  {
+    stream->bytes_written += frames_len;
+    if( min_framesize < stream->min_framesize )
+    {
+      stream->min_framesize = min_framesize;
+    }
+    if( max_framesize > stream->max_framesize )
+    {
+      stream->max_framesize = max_framesize;
+    }
+    stream->chunks_done++;
+
+    /* last chunk, complete STREAMINFO and close the file */
+    if( stream->chunks_done == stream->chunks_total )
+    {
+      if( stream->max_framesize == 0 )
+      {
+        stream->min_framesize = 0;
+      }
+      status = process_flac_header( ctx, stream, 1 );
+      if( stream->sub_out != NULL )
+      {
+        status = close_output( ctx, track, stream->sub_out, status );
+        stream->sub_out = NULL;
+      }
+      status = close_output( ctx, track, stream->out, status );
+      stream->out = NULL;
+
+      if( status == WAVER_OK && ctx->use_journal &&
+          journal_done( &ctx->journal, ( track->idx + 1 ), stream->bytes_written ) != WAVER_OK )
+      {
+        status = set_error( ctx, WAVER_ERR_JOURNAL, "Failed to append to journal" );
+      }
+
+      if( status == WAVER_OK && ctx->verbose && ctx->log != NULL )
+      {
+        fprintf( ctx->log, "track %02d: %u bytes pcm -> %llu bytes flac\n",
+                 track->number, track->size_byte,
+                 ( unsigned long long )stream->bytes_written );
+      }
+    }
+  }
+
+  pthread_cond_broadcast( &stream->turn );
+  pthread_mutex_unlock( &stream->lock );
+  /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
+
+  if( status == WAVER_OK )
+  {
+    add_progress( ctx, track, chunk_no, ( chunk_no + 1 ) );
+  }
+
+  return status;
+}
+
+
+/* thread function for the flac output format */
+/*
+ * every chunk of BLOCK_SIZE is read and encoded independently,
+ * the encoded frames are written in stream order per track.
+ */
+static void* write_flac_chunks( void* arg )
+{
+  worker_t* worker = ( worker_t* )arg;
+  waver_ctx_t* ctx = worker->ctx;
+
+  char* buf = NULL;
+  uint8_t* sub = NULL;
+  uint8_t* frames = NULL;
+  flac_encoder_t* encoder = NULL;
+
+  track_t* track = NULL;
+  uint32_t chunk_no = 0;
+
+  if( ctx->log != NULL )
+  {
+    fprintf( ctx->log, "started worker thread with id %02d ...\n", worker->tid );
+    fflush( ctx->log );
+  }
+  worker_priority( ctx, worker );
+
+  /* buffers on the heap to prevent stack overflows */
+  if( ( buf = ( char* )malloc( ctx->piece_len ) ) == NULL ||
+      ( ctx->subchannel && ctx->raw_input &&
+        ( sub = ( uint8_t* )malloc( PIECE_SECTORS * SUBCHANNEL_LEN ) ) == NULL ) ||
+      ( frames = ( uint8_t* )malloc( ( BLOCK_SIZE / FLAC_FRAME_BYTES ) *
+                                     FLAC_MAX_FRAME_LEN ) ) == NULL ||
+      ( encoder = flac_encoder_create() ) == NULL )
+  {
+    set_error( ctx, WAVER_ERR_NOMEM, "Failed to allocate memory for buffer" );
+    wake_flac_streams( ctx );
+  }
+
+  while( get_status( ctx ) == WAVER_OK )
+  {
+    wait_wanted( ctx, worker );
+
+    /* critical section. get chunk from track pool */
+    /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
+    pthread_mutex_lock( &ctx->lock );
+    track = get_chunk_from_pool( ctx, &chunk_no );
+    pthread_mutex_unlock( &ctx->lock );
+    /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
+
+    if( track == NULL )
+    {
+      break;
+    }
+
+    /* data tracks run alongside the audio chunks */
+    if( !track->is_audio )
+    {
+      if( process_track( ctx, track ) != WAVER_OK )
+      {
+        wake_flac_streams( ctx );
+        break;
+      }
+      continue;
+    }
+
+    if( process_flac_chunk( ctx, track, chunk_no, buf, sub, frames, encoder ) != WAVER_OK )
+    {
+      wake_flac_streams( ctx );
+      break;
+    }
+  }
+
+  free( buf );
+  buf = NULL;
+  free( sub );
+  sub = NULL;
+  free( frames );
+  frames = NULL;
+  flac_encoder_destroy( encoder );
+  encoder = NULL;
+  worker_exit( ctx );
+
+  if( ctx->log != NULL )
+  {
+    fprintf( ctx->log, "thread with id %d has nothing more to do "
+                       "and will terminate now.\n", worker->tid );
+    fflush( ctx->log );
+  }
+
+  return NULL;
+}
+
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+
+/*
+ * the payload kernel of every track: audio is swapped on request,
+ * pieces of wav and iso outputs are summed for the journal. wider
+ * samples of wav outputs are swapped, converted and summed by the
+ * sample kernel, the payload kernel leaves them as they are.
+ * resampled audio is only swapped, the resampler writes the sample
+ * format (not summed, these tracks are not resumed).
+ */
+static waver_status_t plan_kernels( waver_ctx_t* ctx )
+{
+  track_t* track = NULL;
+  uint64_t data_len;
+  uint8_t checksum;
+  uint8_t i;
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    checksum = ( ctx->use_journal &&
+                 ( !track->is_audio || ctx->output_format == FORMAT_WAV ) );
+
+    track->convert    = NULL;
+    track->sample_len = sample_len( WAVER_SAMPLES_S16 );
+    track->resample   = ( track->is_audio && ctx->output_format == FORMAT_WAV &&
+                          ctx->resampler.taps != NULL );
+    if( track->is_audio && ctx->output_format == FORMAT_WAV && !track->resample )
+    {
+      track->convert = sample_kernel( ctx->sample_format, ctx->swap_bytes, checksum );
+    }
+
+    if( track->convert != NULL || track->resample )
+    {
+      track->sample_len = sample_len( ctx->sample_format );
+    }
+    if( track->sample_len != sample_len( WAVER_SAMPLES_S16 ) )
+    {
+      track->header_len = WAV_EXT_HEADER_LEN +
+                          ( ( ctx->sample_format == WAVER_SAMPLES_F32 ) ? FACT_CHUNK_LEN : 0 );
+    }
+
+    if( track->convert != NULL )
+    {
+      track->kernel = payload_kernel( 0, 0 );
+    }
+    else
+    {
+      track->kernel = payload_kernel( ( track->is_audio && ctx->swap_bytes ),
+                                      ( checksum && !track->resample ) );
+    }
+
+    data_len = track->size_byte;
+    if( track->resample )
+    {
+      data_len = resample_frames( &ctx->resampler, track->size_byte / EFFECTIVE_BYTES ) *
+                 CHANNELS * track->sample_len;
+    }
+    else if( track->convert != NULL )
+    {
+      data_len = ( track->size_byte / sample_len( WAVER_SAMPLES_S16 ) ) * track->sample_len;
+    }
+
+    /* the sizes of the riff header are 32 bit */
+    if( ( data_len + track->header_len ) > UINT32_MAX )
+    {
+      return set_error( ctx, WAVER_ERR_ARG, "track %02d exceeds the 4 GiB of a wav file",
+                        track->number );
+    }
+    track->data_len = ( uint32_t )data_len;
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * unswapped cooked audio of a bin file is cloned into the wav
+ * files (reflink). the header is padded, so the payload has the
+ * offset in the block it has in the bin.
+ */
+static void plan_clones( waver_ctx_t* ctx )
+{
+  int64_t shift = ( int64_t )ctx->offset * EFFECTIVE_BYTES;
+  int64_t src;
+  track_t* track = NULL;
+  uint8_t i;
+
+  if( !ctx->reflink || ctx->output_format != FORMAT_WAV || ctx->swap_bytes ||
+      ctx->sample_format != WAVER_SAMPLES_S16 || ctx->resampler.taps != NULL ||
+      ctx->loudness != WAVER_LOUDNESS_OFF ||
+      ctx->raw_input || ctx->use_journal || ctx->output.clone == NULL ||
+      !is_fd_input( &ctx->input ) )
+  {
+    return;
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    src = ( int64_t )track->startbyte + shift;
+
+    /* zeros of the offset correction are not in the bin */
+    if( !track->is_audio || src < track->run_startbyte ||
+        ( ( int64_t )track->endbyte + shift ) > track->run_endbyte )
+    {
+      continue;
+    }
+
+    track->header_len = WAV_HEADER_LEN + JUNK_CHUNK_LEN +
+                        ( uint32_t )( ( ( src % CLONE_ALIGN ) + ( 2 * CLONE_ALIGN ) -
+                                        WAV_HEADER_LEN - JUNK_CHUNK_LEN ) % CLONE_ALIGN );
+    track->clone = 1;
+  }
+}
+
+
+/* the audio tracks are measured, the album starts from scratch */
+static waver_status_t plan_loudness( waver_ctx_t* ctx )
+{
+  track_t* track = NULL;
+  uint8_t i;
+
+  loudness_init( &ctx->album );
+  if( ctx->loudness == WAVER_LOUDNESS_OFF )
+  {
+    return WAVER_OK;
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    if( !track->is_audio )
+    {
+      continue;
+    }
+    if( ( track->loudness = ( loudness_t* )malloc( sizeof( loudness_t ) ) ) == NULL )
+    {
+      return set_error( ctx, WAVER_ERR_NOMEM, "Failed to allocate memory for loudness" );
+    }
+    loudness_init( track->loudness );
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * the input ranges in the order the workers take the tracks.
+ * cloned tracks and skipped flac streams are not read. the
+ * kernel would read ahead past the read limits of a run.
+ */
+static waver_status_t plan_readahead( waver_ctx_t* ctx )
+{
+  uint64_t* starts = NULL;
+  uint64_t* ends = NULL;
+  track_t* track = NULL;
+  waver_status_t status;
+  uint8_t i;
+
+  if( ctx->readahead_window == 0 || ctx->tracks_len == 0 || !is_fd_input( &ctx->input ) ||
+      ctx->throttle.read.rate > 0.0 || ctx->throttle.requests.rate > 0.0 )
+  {
+    return readahead_open( &ctx->readahead, (-1), 0, NULL, NULL, 0 );
+  }
+
+  if( ( starts = ( uint64_t* )calloc( ctx->tracks_len, sizeof( uint64_t ) ) ) == NULL ||
+      ( ends = ( uint64_t* )calloc( ctx->tracks_len, sizeof( uint64_t ) ) ) == NULL )
+  {
+    free( starts );
+    return set_error( ctx, WAVER_ERR_NOMEM, "memory allocation failure" );
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    *( starts + i ) = track->startbyte;
+    *( ends + i )   = track->endbyte;
+    if( track->clone ||
+        ( ctx->flac_streams != NULL && ( ctx->flac_streams + i )->chunks_total == 0 ) )
+    {
+      *( ends + i ) = track->startbyte;
+    }
+  }
+
+  status = readahead_open( &ctx->readahead, input_fd( &ctx->input ), ctx->readahead_window,
+                           starts, ends, ctx->tracks_len );
+  free( starts );
+  free( ends );
+
+  if( status != WAVER_OK )
+  {
+    return set_error( ctx, status, "Failed to set up the readahead" );
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * all streams are allocated before the workers start, so the
+ * concurrent writers of the tracks don't interleave their extents.
+ * tracks of a journal are left to process_track, a stream that
+ * resumes must not be created anew.
+ */
+static waver_status_t reserve_outputs( waver_ctx_t* ctx )
+{
+  track_t* track = NULL;
+  void* out = NULL;
+  waver_status_t status = WAVER_OK;
+  uint8_t i;
+
+  if( ctx->prealloc != WAVER_PREALLOC_ALL || ctx->use_journal )
+  {
+    return WAVER_OK;
+  }
+
+  for( i = 0; i < ctx->tracks_len && status == WAVER_OK; i++ )
+  {
+    track = *( ctx->tracks + i );
+    if( !wants_reserve( ctx, track ) )
+    {
+      continue;
+    }
+
+    if( ( status = open_output( ctx, track, track_extension( ctx, track ), 0,
+                                &out ) ) != WAVER_OK )
+    {
+      break;
+    }
+    status = reserve_output( ctx, track, out );
+    if( ctx->output.close( out ) != 0 && status == WAVER_OK )
+    {
+      status = set_error( ctx, WAVER_ERR_WRITE, "Failed to close output file at %d",
+                          track->number );
+    }
+    track->reserved = ( status == WAVER_OK );
+  }
+
+  return status;
+}
+
+
+/*
+ * tell an output that needs it (container) the final length
+ * of every track stream before the first one is opened.
+ */
+static waver_status_t layout_output( waver_ctx_t* ctx )
+{
+  uint64_t* sizes = NULL;
+  const char** extensions = NULL;
+  uint8_t* numbers = NULL;
+  uint8_t i;
+  int result;
+
+  if( ctx->output.layout == NULL )
+  {
+    return WAVER_OK;
+  }
+
+  /* flac stream lengths are not known in advance */
+  if( ctx->output_format != FORMAT_WAV )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "this output only supports the wav format" );
+  }
+
+  if( ( sizes = ( uint64_t* )calloc( ( ctx->tracks_len > 0 ) ? ctx->tracks_len : 1,
+                                     sizeof( uint64_t ) ) ) == NULL ||
+      ( extensions = ( const char** )calloc( ( ctx->tracks_len > 0 ) ? ctx->tracks_len : 1,
+                                             sizeof( char* ) ) ) == NULL ||
+      ( numbers = ( uint8_t* )calloc( ( ctx->tracks_len > 0 ) ? ctx->tracks_len : 1,
+                                      sizeof( uint8_t ) ) ) == NULL )
+  {
+    free( sizes );
+    free( extensions );
+    return set_error( ctx, WAVER_ERR_NOMEM, "memory allocation failure" );
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    *( sizes + i ) = track_output_size( ctx, *( ctx->tracks + i ) );
+    *( extensions + i ) = track_extension( ctx, *( ctx->tracks + i ) );
+    *( numbers + i ) = ( *( ctx->tracks + i ) )->number;
+  }
+
+  result = ctx->output.layout( ctx->output.handle, numbers, extensions, sizes,
+                               ctx->tracks_len );
+  free( sizes );
+  free( extensions );
+  free( numbers );
+
+  if( result != 0 )
+  {
+    return set_error( ctx, WAVER_ERR_WRITE, "Failed to lay out the output, errno: %s",
+                      strerror( errno ) );
+  }
+
+  return WAVER_OK;
+}
+
+
+/* options that exclude each other, whatever the input and output */
+static waver_status_t check_formats( waver_ctx_t* ctx )
+{
+  /* the flac encoder takes the samples of the disc */
+  if( ctx->output_format == FORMAT_FLAC && ctx->sample_format != WAVER_SAMPLES_S16 )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "sample formats other than s16 need the wav format" );
+  }
+  if( ctx->output_format == FORMAT_FLAC && ctx->resampler.taps != NULL )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "sample rate conversion needs the wav format" );
+  }
+
+  /* every piece of every track passes the analysis, in order */
+  if( ctx->loudness != WAVER_LOUDNESS_OFF &&
+      ( ctx->output_format == FORMAT_FLAC || ctx->use_journal ) )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "loudness analysis needs the wav format "
+                      "and no journal" );
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * the number of threads set, else one per cpu. the workers of
+ * an adaptive run may wait on the device, not only compute.
+ * a run keeps it in n_workers, n_threads stays as it was set.
+ */
+static int32_t count_workers( const waver_ctx_t* ctx )
+{
+  int32_t n_threads = ctx->n_threads;
+
+  if( n_threads == 0 && ctx->adaptive )
+  {
+    return MAX_THREADS;
+  }
+  if( n_threads == 0 )
+  {
+    n_threads = ( int32_t )sysconf( _SC_NPROCESSORS_ONLN );
+    if( n_threads > MAX_THREADS || n_threads < 1 )
+    {
+      n_threads = 1;
+    }
+  }
+
+  return n_threads;
+}
+
+
+static waver_status_t start_worker( waver_ctx_t* ctx, int32_t tid )
+{
+  int errsv;
+
+  ctx->workers[ tid ].ctx = ctx;
+  ctx->workers[ tid ].tid = tid;
+  errsv = pthread_create( &ctx->workers[ tid ].thread, NULL,
+                          ( ctx->output_format == FORMAT_FLAC ) ?
+                            write_flac_chunks : write_track,
+                          ( void* )&ctx->workers[ tid ] );
+
+  if( errsv != 0 )
+  {
+    set_error( ctx, WAVER_ERR_THREAD, "can't create thread. reason: [ %s ]",
+               strerror( errsv ) );
+    if( ctx->output_format == FORMAT_FLAC )
+    {
+      wake_flac_streams( ctx );
+    }
+    return WAVER_ERR_THREAD;
+  }
+
+  return WAVER_OK;
+}
+
+
+/*
+ * the controller of an adaptive run (adapt.h), until the first
+ * worker leaves. workers are started when they are first wanted.
+ */
+static void adapt_workers( waver_ctx_t* ctx, int32_t* created )
+{
+  adapt_t ad;
+  struct timespec until;
+  int32_t wanted;
+
+  adapt_init( &ad, ctx->n_workers, __atomic_load_n( &ctx->bytes_done, __ATOMIC_RELAXED ) );
+
+  pthread_mutex_lock( &ctx->lock );
+  while( ctx->exited == 0 && get_status( ctx ) == WAVER_OK )
+  {
+    clock_gettime( CLOCK_REALTIME, &until );
+    until.tv_sec  += ( until.tv_nsec + ADAPT_INTERVAL * 1000000L ) / 1000000000L;
+    until.tv_nsec  = ( until.tv_nsec + ADAPT_INTERVAL * 1000000L ) % 1000000000L;
+    if( pthread_cond_timedwait( &ctx->workers_cond, &ctx->lock, &until ) != ETIMEDOUT ||
+        ctx->exited > 0 )
+    {
+      continue;
+    }
+
+    wanted = adapt_step( &ad, __atomic_load_n( &ctx->bytes_done, __ATOMIC_RELAXED ) );
+    if( wanted == ctx->wanted )
+    {
+      continue;
+    }
+    if( ctx->verbose && ctx->log != NULL )
+    {
+      fprintf( ctx->log, "%d workers (%.1f MB/s, io pressure %.0f%%) ...\n",
+               wanted, ad.rate, ( ad.pressure * 100.0 ) );
+      fflush( ctx->log );
+    }
+    ctx->wanted = wanted;
+    pthread_cond_broadcast( &ctx->workers_cond );
+
+    /* set_error takes the lock */
+    while( *created < wanted )
+    {
+      pthread_mutex_unlock( &ctx->lock );
+      if( start_worker( ctx, *created ) != WAVER_OK )
+      {
+        pthread_mutex_lock( &ctx->lock );
+        break;
+      }
+      pthread_mutex_lock( &ctx->lock );
+      ( *created )++;
+    }
+  }
+
+  /* the waiting workers leave with the empty pool */
+  ctx->wanted = MAX_THREADS;
+  pthread_cond_broadcast( &ctx->workers_cond );
+  pthread_mutex_unlock( &ctx->lock );
+}
+
+
+/* start and join threads */
+static waver_status_t run_workers( waver_ctx_t* ctx )
+{
+  int32_t created;
+  int32_t wanted = ctx->n_workers;
+  int32_t i;
+  int errsv;
+
+  /* the workers change ctx->wanted when they leave */
+  if( ctx->adaptive )
+  {
+    wanted = ( ADAPT_START < ctx->n_workers ) ? ADAPT_START : ctx->n_workers;
+  }
+  ctx->exited = 0;
+  ctx->wanted = wanted;
+
+  for( created = 0; created < wanted; created++ )
+  {
+    if( start_worker( ctx, created ) != WAVER_OK )
+    {
+      break;
+    }
+  }
+
+  if( ctx->adaptive && created == wanted )
+  {
+    adapt_workers( ctx, &created );
+  }
+
+  for( i = 0; i < created; i++ )
+  {
+    errsv = pthread_join( ctx->workers[ i ].thread, NULL );
+    if( errsv != 0 )
+    {
+      set_error( ctx, WAVER_ERR_THREAD, "can't join thread. reason: [ %s ]",
+                 strerror( errsv ) );
+    }
+  }
+
+  return get_status( ctx );
+}
+
+
+static void fill_loudness( const loudness_t* ln, waver_loudness_t* loudness )
+{
+  loudness->valid       = 1;
+  loudness->integrated  = loudness_integrated( ln );
+  loudness->gain        = LOUDNESS_REFERENCE - loudness->integrated;
+  loudness->sample_peak = ln->sample_peak;
+  loudness->true_peak   = ln->true_peak;
+}
+
+
+/* one object of the json sidecar, values of silence are null */
+static void write_loudness_json( FILE* out, const waver_loudness_t* ln )
+{
+  if( isfinite( ln->integrated ) )
+  {
+    fprintf( out, "{ \"integrated_lufs\": %.2f, \"replaygain_db\": %.2f, ",
+             ln->integrated, ln->gain );
+  }
+  else
+  {
+    fprintf( out, "{ \"integrated_lufs\": null, \"replaygain_db\": null, " );
+  }
+  fprintf( out, "\"sample_peak\": %.6f, \"true_peak\": %.6f, ",
+           ln->sample_peak, ln->true_peak );
+  if( ln->true_peak > 0.0 )
+  {
+    fprintf( out, "\"true_peak_dbtp\": %.2f }", 20.0 * log10( ln->true_peak ) );
+  }
+  else
+  {
+    fprintf( out, "\"true_peak_dbtp\": null }" );
+  }
+}
+
+
+/*
+ * the sidecar next to the outputs: json with the loudness of every
+ * audio track and the album, or a cue sheet of the wav files with
+ * the ReplayGain REMs players read. silence has no gain (null).
+ */
+static waver_status_t write_loudness( waver_ctx_t* ctx )
+{
+  char name[ PATH_LEN ];
+  char file[ PATH_LEN ];
+  const char* base = NULL;
+  waver_loudness_t ln;
+  track_t* track = NULL;
+  FILE* out = NULL;
+  uint8_t first = 1;
+  uint8_t i;
+
+  file_output_sidecar_name( &ctx->output, ( ctx->loudness == WAVER_LOUDNESS_CUE ) ?
+                            LOUDNESS_CUE_EXTENSION : LOUDNESS_JSON_EXTENSION, name );
+  if( ( out = fopen( name, "w" ) ) == NULL )
+  {
+    return set_error( ctx, WAVER_ERR_OPEN, "Failed to create %s, errno: %s",
+                      name, strerror( errno ) );
+  }
+
+  fill_loudness( &ctx->album, &ln );
+  if( ctx->loudness == WAVER_LOUDNESS_CUE )
+  {
+    if( isfinite( ln.gain ) )
+    {
+      fprintf( out, "REM REPLAYGAIN_ALBUM_GAIN %.2f dB\n", ln.gain );
+    }
+    fprintf( out, "REM REPLAYGAIN_ALBUM_PEAK %.6f\n", ln.sample_peak );
+  }
+  else
+  {
+    fprintf( out, "{\n  \"album\": " );
+    write_loudness_json( out, &ln );
+    fprintf( out, ",\n  \"tracks\": [" );
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    if( track->loudness == NULL )
+    {
+      continue;
+    }
+    fill_loudness( track->loudness, &ln );
+    file_output_name( &ctx->output, track->number, track_extension( ctx, track ), file );
+    base = ( strrchr( file, '/' ) != NULL ) ? ( strrchr( file, '/' ) + 1 ) : file;
+
+    if( ctx->loudness == WAVER_LOUDNESS_CUE )
+    {
+      fprintf( out, "FILE \"%s\" WAVE\n  TRACK %02d AUDIO\n", base, track->number );
+      if( isfinite( ln.gain ) )
+      {
+        fprintf( out, "    REM REPLAYGAIN_TRACK_GAIN %.2f dB\n", ln.gain );
+      }
+      fprintf( out, "    REM REPLAYGAIN_TRACK_PEAK %.6f\n    INDEX 01 00:00:00\n",
+               ln.sample_peak );
+    }
+    else
+    {
+      fprintf( out, "%s\n    { \"track\": %d, \"file\": \"",
+               ( first ? "" : "," ), track->number );
+      for( ; *base != '\0'; base++ )
+      {
+        if( *base == '"' || *base == '\\' )
+        {
+          fputc( '\\', out );
+        }
+        fputc( *base, out );
+      }
+      fprintf( out, "\", \"loudness\": " );
+      write_loudness_json( out, &ln );
+      fprintf( out, " }" );
+    }
+    first = 0;
+  }
+
+  if( ctx->loudness == WAVER_LOUDNESS_JSON )
+  {
+    fprintf( out, "\n  ]\n}\n" );
+  }
+
+  if( fclose( out ) != 0 )
+  {
+    return set_error( ctx, WAVER_ERR_WRITE, "Failed to write %s, errno: %s",
+                      name, strerror( errno ) );
+  }
+
+  return WAVER_OK;
+}
+
+
+/* ...::: public interface :::... */
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+waver_status_t waver_create( waver_ctx_t** ctx )
+{
+  waver_ctx_t* new_ctx = NULL;
+
+  if( ctx == NULL )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  if( ( new_ctx = ( waver_ctx_t* )calloc( 1, sizeof( waver_ctx_t ) ) ) == NULL )
+  {
+    return WAVER_ERR_NOMEM;
+  }
+
+  if( pthread_mutex_init( &new_ctx->lock, NULL ) != 0 )
+  {
+    free( new_ctx );
+    return WAVER_ERR_THREAD;
+  }
+  if( pthread_cond_init( &new_ctx->workers_cond, NULL ) != 0 )
+  {
+    pthread_mutex_destroy( &new_ctx->lock );
+    free( new_ctx );
+    return WAVER_ERR_THREAD;
+  }
+  if( throttle_init( &new_ctx->throttle ) != WAVER_OK )
+  {
+    pthread_cond_destroy( &new_ctx->workers_cond );
+    pthread_mutex_destroy( &new_ctx->lock );
+    free( new_ctx );
+    return WAVER_ERR_THREAD;
+  }
+  if( progress_init( &new_ctx->progress ) != WAVER_OK )
+  {
+    throttle_destroy( &new_ctx->throttle );
+    pthread_cond_destroy( &new_ctx->workers_cond );
+    pthread_mutex_destroy( &new_ctx->lock );
+    free( new_ctx );
+    return WAVER_ERR_THREAD;
+  }
+
+  new_ctx->output_format = FORMAT_WAV;
+  new_ctx->journal.fd = (-1);
+  new_ctx->readahead.fd = (-1);
+  new_ctx->readahead_window = 0;  /* no gain measured yet, tests/bench_baseline.txt */
+  new_ctx->prealloc = WAVER_PREALLOC_TRACK;
+  new_ctx->sample_rate = SAMPLING_RATE;
+
+  *ctx = new_ctx;
+
+  return WAVER_OK;
+}
+
+
+void waver_destroy( waver_ctx_t* ctx )
+{
+  if( ctx == NULL )
+  {
+    return;
+  }
+
+  release_track_metadata( ctx );
+  resample_bank_release( &ctx->resampler );
+
+  if( ctx->input_set && ctx->input.close != NULL )
+  {
+    ctx->input.close( ctx->input.handle );
+  }
+  if( ctx->output_set && ctx->output.release != NULL )
+  {
+    ctx->output.release( ctx->output.handle );
+  }
+
+  free( ctx->cue_text );
+  ctx->cue_text = NULL;
+
+  progress_destroy( &ctx->progress );
+  throttle_destroy( &ctx->throttle );
+  pthread_cond_destroy( &ctx->workers_cond );
+  pthread_mutex_destroy( &ctx->lock );
+  free( ctx );
+}
+
+
+/*
+ * the workers follow the throughput (adapt.h), n_threads of
+ * waver_set_threads is the most of them.
+ */
+waver_status_t waver_set_adaptive( waver_ctx_t* ctx, uint8_t adaptive )
+{
+  ctx->adaptive = ( adaptive != 0 );
+
+  return WAVER_OK;
+}
+
+
+/* 0 = number of CPUs online, clamped to MAX_THREADS */
+waver_status_t waver_set_threads( waver_ctx_t* ctx, int32_t n_threads )
+{
+  if( n_threads < 0 )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  ctx->n_threads = ( n_threads > MAX_THREADS ) ? MAX_THREADS : n_threads;
+
+  return WAVER_OK;
+}
+
+
+waver_status_t waver_set_swap( waver_ctx_t* ctx, uint8_t swap_bytes )
+{
+  ctx->swap_bytes = ( swap_bytes != 0 );
+
+  return WAVER_OK;
+}
+
+
+waver_status_t waver_set_format( waver_ctx_t* ctx, uint8_t format )
+{
+  if( format != FORMAT_WAV && format != FORMAT_FLAC )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  ctx->output_format = format;
+
+  return WAVER_OK;
+}
+
+
+/* NULL disables the journal */
+waver_status_t waver_set_journal( waver_ctx_t* ctx, const char* path )
+{
+  if( path == NULL )
+  {
+    ctx->use_journal = 0;
+    return WAVER_OK;
+  }
+
+  if( ( strlen( path ) + 1 ) > PATH_LEN )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  strncpy( ctx->journalfile, path, PATH_LEN );
+  ctx->use_journal = 1;
+
+  return WAVER_OK;
+}
+
+
+/* WAVER_SECTORS_AUTO, WAVER_SECTORS_COOKED or WAVER_SECTORS_RAW */
+waver_status_t waver_set_sector_layout( waver_ctx_t* ctx, uint8_t layout )
+{
+  if( layout != WAVER_SECTORS_AUTO && layout != WAVER_SECTORS_COOKED &&
+      layout != WAVER_SECTORS_RAW )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  ctx->sector_layout = layout;
+
+  return WAVER_OK;
+}
+
+
+/* write the subchannel data of raw sectors to <base>_NN.sub */
+waver_status_t waver_set_subchannel( waver_ctx_t* ctx, uint8_t sidecar )
+{
+  ctx->subchannel = ( sidecar != 0 );
+
+  return WAVER_OK;
+}
+
+
+/* what happens to the pregaps, one of WAVER_GAPS_* */
+waver_status_t waver_set_gaps( waver_ctx_t* ctx, uint8_t gaps )
+{
+  if( gaps > WAVER_GAPS_HTOA )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "unknown gap policy %u", gaps );
+  }
+  ctx->gaps = gaps;
+
+  return WAVER_OK;
+}
+
+
+/*
+ * bytes of the bin advised to the kernel ahead of the slowest
+ * worker, 0 (the default) leaves the readahead to the kernel alone.
+ */
+waver_status_t waver_set_readahead( waver_ctx_t* ctx, uint64_t window )
+{
+  ctx->readahead_window = window;
+
+  return WAVER_OK;
+}
+
+
+/*
+ * limits of a run that shares the device with other services:
+ * bytes per second read from the bin and written to the outputs,
+ * read and write requests per second. 0 is unlimited.
+ */
+waver_status_t waver_set_throttle( waver_ctx_t* ctx, uint64_t read_rate,
+                                   uint64_t write_rate, uint32_t iops )
+{
+  throttle_set( &ctx->throttle, read_rate, write_rate, iops );
+
+  return WAVER_OK;
+}
+
+
+/*
+ * i/o class (WAVER_IOPRIO_*, level 0 .. 7 of best effort) and
+ * nice value (added to the one of the caller) of the workers.
+ */
+waver_status_t waver_set_priority( waver_ctx_t* ctx, uint8_t io_class, uint8_t io_level,
+                                   int8_t nice )
+{
+  if( ( io_class != WAVER_IOPRIO_NONE && io_class != WAVER_IOPRIO_BE &&
+        io_class != WAVER_IOPRIO_IDLE ) || io_level > 7 || nice < -20 || nice > 19 )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "invalid priority %u:%u, nice %d",
+                      io_class, io_level, nice );
+  }
+  ctx->throttle.io_class = io_class;
+  ctx->throttle.io_level = io_level;
+  ctx->throttle.nice     = nice;
+
+  return WAVER_OK;
+}
+
+
+/*
+ * only the selected tracks are converted, by number (00 is the
+ * hidden track of the htoa policy). without a selection every
+ * track is.
+ */
+waver_status_t waver_select_track( waver_ctx_t* ctx, uint8_t number )
+{
+  if( number > MAX_TRACKS )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "no track %u on a disc", number );
+  }
+  ctx->selection[ number ].on = 1;
+  ctx->selecting = 1;
+
+  return WAVER_OK;
+}
+
+
+/*
+ * selects a track and only the frames [from, to) of it (75 per
+ * second, from INDEX 01 or where the gap policy starts it). a
+ * range beyond the end of the track ends with it.
+ */
+waver_status_t waver_select_range( waver_ctx_t* ctx, uint8_t number, uint32_t from,
+                                   uint32_t to )
+{
+  if( from >= to )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "empty range %u - %u", from, to );
+  }
+  if( waver_select_track( ctx, number ) != WAVER_OK )
+  {
+    return ctx->status;
+  }
+  ctx->selection[ number ].from = from;
+  ctx->selection[ number ].to   = to;
+
+  return WAVER_OK;
+}
+
+
+/*
+ * progress of the runs: a bar redrawn on tty, lines of JSON
+ * written to status_fd (see progress.h). NULL and -1 are none.
+ */
+waver_status_t waver_set_progress( waver_ctx_t* ctx, FILE* tty, int status_fd )
+{
+  ctx->progress.tty = tty;
+  ctx->progress.fd  = ( status_fd >= 0 ) ? status_fd : (-1);
+
+  return WAVER_OK;
+}
+
+
+/* wav outputs get 16 bit samples as on the disc, or wider ones */
+waver_status_t waver_set_sample_format( waver_ctx_t* ctx, uint8_t format )
+{
+  if( format > WAVER_SAMPLES_F32 )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "unknown sample format %u", format );
+  }
+  ctx->sample_format = format;
+
+  return WAVER_OK;
+}
+
+
+/*
+ * audio tracks are measured (loudness, peaks) while they are
+ * written, the results go to a sidecar or waver_track_info.
+ */
+waver_status_t waver_set_loudness( waver_ctx_t* ctx, uint8_t mode )
+{
+  if( mode > WAVER_LOUDNESS_CUE )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "unknown loudness mode %u", mode );
+  }
+  ctx->loudness = mode;
+
+  return WAVER_OK;
+}
+
+
+/*
+ * wav outputs at another rate than the 44.1 kHz of the disc. the
+ * taps of the conversion are computed here, once for all runs.
+ */
+waver_status_t waver_set_sample_rate( waver_ctx_t* ctx, uint32_t rate )
+{
+  waver_status_t status;
+
+  if( rate < WAVER_RATE_MIN || rate > WAVER_RATE_MAX )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "sample rate %u out of range", rate );
+  }
+
+  resample_bank_release( &ctx->resampler );
+  ctx->sample_rate = SAMPLING_RATE;
+  if( rate == SAMPLING_RATE )
+  {
+    return WAVER_OK;
+  }
+
+  if( ( status = resample_bank_init( &ctx->resampler, SAMPLING_RATE, rate ) ) != WAVER_OK )
+  {
+    resample_bank_release( &ctx->resampler );
+    if( status == WAVER_ERR_NOMEM )
+    {
+      return set_error( ctx, status, "Failed to allocate memory for resampler" );
+    }
+    return set_error( ctx, status, "no conversion from %u Hz to %u Hz", SAMPLING_RATE, rate );
+  }
+  ctx->sample_rate = rate;
+
+  return WAVER_OK;
+}
+
+
+/*
+ * storage of the wav and iso outputs is allocated before it is
+ * written (fallocate), when a track is opened or all at once.
+ */
+waver_status_t waver_set_preallocate( waver_ctx_t* ctx, uint8_t mode )
+{
+  if( mode > WAVER_PREALLOC_ALL )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "unknown preallocation mode %u", mode );
+  }
+  ctx->prealloc = mode;
+
+  return WAVER_OK;
+}
+
+
+/* the wav files share the extents of the bin where the file system can */
+waver_status_t waver_set_reflink( waver_ctx_t* ctx, uint8_t reflink )
+{
+  ctx->reflink = ( reflink != 0 );
+
+  return WAVER_OK;
+}
+
+
+/* zero runs of the wav and iso outputs become holes (sparse files) */
+waver_status_t waver_set_sparse( waver_ctx_t* ctx, uint8_t sparse )
+{
+  ctx->sparse = ( sparse != 0 );
+
+  return WAVER_OK;
+}
+
+
+/*
+ * read offset of the drive in samples, the audio is read
+ * from offset samples later (earlier if negative).
+ */
+waver_status_t waver_set_offset( waver_ctx_t* ctx, int32_t samples )
+{
+  if( samples > MAX_OFFSET || samples < -MAX_OFFSET )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "read offset %d out of range", samples );
+  }
+  ctx->offset = samples;
+
+  return WAVER_OK;
+}
+
+
+/* progress messages go to log (NULL = quiet) */
+void waver_set_log( waver_ctx_t* ctx, FILE* log, uint8_t verbose )
+{
+  ctx->log = log;
+  ctx->verbose = verbose;
+}
+
+
+waver_status_t waver_set_cue_file( waver_ctx_t* ctx, const char* path )
+{
+  FILE* cue_fs = NULL;
+  char* text = NULL;
+  long len;
+  waver_status_t status = WAVER_OK;
+
+  if( ( cue_fs = fopen( path, "r" ) ) == NULL )
+  {
+    return WAVER_ERR_OPEN;
+  }
+
+  if( fseek( cue_fs, 0, SEEK_END ) != 0 || ( len = ftell( cue_fs ) ) < 0 ||
+      fseek( cue_fs, 0, SEEK_SET ) != 0 )
+  {
+    fclose( cue_fs );
+    return WAVER_ERR_READ;
+  }
+
+  if( ( text = ( char* )malloc( len + 1 ) ) == NULL )
+  {
+    fclose( cue_fs );
+    return WAVER_ERR_NOMEM;
+  }
+
+  if( fread( text, 1, len, cue_fs ) != ( size_t )len )
+  {
+    status = WAVER_ERR_READ;
+  }
+  else
+  {
+    status = waver_set_cue_buffer( ctx, text, len );
+  }
+
+  free( text );
+  fclose( cue_fs );
+
+  return status;
+}
+
+
+waver_status_t waver_set_cue_buffer( waver_ctx_t* ctx, const char* text, size_t len )
+{
+  char* copy = NULL;
+
+  if( text == NULL )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  /* terminated copy, the parser reads it as a stream */
+  if( ( copy = ( char* )malloc( len + 1 ) ) == NULL )
+  {
+    return WAVER_ERR_NOMEM;
+  }
+  memcpy( copy, text, len );
+  *( copy + len ) = '\0';
+
+  free( ctx->cue_text );
+  ctx->cue_text = copy;
+  ctx->cue_len  = len;
+
+  return WAVER_OK;
+}
+
+
+/* the context takes ownership of the input, it is closed by waver_destroy */
+waver_status_t waver_set_input( waver_ctx_t* ctx, const waver_input_t* input )
+{
+  if( input == NULL || input->size == NULL || input->read == NULL )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  if( ctx->input_set && ctx->input.close != NULL )
+  {
+    ctx->input.close( ctx->input.handle );
+  }
+  ctx->input = *input;
+  ctx->input_set = 1;
+
+  return WAVER_OK;
+}
+
+
+/* the context takes ownership of the output, it is released by waver_destroy */
+waver_status_t waver_set_output( waver_ctx_t* ctx, const waver_output_t* output )
+{
+  if( output == NULL || output->open == NULL || output->write == NULL ||
+      output->sync == NULL || output->close == NULL )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  if( ctx->output_set && ctx->output.release != NULL )
+  {
+    ctx->output.release( ctx->output.handle );
+  }
+  ctx->output = *output;
+  ctx->output_set = 1;
+
+  return WAVER_OK;
+}
+
+
+waver_status_t waver_run( waver_ctx_t* ctx )
+{
+  char job_key[ JOURNAL_KEY_LEN ] = { '\0' };
+  uint64_t total = 0;
+  waver_status_t status;
+  uint8_t i;
+
+  ctx->status = WAVER_OK;
+  memset( ctx->errmsg, '\0', ERRMSG_LEN );
+  __atomic_store_n( &ctx->bytes_done, 0, __ATOMIC_RELAXED );
+  __atomic_store_n( &ctx->bytes_total, 0, __ATOMIC_RELAXED );
+
+  if( __atomic_load_n( &ctx->canceled, __ATOMIC_ACQUIRE ) )
+  {
+    return set_error( ctx, WAVER_ERR_CANCELED, "canceled" );
+  }
+
+  if( !ctx->input_set || !ctx->output_set || ctx->cue_text == NULL )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "missing input, output or cue sheet" );
+  }
+
+  /* the journal checks the outputs on the file system */
+  if( ctx->use_journal && ( !is_fd_input( &ctx->input ) || !is_file_output( &ctx->output ) ) )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "the journal needs file input and file output" );
+  }
+
+  if( ( status = check_formats( ctx ) ) != WAVER_OK )
+  {
+    return status;
+  }
+  if( ctx->loudness >= WAVER_LOUDNESS_JSON && !is_file_output( &ctx->output ) )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "loudness sidecars need file output" );
+  }
+
+  /* sidecars are extra files next to the outputs */
+  if( ctx->subchannel && !is_file_output( &ctx->output ) )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "subchannel sidecars need file output" );
+  }
+
+  release_track_metadata( ctx );
+  if( ( status = create_track_metadata( ctx ) ) != WAVER_OK )
+  {
+    return status;
+  }
+  if( ( status = select_tracks( ctx ) ) != WAVER_OK )
+  {
+    release_track_metadata( ctx );
+    return status;
+  }
+
+  if( ctx->subchannel && !ctx->raw_input && ctx->log != NULL )
+  {
+    fprintf( ctx->log, "input has no subchannel data, no sidecars written ...\n" );
+  }
+
+  /* fds and memory buffers are given per track from 01 on */
+  if( ctx->tracks_len > 0 && ( *( ctx->tracks + 0 ) )->number == 0 &&
+      !is_file_output( &ctx->output ) && ctx->output.layout == NULL )
+  {
+    release_track_metadata( ctx );
+    return set_error( ctx, WAVER_ERR_ARG, "the hidden track 00 needs file or container output" );
+  }
+
+  if( ( status = plan_kernels( ctx ) ) != WAVER_OK ||
+      ( status = plan_loudness( ctx ) ) != WAVER_OK )
+  {
+    release_track_metadata( ctx );
+    return status;
+  }
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    total += ( *( ctx->tracks + i ) )->endbyte - ( *( ctx->tracks + i ) )->startbyte;
+  }
+  __atomic_store_n( &ctx->bytes_total, total, __ATOMIC_RELAXED );
+
+  /* buffers hold the sectors of one piece */
+  ctx->piece_len = ( PIECE_SECTORS + 1 ) * ( ctx->raw_input ? SECTOR_RAW_LEN : SECTOR_LEN );
+
+  ctx->track_pool.tracks     = ctx->tracks;
+  ctx->track_pool.tracks_len = ctx->tracks_len;
+  ctx->track_pool.cur_top    = 0;
+  ctx->track_pool.cur_chunk  = 0;
+
+  if( ctx->use_journal )
+  {
+    if( ( status = build_job_key( ctx, job_key, JOURNAL_KEY_LEN ) ) != WAVER_OK )
+    {
+      return status;
+    }
+    if( ( status = journal_open( &ctx->journal, ctx->journalfile,
+                                 job_key, ctx->tracks_len ) ) != WAVER_OK )
+    {
+      return set_error( ctx, status, "Failed to open journal" );
+    }
+  }
+
+  ctx->n_workers = count_workers( ctx );
+
+  if( ctx->output_format == FORMAT_FLAC )
+  {
+    status = init_flac_streams( ctx );
+  }
+
+  if( status == WAVER_OK )
+  {
+    plan_clones( ctx );
+    status = layout_output( ctx );
+  }
+
+  if( status == WAVER_OK )
+  {
+    status = reserve_outputs( ctx );
+  }
+
+  if( status == WAVER_OK )
+  {
+    status = plan_readahead( ctx );
+  }
+
+  if( status == WAVER_OK )
+  {
+    throttle_start( &ctx->throttle );
+    if( ( status = progress_start( &ctx->progress, ctx ) ) != WAVER_OK )
+    {
+      status = set_error( ctx, status, "Failed to start the progress reporter" );
+    }
+    else
+    {
+      status = run_workers( ctx );
+      progress_stop( &ctx->progress, ctx, status );
+    }
+    readahead_close( &ctx->readahead );
+  }
+
+  if( status == WAVER_OK && ctx->loudness >= WAVER_LOUDNESS_JSON )
+  {
+    status = write_loudness( ctx );
+  }
+
+  release_flac_streams( ctx );
+
+  if( ctx->use_journal && journal_close( &ctx->journal ) != WAVER_OK )
+  {
+    status = set_error( ctx, WAVER_ERR_JOURNAL, "Failed to close journal" );
+  }
+
+  return status;
+}
+
+
+/*
+ * dry run: the tracks of the cue sheet and their schedule on the
+ * workers, predicted by the model of cal. nothing is read or
+ * written but the size of the input, no output is needed.
+ */
+waver_status_t waver_plan( waver_ctx_t* ctx, const waver_calibration_t* cal, FILE* out )
+{
+  waver_status_t status;
+
+  ctx->status = WAVER_OK;
+  memset( ctx->errmsg, '\0', ERRMSG_LEN );
+
+  if( !ctx->input_set || ctx->cue_text == NULL || cal == NULL || out == NULL )
+  {
+    return set_error( ctx, WAVER_ERR_ARG, "missing input, cue sheet or calibration" );
+  }
+  if( ( status = check_formats( ctx ) ) != WAVER_OK )
+  {
+    return status;
+  }
+
+  release_track_metadata( ctx );
+  if( ( status = create_track_metadata( ctx ) ) != WAVER_OK )
+  {
+    return status;
+  }
+  if( ( status = select_tracks( ctx ) ) != WAVER_OK )
+  {
+    release_track_metadata( ctx );
+    return status;
+  }
+  if( ( status = plan_kernels( ctx ) ) != WAVER_OK )
+  {
+    release_track_metadata( ctx );
+    return status;
+  }
+
+  plan_print( ctx, cal, count_workers( ctx ), out );
+
+  return WAVER_OK;
+}
+
+
+/*
+ * stops a run of another thread as soon as every worker has
+ * finished its piece. the context stays canceled, later runs
+ * fail at once.
+ */
+void waver_cancel( waver_ctx_t* ctx )
+{
+  __atomic_store_n( &ctx->canceled, 1, __ATOMIC_RELEASE );
+  set_error( ctx, WAVER_ERR_CANCELED, "canceled" );
+}
+
+
+/* input bytes done and to do of the current (or last) run */
+void waver_progress( const waver_ctx_t* ctx, uint64_t* done, uint64_t* total )
+{
+  *done  = __atomic_load_n( &ctx->bytes_done, __ATOMIC_RELAXED );
+  *total = __atomic_load_n( &ctx->bytes_total, __ATOMIC_RELAXED );
+}
+
+
+uint8_t waver_track_count( const waver_ctx_t* ctx )
+{
+  return ctx->tracks_len;
+}
+
+
+waver_status_t waver_track_info( const waver_ctx_t* ctx, uint8_t idx,
+                                 waver_track_info_t* info )
+{
+  track_t* track = NULL;
+
+  if( idx >= ctx->tracks_len || info == NULL )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  track = *( ctx->tracks + idx );
+  info->number     = track->number;
+  info->is_audio   = track->is_audio;
+  info->startbyte  = track->startbyte;
+  info->endbyte    = track->endbyte;
+  info->size_byte  = track->size_byte;
+  info->zero_bytes = track->zero_bytes;
+  info->zero_runs  = track->zero_runs;
+  info->hole_bytes = track->hole_bytes;
+  info->bytes_done = __atomic_load_n( &track->bytes_done, __ATOMIC_RELAXED );
+
+  memset( &info->loudness, 0x00, sizeof( waver_loudness_t ) );
+  if( track->loudness != NULL )
+  {
+    fill_loudness( track->loudness, &info->loudness );
+  }
+
+  return WAVER_OK;
+}
+
+
+/* the loudness of all measured tracks of the last run */
+waver_status_t waver_album_loudness( const waver_ctx_t* ctx, waver_loudness_t* loudness )
+{
+  uint8_t i;
+
+  if( loudness == NULL )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  memset( loudness, 0x00, sizeof( waver_loudness_t ) );
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    if( ( *( ctx->tracks + i ) )->loudness != NULL )
+    {
+      fill_loudness( &ctx->album, loudness );
+      return WAVER_OK;
+    }
+  }
+
+  return WAVER_ERR_ARG;
+}
+
+
+const char* waver_strerror( waver_status_t status )
+{
+  switch( status )
+  {
+    case WAVER_OK:          return "success";
+    case WAVER_ERR_ARG:     return "invalid argument";
+    case WAVER_ERR_NOMEM:   return "memory allocation failure";
+    case WAVER_ERR_OPEN:    return "failed to open file";
+    case WAVER_ERR_READ:    return "failed to read input";
+    case WAVER_ERR_WRITE:   return "failed to write output";
+    case WAVER_ERR_SEEK:    return "failed to seek";
+    case WAVER_ERR_SYNC:    return "failed to commit data to disk";
+    case WAVER_ERR_CUE:     return "malformed cue sheet";
+    case WAVER_ERR_THREAD:  return "thread error";
+    case WAVER_ERR_JOURNAL: return "journal error";
+    case WAVER_ERR_CANCELED: return "canceled";
+    default:                return "unknown error";
+  }
+}
+
+
+/* message of the first error of the last run */
+const char* waver_error_message( const waver_ctx_t* ctx )
+{
+  if( ctx->errmsg[ 0 ] == '\0' )
+  {
+    return waver_strerror( ctx->status );
+  }
+  return ctx->errmsg;
+}
+
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
@@ -0,0 +1,450 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    loudness.c
+# Purpose: loudness and peaks of the audio tracks
+#
+#==========================================
+*/
+
+#include "loudness.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* "private" defines */
+#define TRUE_PEAK_HALF  ( TRUE_PEAK_TAPS / 2 )
+#define DENORMAL_LIMIT  1e-30
+
+/* "private" function prototypes */
+static void init_filters( void );
+static inline double kweight( double state[ 2 ][ 4 ], const float* left, const float* right,
+                              uint32_t n );
+static inline float peak_of( const float* x, uint32_t n, float peak );
+static void add_block( loudness_t* ln, double energy );
+static void true_peak_block( loudness_t* ln, float x[ 2 ][ TRUE_PEAK_TAPS - 1 + TRUE_PEAK_BLOCK ],
+                             uint32_t n );
+
+/* ****************************************************************** */
+
+/* the filters, the same for every track */
+static pthread_once_t filters_once = PTHREAD_ONCE_INIT;
+static double kw_b[ 2 ][ 3 ];  /* k-weighting: high shelf, high pass */
+static double kw_a[ 2 ][ 3 ];
+static float tp_taps[ TRUE_PEAK_PHASES ][ TRUE_PEAK_TAPS ];
+static float tp_gain;          /* largest sum of the magnitudes of a phase */
+
+/* ****************************************************************** */
+
+
+/*
+ * the k-weighting of BS.1770 at the rate of the disc (the analog
+ * prototypes of libebur128), and the oversampling filter: a hann
+ * windowed sinc, phase 0 is the input itself.
+ */
+static void init_filters( void )
+{
+  double k;
+  double vh;
+  double vb;
+  double a0;
+  double u;
+  double h;
+  double sum;
+  double mag;
+  uint32_t p;
+  uint32_t i;
+
+  k  = tan( M_PI * 1681.974450955533 / LOUDNESS_RATE );
+  vh = pow( 10.0, 3.999843853973347 / 20.0 );
+  vb = pow( vh, 0.4996667741545416 );
+  a0 = 1.0 + k / 0.7071752369554196 + k * k;
+  kw_b[ 0 ][ 0 ] = ( vh + vb * k / 0.7071752369554196 + k * k ) / a0;
+  kw_b[ 0 ][ 1 ] = 2.0 * ( k * k - vh ) / a0;
+  kw_b[ 0 ][ 2 ] = ( vh - vb * k / 0.7071752369554196 + k * k ) / a0;
+  kw_a[ 0 ][ 1 ] = 2.0 * ( k * k - 1.0 ) / a0;
+  kw_a[ 0 ][ 2 ] = ( 1.0 - k / 0.7071752369554196 + k * k ) / a0;
+
+  k  = tan( M_PI * 38.13547087602444 / LOUDNESS_RATE );
+  a0 = 1.0 + k / 0.5003270373238773 + k * k;
+  kw_b[ 1 ][ 0 ] = 1.0;
+  kw_b[ 1 ][ 1 ] = -2.0;
+  kw_b[ 1 ][ 2 ] = 1.0;
+  kw_a[ 1 ][ 1 ] = 2.0 * ( k * k - 1.0 ) / a0;
+  kw_a[ 1 ][ 2 ] = ( 1.0 - k / 0.5003270373238773 + k * k ) / a0;
+
+  tp_gain = 1.0f;
+  for( p = 0; p < TRUE_PEAK_PHASES; p++ )
+  {
+    sum = 0.0;
+    for( i = 0; i < TRUE_PEAK_TAPS; i++ )
+    {
+      u = ( double )( TRUE_PEAK_HALF - 1 ) - i + ( ( double )p / TRUE_PEAK_PHASES );
+      h = ( u == 0.0 ) ? 1.0 : sin( M_PI * u ) / ( M_PI * u );
+      h *= 0.5 * ( 1.0 + cos( M_PI * u / TRUE_PEAK_HALF ) );
+      tp_taps[ p ][ i ] = ( float )h;
+      sum += h;
+    }
+
+    mag = 0.0;
+    for( i = 0; i < TRUE_PEAK_TAPS; i++ )
+    {
+      tp_taps[ p ][ i ] = ( float )( tp_taps[ p ][ i ] / sum );
+      mag += fabs( tp_taps[ p ][ i ] );
+    }
+    if( mag > tp_gain )
+    {
+      tp_gain = ( float )mag;
+    }
+  }
+}
+
+
+/*
+ * the largest magnitude of x and peak. eight lanes, so the compare
+ * and select become packed instructions (a plain max of floats
+ * isn't vectorized without -ffast-math).
+ */
+static inline float peak_of( const float* x, uint32_t n, float peak )
+{
+  float lane[ 8 ];
+  float v;
+  uint32_t i;
+  uint32_t j;
+
+  for( j = 0; j < 8; j++ )
+  {
+    lane[ j ] = peak;
+  }
+  for( i = 0; ( i + 8 ) <= n; i += 8 )
+  {
+    for( j = 0; j < 8; j++ )
+    {
+      v = fabsf( *( x + i + j ) );
+      lane[ j ] = ( v > lane[ j ] ) ? v : lane[ j ];
+    }
+  }
+  for( ; i < n; i++ )
+  {
+    v = fabsf( *( x + i ) );
+    lane[ 0 ] = ( v > lane[ 0 ] ) ? v : lane[ 0 ];
+  }
+  for( j = 0; j < 8; j++ )
+  {
+    peak = ( lane[ j ] > peak ) ? lane[ j ] : peak;
+  }
+
+  return peak;
+}
+
+
+/*
+ * n frames of both channels through the two biquads, returns the
+ * sum of the squares. the states stay in registers, the channels
+ * are independent chains the cpu runs side by side.
+ */
+static inline double kweight( double state[ 2 ][ 4 ], const float* left, const float* right,
+                              uint32_t n )
+{
+  double l0 = state[ 0 ][ 0 ], l1 = state[ 0 ][ 1 ], l2 = state[ 0 ][ 2 ], l3 = state[ 0 ][ 3 ];
+  double r0 = state[ 1 ][ 0 ], r1 = state[ 1 ][ 1 ], r2 = state[ 1 ][ 2 ], r3 = state[ 1 ][ 3 ];
+  double energy_l = 0.0;
+  double energy_r = 0.0;
+  double in_l, mid_l, out_l;
+  double in_r, mid_r, out_r;
+  uint32_t i;
+
+  for( i = 0; i < n; i++ )
+  {
+    in_l  = *( left + i );
+    in_r  = *( right + i );
+    mid_l = kw_b[ 0 ][ 0 ] * in_l + l0;
+    mid_r = kw_b[ 0 ][ 0 ] * in_r + r0;
+    l0    = kw_b[ 0 ][ 1 ] * in_l - kw_a[ 0 ][ 1 ] * mid_l + l1;
+    r0    = kw_b[ 0 ][ 1 ] * in_r - kw_a[ 0 ][ 1 ] * mid_r + r1;
+    l1    = kw_b[ 0 ][ 2 ] * in_l - kw_a[ 0 ][ 2 ] * mid_l;
+    r1    = kw_b[ 0 ][ 2 ] * in_r - kw_a[ 0 ][ 2 ] * mid_r;
+    out_l = kw_b[ 1 ][ 0 ] * mid_l + l2;
+    out_r = kw_b[ 1 ][ 0 ] * mid_r + r2;
+    l2    = kw_b[ 1 ][ 1 ] * mid_l - kw_a[ 1 ][ 1 ] * out_l + l3;
+    r2    = kw_b[ 1 ][ 1 ] * mid_r - kw_a[ 1 ][ 1 ] * out_r + r3;
+    l3    = kw_b[ 1 ][ 2 ] * mid_l - kw_a[ 1 ][ 2 ] * out_l;
+    r3    = kw_b[ 1 ][ 2 ] * mid_r - kw_a[ 1 ][ 2 ] * out_r;
+    energy_l += out_l * out_l;
+    energy_r += out_r * out_r;
+  }
+
+  state[ 0 ][ 0 ] = l0;
+  state[ 0 ][ 1 ] = l1;
+  state[ 0 ][ 2 ] = l2;
+  state[ 0 ][ 3 ] = l3;
+  state[ 1 ][ 0 ] = r0;
+  state[ 1 ][ 1 ] = r1;
+  state[ 1 ][ 2 ] = r2;
+  state[ 1 ][ 3 ] = r3;
+
+  return energy_l + energy_r;
+}
+
+
+/* a gating block of the mean square energy, below the absolute gate it is dropped */
+static void add_block( loudness_t* ln, double energy )
+{
+  double loudness;
+  int32_t bin;
+
+  if( energy <= 0.0 )
+  {
+    return;
+  }
+
+  loudness = -0.691 + 10.0 * log10( energy );
+  if( loudness < LOUDNESS_FLOOR )
+  {
+    return;
+  }
+
+  bin = ( int32_t )( ( loudness - LOUDNESS_FLOOR ) * ( LOUDNESS_BINS /
+                                                       ( LOUDNESS_CEIL - LOUDNESS_FLOOR ) ) );
+  if( bin >= LOUDNESS_BINS )
+  {
+    bin = LOUDNESS_BINS - 1;
+  }
+
+  ln->block_count[ bin ]++;
+  ln->block_energy[ bin ] += energy;
+}
+
+
+/*
+ * the oversampled points between the input frames of x, which has
+ * the last TRUE_PEAK_TAPS - 1 frames before the n new ones in front.
+ * a block whose peak can't reach the true peak so far is skipped.
+ */
+static void true_peak_block( loudness_t* ln, float x[ 2 ][ TRUE_PEAK_TAPS - 1 + TRUE_PEAK_BLOCK ],
+                             uint32_t n )
+{
+  float acc[ TRUE_PEAK_BLOCK ];
+  float peak = 0.0f;
+  uint32_t c;
+  uint32_t p;
+  uint32_t i;
+  uint32_t k;
+
+  peak = peak_of( x[ 0 ], ( TRUE_PEAK_TAPS - 1 + n ), peak );
+  peak = peak_of( x[ 1 ], ( TRUE_PEAK_TAPS - 1 + n ), peak );
+  if( ( double )( peak * tp_gain ) <= ln->true_peak )
+  {
+    return;
+  }
+
+  /* tap by tap over the block, the inner loop vectorizes */
+  peak = ( float )ln->true_peak;
+  for( c = 0; c < 2; c++ )
+  {
+    for( p = 1; p < TRUE_PEAK_PHASES; p++ )
+    {
+      memset( acc, 0x00, ( n * sizeof( float ) ) );
+      for( k = 0; k < TRUE_PEAK_TAPS; k++ )
+      {
+        for( i = 0; i < n; i++ )
+        {
+          acc[ i ] += tp_taps[ p ][ k ] * x[ c ][ i + k ];
+        }
+      }
+      peak = peak_of( acc, n, peak );
+    }
+  }
+  ln->true_peak = peak;
+}
+
+
+void loudness_init( loudness_t* ln )
+{
+  pthread_once( &filters_once, init_filters );
+  memset( ln, 0x00, sizeof( loudness_t ) );
+}
+
+
+/*
+ * len bytes of 16 bit stereo frames, swapped before they are
+ * measured on request. a step that is not complete at the end of
+ * a track is not measured (as in libebur128).
+ */
+void loudness_add( loudness_t* ln, const char* buf, uint32_t len, uint8_t swap )
+{
+  float x[ 2 ][ TRUE_PEAK_TAPS - 1 + TRUE_PEAK_BLOCK ];
+  uint32_t frames = len / 4;
+  uint32_t n;
+  uint32_t i;
+  uint32_t c;
+  uint32_t j;
+  uint32_t seg;
+  uint16_t word[ 2 ];
+  int32_t peak = 0;
+  int32_t mag;
+
+  for( j = 0; j < frames; j += n )
+  {
+    n = ( ( frames - j ) > TRUE_PEAK_BLOCK ) ? TRUE_PEAK_BLOCK : ( frames - j );
+    memcpy( x[ 0 ], ln->history[ 0 ], sizeof( ln->history[ 0 ] ) );
+    memcpy( x[ 1 ], ln->history[ 1 ], sizeof( ln->history[ 1 ] ) );
+
+    for( i = 0; i < n; i++ )
+    {
+      memcpy( word, ( buf + ( ( size_t )( j + i ) * 4 ) ), sizeof( word ) );
+      if( swap )
+      {
+        word[ 0 ] = ( uint16_t )( ( word[ 0 ] >> 8 ) | ( word[ 0 ] << 8 ) );
+        word[ 1 ] = ( uint16_t )( ( word[ 1 ] >> 8 ) | ( word[ 1 ] << 8 ) );
+      }
+      mag  = abs( ( int16_t )word[ 0 ] );
+      peak = ( mag > peak ) ? mag : peak;
+      mag  = abs( ( int16_t )word[ 1 ] );
+      peak = ( mag > peak ) ? mag : peak;
+      x[ 0 ][ TRUE_PEAK_TAPS - 1 + i ] = ( float )( int16_t )word[ 0 ] * ( 1.0f / 32768.0f );
+      x[ 1 ][ TRUE_PEAK_TAPS - 1 + i ] = ( float )( int16_t )word[ 1 ] * ( 1.0f / 32768.0f );
+    }
+
+    /* k-weighted energy, step by step */
+    for( i = 0; i < n; i += seg )
+    {
+      seg = ( ( n - i ) > ( LOUDNESS_STEP - ln->step_frames ) ) ?
+            ( LOUDNESS_STEP - ln->step_frames ) : ( n - i );
+      ln->step_energy += kweight( ln->state, ( x[ 0 ] + TRUE_PEAK_TAPS - 1 + i ),
+                                  ( x[ 1 ] + TRUE_PEAK_TAPS - 1 + i ), seg );
+      ln->step_frames += seg;
+
+      if( ln->step_frames == LOUDNESS_STEP )
+      {
+        if( ln->steps_len == ( LOUDNESS_STEPS - 1 ) )
+        {
+          add_block( ln, ( ln->steps[ 0 ] + ln->steps[ 1 ] + ln->steps[ 2 ] +
+                           ln->step_energy ) / ( LOUDNESS_STEPS * LOUDNESS_STEP ) );
+          ln->steps[ 0 ] = ln->steps[ 1 ];
+          ln->steps[ 1 ] = ln->steps[ 2 ];
+          ln->steps[ 2 ] = ln->step_energy;
+        }
+        else
+        {
+          ln->steps[ ln->steps_len++ ] = ln->step_energy;
+        }
+        ln->step_energy = 0.0;
+        ln->step_frames = 0;
+      }
+    }
+
+    true_peak_block( ln, x, n );
+    memcpy( ln->history[ 0 ], ( x[ 0 ] + n ), sizeof( ln->history[ 0 ] ) );
+    memcpy( ln->history[ 1 ], ( x[ 1 ] + n ), sizeof( ln->history[ 1 ] ) );
+  }
+
+  /* silence decays the filters into denormals, which are slow */
+  for( c = 0; c < 2; c++ )
+  {
+    for( i = 0; i < 4; i++ )
+    {
+      if( fabs( ln->state[ c ][ i ] ) < DENORMAL_LIMIT )
+      {
+        ln->state[ c ][ i ] = 0.0;
+      }
+    }
+  }
+
+  if( ( peak / 32768.0 ) > ln->sample_peak )
+  {
+    ln->sample_peak = peak / 32768.0;
+  }
+  if( ln->sample_peak > ln->true_peak )
+  {
+    ln->true_peak = ln->sample_peak;
+  }
+}
+
+
+/* the points behind the last frame, the track ends in silence */
+void loudness_finish( loudness_t* ln )
+{
+  float x[ 2 ][ TRUE_PEAK_TAPS - 1 + TRUE_PEAK_BLOCK ];
+
+  memset( x, 0x00, sizeof( x ) );
+  memcpy( x[ 0 ], ln->history[ 0 ], sizeof( ln->history[ 0 ] ) );
+  memcpy( x[ 1 ], ln->history[ 1 ], sizeof( ln->history[ 1 ] ) );
+  true_peak_block( ln, x, TRUE_PEAK_HALF );
+}
+
+
+void loudness_merge( loudness_t* album, const loudness_t* track )
+{
+  uint32_t i;
+
+  for( i = 0; i < LOUDNESS_BINS; i++ )
+  {
+    album->block_count[ i ]  += track->block_count[ i ];
+    album->block_energy[ i ] += track->block_energy[ i ];
+  }
+  if( track->sample_peak > album->sample_peak )
+  {
+    album->sample_peak = track->sample_peak;
+  }
+  if( track->true_peak > album->true_peak )
+  {
+    album->true_peak = track->true_peak;
+  }
+}
+
+
+/*
+ * integrated loudness in LUFS: the mean of the blocks above the
+ * absolute gate, then of those not more than 10 LU below it.
+ * -HUGE_VAL for silence.
+ */
+double loudness_integrated( const loudness_t* ln )
+{
+  double energy = 0.0;
+  uint64_t count = 0;
+  double gate;
+  int32_t first;
+  int32_t i;
+
+  for( i = 0; i < LOUDNESS_BINS; i++ )
+  {
+    count  += ln->block_count[ i ];
+    energy += ln->block_energy[ i ];
+  }
+  if( count == 0 )
+  {
+    return -HUGE_VAL;
+  }
+
+  gate = -0.691 + 10.0 * log10( energy / count ) + LOUDNESS_RELATIVE;
+  first = ( int32_t )( ( gate - LOUDNESS_FLOOR ) * ( LOUDNESS_BINS /
+                                                    ( LOUDNESS_CEIL - LOUDNESS_FLOOR ) ) );
+  first = ( first < 0 ) ? 0 : first;
+
+  energy = 0.0;
+  count = 0;
+  for( i = first; i < LOUDNESS_BINS; i++ )
+  {
+    count  += ln->block_count[ i ];
+    energy += ln->block_energy[ i ];
+  }
+
+  return -0.691 + 10.0 * log10( energy / count );
+}
@@ -0,0 +1,511 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    plan.c
+# Purpose: dry run schedule and the
+#          throughput model behind it
+#
+#==========================================
+*/
+
+#include "plan.h"
+#include "flac.h"
+#include "mtimer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static void make_parents( const char* path );
+static void bench_storage( FILE* log, waver_calibration_t* cal, char* buf );
+static void bench_stages( FILE* log, waver_calibration_t* cal, char* buf );
+static double stage_rate( const waver_ctx_t* ctx, const track_t* track,
+                          const waver_calibration_t* cal );
+static uint64_t written_bytes( const waver_ctx_t* ctx, const track_t* track );
+static double limited( double measured, double limit );
+static double io_time( const waver_ctx_t* ctx, const waver_calibration_t* cal,
+                       uint64_t read, uint64_t written );
+static uint32_t next_worker( const double* busy, int32_t n_threads );
+
+/* ****************************************************************** */
+
+
+/* the rates of the calibration file, by name */
+static const struct
+{
+
+  const char* name;
+  size_t      offset;
+
+} calibration_names[] =
+{
+  { "read",     offsetof( waver_calibration_t, read ) },
+  { "write",    offsetof( waver_calibration_t, write ) },
+  { "kernel",   offsetof( waver_calibration_t, kernel ) },
+  { "convert",  offsetof( waver_calibration_t, convert ) },
+  { "resample", offsetof( waver_calibration_t, resample ) },
+  { "flac",     offsetof( waver_calibration_t, flac ) }
+};
+
+#define CALIBRATION_NAMES ( sizeof( calibration_names ) / sizeof( calibration_names[ 0 ] ) )
+
+
+/* ...::: calibration :::... */
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+uint8_t calibration_path( char* path, size_t len )
+{
+  const char* env = getenv( CALIBRATION_ENV );
+  const char* home = getenv( "HOME" );
+
+  if( env != NULL && *env != '\0' )
+  {
+    snprintf( path, len, "%s", env );
+    return 1;
+  }
+  if( home == NULL || *home == '\0' )
+  {
+    return 0;
+  }
+  snprintf( path, len, "%s/%s/%s", home, CALIBRATION_DIR, CALIBRATION_FILE );
+
+  return 1;
+}
+
+
+/* rates missing from the file stay 0 (not measured) */
+waver_status_t calibration_load( waver_calibration_t* cal, const char* path )
+{
+  FILE* in = NULL;
+  char line[ 128 ];
+  char name[ 32 ];
+  double rate;
+  uint32_t i;
+
+  memset( cal, 0, sizeof( waver_calibration_t ) );
+
+  if( ( in = fopen( path, "r" ) ) == NULL )
+  {
+    return WAVER_ERR_OPEN;
+  }
+
+  while( fgets( line, sizeof( line ), in ) != NULL )
+  {
+    if( line[ 0 ] == '#' || sscanf( line, "%31s %lf", name, &rate ) != 2 ||
+        !isfinite( rate ) || rate < 0.0 )
+    {
+      continue;
+    }
+    for( i = 0; i < CALIBRATION_NAMES; i++ )
+    {
+      if( strcmp( name, calibration_names[ i ].name ) == 0 )
+      {
+        *( double* )( ( char* )cal + calibration_names[ i ].offset ) = rate;
+      }
+    }
+  }
+  fclose( in );
+
+  return WAVER_OK;
+}
+
+
+/* the directories of the path are created as needed */
+static void make_parents( const char* path )
+{
+  char dir[ PATH_LEN ];
+  char* slash = NULL;
+
+  snprintf( dir, PATH_LEN, "%s", path );
+  for( slash = strchr( ( dir + 1 ), '/' ); slash != NULL; slash = strchr( ( slash + 1 ), '/' ) )
+  {
+    *slash = '\0';
+    mkdir( dir, S_IRWXU );
+    *slash = '/';
+  }
+}
+
+
+waver_status_t calibration_save( const waver_calibration_t* cal, const char* path )
+{
+  FILE* out = NULL;
+  uint32_t i;
+
+  make_parents( path );
+  if( ( out = fopen( path, "w" ) ) == NULL )
+  {
+    return WAVER_ERR_OPEN;
+  }
+
+  fprintf( out, "# waver -B, MB/s of one worker (read and write: the device)\n" );
+  for( i = 0; i < CALIBRATION_NAMES; i++ )
+  {
+    fprintf( out, "%s %.1f\n", calibration_names[ i ].name,
+             *( const double* )( ( const char* )cal + calibration_names[ i ].offset ) );
+  }
+
+  return ( fclose( out ) == 0 ) ? WAVER_OK : WAVER_ERR_WRITE;
+}
+
+
+/*
+ * sequential writes (down to the device) and reads (out of
+ * the device, the cache is dropped) of a scratch file in the
+ * current directory, where the outputs usually go.
+ */
+static void bench_storage( FILE* log, waver_calibration_t* cal, char* buf )
+{
+  ctimer_t timer;
+  double seconds;
+  uint32_t i;
+  uint8_t ok = 1;
+  int fd;
+
+  if( ( fd = open( BENCH_FILE, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR ) ) < 0 )
+  {
+    fprintf( log, "storage: can't create %s, not measured\n", BENCH_FILE );
+    return;
+  }
+
+  initCTimer( timer, MONOTONIC );
+  startCTimer( timer );
+  for( i = 0; i < BENCH_IO_PIECES && ok; i++ )
+  {
+    ok = ( pwrite( fd, buf, BLOCK_SIZE, ( off_t )i * BLOCK_SIZE ) == BLOCK_SIZE );
+  }
+  ok = ok && ( fdatasync( fd ) == 0 );
+  stopCTimer( timer );
+  seconds = getCTime( timer );
+  if( ok )
+  {
+    cal->write = ( ( double )BLOCK_SIZE * BENCH_IO_PIECES / 1e6 ) / seconds;
+  }
+
+  posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+  startCTimer( timer );
+  for( i = 0; i < BENCH_IO_PIECES && ok; i++ )
+  {
+    ok = ( pread( fd, buf, BLOCK_SIZE, ( off_t )i * BLOCK_SIZE ) == BLOCK_SIZE );
+  }
+  stopCTimer( timer );
+  seconds = getCTime( timer );
+  if( ok )
+  {
+    cal->read = ( ( double )BLOCK_SIZE * BENCH_IO_PIECES / 1e6 ) / seconds;
+  }
+
+  close( fd );
+  unlink( BENCH_FILE );
+
+  if( !ok )
+  {
+    fprintf( log, "storage: %s failed, not measured\n", BENCH_FILE );
+    return;
+  }
+  fprintf( log, "storage of the current directory: write %.1f MB/s, read %.1f MB/s\n",
+           cal->write, cal->read );
+}
+
+
+/* resampler (to 48000 Hz) and flac encoder on a piece of music-like audio */
+static void bench_stages( FILE* log, waver_calibration_t* cal, char* buf )
+{
+  resample_bank_t bank = { 0 };
+  resample_state_t state = { 0 };
+  flac_encoder_t* encoder = NULL;
+  char* out = NULL;
+  uint32_t frames = BLOCK_SIZE / EFFECTIVE_BYTES;
+  uint32_t block;
+  uint32_t min_framesize = UINT32_MAX;
+  uint32_t max_framesize = 0;
+  uint32_t i;
+  int16_t sample;
+  ctimer_t timer;
+  double seconds;
+
+  /* two tones and a little noise, the encoder neither idles nor gives up */
+  srand( 1 );
+  for( i = 0; i < frames; i++ )
+  {
+    sample = ( int16_t )( 9000.0 * sin( 2.0 * M_PI * 440.0 * i / SAMPLING_RATE ) +
+                          5000.0 * sin( 2.0 * M_PI * 1250.0 * i / SAMPLING_RATE ) +
+                          ( rand() % 64 ) - 32 );
+    memcpy( ( buf + ( ( size_t )i * EFFECTIVE_BYTES ) ), &sample, sizeof( int16_t ) );
+    memcpy( ( buf + ( ( size_t )i * EFFECTIVE_BYTES ) + 2 ), &sample, sizeof( int16_t ) );
+  }
+
+  initCTimer( timer, MONOTONIC );
+
+  if( resample_bank_init( &bank, SAMPLING_RATE, 48000 ) == WAVER_OK &&
+      resample_open( &state, &bank, frames ) == WAVER_OK &&
+      ( out = ( char* )malloc( ( size_t )resample_max_out( &bank ) * CHANNELS *
+                               sizeof( int16_t ) ) ) != NULL )
+  {
+    startCTimer( timer );
+    for( i = 0; i < frames; i += block )
+    {
+      block = ( ( frames - i ) > RESAMPLE_BLOCK ) ? RESAMPLE_BLOCK : ( frames - i );
+      resample_run( &state, ( buf + ( ( size_t )i * EFFECTIVE_BYTES ) ), block,
+                    ( ( i + block ) == frames ), out, WAVER_SAMPLES_S16 );
+    }
+    stopCTimer( timer );
+    seconds = getCTime( timer );
+    cal->resample = ( ( double )BLOCK_SIZE / 1e6 ) / seconds;
+    fprintf( log, "resampler to 48000 Hz: %.1f MB/s\n", cal->resample );
+  }
+  free( out );
+  out = NULL;
+  resample_close( &state );
+  resample_bank_release( &bank );
+
+  if( ( encoder = flac_encoder_create() ) != NULL &&
+      ( out = ( char* )malloc( ( size_t )( BLOCK_SIZE / FLAC_FRAME_BYTES ) *
+                               FLAC_MAX_FRAME_LEN ) ) != NULL )
+  {
+    startCTimer( timer );
+    flac_encode_block( encoder, buf, BLOCK_SIZE, 0, ( uint8_t* )out,
+                       &min_framesize, &max_framesize );
+    stopCTimer( timer );
+    seconds = getCTime( timer );
+    cal->flac = ( ( double )BLOCK_SIZE / 1e6 ) / seconds;
+    fprintf( log, "flac encoder: %.1f MB/s\n", cal->flac );
+  }
+  free( out );
+  if( encoder != NULL )
+  {
+    flac_encoder_destroy( encoder );
+  }
+}
+
+
+/*
+ * the rates of the storage and of the stages the kernel
+ * benchmark doesn't cover. rates that can't be measured stay.
+ */
+void calibration_bench( FILE* log, waver_calibration_t* cal )
+{
+  char* buf = NULL;
+
+  if( ( buf = ( char* )malloc( BLOCK_SIZE ) ) == NULL )
+  {
+    fprintf( log, "Failed to allocate memory for the benchmark\n" );
+    return;
+  }
+  memset( buf, 0x5A, BLOCK_SIZE );
+
+  fprintf( log, "\n" );
+  bench_storage( log, cal, buf );
+  bench_stages( log, cal, buf );
+
+  free( buf );
+}
+
+
+/* ...::: plan :::... */
+/* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
+
+/* MB/s of the stage a worker runs the track through, 0 is not calibrated */
+static double stage_rate( const waver_ctx_t* ctx, const track_t* track,
+                          const waver_calibration_t* cal )
+{
+  if( track->is_audio && ctx->output_format == FORMAT_FLAC )
+  {
+    return cal->flac;
+  }
+  if( track->resample )
+  {
+    return cal->resample;
+  }
+
+  return ( track->convert != NULL ) ? cal->convert : cal->kernel;
+}
+
+
+/* a flac file is at most as long as its samples (verbatim frames) */
+static uint64_t written_bytes( const waver_ctx_t* ctx, const track_t* track )
+{
+  uint64_t bytes = ( track->is_audio && ctx->output_format == FORMAT_FLAC ) ?
+                   ( FLAC_HEADER_LEN + ( uint64_t )track->size_byte ) :
+                   track_output_size( ctx, track );
+
+  if( ctx->subchannel && ctx->raw_input )
+  {
+    bytes += ( uint64_t )( ( track->endbyte - track->startbyte ) / track->sector_len ) *
+             SUBCHANNEL_LEN;
+  }
+
+  return bytes;
+}
+
+
+/* MB/s of the device under a limit of the run (bytes/s), 0 is neither */
+static double limited( double measured, double limit )
+{
+  limit /= 1e6;
+  if( limit > 0.0 && ( measured <= 0.0 || limit < measured ) )
+  {
+    return limit;
+  }
+
+  return measured;
+}
+
+
+static double io_time( const waver_ctx_t* ctx, const waver_calibration_t* cal,
+                       uint64_t read, uint64_t written )
+{
+  double read_rate = limited( cal->read, ctx->throttle.read.rate );
+  double write_rate = limited( cal->write, ctx->throttle.write.rate );
+
+  return ( ( read_rate > 0.0 ) ? ( ( double )read / 1e6 / read_rate ) : 0.0 ) +
+         ( ( write_rate > 0.0 ) ? ( ( double )written / 1e6 / write_rate ) : 0.0 );
+}
+
+
+/* the worker that asks the pool next is the one idle first */
+static uint32_t next_worker( const double* busy, int32_t n_threads )
+{
+  uint32_t w = 0;
+  int32_t i;
+
+  for( i = 1; i < n_threads; i++ )
+  {
+    if( *( busy + i ) < *( busy + w ) )
+    {
+      w = ( uint32_t )i;
+    }
+  }
+
+  return w;
+}
+
+
+/*
+ * a worker takes as long for a track (or chunk) as its stage or
+ * the device alone would, whichever is slower. the workers share
+ * the device, the run takes at least the device time of all bytes.
+ */
+void plan_print( const waver_ctx_t* ctx, const waver_calibration_t* cal,
+                 int32_t n_threads, FILE* out )
+{
+  double busy[ MAX_THREADS ] = { 0.0 };
+  uint32_t chunks_of[ MAX_THREADS ] = { 0 };
+  uint8_t first_of[ MAX_THREADS ];
+  uint8_t last_of[ MAX_THREADS ];
+  const track_t* track = NULL;
+  uint64_t in_len;
+  uint64_t out_len;
+  uint64_t read_total = 0;
+  uint64_t written_total = 0;
+  uint32_t chunks;
+  uint32_t c;
+  uint32_t w;
+  double rate;
+  double time;
+  double start;
+  double end;
+  double makespan = 0.0;
+  double device;
+  uint8_t calibrated = ( cal->kernel > 0.0 || cal->read > 0.0 || cal->write > 0.0 );
+  uint8_t flac = ( ctx->output_format == FORMAT_FLAC );
+  int32_t i;
+
+  fprintf( out, "plan of %u tracks, %s output, %d workers\n\n", ctx->tracks_len,
+           flac ? "flac" : "wav", n_threads );
+  fprintf( out, "track  mode          input bytes               output bytes  %s"
+                "  start (s)    end (s)\n", flac ? "chunks" : "worker" );
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    in_len  = track->endbyte - track->startbyte;
+    out_len = written_bytes( ctx, track );
+    read_total    += in_len;
+    written_total += out_len;
+
+    /* one chunk per track, or BLOCK_SIZE chunks of flac audio in stream order */
+    chunks = 1;
+    if( flac && track->is_audio )
+    {
+      chunks = ( uint32_t )( ( track->size_byte + BLOCK_SIZE - 1 ) / BLOCK_SIZE );
+      chunks = ( chunks > 0 ) ? chunks : 1;
+    }
+
+    rate = stage_rate( ctx, track, cal );
+    time = ( rate > 0.0 ) ? ( ( double )in_len / 1e6 / rate ) : 0.0;
+    time = ( time > io_time( ctx, cal, in_len, out_len ) ) ? time : io_time( ctx, cal, in_len, out_len );
+
+    start = -1.0;
+    end = 0.0;
+    for( c = 0; c < chunks; c++ )
+    {
+      w = next_worker( busy, n_threads );
+      start = ( start < 0.0 ) ? busy[ w ] : start;
+      busy[ w ] += time / chunks;
+      end = ( busy[ w ] > end ) ? busy[ w ] : end;
+      if( chunks_of[ w ]++ == 0 )
+      {
+        first_of[ w ] = track->number;
+      }
+      last_of[ w ] = track->number;
+    }
+    makespan = ( end > makespan ) ? end : makespan;
+
+    fprintf( out, "  %02u   %-12s %10u .. %-10u %12llu  %6u", track->number, track->mode,
+             track->startbyte, track->endbyte, ( unsigned long long )out_len,
+             flac ? chunks : w );
+    if( calibrated )
+    {
+      fprintf( out, "  %9.2f  %9.2f", start, end );
+    }
+    fprintf( out, "\n" );
+  }
+
+  fprintf( out, "\nworker   count  tracks    busy (s)\n" );
+  for( i = 0; i < n_threads; i++ )
+  {
+    if( chunks_of[ i ] == 0 )
+    {
+      fprintf( out, "  %02d    idle\n", i );
+      continue;
+    }
+    fprintf( out, "  %02d    %6u  %02u .. %02u  %8.2f\n", i, chunks_of[ i ],
+             first_of[ i ], last_of[ i ], busy[ i ] );
+  }
+
+  fprintf( out, "\nread %.1f MB of the bin, write %s%.1f MB\n", ( double )read_total / 1e6,
+           flac ? "at most " : "", ( double )written_total / 1e6 );
+
+  if( !calibrated )
+  {
+    fprintf( out, "no calibration, waver -B measures one for a runtime prediction\n" );
+    return;
+  }
+
+  device = io_time( ctx, cal, read_total, written_total );
+  fprintf( out, "predicted runtime: %.2f s (%s bound)\n",
+           ( device > makespan ) ? device : makespan,
+           ( device >= makespan ) ? "device" : "worker" );
+}
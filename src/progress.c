@@ -0,0 +1,386 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    progress.c
+# Purpose: reporter thread of the progress
+#          of a run
+#
+#==========================================
+*/
+
+#include "progress.h"
+#include "waver.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STATUS_TRACK_LEN  80   /* bytes of the JSON of one track, at most */
+#define STATUS_LINE_LEN   ( 256 + ERRMSG_LEN * 6 )  /* without the tracks */
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static double now( void );
+static uint64_t track_done( const track_t* track );
+static void print_time( char* buf, size_t len, double seconds );
+static void draw_bar( progress_t* pr, const waver_ctx_t* ctx, uint64_t done, uint64_t total,
+                      double eta, double idle, uint8_t final );
+static size_t json_string( char* buf, size_t len, const char* str );
+static void write_status( progress_t* pr, const waver_ctx_t* ctx, uint64_t done,
+                          uint64_t total, double eta, double idle, const char* state,
+                          const char* error );
+static void report( progress_t* pr, const waver_ctx_t* ctx, const char* state,
+                    const char* error );
+static void* report_loop( void* arg );
+
+/* ****************************************************************** */
+
+
+static double now( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return ( double )ts.tv_sec + ( double )ts.tv_nsec / 1e9;
+}
+
+
+static uint64_t track_done( const track_t* track )
+{
+  return __atomic_load_n( &track->bytes_done, __ATOMIC_RELAXED );
+}
+
+
+/* m:ss or h:mm:ss */
+static void print_time( char* buf, size_t len, double seconds )
+{
+  unsigned long s = ( unsigned long )( seconds + 0.5 );
+
+  if( s >= 3600 )
+  {
+    snprintf( buf, len, "%lu:%02lu:%02lu", s / 3600, ( s / 60 ) % 60, s % 60 );
+  }
+  else
+  {
+    snprintf( buf, len, "%lu:%02lu", s / 60, s % 60 );
+  }
+}
+
+
+/* one line, redrawn in place. the last one ends it */
+static void draw_bar( progress_t* pr, const waver_ctx_t* ctx, uint64_t done, uint64_t total,
+                      double eta, double idle, uint8_t final )
+{
+  char bar[ PROGRESS_BAR_LEN + 1 ];
+  char time[ 32 ] = "-:--";
+  double share = ( total > 0 ) ? ( ( double )done / ( double )total ) : 1.0;
+  uint32_t filled = ( uint32_t )( share * PROGRESS_BAR_LEN );
+  uint32_t tracks = 0;
+  const track_t* track = NULL;
+  uint8_t i;
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    if( track_done( track ) >= ( uint64_t )( track->endbyte - track->startbyte ) )
+    {
+      tracks++;
+    }
+  }
+
+  memset( bar, '.', PROGRESS_BAR_LEN );
+  memset( bar, '#', ( filled > PROGRESS_BAR_LEN ) ? PROGRESS_BAR_LEN : filled );
+  bar[ PROGRESS_BAR_LEN ] = '\0';
+
+  if( final )
+  {
+    print_time( time, sizeof( time ), ( pr->last_time - pr->start ) );
+  }
+  else if( eta >= 0.0 )
+  {
+    print_time( time, sizeof( time ), eta );
+  }
+
+  if( !final && idle >= PROGRESS_STALL )
+  {
+    fprintf( pr->tty, "\r[%s] %5.1f%%  stalled for %.0f s           %3u/%u tracks ",
+             bar, ( share * 100.0 ), idle, tracks, ctx->tracks_len );
+  }
+  else
+  {
+    fprintf( pr->tty, "\r[%s] %5.1f%%  %7.1f MB/s  %s %-8s  %3u/%u tracks %s", bar,
+             ( share * 100.0 ), ( pr->rate / 1e6 ), ( final ? "took" : "ETA " ), time,
+             tracks, ctx->tracks_len, ( final ? "\n" : "" ) );
+  }
+  fflush( pr->tty );
+}
+
+
+/* str as a JSON string, quotes included. gives its length */
+static size_t json_string( char* buf, size_t len, const char* str )
+{
+  size_t n = 0;
+
+  if( len < 3 )
+  {
+    return 0;
+  }
+
+  *( buf + n++ ) = '"';
+  for( ; *str != '\0' && ( n + 8 ) < len; str++ )
+  {
+    if( *str == '"' || *str == '\\' )
+    {
+      *( buf + n++ ) = '\\';
+      *( buf + n++ ) = *str;
+    }
+    else if( ( unsigned char )*str < 0x20 )
+    {
+      n += ( size_t )snprintf( ( buf + n ), ( len - n ), "\\u%04x", ( unsigned char )*str );
+    }
+    else
+    {
+      *( buf + n++ ) = *str;
+    }
+  }
+  *( buf + n++ ) = '"';
+  *( buf + n ) = '\0';
+
+  return n;
+}
+
+
+/*
+ * one line of JSON, error is the message of a failed run. a
+ * status fd that can't be written (the reader left) is given
+ * up, the run goes on.
+ */
+static void write_status( progress_t* pr, const waver_ctx_t* ctx, uint64_t done,
+                          uint64_t total, double eta, double idle, const char* state,
+                          const char* error )
+{
+  size_t len = STATUS_LINE_LEN + ( size_t )ctx->tracks_len * STATUS_TRACK_LEN;
+  size_t n;
+  size_t from = 0;
+  ssize_t written;
+  const track_t* track = NULL;
+  char* line = NULL;
+  uint8_t i;
+
+  if( ( line = ( char* )malloc( len ) ) == NULL )
+  {
+    return;
+  }
+
+  n = ( size_t )snprintf( line, len, "{\"state\":\"%s\",\"time\":%.3f,\"done\":%llu,"
+                          "\"total\":%llu,\"rate\":%.0f,", state, ( pr->last_time - pr->start ),
+                          ( unsigned long long )done, ( unsigned long long )total, pr->rate );
+  n += ( size_t )( ( eta >= 0.0 ) ? snprintf( ( line + n ), ( len - n ), "\"eta\":%.1f,", eta ) :
+                                    snprintf( ( line + n ), ( len - n ), "\"eta\":null," ) );
+  n += ( size_t )snprintf( ( line + n ), ( len - n ), "\"idle\":%.1f,", idle );
+  if( error != NULL )
+  {
+    n += ( size_t )snprintf( ( line + n ), ( len - n ), "\"error\":" );
+    n += json_string( ( line + n ), ( len - n ), error );
+    *( line + n++ ) = ',';
+  }
+  n += ( size_t )snprintf( ( line + n ), ( len - n ), "\"tracks\":[" );
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    n += ( size_t )snprintf( ( line + n ), ( len - n ),
+                             "%s{\"number\":%u,\"done\":%llu,\"total\":%llu}",
+                             ( ( i > 0 ) ? "," : "" ), track->number,
+                             ( unsigned long long )track_done( track ),
+                             ( unsigned long long )( track->endbyte - track->startbyte ) );
+  }
+  n += ( size_t )snprintf( ( line + n ), ( len - n ), "]}\n" );
+
+  while( n > 0 )
+  {
+    if( ( written = write( pr->fd, ( line + from ), n ) ) < 0 )
+    {
+      if( errno == EINTR )
+      {
+        continue;
+      }
+      pr->fd = (-1);
+      break;
+    }
+    from += ( size_t )written;
+    n    -= ( size_t )written;
+  }
+
+  free( line );
+}
+
+
+/* state NULL: a report while the run goes on */
+static void report( progress_t* pr, const waver_ctx_t* ctx, const char* state,
+                    const char* error )
+{
+  double t = now();
+  double dt = t - pr->last_time;
+  uint64_t done = __atomic_load_n( &ctx->bytes_done, __ATOMIC_RELAXED );
+  uint64_t total = __atomic_load_n( &ctx->bytes_total, __ATOMIC_RELAXED );
+  double rate;
+  double eta = (-1.0);
+
+  if( dt > 0.0 && done >= pr->last_done )
+  {
+    rate = ( double )( done - pr->last_done ) / dt;
+    pr->rate = ( pr->last_time == pr->start ) ? rate :
+               ( PROGRESS_SMOOTH * rate + ( 1.0 - PROGRESS_SMOOTH ) * pr->rate );
+  }
+  if( done != pr->last_done )
+  {
+    pr->moved = t;
+  }
+  pr->last_done = done;
+  pr->last_time = t;
+
+  if( state != NULL )
+  {
+    /* the rate of the whole run */
+    pr->rate = ( t > pr->start ) ? ( ( double )done / ( t - pr->start ) ) : 0.0;
+  }
+  if( pr->rate > 0.0 && total >= done )
+  {
+    eta = ( double )( total - done ) / pr->rate;
+  }
+
+  if( pr->tty != NULL )
+  {
+    draw_bar( pr, ctx, done, total, eta, ( t - pr->moved ), ( state != NULL ) );
+  }
+  if( pr->fd >= 0 &&
+      ( state != NULL || ( t - pr->last_status ) * 1000.0 >= STATUS_INTERVAL ) )
+  {
+    write_status( pr, ctx, done, total, eta, ( t - pr->moved ),
+                  ( state != NULL ) ? state : "running", error );
+    pr->last_status = t;
+  }
+}
+
+
+static void* report_loop( void* arg )
+{
+  waver_ctx_t* ctx = ( waver_ctx_t* )arg;
+  progress_t* pr = &ctx->progress;
+  struct timespec until;
+
+  pthread_mutex_lock( &pr->lock );
+  while( !pr->stop )
+  {
+    clock_gettime( CLOCK_REALTIME, &until );
+    until.tv_sec  += ( until.tv_nsec + PROGRESS_INTERVAL * 1000000L ) / 1000000000L;
+    until.tv_nsec  = ( until.tv_nsec + PROGRESS_INTERVAL * 1000000L ) % 1000000000L;
+    if( pthread_cond_timedwait( &pr->wake, &pr->lock, &until ) != ETIMEDOUT || pr->stop )
+    {
+      continue;
+    }
+
+    pthread_mutex_unlock( &pr->lock );
+    report( pr, ctx, NULL, NULL );
+    pthread_mutex_lock( &pr->lock );
+  }
+  pthread_mutex_unlock( &pr->lock );
+
+  return NULL;
+}
+
+
+waver_status_t progress_init( progress_t* pr )
+{
+  memset( pr, 0, sizeof( progress_t ) );
+  pr->fd = (-1);
+
+  if( pthread_mutex_init( &pr->lock, NULL ) != 0 )
+  {
+    return WAVER_ERR_THREAD;
+  }
+  if( pthread_cond_init( &pr->wake, NULL ) != 0 )
+  {
+    pthread_mutex_destroy( &pr->lock );
+    return WAVER_ERR_THREAD;
+  }
+
+  return WAVER_OK;
+}
+
+
+void progress_destroy( progress_t* pr )
+{
+  pthread_cond_destroy( &pr->wake );
+  pthread_mutex_destroy( &pr->lock );
+}
+
+
+/* after the tracks of the run are laid out, nothing to do without a sink */
+waver_status_t progress_start( progress_t* pr, waver_ctx_t* ctx )
+{
+  pr->running = 0;
+  if( pr->tty == NULL && pr->fd < 0 )
+  {
+    return WAVER_OK;
+  }
+
+  pr->stop        = 0;
+  pr->start       = now();
+  pr->last_time   = pr->start;
+  pr->last_status = pr->start;
+  pr->moved       = pr->start;
+  pr->last_done   = __atomic_load_n( &ctx->bytes_done, __ATOMIC_RELAXED );
+  pr->rate        = 0.0;
+
+  if( pthread_create( &pr->thread, NULL, report_loop, ctx ) != 0 )
+  {
+    return WAVER_ERR_THREAD;
+  }
+  pr->running = 1;
+
+  return WAVER_OK;
+}
+
+
+/* joins the reporter and gives the last report, status of the run */
+void progress_stop( progress_t* pr, waver_ctx_t* ctx, waver_status_t status )
+{
+  const char* state = "done";
+
+  if( !pr->running )
+  {
+    return;
+  }
+
+  pthread_mutex_lock( &pr->lock );
+  pr->stop = 1;
+  pthread_cond_signal( &pr->wake );
+  pthread_mutex_unlock( &pr->lock );
+  pthread_join( pr->thread, NULL );
+  pr->running = 0;
+
+  if( status != WAVER_OK )
+  {
+    state = ( status == WAVER_ERR_CANCELED ) ? "canceled" : "failed";
+  }
+  report( pr, ctx, state, ( status != WAVER_OK ) ? ctx->errmsg : NULL );
+}
@@ -0,0 +1,200 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    readahead.c
+# Purpose: readahead along the track schedule
+#
+#==========================================
+*/
+
+#include "readahead.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static void readahead_issue( readahead_t* ra, uint64_t from, uint64_t to );
+static void readahead_advance( readahead_t* ra );
+
+/* ****************************************************************** */
+
+
+/*
+ * advise the schedule range [from, to). the input ranges of
+ * adjacent tracks are merged into one call.
+ */
+static void readahead_issue( readahead_t* ra, uint64_t from, uint64_t to )
+{
+  uint64_t base = 0;
+  uint64_t len;
+  uint64_t lo;
+  uint64_t hi;
+  uint64_t run_start = 0;
+  uint64_t run_end = 0;
+  uint8_t i;
+
+  for( i = 0; i < ra->tracks_len && base < to; i++ )
+  {
+    len = *( ra->ends + i ) - *( ra->starts + i );
+    if( len > 0 && ( base + len ) > from )
+    {
+      lo = *( ra->starts + i ) + ( ( from > base ) ? ( from - base ) : 0 );
+      hi = *( ra->starts + i ) + ( ( ( base + len ) > to ) ? ( to - base ) : len );
+
+      if( lo != run_end )
+      {
+        if( run_end > run_start )
+        {
+          posix_fadvise( ra->fd, ( off_t )run_start, ( off_t )( run_end - run_start ),
+                         POSIX_FADV_WILLNEED );
+        }
+        run_start = lo;
+      }
+      run_end = hi;
+    }
+    base += len;
+  }
+
+  if( run_end > run_start )
+  {
+    posix_fadvise( ra->fd, ( off_t )run_start, ( off_t )( run_end - run_start ),
+                   POSIX_FADV_WILLNEED );
+  }
+}
+
+
+/*
+ * the lowest position still to be read is the watermark. the
+ * window in front of it is advised in steps of a quarter window,
+ * the end of the schedule at once.
+ * called with the lock held.
+ */
+static void readahead_advance( readahead_t* ra )
+{
+  uint64_t base = 0;
+  uint64_t low = 0;
+  uint64_t len;
+  uint64_t target;
+  uint8_t found = 0;
+  uint8_t i;
+
+  for( i = 0; i < ra->tracks_len; i++ )
+  {
+    len = *( ra->ends + i ) - *( ra->starts + i );
+    if( !found && *( ra->consumed + i ) < len )
+    {
+      low = base + *( ra->consumed + i );
+      found = 1;
+    }
+    base += len;
+  }
+  if( !found )
+  {
+    return;
+  }
+
+  target = ( ( low + ra->window ) < base ) ? ( low + ra->window ) : base;
+  if( target > ra->issued &&
+      ( ( target - ra->issued ) >= ( ra->window / 4 ) || target == base ) )
+  {
+    readahead_issue( ra, ra->issued, target );
+    ra->issued = target;
+  }
+}
+
+
+/*
+ * starts and ends are the input ranges of the tracks in the order
+ * of the pool. without an fd (or window 0) every call is a no-op.
+ */
+waver_status_t readahead_open( readahead_t* ra, int fd, uint64_t window,
+                               const uint64_t* starts, const uint64_t* ends,
+                               uint8_t tracks_len )
+{
+  memset( ra, 0x00, sizeof( readahead_t ) );
+  ra->fd = (-1);
+  if( fd < 0 || window == 0 || tracks_len == 0 )
+  {
+    return WAVER_OK;
+  }
+
+  if( ( ra->starts = ( uint64_t* )calloc( tracks_len, sizeof( uint64_t ) ) ) == NULL ||
+      ( ra->ends = ( uint64_t* )calloc( tracks_len, sizeof( uint64_t ) ) ) == NULL ||
+      ( ra->consumed = ( uint64_t* )calloc( tracks_len, sizeof( uint64_t ) ) ) == NULL )
+  {
+    readahead_close( ra );
+    return WAVER_ERR_NOMEM;
+  }
+  if( pthread_mutex_init( &ra->lock, NULL ) != 0 )
+  {
+    readahead_close( ra );
+    return WAVER_ERR_THREAD;
+  }
+
+  memcpy( ra->starts, starts, sizeof( uint64_t ) * tracks_len );
+  memcpy( ra->ends, ends, sizeof( uint64_t ) * tracks_len );
+  ra->tracks_len = tracks_len;
+  ra->window     = window;
+  ra->fd         = fd;
+
+  /* the kernel's own readahead doubles for sequential files */
+  posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+  pthread_mutex_lock( &ra->lock );
+  readahead_advance( ra );
+  pthread_mutex_unlock( &ra->lock );
+
+  return WAVER_OK;
+}
+
+
+void readahead_close( readahead_t* ra )
+{
+  if( ra->fd >= 0 )
+  {
+    pthread_mutex_destroy( &ra->lock );
+  }
+  ra->fd = (-1);
+
+  free( ra->starts );
+  free( ra->ends );
+  free( ra->consumed );
+  ra->starts   = NULL;
+  ra->ends     = NULL;
+  ra->consumed = NULL;
+}
+
+
+/* the first len bytes of the track idx are read (or skipped) */
+void readahead_consumed( readahead_t* ra, uint8_t idx, uint64_t len )
+{
+  if( ra->fd < 0 || idx >= ra->tracks_len )
+  {
+    return;
+  }
+
+  pthread_mutex_lock( &ra->lock );
+  if( len > *( ra->consumed + idx ) )
+  {
+    *( ra->consumed + idx ) = len;
+    readahead_advance( ra );
+  }
+  pthread_mutex_unlock( &ra->lock );
+}
@@ -0,0 +1,333 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    resample.c
+# Purpose: polyphase sample rate conversion
+#
+#==========================================
+*/
+
+#include "resample.h"
+#include "waver.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* "private" defines */
+#define RESAMPLE_HALF  ( RESAMPLE_TAPS / 2 )
+
+/* "private" function prototypes */
+static uint32_t gcd( uint32_t a, uint32_t b );
+static double bessel_i0( double x );
+static inline float dot_taps( const float* taps, const float* x );
+static inline char* store_sample( float y, char* dst, uint8_t format );
+
+/* ****************************************************************** */
+
+
+static uint32_t gcd( uint32_t a, uint32_t b )
+{
+  uint32_t t;
+
+  while( b != 0 )
+  {
+    t = a % b;
+    a = b;
+    b = t;
+  }
+
+  return a;
+}
+
+
+/* modified bessel function of the first kind, order 0 (series) */
+static double bessel_i0( double x )
+{
+  double sum = 1.0;
+  double term = 1.0;
+  uint32_t k;
+
+  for( k = 1; k < 64 && term > ( sum * 1e-14 ); k++ )
+  {
+    term *= ( x / ( 2.0 * k ) ) * ( x / ( 2.0 * k ) );
+    sum += term;
+  }
+
+  return sum;
+}
+
+
+/*
+ * eight partial sums, the compiler keeps them in one vector
+ * register and the loop becomes packed multiply-adds.
+ */
+static inline float dot_taps( const float* taps, const float* x )
+{
+  float acc[ 8 ] = { 0.0f };
+  uint32_t k;
+  uint32_t j;
+
+  for( k = 0; k < RESAMPLE_TAPS; k += 8 )
+  {
+    for( j = 0; j < 8; j++ )
+    {
+      acc[ j ] += *( taps + k + j ) * *( x + k + j );
+    }
+  }
+
+  return ( ( acc[ 0 ] + acc[ 4 ] ) + ( acc[ 1 ] + acc[ 5 ] ) ) +
+         ( ( acc[ 2 ] + acc[ 6 ] ) + ( acc[ 3 ] + acc[ 7 ] ) );
+}
+
+
+/* one output sample, rounded and clipped to the integer formats */
+static inline char* store_sample( float y, char* dst, uint8_t format )
+{
+  int32_t wide;
+  double scaled;
+
+  if( format == WAVER_SAMPLES_F32 )
+  {
+    memcpy( dst, &y, sizeof( float ) );
+    return ( dst + 4 );
+  }
+
+  scaled = ( double )y * ( ( format == WAVER_SAMPLES_S16 ) ? 32768.0 :
+                           ( format == WAVER_SAMPLES_S24 ) ? 8388608.0 : 2147483648.0 );
+  scaled = nearbyint( scaled );
+
+  if( format == WAVER_SAMPLES_S16 )
+  {
+    wide = ( scaled > 32767.0 ) ? 32767 : ( scaled < -32768.0 ) ? -32768 : ( int32_t )scaled;
+    *( dst )     = ( char )( wide & 0xFF );
+    *( dst + 1 ) = ( char )( ( wide >> 8 ) & 0xFF );
+    return ( dst + 2 );
+  }
+  if( format == WAVER_SAMPLES_S24 )
+  {
+    wide = ( scaled > 8388607.0 ) ? 8388607 : ( scaled < -8388608.0 ) ? -8388608 :
+                                               ( int32_t )scaled;
+    *( dst )     = ( char )( wide & 0xFF );
+    *( dst + 1 ) = ( char )( ( wide >> 8 ) & 0xFF );
+    *( dst + 2 ) = ( char )( ( wide >> 16 ) & 0xFF );
+    return ( dst + 3 );
+  }
+
+  wide = ( scaled > 2147483647.0 ) ? INT32_MAX : ( scaled < -2147483648.0 ) ? INT32_MIN :
+                                                 ( int32_t )scaled;
+  memcpy( dst, &wide, sizeof( int32_t ) );
+
+  return ( dst + 4 );
+}
+
+
+/*
+ * the bank of in_rate -> out_rate. the phase p of output frame m
+ * is ( m * down ) % up, its taps weigh the input frames base - 31
+ * .. base + 32 around base = ( m * down ) / up. the cutoff is below
+ * the lower of the rates, every row sums to 1 (no ripple of dc).
+ */
+waver_status_t resample_bank_init( resample_bank_t* bank, uint32_t in_rate,
+                                   uint32_t out_rate )
+{
+  uint32_t g;
+  uint32_t p;
+  uint32_t i;
+  double cutoff;
+  double u;
+  double x;
+  double h;
+  double sum;
+  double norm;
+  float* row = NULL;
+
+  memset( bank, 0x00, sizeof( resample_bank_t ) );
+
+  if( in_rate == 0 || out_rate == 0 )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  g = gcd( in_rate, out_rate );
+  bank->up   = out_rate / g;
+  bank->down = in_rate / g;
+  if( bank->up > RESAMPLE_MAX_PHASES )
+  {
+    return WAVER_ERR_ARG;
+  }
+
+  if( ( bank->taps = ( float* )malloc( ( size_t )bank->up * RESAMPLE_TAPS *
+                                       sizeof( float ) ) ) == NULL )
+  {
+    return WAVER_ERR_NOMEM;
+  }
+
+  /* cycles per input frame */
+  cutoff = RESAMPLE_CUTOFF * ( ( out_rate < in_rate ) ? ( ( double )out_rate / in_rate ) : 1.0 );
+  norm = bessel_i0( RESAMPLE_BETA );
+
+  for( p = 0; p < bank->up; p++ )
+  {
+    row = ( bank->taps + ( ( size_t )p * RESAMPLE_TAPS ) );
+    sum = 0.0;
+
+    for( i = 0; i < RESAMPLE_TAPS; i++ )
+    {
+      /* distance of the output to input frame i, in input frames */
+      u = ( double )( RESAMPLE_HALF - 1 ) - i + ( ( double )p / bank->up );
+      x = u / RESAMPLE_HALF;
+
+      h = ( u == 0.0 ) ? 1.0 : sin( 2.0 * M_PI * cutoff * u ) / ( 2.0 * M_PI * cutoff * u );
+      h *= ( x > -1.0 && x < 1.0 ) ? ( bessel_i0( RESAMPLE_BETA * sqrt( 1.0 - x * x ) ) / norm ) :
+                                     0.0;
+      *( row + i ) = ( float )h;
+      sum += h;
+    }
+
+    for( i = 0; i < RESAMPLE_TAPS; i++ )
+    {
+      *( row + i ) = ( float )( *( row + i ) / sum );
+    }
+  }
+
+  return WAVER_OK;
+}
+
+
+void resample_bank_release( resample_bank_t* bank )
+{
+  free( bank->taps );
+  bank->taps = NULL;
+}
+
+
+/* output frames of a track of in_frames, up to its last input frame */
+uint64_t resample_frames( const resample_bank_t* bank, uint64_t in_frames )
+{
+  return ( ( in_frames * bank->up ) + bank->down - 1 ) / bank->down;
+}
+
+
+/* output frames of one call of RESAMPLE_BLOCK input frames (max) */
+uint32_t resample_max_out( const resample_bank_t* bank )
+{
+  return ( uint32_t )( ( ( uint64_t )( RESAMPLE_BLOCK + RESAMPLE_TAPS ) * bank->up ) /
+                       bank->down ) + 2;
+}
+
+
+/* the input before the track is silence */
+waver_status_t resample_open( resample_state_t* state, const resample_bank_t* bank,
+                              uint64_t in_frames )
+{
+  size_t cap = RESAMPLE_TAPS + RESAMPLE_BLOCK + RESAMPLE_HALF;
+
+  memset( state, 0x00, sizeof( resample_state_t ) );
+  state->bank = bank;
+
+  if( ( state->left = ( float* )calloc( cap, sizeof( float ) ) ) == NULL ||
+      ( state->right = ( float* )calloc( cap, sizeof( float ) ) ) == NULL )
+  {
+    resample_close( state );
+    return WAVER_ERR_NOMEM;
+  }
+
+  state->len   = RESAMPLE_HALF;
+  state->first = -RESAMPLE_HALF;
+  state->total = resample_frames( bank, in_frames );
+
+  return WAVER_OK;
+}
+
+
+void resample_close( resample_state_t* state )
+{
+  free( state->left );
+  state->left = NULL;
+  free( state->right );
+  state->right = NULL;
+}
+
+
+/*
+ * appends frames (RESAMPLE_BLOCK max) of 16 bit stereo samples in
+ * src, silence behind the last ones, and writes the output frames
+ * their input is complete for to dst in format. returns the number
+ * of output frames, at most resample_max_out.
+ */
+uint32_t resample_run( resample_state_t* state, const char* src, uint32_t frames,
+                       uint8_t last, char* dst, uint8_t format )
+{
+  const resample_bank_t* bank = state->bank;
+  const float* taps = NULL;
+  int16_t sample[ CHANNELS ];
+  uint64_t pos;
+  int64_t base;
+  int64_t drop;
+  uint32_t at;
+  uint32_t out = 0;
+  uint32_t i;
+
+  for( i = 0; i < frames; i++ )
+  {
+    memcpy( sample, ( src + ( ( size_t )i * EFFECTIVE_BYTES ) ), EFFECTIVE_BYTES );
+    *( state->left + state->len + i )  = ( float )sample[ 0 ] * ( 1.0f / 32768.0f );
+    *( state->right + state->len + i ) = ( float )sample[ 1 ] * ( 1.0f / 32768.0f );
+  }
+  state->len += frames;
+
+  if( last )
+  {
+    memset( ( state->left + state->len ), 0x00, RESAMPLE_HALF * sizeof( float ) );
+    memset( ( state->right + state->len ), 0x00, RESAMPLE_HALF * sizeof( float ) );
+    state->len += RESAMPLE_HALF;
+  }
+
+  for( ; state->next < state->total; state->next++ )
+  {
+    pos  = state->next * bank->down;
+    base = ( int64_t )( pos / bank->up );
+    if( ( base + RESAMPLE_HALF ) >= ( state->first + state->len ) )
+    {
+      break;
+    }
+
+    at   = ( uint32_t )( base - RESAMPLE_HALF + 1 - state->first );
+    taps = ( bank->taps + ( ( size_t )( pos % bank->up ) * RESAMPLE_TAPS ) );
+    dst  = store_sample( dot_taps( taps, ( state->left + at ) ), dst, format );
+    dst  = store_sample( dot_taps( taps, ( state->right + at ) ), dst, format );
+    out++;
+  }
+
+  /* keep the input of the next output frame */
+  base = ( int64_t )( ( state->next * bank->down ) / bank->up );
+  drop = base - RESAMPLE_HALF + 1 - state->first;
+  if( drop > ( int64_t )state->len )
+  {
+    drop = state->len;
+  }
+  if( drop > 0 )
+  {
+    memmove( state->left, ( state->left + drop ), ( state->len - drop ) * sizeof( float ) );
+    memmove( state->right, ( state->right + drop ), ( state->len - drop ) * sizeof( float ) );
+    state->first += drop;
+    state->len   -= ( uint32_t )drop;
+  }
+
+  return out;
+}
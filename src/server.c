@@ -0,0 +1,933 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    server.c
+# Purpose: job queue on a UNIX socket
+#
+#==========================================
+*/
+
+#include "server.h"
+
+#include <errno.h>
+#include <malloc.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* "private" defines */
+#define JOB_FREE      0
+#define JOB_QUEUED    1
+#define JOB_RUNNING   2
+#define JOB_DONE      3
+#define JOB_FAILED    4
+#define JOB_CANCELED  5
+
+#define JOB_ERR_LEN   256
+#define MSG_LEN       512
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  uint32_t         id;         /* 0: free slot */
+  uint8_t          state;
+  int32_t          priority;   /* higher runs first, then in order */
+
+  /* options of the conversion */
+  char             binfile[ PATH_LEN ];
+  char             cuefile[ PATH_LEN ];
+  char             base_name[ NAME_LEN ];
+  uint8_t          format;
+  uint8_t          sample_format;
+  uint32_t         sample_rate;
+  uint8_t          loudness;
+  uint8_t          swap_bytes;
+  uint8_t          gaps;
+  uint8_t          sparse;
+  uint8_t          reflink;
+  int32_t          offset;
+  int32_t          n_threads;
+  uint8_t          adaptive;   /* n_threads is the most */
+  uint64_t         read_limit;   /* bytes per second, 0 = unlimited */
+  uint64_t         write_limit;
+  uint32_t         iops_limit;
+  uint8_t          io_class;
+  uint8_t          io_level;
+  int8_t           nice;
+
+  /* state and metrics */
+  waver_ctx_t*     ctx;        /* while it runs */
+  uint8_t          cancel;
+  uint64_t         done;
+  uint64_t         total;
+  struct timespec  start;
+  struct timespec  end;
+  char             errmsg[ JOB_ERR_LEN ];
+
+} job_t;
+
+
+typedef struct
+{
+
+  server_options_t  options;
+  int               fd;
+  uint8_t           stop;
+  uint32_t          next_id;
+  job_t             jobs[ SERVER_MAX_JOBS ];
+  pthread_t         runners[ SERVER_MAX_RUNNERS ];
+  pthread_mutex_t   lock;
+  pthread_cond_t    queued;
+
+} server_t;
+
+
+/* set by SIGINT and SIGTERM, the accept loop ends */
+static volatile sig_atomic_t stop_signal = 0;
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static void on_signal( int signo );
+static double elapsed( const struct timespec* from, const struct timespec* to );
+static const char* state_name( uint8_t state );
+static uint8_t is_archive( const char* file );
+static job_t* find_job( server_t* server, uint32_t id );
+static job_t* next_job( server_t* server );
+static job_t* free_slot( server_t* server );
+static void run_job( server_t* server, job_t* job );
+static void* run_jobs( void* arg );
+static int parse_job( job_t* job, char* args, char* msg );
+static void reply( int fd, const char* fmt, ... )
+  __attribute__( ( format( printf, 2, 3 ) ) );
+static void reply_job( int fd, job_t* job );
+static void handle_submit( server_t* server, int fd, char* args );
+static void handle_cancel( server_t* server, int fd, char* args );
+static void handle_status( server_t* server, int fd, char* args );
+static uint8_t handle_client( server_t* server, int fd );
+static int open_socket( const char* socket_path );
+
+/* ****************************************************************** */
+
+
+static void on_signal( int signo )
+{
+  ( void )signo;
+  stop_signal = 1;
+}
+
+
+static double elapsed( const struct timespec* from, const struct timespec* to )
+{
+  return ( double )( to->tv_sec - from->tv_sec ) +
+         ( double )( to->tv_nsec - from->tv_nsec ) / 1e9;
+}
+
+
+static const char* state_name( uint8_t state )
+{
+  switch( state )
+  {
+    case JOB_QUEUED:   return "queued";
+    case JOB_RUNNING:  return "running";
+    case JOB_DONE:     return "done";
+    case JOB_FAILED:   return "failed";
+    case JOB_CANCELED: return "canceled";
+    default:           return "unknown";
+  }
+}
+
+
+/* a zstd or xz archive of the bin, by its name */
+static uint8_t is_archive( const char* file )
+{
+  size_t len = strlen( file );
+
+  return ( ( len > 4 && strcmp( ( file + len - 4 ), ".zst" ) == 0 ) ||
+           ( len > 3 && strcmp( ( file + len - 3 ), ".xz" ) == 0 ) );
+}
+
+
+/* called with the lock held */
+static job_t* find_job( server_t* server, uint32_t id )
+{
+  uint32_t i;
+
+  for( i = 0; i < SERVER_MAX_JOBS && id != 0; i++ )
+  {
+    if( server->jobs[ i ].id == id )
+    {
+      return &server->jobs[ i ];
+    }
+  }
+
+  return NULL;
+}
+
+
+/* highest priority first, the oldest of equals. called with the lock held */
+static job_t* next_job( server_t* server )
+{
+  job_t* best = NULL;
+  job_t* job = NULL;
+  uint32_t i;
+
+  for( i = 0; i < SERVER_MAX_JOBS; i++ )
+  {
+    job = &server->jobs[ i ];
+    if( job->state == JOB_QUEUED &&
+        ( best == NULL || job->priority > best->priority ||
+          ( job->priority == best->priority && job->id < best->id ) ) )
+    {
+      best = job;
+    }
+  }
+
+  return best;
+}
+
+
+/* a free slot, or the one of the oldest finished job. called with the lock held */
+static job_t* free_slot( server_t* server )
+{
+  job_t* oldest = NULL;
+  job_t* job = NULL;
+  uint32_t i;
+
+  for( i = 0; i < SERVER_MAX_JOBS; i++ )
+  {
+    job = &server->jobs[ i ];
+    if( job->state == JOB_FREE )
+    {
+      return job;
+    }
+    if( job->state >= JOB_DONE && ( oldest == NULL || job->id < oldest->id ) )
+    {
+      oldest = job;
+    }
+  }
+
+  return oldest;
+}
+
+
+/* the conversion of one job, like main() of the program does it */
+static void run_job( server_t* server, job_t* job )
+{
+  waver_ctx_t* ctx = NULL;
+  waver_input_t input;
+  waver_output_t output;
+  waver_status_t status = WAVER_ERR_NOMEM;
+  char errmsg[ JOB_ERR_LEN ] = "memory allocation failure";
+
+  if( waver_create( &ctx ) == WAVER_OK )
+  {
+    if( ( status = ( is_archive( job->binfile ) ?
+                     waver_input_compressed( &input, job->binfile ) :
+                     waver_input_file( &input, job->binfile ) ) ) != WAVER_OK )
+    {
+      snprintf( errmsg, JOB_ERR_LEN, "Failed to open bin file: %s",
+                waver_strerror( status ) );
+    }
+    else
+    {
+      waver_set_input( ctx, &input );
+      if( ( status = waver_output_files( &output, job->base_name ) ) != WAVER_OK )
+      {
+        snprintf( errmsg, JOB_ERR_LEN, "Failed to create output: %s",
+                  waver_strerror( status ) );
+      }
+      else
+      {
+        waver_set_output( ctx, &output );
+        if( ( status = waver_set_cue_file( ctx, job->cuefile ) ) != WAVER_OK )
+        {
+          snprintf( errmsg, JOB_ERR_LEN, "Failed to read cue file" );
+        }
+      }
+    }
+  }
+
+  if( status == WAVER_OK )
+  {
+    waver_set_threads( ctx, job->n_threads );
+    waver_set_adaptive( ctx, job->adaptive );
+    waver_set_swap( ctx, job->swap_bytes );
+    waver_set_format( ctx, job->format );
+    waver_set_log( ctx, ( server->options.verbose ? stdout : NULL ),
+                   server->options.verbose );
+    waver_set_gaps( ctx, job->gaps );
+    waver_set_offset( ctx, job->offset );
+    waver_set_sparse( ctx, job->sparse );
+    waver_set_reflink( ctx, job->reflink );
+    waver_set_sample_format( ctx, job->sample_format );
+    waver_set_loudness( ctx, job->loudness );
+    waver_set_throttle( ctx, job->read_limit, job->write_limit, job->iops_limit );
+    waver_set_priority( ctx, job->io_class, job->io_level, job->nice );
+
+    /* from here on CANCEL and STATUS see the context */
+    pthread_mutex_lock( &server->lock );
+    job->ctx = ctx;
+    if( job->cancel || server->stop )
+    {
+      waver_cancel( ctx );
+    }
+    pthread_mutex_unlock( &server->lock );
+
+    if( ( status = waver_set_sample_rate( ctx, job->sample_rate ) ) != WAVER_OK ||
+        ( status = waver_run( ctx ) ) != WAVER_OK )
+    {
+      snprintf( errmsg, JOB_ERR_LEN, "%s", waver_error_message( ctx ) );
+    }
+  }
+
+  pthread_mutex_lock( &server->lock );
+  if( ctx != NULL )
+  {
+    waver_progress( ctx, &job->done, &job->total );
+  }
+  job->ctx = NULL;
+  clock_gettime( CLOCK_MONOTONIC, &job->end );
+  if( status == WAVER_OK )
+  {
+    job->state = JOB_DONE;
+  }
+  else
+  {
+    job->state = ( status == WAVER_ERR_CANCELED ) ? JOB_CANCELED : JOB_FAILED;
+    snprintf( job->errmsg, JOB_ERR_LEN, "%s", errmsg );
+  }
+  fprintf( stdout, "job %u %s after %.3f s%s%s\n", job->id, state_name( job->state ),
+           elapsed( &job->start, &job->end ),
+           ( status == WAVER_OK ) ? "" : ": ", ( status == WAVER_OK ) ? "" : errmsg );
+  fflush( stdout );
+  pthread_mutex_unlock( &server->lock );
+
+  waver_destroy( ctx );
+}
+
+
+/* thread function, runs queued jobs until the server stops */
+static void* run_jobs( void* arg )
+{
+  server_t* server = ( server_t* )arg;
+  job_t* job = NULL;
+
+  for( ;; )
+  {
+    /* critical section. take the next job of the queue */
+    /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
+    pthread_mutex_lock( &server->lock );
+    while( !server->stop && ( job = next_job( server ) ) == NULL )
+    {
+      pthread_cond_wait( &server->queued, &server->lock );
+    }
+    if( server->stop )
+    {
+      pthread_mutex_unlock( &server->lock );
+      break;
+    }
+    job->state = JOB_RUNNING;
+    clock_gettime( CLOCK_MONOTONIC, &job->start );
+    pthread_mutex_unlock( &server->lock );
+    /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
+
+    run_job( server, job );
+  }
+
+  return NULL;
+}
+
+
+/* key=value arguments of SUBMIT, msg gets the reason of a failure */
+static int parse_job( job_t* job, char* args, char* msg )
+{
+  char* save = NULL;
+  char* token = NULL;
+  char* value = NULL;
+  char* end = NULL;
+  long number;
+
+  for( token = strtok_r( args, " \t", &save ); token != NULL;
+       token = strtok_r( NULL, " \t", &save ) )
+  {
+    if( ( value = strchr( token, '=' ) ) == NULL )
+    {
+      snprintf( msg, MSG_LEN, "argument without value: %.64s", token );
+      return (-1);
+    }
+    *value = '\0';
+    value++;
+
+    errno = 0;
+    number = strtol( value, &end, 10 );
+
+    if( strcmp( token, "bin" ) == 0 || strcmp( token, "cue" ) == 0 ||
+        strcmp( token, "name" ) == 0 )
+    {
+      if( ( strlen( value ) + 1 ) > ( ( *token == 'n' ) ? ( NAME_LEN - 4 ) : PATH_LEN ) )
+      {
+        snprintf( msg, MSG_LEN, "%s too long", token );
+        return (-1);
+      }
+      strcpy( ( *token == 'b' ) ? job->binfile :
+              ( ( *token == 'c' ) ? job->cuefile : job->base_name ), value );
+    }
+    else if( strcmp( token, "format" ) == 0 &&
+             ( strcasecmp( value, "wav" ) == 0 || strcasecmp( value, "flac" ) == 0 ) )
+    {
+      job->format = ( strcasecmp( value, "flac" ) == 0 ) ? WAVER_FORMAT_FLAC : WAVER_FORMAT_WAV;
+    }
+    else if( strcmp( token, "gaps" ) == 0 )
+    {
+      if( strcasecmp( value, "omit" ) == 0 )
+      {
+        job->gaps = WAVER_GAPS_OMIT;
+      }
+      else if( strcasecmp( value, "append" ) == 0 )
+      {
+        job->gaps = WAVER_GAPS_APPEND;
+      }
+      else if( strcasecmp( value, "prepend" ) == 0 )
+      {
+        job->gaps = WAVER_GAPS_PREPEND;
+      }
+      else if( strcasecmp( value, "htoa" ) == 0 )
+      {
+        job->gaps = WAVER_GAPS_HTOA;
+      }
+      else
+      {
+        snprintf( msg, MSG_LEN, "unknown gap policy" );
+        return (-1);
+      }
+    }
+    else if( strcmp( token, "samples" ) == 0 )
+    {
+      if( strcasecmp( value, "s16" ) == 0 )
+      {
+        job->sample_format = WAVER_SAMPLES_S16;
+      }
+      else if( strcasecmp( value, "s24" ) == 0 )
+      {
+        job->sample_format = WAVER_SAMPLES_S24;
+      }
+      else if( strcasecmp( value, "s32" ) == 0 )
+      {
+        job->sample_format = WAVER_SAMPLES_S32;
+      }
+      else if( strcasecmp( value, "f32" ) == 0 )
+      {
+        job->sample_format = WAVER_SAMPLES_F32;
+      }
+      else
+      {
+        snprintf( msg, MSG_LEN, "unknown sample format" );
+        return (-1);
+      }
+    }
+    else if( strcmp( token, "loudness" ) == 0 )
+    {
+      if( strcasecmp( value, "json" ) == 0 )
+      {
+        job->loudness = WAVER_LOUDNESS_JSON;
+      }
+      else if( strcasecmp( value, "cue" ) == 0 )
+      {
+        job->loudness = WAVER_LOUDNESS_CUE;
+      }
+      else
+      {
+        snprintf( msg, MSG_LEN, "unknown loudness sidecar" );
+        return (-1);
+      }
+    }
+    else if( strcmp( token, "threads" ) == 0 && strcasecmp( value, "auto" ) == 0 )
+    {
+      job->adaptive = 1;
+    }
+    else if( strcmp( token, "ioprio" ) == 0 )
+    {
+      if( strcasecmp( value, "idle" ) == 0 )
+      {
+        job->io_class = WAVER_IOPRIO_IDLE;
+      }
+      else if( strcasecmp( value, "be" ) == 0 )
+      {
+        job->io_class = WAVER_IOPRIO_BE;
+      }
+      else if( strncasecmp( value, "be:", 3 ) == 0 && *( value + 3 ) >= '0' &&
+               *( value + 3 ) <= '7' && *( value + 4 ) == '\0' )
+      {
+        job->io_class = WAVER_IOPRIO_BE;
+        job->io_level = ( uint8_t )( *( value + 3 ) - '0' );
+      }
+      else
+      {
+        snprintf( msg, MSG_LEN, "unknown i/o class" );
+        return (-1);
+      }
+    }
+    else if( *value == '\0' || *end != '\0' || errno != 0 )
+    {
+      snprintf( msg, MSG_LEN, "invalid argument: %.64s", token );
+      return (-1);
+    }
+    else if( strcmp( token, "prio" ) == 0 )
+    {
+      job->priority = ( int32_t )number;
+    }
+    else if( strcmp( token, "threads" ) == 0 && number >= 0 && number <= MAX_THREADS )
+    {
+      job->n_threads = ( int32_t )number;
+    }
+    else if( strcmp( token, "offset" ) == 0 && number >= -MAX_OFFSET && number <= MAX_OFFSET )
+    {
+      job->offset = ( int32_t )number;
+    }
+    else if( strcmp( token, "rate" ) == 0 && number >= WAVER_RATE_MIN &&
+             number <= WAVER_RATE_MAX )
+    {
+      job->sample_rate = ( uint32_t )number;
+    }
+    else if( strcmp( token, "swap" ) == 0 )
+    {
+      job->swap_bytes = ( number != 0 );
+    }
+    else if( strcmp( token, "sparse" ) == 0 )
+    {
+      job->sparse = ( number != 0 );
+    }
+    else if( strcmp( token, "reflink" ) == 0 )
+    {
+      job->reflink = ( number != 0 );
+    }
+    else if( ( strcmp( token, "read" ) == 0 || strcmp( token, "write" ) == 0 ) &&
+             number >= 0 && number <= UINT32_MAX )
+    {
+      *( ( *token == 'r' ) ? &job->read_limit : &job->write_limit ) =
+        ( uint64_t )number * 1000000;
+    }
+    else if( strcmp( token, "iops" ) == 0 && number >= 0 && number <= UINT32_MAX )
+    {
+      job->iops_limit = ( uint32_t )number;
+    }
+    else if( strcmp( token, "nice" ) == 0 && number >= -20 && number <= 19 )
+    {
+      job->nice = ( int8_t )number;
+    }
+    else
+    {
+      snprintf( msg, MSG_LEN, "invalid argument: %.64s", token );
+      return (-1);
+    }
+  }
+
+  if( job->binfile[ 0 ] == '\0' || job->cuefile[ 0 ] == '\0' || job->base_name[ 0 ] == '\0' )
+  {
+    snprintf( msg, MSG_LEN, "bin, cue and name are required" );
+    return (-1);
+  }
+  if( access( job->binfile, R_OK ) != 0 || access( job->cuefile, R_OK ) != 0 )
+  {
+    snprintf( msg, MSG_LEN, "bin or cue file not readable" );
+    return (-1);
+  }
+
+  return 0;
+}
+
+
+/* the client may be gone, its answer is lost then */
+static void reply( int fd, const char* fmt, ... )
+{
+  char line[ MSG_LEN + JOB_ERR_LEN ];
+  va_list args;
+  int len;
+
+  va_start( args, fmt );
+  len = vsnprintf( line, sizeof( line ), fmt, args );
+  va_end( args );
+
+  if( len > 0 )
+  {
+    len = ( len < ( int )sizeof( line ) ) ? len : ( int )( sizeof( line ) - 1 );
+    if( send( fd, line, ( size_t )len, MSG_NOSIGNAL ) < 0 )
+    {
+      return;
+    }
+  }
+}
+
+
+/* one line per job, with the progress of a running one. called with the lock held */
+static void reply_job( int fd, job_t* job )
+{
+  struct timespec now;
+  uint64_t done = job->done;
+  uint64_t total = job->total;
+  double seconds = 0.0;
+
+  if( job->state == JOB_RUNNING )
+  {
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    seconds = elapsed( &job->start, &now );
+    if( job->ctx != NULL )
+    {
+      waver_progress( job->ctx, &done, &total );
+    }
+  }
+  else if( job->state != JOB_QUEUED && job->start.tv_sec != 0 )
+  {
+    seconds = elapsed( &job->start, &job->end );
+  }
+
+  reply( fd, "JOB %u %s prio=%d done=%llu total=%llu elapsed=%.3f rate=%.1f%s%s%s\n",
+         job->id, state_name( job->state ), job->priority,
+         ( unsigned long long )done, ( unsigned long long )total, seconds,
+         ( seconds > 0.0 ) ? ( ( double )done / ( 1024.0 * 1024.0 ) / seconds ) : 0.0,
+         ( job->errmsg[ 0 ] != '\0' ) ? " error=\"" : "", job->errmsg,
+         ( job->errmsg[ 0 ] != '\0' ) ? "\"" : "" );
+}
+
+
+static void handle_submit( server_t* server, int fd, char* args )
+{
+  job_t parsed;
+  job_t* job = NULL;
+  char msg[ MSG_LEN ] = { '\0' };
+
+  memset( &parsed, 0x00, sizeof( job_t ) );
+  parsed.n_threads = server->options.n_threads;
+  parsed.adaptive  = server->options.adaptive;
+  parsed.gaps      = WAVER_GAPS_OMIT;
+  parsed.format    = WAVER_FORMAT_WAV;
+  parsed.sample_rate = SAMPLING_RATE;
+  parsed.io_level  = 4;
+
+  if( parse_job( &parsed, args, msg ) != 0 )
+  {
+    reply( fd, "ERR %s\n", msg );
+    return;
+  }
+
+  pthread_mutex_lock( &server->lock );
+  if( ( job = free_slot( server ) ) == NULL )
+  {
+    pthread_mutex_unlock( &server->lock );
+    reply( fd, "ERR queue full\n" );
+    return;
+  }
+  *job = parsed;
+  job->id    = server->next_id++;
+  job->state = JOB_QUEUED;
+  pthread_cond_signal( &server->queued );
+
+  fprintf( stdout, "job %u queued: %s, priority %d\n", job->id, job->base_name,
+           job->priority );
+  fflush( stdout );
+  reply( fd, "OK %u\n", job->id );
+  pthread_mutex_unlock( &server->lock );
+}
+
+
+/* a queued job is dropped, a running one stops after its current pieces */
+static void handle_cancel( server_t* server, int fd, char* args )
+{
+  job_t* job = NULL;
+
+  pthread_mutex_lock( &server->lock );
+  if( ( job = find_job( server, ( uint32_t )strtoul( args, NULL, 10 ) ) ) == NULL )
+  {
+    reply( fd, "ERR unknown job\n" );
+  }
+  else if( job->state == JOB_QUEUED )
+  {
+    job->state = JOB_CANCELED;
+    snprintf( job->errmsg, JOB_ERR_LEN, "canceled" );
+    reply( fd, "OK\n" );
+  }
+  else if( job->state == JOB_RUNNING )
+  {
+    job->cancel = 1;
+    if( job->ctx != NULL )
+    {
+      waver_cancel( job->ctx );
+    }
+    reply( fd, "OK\n" );
+  }
+  else
+  {
+    reply( fd, "ERR job %s\n", state_name( job->state ) );
+  }
+  pthread_mutex_unlock( &server->lock );
+}
+
+
+static void handle_status( server_t* server, int fd, char* args )
+{
+  job_t* job = NULL;
+  uint32_t i;
+
+  pthread_mutex_lock( &server->lock );
+  if( *args != '\0' )
+  {
+    if( ( job = find_job( server, ( uint32_t )strtoul( args, NULL, 10 ) ) ) == NULL )
+    {
+      reply( fd, "ERR unknown job\n" );
+    }
+    else
+    {
+      reply_job( fd, job );
+    }
+  }
+  else
+  {
+    for( i = 0; i < SERVER_MAX_JOBS; i++ )
+    {
+      if( server->jobs[ i ].state != JOB_FREE )
+      {
+        reply_job( fd, &server->jobs[ i ] );
+      }
+    }
+    reply( fd, "END\n" );
+  }
+  pthread_mutex_unlock( &server->lock );
+}
+
+
+/* one request of a client, returns 1 on SHUTDOWN */
+static uint8_t handle_client( server_t* server, int fd )
+{
+  char line[ SERVER_LINE_LEN ];
+  struct timeval timeout = { SERVER_TIMEOUT, 0 };
+  size_t len = 0;
+  ssize_t got;
+  char* args = NULL;
+
+  setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+
+  while( len < ( sizeof( line ) - 1 ) && memchr( line, '\n', len ) == NULL )
+  {
+    got = recv( fd, ( line + len ), ( sizeof( line ) - 1 - len ), 0 );
+    if( got < 0 && errno == EINTR )
+    {
+      continue;
+    }
+    if( got <= 0 )
+    {
+      break;
+    }
+    len += ( size_t )got;
+  }
+  line[ len ] = '\0';
+  line[ strcspn( line, "\r\n" ) ] = '\0';
+
+  args = line + strcspn( line, " \t" );
+  if( *args != '\0' )
+  {
+    *args = '\0';
+    args++;
+  }
+
+  if( strcasecmp( line, "SUBMIT" ) == 0 )
+  {
+    handle_submit( server, fd, args );
+  }
+  else if( strcasecmp( line, "CANCEL" ) == 0 )
+  {
+    handle_cancel( server, fd, args );
+  }
+  else if( strcasecmp( line, "STATUS" ) == 0 )
+  {
+    handle_status( server, fd, args );
+  }
+  else if( strcasecmp( line, "SHUTDOWN" ) == 0 )
+  {
+    reply( fd, "OK\n" );
+    return 1;
+  }
+  else
+  {
+    reply( fd, "ERR unknown request\n" );
+  }
+
+  return 0;
+}
+
+
+/* a stale socket of an earlier server is replaced, any other file is not */
+static int open_socket( const char* socket_path )
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  int fd;
+
+  if( ( strlen( socket_path ) + 1 ) > sizeof( addr.sun_path ) )
+  {
+    errno = ENAMETOOLONG;
+    return (-1);
+  }
+  if( lstat( socket_path, &st ) == 0 )
+  {
+    if( !S_ISSOCK( st.st_mode ) )
+    {
+      errno = EEXIST;
+      return (-1);
+    }
+    unlink( socket_path );
+  }
+
+  if( ( fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 ) ) < 0 )
+  {
+    return (-1);
+  }
+
+  memset( &addr, 0x00, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  strcpy( addr.sun_path, socket_path );
+
+  if( bind( fd, ( struct sockaddr* )&addr, sizeof( addr ) ) != 0 ||
+      listen( fd, SOMAXCONN ) != 0 )
+  {
+    close( fd );
+    return (-1);
+  }
+
+  return fd;
+}
+
+
+/*
+ * runs until SHUTDOWN, SIGINT or SIGTERM. running jobs are
+ * canceled then, queued jobs are dropped.
+ */
+int serve( const char* socket_path, const server_options_t* options )
+{
+  server_t* server = NULL;
+  struct sigaction action;
+  int client;
+  uint8_t created = 0;
+  uint8_t quit = 0;
+  uint32_t i;
+
+  if( ( server = ( server_t* )calloc( 1, sizeof( server_t ) ) ) == NULL )
+  {
+    fprintf( stderr, "memory allocation failure, exiting ...\n" );
+    return EXIT_FAILURE;
+  }
+  server->options = *options;
+  server->next_id = 1;
+  if( server->options.runners < 1 || server->options.runners > SERVER_MAX_RUNNERS )
+  {
+    server->options.runners = 1;
+  }
+
+  /*
+   * piece buffers are kept on the heap instead of being mapped and
+   * unmapped for every track, later jobs reuse the faulted pages.
+   */
+  mallopt( M_MMAP_MAX, 0 );
+  mallopt( M_TRIM_THRESHOLD, INT32_MAX );
+
+  /* no SA_RESTART, a signal ends accept() */
+  memset( &action, 0x00, sizeof( action ) );
+  action.sa_handler = on_signal;
+  sigemptyset( &action.sa_mask );
+  sigaction( SIGINT, &action, NULL );
+  sigaction( SIGTERM, &action, NULL );
+  signal( SIGPIPE, SIG_IGN );
+
+  if( ( server->fd = open_socket( socket_path ) ) < 0 )
+  {
+    fprintf( stderr, "Failed to listen on %s: %s, exiting ...\n", socket_path,
+             strerror( errno ) );
+    free( server );
+    return EXIT_FAILURE;
+  }
+
+  pthread_mutex_init( &server->lock, NULL );
+  pthread_cond_init( &server->queued, NULL );
+
+  for( created = 0; created < server->options.runners; created++ )
+  {
+    if( pthread_create( &server->runners[ created ], NULL, run_jobs, server ) != 0 )
+    {
+      fprintf( stderr, "can't create thread, exiting ...\n" );
+      stop_signal = 1;
+      break;
+    }
+  }
+
+  fprintf( stdout, "serving on %s, %u job(s) at once, %d threads each ...\n",
+           socket_path, created, server->options.n_threads );
+  fflush( stdout );
+
+  while( !stop_signal && !quit )
+  {
+    if( ( client = accept( server->fd, NULL, NULL ) ) < 0 )
+    {
+      if( errno == EINTR || errno == ECONNABORTED )
+      {
+        continue;
+      }
+      fprintf( stderr, "accept failed: %s\n", strerror( errno ) );
+      break;
+    }
+    quit = handle_client( server, client );
+    close( client );
+  }
+
+  /* running jobs stop after their current pieces */
+  pthread_mutex_lock( &server->lock );
+  server->stop = 1;
+  for( i = 0; i < SERVER_MAX_JOBS; i++ )
+  {
+    if( server->jobs[ i ].ctx != NULL )
+    {
+      waver_cancel( server->jobs[ i ].ctx );
+    }
+  }
+  pthread_cond_broadcast( &server->queued );
+  pthread_mutex_unlock( &server->lock );
+
+  for( i = 0; i < created; i++ )
+  {
+    pthread_join( server->runners[ i ], NULL );
+  }
+
+  close( server->fd );
+  unlink( socket_path );
+  pthread_cond_destroy( &server->queued );
+  pthread_mutex_destroy( &server->lock );
+  free( server );
+
+  fprintf( stdout, "server stopped.\n" );
+
+  return EXIT_SUCCESS;
+}
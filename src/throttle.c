@@ -0,0 +1,221 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    throttle.c
+# Purpose: token buckets and priorities
+#          of the workers
+#
+#==========================================
+*/
+
+#include "throttle.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+/* not in the headers of glibc, see ioprio_set(2) */
+#define IOPRIO_WHO_PROCESS  1
+#define IOPRIO_CLASS_SHIFT  13
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static double now( void );
+static waver_status_t bucket_init( bucket_t* b );
+static void bucket_start( bucket_t* b );
+static void bucket_take( bucket_t* b, double n );
+
+/* ****************************************************************** */
+
+
+static double now( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return ( double )ts.tv_sec + ( double )ts.tv_nsec / 1e9;
+}
+
+
+static waver_status_t bucket_init( bucket_t* b )
+{
+  b->rate   = 0.0;
+  b->tokens = 0.0;
+  b->last   = 0.0;
+
+  return ( pthread_mutex_init( &b->lock, NULL ) == 0 ) ? WAVER_OK : WAVER_ERR_THREAD;
+}
+
+
+/* a run starts with a full bucket */
+static void bucket_start( bucket_t* b )
+{
+  b->tokens = b->rate * THROTTLE_BURST;
+  b->last   = now();
+}
+
+
+/*
+ * the tokens are taken at once, even into debt. the taker
+ * sleeps until the debt is paid by the rate, a concurrent
+ * taker finds the debt and sleeps for it and its own tokens.
+ */
+static void bucket_take( bucket_t* b, double n )
+{
+  struct timespec ts;
+  double t;
+  double wait = 0.0;
+
+  if( b->rate <= 0.0 )
+  {
+    return;
+  }
+
+  pthread_mutex_lock( &b->lock );
+  t = now();
+  b->tokens += ( t - b->last ) * b->rate;
+  if( b->tokens > b->rate * THROTTLE_BURST )
+  {
+    b->tokens = b->rate * THROTTLE_BURST;
+  }
+  b->last = t;
+  b->tokens -= n;
+  if( b->tokens < 0.0 )
+  {
+    wait = -b->tokens / b->rate;
+  }
+  pthread_mutex_unlock( &b->lock );
+
+  if( wait > 0.0 )
+  {
+    ts.tv_sec  = ( time_t )wait;
+    ts.tv_nsec = ( long )( ( wait - ( double )ts.tv_sec ) * 1e9 );
+    while( nanosleep( &ts, &ts ) != 0 && errno == EINTR );
+  }
+}
+
+
+waver_status_t throttle_init( throttle_t* th )
+{
+  memset( th, 0, sizeof( throttle_t ) );
+
+  if( bucket_init( &th->read ) != WAVER_OK )
+  {
+    return WAVER_ERR_THREAD;
+  }
+  if( bucket_init( &th->write ) != WAVER_OK )
+  {
+    pthread_mutex_destroy( &th->read.lock );
+    return WAVER_ERR_THREAD;
+  }
+  if( bucket_init( &th->requests ) != WAVER_OK )
+  {
+    pthread_mutex_destroy( &th->write.lock );
+    pthread_mutex_destroy( &th->read.lock );
+    return WAVER_ERR_THREAD;
+  }
+
+  return WAVER_OK;
+}
+
+
+void throttle_destroy( throttle_t* th )
+{
+  pthread_mutex_destroy( &th->requests.lock );
+  pthread_mutex_destroy( &th->write.lock );
+  pthread_mutex_destroy( &th->read.lock );
+}
+
+
+/* bytes per second and requests per second, 0 = unlimited */
+void throttle_set( throttle_t* th, uint64_t read_rate, uint64_t write_rate,
+                   uint32_t iops )
+{
+  th->read.rate     = ( double )read_rate;
+  th->write.rate    = ( double )write_rate;
+  th->requests.rate = ( double )iops;
+  th->active = ( read_rate > 0 || write_rate > 0 || iops > 0 );
+}
+
+
+void throttle_start( throttle_t* th )
+{
+  bucket_start( &th->read );
+  bucket_start( &th->write );
+  bucket_start( &th->requests );
+}
+
+
+/* a request of at most THROTTLE_CHUNK bytes */
+void throttle_read( throttle_t* th, uint64_t len )
+{
+  bucket_take( &th->requests, 1.0 );
+  bucket_take( &th->read, ( double )len );
+}
+
+
+void throttle_write( throttle_t* th, uint64_t len )
+{
+  bucket_take( &th->requests, 1.0 );
+  bucket_take( &th->write, ( double )len );
+}
+
+
+/* the run makes room for other services, see close_output */
+uint8_t throttle_shared( const throttle_t* th )
+{
+  return ( th->active || th->io_class != WAVER_IOPRIO_NONE || th->nice > 0 );
+}
+
+
+/*
+ * I/O class and nice value of the calling thread. both are
+ * per thread on linux, the other threads of the process keep
+ * theirs. -1 with errno if one of them could not be set.
+ */
+int throttle_priority( const throttle_t* th )
+{
+  pid_t tid = ( pid_t )syscall( SYS_gettid );
+  int level = ( th->io_class == WAVER_IOPRIO_BE ) ? th->io_level : 0;
+  int prio;
+  int result = 0;
+
+  if( th->io_class != WAVER_IOPRIO_NONE &&
+      syscall( SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+               ( ( int )th->io_class << IOPRIO_CLASS_SHIFT ) | level ) != 0 )
+  {
+    result = (-1);
+  }
+
+  if( th->nice != 0 )
+  {
+    errno = 0;
+    prio = getpriority( PRIO_PROCESS, ( id_t )tid );
+    if( ( prio == (-1) && errno != 0 ) ||
+        setpriority( PRIO_PROCESS, ( id_t )tid, prio + th->nice ) != 0 )
+    {
+      result = (-1);
+    }
+  }
+
+  return result;
+}
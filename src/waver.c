@@ -24,61 +24,109 @@
 */
 
 #include "waver.h"
+#include "kernel.h"
+#include "plan.h"
+#include "adapt.h"
+#include "server.h"
 #include "cpuinfo.h"
 #include "mtimer.h"
 
-#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <limits.h>
 #include <sys/stat.h>
 #include <string.h>
-#include <pthread.h>
-
-/* "private" defines */
-#define PATH_LEN  1024
-#define NAME_LEN   256
-
-#define LINE_LEN  1024
-#define MAX_LINES 1024
+#include <strings.h>
+#include <unistd.h>
 
 /* ****************************************************************** */
 
 /* "private" function prototypes */
-uint32_t time_to_frames( char* timestr );
-void swapb( char* container, uint32_t container_len );
 void parse_arguments( int argc, char* argv[] );
 int file_exists( const char* file );
+int is_archive( const char* file );
 void check_opt_str_len( char* optarg, uint16_t len );
 void print_usage( void );
-
-track_t** create_track_metadata( uint8_t* track_cnt );
-void release_track_metadata( track_t** tracks, uint8_t tracks_len );
-void process_wav_header( int out_fd, track_t* track );
-void process_wav_payload( int in_fd, int out_fd, track_t* track );
-void* write_track( void* arg );
-track_t* get_track_from_pool( void );
+void default_threads( void );
+void parse_throttle( char* arg );
+void parse_ioprio( char* arg );
+void parse_tracks( char* arg );
+void parse_range( char* arg );
 int64_t try_strtol( char* str );
-void tokenize( char* str, const char* del, char** tokens, uint32_t exp_tokens );
-void flush_fs_buffer( int fd );
 
 /* ****************************************************************** */
 
-/* globals */
+/* globals, the options of the command line */
 uint8_t swap_bytes = 0;
 uint8_t verbose = 0;
+uint8_t output_format = FORMAT_WAV;
+uint8_t use_journal = 0;
+uint8_t use_archive = 0;
+uint8_t raw_sectors = 0;
+uint8_t subchannel = 0;
+uint8_t gaps = WAVER_GAPS_OMIT;
+uint8_t sparse = 0;
+uint8_t reflink = 0;
+uint8_t mapped = 0;
+uint8_t dry_run = 0;
+uint8_t adaptive = 0;
+uint8_t bench = 0;
+uint8_t prealloc = WAVER_PREALLOC_TRACK;
+uint8_t runners = 1;
+uint8_t sample_format = WAVER_SAMPLES_S16;
+uint8_t loudness = WAVER_LOUDNESS_OFF;
+uint8_t archive_kind = WAVER_CONTAINER_TAR;
+uint8_t io_class = WAVER_IOPRIO_NONE;
+uint8_t io_level = 4;       /* default level of best effort */
+int8_t  cpu_nice = 0;
+int     archive_fd = (-1);  /* archive on stdout */
+int     status_fd = (-1);   /* JSON lines of the progress */
+
+selection_t selection[ MAX_TRACKS + 1 ];  /* -x and -X, by track number */
 
 char cuefile[ PATH_LEN ]   = { '\0' };
 char binfile[ PATH_LEN ]   = { '\0' };
 char base_name[ NAME_LEN ] = { '\0' };
+char journalfile[ PATH_LEN ] = { '\0' };
+char archivefile[ PATH_LEN ] = { '\0' };
+char socketfile[ PATH_LEN ]  = { '\0' };  /* server mode */
 
 int32_t  n_threads = 0;
-
-track_pool_t track_pool;
-
-pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+int32_t  read_offset = 0;
+int32_t  readahead_mib = (-1);  /* library default */
+uint32_t sample_rate = SAMPLING_RATE;
+uint64_t read_limit = 0;    /* bytes per second, 0 = unlimited */
+uint64_t write_limit = 0;
+uint32_t iops_limit = 0;
+
+/* long options, each one has a short option as well */
+static const struct option long_options[] =
+{
+  { "gaps",          required_argument, NULL, 'g' },
+  { "offset",        required_argument, NULL, 'o' },
+  { "sparse",        no_argument,       NULL, 'z' },
+  { "reflink",       no_argument,       NULL, 'l' },
+  { "bench",         no_argument,       NULL, 'B' },
+  { "readahead",     required_argument, NULL, 'w' },
+  { "preallocate",   required_argument, NULL, 'p' },
+  { "serve",         required_argument, NULL, 'S' },
+  { "jobs",          required_argument, NULL, 'J' },
+  { "sample-format", required_argument, NULL, 'e' },
+  { "rate",          required_argument, NULL, 'R' },
+  { "loudness",      required_argument, NULL, 'L' },
+  { "mmap",          no_argument,       NULL, 'm' },
+  { "plan",          no_argument,       NULL, 'P' },
+  { "throttle",      required_argument, NULL, 'T' },
+  { "ioprio",        required_argument, NULL, 'I' },
+  { "nice",          required_argument, NULL, 'N' },
+  { "status-fd",     required_argument, NULL, 'F' },
+  { "tracks",        required_argument, NULL, 'x' },
+  { "range",         required_argument, NULL, 'X' },
+  { NULL,            0,                 NULL, 0   }
+};
 
 /* ****************************************************************** */
 
@@ -86,7 +134,18 @@ void print_usage( void )
 {
   fprintf( stdout, "\nUsage: \n"
                    " waver -b binfile -c cuefile -n basename "
-                   "[-s] [-v] [-t numthreads]\n\n"
+                   "[-s] [-v] [-t numthreads] [-f format]\n"
+                   "       [-j journalfile] [-a archive] [-k kind] [-r] [-q]\n"
+                   "       [-g|--gaps=policy] [-o|--offset=samples] [-z|--sparse]\n"
+                   "       [-l|--reflink] [-w|--readahead=MiB]\n"
+                   "       [-p|--preallocate=mode] [-e|--sample-format=fmt]\n"
+                   "       [-R|--rate=Hz] [-L|--loudness=sidecar] [-m|--mmap]\n"
+                   "       [-P|--plan] [-T|--throttle=limits]\n"
+                   "       [-I|--ioprio=class] [-N|--nice=n]\n"
+                   "       [-F|--status-fd=fd] [-x|--tracks=list]\n"
+                   "       [-X|--range=track:mm:ss:ff-mm:ss:ff]\n"
+                   "       waver -B|--bench\n"
+                   "       waver -S|--serve=socket [-J|--jobs=n] [-t numthreads] [-v]\n\n"
                    "=====================================================\n"
                    " Example: waver -b foo.bin -c foo.cue -n bar -s -t 4\n" 
                    "=====================================================\n\n"
@@ -97,7 +156,151 @@ void print_usage( void )
                    "   -t   Specify a number of threads\n" 
                    "        you want to use for waving.\n"
                    "        Default value: No of CPUs on\n"
-                   "        your machine.\n\n" );
+                   "        your machine. auto starts with\n"
+                   "        2 threads and adds or retires them\n"
+                   "        as the throughput and the I/O\n"
+                   "        pressure demand, up to 64.\n"
+                   "   -f   Output format: wav or flac.\n"
+                   "        flac encodes the tracks with the\n"
+                   "        built in encoder, the frames of\n"
+                   "        one track are encoded in parallel.\n"
+                   "        Default value: wav\n"
+                   "   -j   Keep a journal of the written\n"
+                   "        tracks and chunks. A rerun with\n"
+                   "        the same journal skips finished\n"
+                   "        tracks and resumes partial ones.\n"
+                   "   -a   Write all tracks into one archive\n"
+                   "        instead of one file per track,\n"
+                   "        - writes it to stdout. Only for\n"
+                   "        the wav format.\n"
+                   "   -k   Archive kind: tar or zip (stored).\n"
+                   "        Default value: zip if the archive\n"
+                   "        name ends with .zip, else tar\n"
+                   "   -r   The bin file holds raw sectors of\n"
+                   "        3234 bytes (cdrdao --read-raw).\n"
+                   "        Detected if the size only fits\n"
+                   "        raw sectors.\n"
+                   "   -q   Write the subchannel data of raw\n"
+                   "        sectors to basename_NN.sub\n"
+                   "   -g, --gaps=policy\n"
+                   "        What happens to the pregaps (INDEX 00):\n"
+                   "        omit    dropped\n"
+                   "        append  end of the previous track\n"
+                   "        prepend start of their own track\n"
+                   "        htoa    append, audio hidden before\n"
+                   "                track 01 is written as track 00\n"
+                   "        Default value: omit\n"
+                   "   -o, --offset=samples\n"
+                   "        Read offset of the drive, e.g. +6.\n"
+                   "        The audio is shifted by the given\n"
+                   "        number of samples, zeros are filled\n"
+                   "        in at the edges of the disc.\n"
+                   "        Default value: 0\n"
+                   "   -z, --sparse\n"
+                   "        Leave runs of digital silence as\n"
+                   "        holes in the output files if the\n"
+                   "        file system supports them. -v\n"
+                   "        reports the silence of every track.\n"
+                   "   -l, --reflink\n"
+                   "        Clone the audio of unswapped WAV\n"
+                   "        files from the bin file (btrfs, XFS).\n"
+                   "        A JUNK chunk pads the WAV header to\n"
+                   "        align the audio. Tracks are copied\n"
+                   "        if the file system can't clone.\n"
+                   "   -w, --readahead=<MiB>\n"
+                   "        Size of the window of the bin file\n"
+                   "        read ahead of the slowest worker,\n"
+                   "        0 leaves it to the kernel.\n"
+                   "        Default value: 0\n"
+                   "   -p, --preallocate=<mode>\n"
+                   "        Allocate the storage of the WAV and\n"
+                   "        ISO files before they are written:\n"
+                   "        none, track (when a track starts)\n"
+                   "        or all (every file at the start).\n"
+                   "        Default value: track\n"
+                   "   -e, --sample-format=<fmt>\n"
+                   "        Samples of the WAV files: s16 (as on\n"
+                   "        the disc), s24, s32 or f32 (float).\n"
+                   "        Wider samples get an extensible WAV\n"
+                   "        header. Only with -f wav.\n"
+                   "        Default value: s16\n"
+                   "   -R, --rate=<Hz>\n"
+                   "        Sample rate of the WAV files, e. g.\n"
+                   "        48000 or 96000 (polyphase resampling\n"
+                   "        of the 44100 Hz of the disc). Only\n"
+                   "        with -f wav.\n"
+                   "        Default value: 44100\n"
+                   "   -L, --loudness=<sidecar>\n"
+                   "        Measure the audio tracks while they\n"
+                   "        are written (EBU R128 loudness,\n"
+                   "        sample and true peak, ReplayGain)\n"
+                   "        and write basename_loudness.json\n"
+                   "        (json) or basename_loudness.cue\n"
+                   "        (cue, ReplayGain REMs). Only with\n"
+                   "        -f wav and without -j.\n"
+                   "   -m, --mmap\n"
+                   "        Map the WAV and ISO files and make\n"
+                   "        the payload right in the page cache\n"
+                   "        instead of writing it from a buffer.\n"
+                   "        The files are always preallocated.\n"
+                   "        Not with -a.\n"
+                   "   -P, --plan\n"
+                   "        Dry run: print the byte ranges of\n"
+                   "        the tracks, their schedule on the\n"
+                   "        workers and the runtime the -B\n"
+                   "        calibration predicts. Only the cue\n"
+                   "        file and the size of the bin file\n"
+                   "        are read, nothing is written.\n"
+                   "   -T, --throttle=<limits>\n"
+                   "        Limits for a run next to other\n"
+                   "        services, comma separated:\n"
+                   "        read=<MB/s>, write=<MB/s> and\n"
+                   "        iops=<n> (requests of 1 MiB at\n"
+                   "        most), e. g. read=80,write=40.\n"
+                   "        Tracks are committed without a\n"
+                   "        sync of the whole file system.\n"
+                   "   -I, --ioprio=<class>\n"
+                   "        I/O class of the workers: idle\n"
+                   "        (only when the device is not\n"
+                   "        used otherwise) or be[:0-7]\n"
+                   "        (best effort, 7 is the lowest).\n"
+                   "   -N, --nice=<n>\n"
+                   "        Added to the nice value of the\n"
+                   "        workers, 19 is the lowest CPU\n"
+                   "        priority.\n"
+                   "   -F, --status-fd=<fd>\n"
+                   "        Write the progress of the run as\n"
+                   "        a line of JSON per second to the\n"
+                   "        open file descriptor fd (see\n"
+                   "        include/progress.h). On a terminal\n"
+                   "        a progress bar is drawn on stderr\n"
+                   "        instead of the worker messages,\n"
+                   "        unless -v is given.\n"
+                   "   -x, --tracks=<list>\n"
+                   "        Convert only these tracks, e. g.\n"
+                   "        3,7-9. The others are not read.\n"
+                   "   -X, --range=<track:mm:ss:ff-mm:ss:ff>\n"
+                   "        Convert only this range of a\n"
+                   "        track, from its INDEX 01 (frames\n"
+                   "        of 1/75 s), e. g. 3:00:30:00-01:00:00.\n"
+                   "        May be given once per track.\n"
+                   "   -S, --serve=<socket>\n"
+                   "        Run as a server, conversion jobs are\n"
+                   "        queued over the UNIX socket (see\n"
+                   "        include/server.h for the requests).\n"
+                   "   -J, --jobs=<n>\n"
+                   "        Jobs the server runs at once, each\n"
+                   "        with numthreads threads.\n"
+                   "        Default value: 1\n"
+                   "   -B, --bench\n"
+                   "        Measure the throughput of the\n"
+                   "        payload kernels, resampler, flac\n"
+                   "        encoder and of the storage of the\n"
+                   "        current directory, keep it as the\n"
+                   "        calibration of -P and exit.\n\n"
+                   " A binfile ending in .zst or .xz is read from\n"
+                   " the zstd or xz archive, without a copy on disk\n"
+                   " (make HAVE_ZSTD=1 HAVE_LZMA=1).\n\n" );
 }
 
 
@@ -108,6 +311,16 @@ int file_exists( const char* file )
 }
 
 
+/* a zstd or xz archive of the bin, by its name */
+int is_archive( const char* file )
+{
+  size_t len = strlen( file );
+
+  return ( ( len > 4 && strcmp( ( file + len - 4 ), ".zst" ) == 0 ) ||
+           ( len > 3 && strcmp( ( file + len - 3 ), ".xz" ) == 0 ) );
+}
+
+
 void check_opt_str_len( char* optarg, uint16_t len )
 {
   if( ( strlen( optarg ) + 1 ) > len )
@@ -127,8 +340,12 @@ void parse_arguments( int argc, char* argv[] )
   uint8_t binflag = 0;
   uint8_t cueflag = 0;
   uint8_t nameflag = 0;
+  uint8_t kindflag = 0;
+  size_t  len;
+  int64_t val;
   
-  while( ( option = getopt( argc, argv, "b:c:n:st:v" ) ) != -1 )
+  while( ( option = getopt_long( argc, argv, "b:c:n:st:vf:j:a:k:rqg:o:zlBw:p:S:J:e:R:L:mPT:I:N:F:x:X:",
+                                 long_options, NULL ) ) != -1 )
   {
     switch( option )
     {
@@ -173,6 +390,11 @@ void parse_arguments( int argc, char* argv[] )
       case 't':
       {
         check_opt_str_len( optarg, NAME_LEN );
+        if( strcasecmp( optarg, "auto" ) == 0 )
+        {
+          adaptive = 1;
+          break;
+        }
         n_threads = ( int32_t )try_strtol( optarg );
 
         if( n_threads > MAX_THREADS )
@@ -191,6 +413,284 @@ void parse_arguments( int argc, char* argv[] )
         verbose = 1;
         break;
       }
+      case 'f':
+      {
+        if( strcasecmp( optarg, "wav" ) == 0 )
+        {
+          output_format = FORMAT_WAV;
+        }
+        else if( strcasecmp( optarg, "flac" ) == 0 )
+        {
+          output_format = FORMAT_FLAC;
+        }
+        else
+        {
+          fprintf( stderr, "unknown output format, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        break;
+      }
+      case 'j':
+      {
+        check_opt_str_len( optarg, PATH_LEN );
+        strncpy( journalfile, optarg, PATH_LEN );
+        use_journal = 1;
+        break;
+      }
+      case 'a':
+      {
+        check_opt_str_len( optarg, PATH_LEN );
+        strncpy( archivefile, optarg, PATH_LEN );
+        use_archive = 1;
+        break;
+      }
+      case 'r':
+      {
+        raw_sectors = 1;
+        break;
+      }
+      case 'q':
+      {
+        subchannel = 1;
+        break;
+      }
+      case 'g':
+      {
+        if( strcasecmp( optarg, "omit" ) == 0 )
+        {
+          gaps = WAVER_GAPS_OMIT;
+        }
+        else if( strcasecmp( optarg, "append" ) == 0 )
+        {
+          gaps = WAVER_GAPS_APPEND;
+        }
+        else if( strcasecmp( optarg, "prepend" ) == 0 )
+        {
+          gaps = WAVER_GAPS_PREPEND;
+        }
+        else if( strcasecmp( optarg, "htoa" ) == 0 )
+        {
+          gaps = WAVER_GAPS_HTOA;
+        }
+        else
+        {
+          fprintf( stderr, "unknown gap policy, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        break;
+      }
+      case 'o':
+      {
+        read_offset = ( int32_t )try_strtol( optarg );
+        if( read_offset > SAMPLING_RATE || read_offset < -SAMPLING_RATE )
+        {
+          fprintf( stderr, "read offset out of range, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        break;
+      }
+      case 'e':
+      {
+        if( strcasecmp( optarg, "s16" ) == 0 )
+        {
+          sample_format = WAVER_SAMPLES_S16;
+        }
+        else if( strcasecmp( optarg, "s24" ) == 0 )
+        {
+          sample_format = WAVER_SAMPLES_S24;
+        }
+        else if( strcasecmp( optarg, "s32" ) == 0 )
+        {
+          sample_format = WAVER_SAMPLES_S32;
+        }
+        else if( strcasecmp( optarg, "f32" ) == 0 )
+        {
+          sample_format = WAVER_SAMPLES_F32;
+        }
+        else
+        {
+          fprintf( stderr, "unknown sample format, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        break;
+      }
+      case 'R':
+      {
+        val = try_strtol( optarg );
+        if( val < WAVER_RATE_MIN || val > WAVER_RATE_MAX )
+        {
+          fprintf( stderr, "sample rate out of range, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        sample_rate = ( uint32_t )val;
+        break;
+      }
+      case 'L':
+      {
+        if( strcasecmp( optarg, "json" ) == 0 )
+        {
+          loudness = WAVER_LOUDNESS_JSON;
+        }
+        else if( strcasecmp( optarg, "cue" ) == 0 )
+        {
+          loudness = WAVER_LOUDNESS_CUE;
+        }
+        else
+        {
+          fprintf( stderr, "unknown loudness sidecar, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        break;
+      }
+      case 'S':
+      {
+        check_opt_str_len( optarg, PATH_LEN );
+        strncpy( socketfile, optarg, PATH_LEN );
+        break;
+      }
+      case 'J':
+      {
+        val = try_strtol( optarg );
+        if( val < 1 || val > SERVER_MAX_RUNNERS )
+        {
+          fprintf( stderr, "number of jobs out of range, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        runners = ( uint8_t )val;
+        break;
+      }
+      case 'p':
+      {
+        if( strcasecmp( optarg, "none" ) == 0 )
+        {
+          prealloc = WAVER_PREALLOC_NONE;
+        }
+        else if( strcasecmp( optarg, "track" ) == 0 )
+        {
+          prealloc = WAVER_PREALLOC_TRACK;
+        }
+        else if( strcasecmp( optarg, "all" ) == 0 )
+        {
+          prealloc = WAVER_PREALLOC_ALL;
+        }
+        else
+        {
+          fprintf( stderr, "unknown preallocation mode, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        break;
+      }
+      case 'w':
+      {
+        readahead_mib = ( int32_t )try_strtol( optarg );
+        if( readahead_mib < 0 || readahead_mib > READAHEAD_MAX_MIB )
+        {
+          fprintf( stderr, "readahead window out of range, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        break;
+      }
+      case 'B':
+      {
+        bench = 1;
+        break;
+      }
+      case 'l':
+      {
+        reflink = 1;
+        break;
+      }
+      case 'm':
+      {
+        mapped = 1;
+        break;
+      }
+      case 'P':
+      {
+        dry_run = 1;
+        break;
+      }
+      case 'T':
+      {
+        check_opt_str_len( optarg, NAME_LEN );
+        parse_throttle( optarg );
+        break;
+      }
+      case 'I':
+      {
+        check_opt_str_len( optarg, NAME_LEN );
+        parse_ioprio( optarg );
+        break;
+      }
+      case 'N':
+      {
+        val = try_strtol( optarg );
+        if( val < -20 || val > 19 )
+        {
+          fprintf( stderr, "nice value out of range, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        cpu_nice = ( int8_t )val;
+        break;
+      }
+      case 'F':
+      {
+        val = try_strtol( optarg );
+        if( val < 0 || val > INT_MAX || fcntl( ( int )val, F_GETFD ) < 0 )
+        {
+          fprintf( stderr, "status fd is not open, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        status_fd = ( int )val;
+        break;
+      }
+      case 'x':
+      {
+        check_opt_str_len( optarg, PATH_LEN );
+        parse_tracks( optarg );
+        break;
+      }
+      case 'X':
+      {
+        check_opt_str_len( optarg, NAME_LEN );
+        parse_range( optarg );
+        break;
+      }
+      case 'z':
+      {
+        sparse = 1;
+        break;
+      }
+      case 'k':
+      {
+        if( strcasecmp( optarg, "tar" ) == 0 )
+        {
+          archive_kind = WAVER_CONTAINER_TAR;
+        }
+        else if( strcasecmp( optarg, "zip" ) == 0 )
+        {
+          archive_kind = WAVER_CONTAINER_ZIP;
+        }
+        else
+        {
+          fprintf( stderr, "unknown archive kind, exiting ...\n" );
+          print_usage();
+          exit( EXIT_FAILURE );
+        }
+        kindflag = 1;
+        break;
+      }
       default:
       {
         fprintf( stderr, "invalid or missing arguments, exiting ...\n" );
@@ -201,6 +701,19 @@ void parse_arguments( int argc, char* argv[] )
     }
   }
   
+  /* the benchmark needs no files */
+  if( bench )
+  {
+    return;
+  }
+
+  /* jobs of the server bring their own files */
+  if( socketfile[ 0 ] != '\0' )
+  {
+    default_threads();
+    return;
+  }
+
   if( binflag == 0 )
   {
     fprintf( stderr, "missing binfile, exiting ...\n" );
@@ -220,7 +733,52 @@ void parse_arguments( int argc, char* argv[] )
     exit( EXIT_FAILURE );
   }
 
-  if( n_threads == 0 )
+  if( use_archive && mapped )
+  {
+    fprintf( stderr, "an archive can't be mapped, exiting ...\n" );
+    print_usage();
+    exit( EXIT_FAILURE );
+  }
+
+  if( use_archive )
+  {
+    len = strlen( archivefile );
+    if( !kindflag && len > 4 && strcasecmp( ( archivefile + len - 4 ), ".zip" ) == 0 )
+    {
+      archive_kind = WAVER_CONTAINER_ZIP;
+    }
+
+    /* the archive gets stdout, all messages go to stderr */
+    if( strcmp( archivefile, "-" ) == 0 )
+    {
+      if( ( archive_fd = dup( STDOUT_FILENO ) ) < 0 ||
+          dup2( STDERR_FILENO, STDOUT_FILENO ) < 0 )
+      {
+        fprintf( stderr, "Failed to redirect stdout, exiting ...\n" );
+        exit( EXIT_FAILURE );
+      }
+    }
+  }
+
+  default_threads();
+  if( adaptive )
+  {
+    fprintf( stdout, "using %d to %d threads for waving ...\n", ADAPT_START,
+             ( n_threads > 0 ) ? n_threads : MAX_THREADS );
+  }
+  else
+  {
+    fprintf( stdout, "using %d threads for waving ...\n",
+             n_threads );
+  }
+
+}
+
+
+/* one thread per cpu, unless -t is given */
+void default_threads( void )
+{
+  if( n_threads == 0 && !adaptive )
   {
     n_threads = getNumCPUs();
     if( n_threads > MAX_THREADS || n_threads < 1 )
@@ -228,61 +786,153 @@ void parse_arguments( int argc, char* argv[] )
       n_threads = 1;
     }
   }
-  fprintf( stdout, "using %d threads for waving ...\n", 
-           n_threads );
-
 }
 
 
-uint32_t time_to_frames( char* timestr )
+/* read=<MB/s>,write=<MB/s>,iops=<n>, each one optional */
+void parse_throttle( char* arg )
 {
-  char timestrcpy[ 32 + 1 ] = { '\0' };
-  const char del[ 2 ] = ":";
-  char* tokens[ 3 ] = { NULL };
-  uint8_t cnt = 0;
-  
-  int64_t msf[ 3 ];
+  char* save = NULL;
+  char* item = NULL;
+  char* value = NULL;
+  int64_t val;
 
-  uint32_t frames_total;
+  for( item = strtok_r( arg, ",", &save ); item != NULL; item = strtok_r( NULL, ",", &save ) )
+  {
+    if( ( value = strchr( item, '=' ) ) == NULL )
+    {
+      fprintf( stderr, "limit without a value, exiting ...\n" );
+      print_usage();
+      exit( EXIT_FAILURE );
+    }
+    *( value++ ) = '\0';
 
-  
-  strncpy( timestrcpy, timestr, 32 );
+    val = try_strtol( value );
+    if( val < 0 || val > UINT32_MAX )
+    {
+      fprintf( stderr, "limit out of range, exiting ...\n" );
+      print_usage();
+      exit( EXIT_FAILURE );
+    }
+
+    if( strcasecmp( item, "read" ) == 0 )
+    {
+      read_limit = ( uint64_t )val * 1000000;
+    }
+    else if( strcasecmp( item, "write" ) == 0 )
+    {
+      write_limit = ( uint64_t )val * 1000000;
+    }
+    else if( strcasecmp( item, "iops" ) == 0 )
+    {
+      iops_limit = ( uint32_t )val;
+    }
+    else
+    {
+      fprintf( stderr, "unknown limit, exiting ...\n" );
+      print_usage();
+      exit( EXIT_FAILURE );
+    }
+  }
+}
 
-  tokenize( timestrcpy, del, tokens, 3 );
 
-  if( tokens[ 0 ] == NULL || 
-      tokens[ 1 ] == NULL || 
-      tokens[ 2 ] == NULL )
+/* idle, be or be:<level> */
+void parse_ioprio( char* arg )
+{
+  int64_t val;
+
+  if( strcasecmp( arg, "idle" ) == 0 )
   {
-    fprintf( stderr, "Failed to tokenize time value, exiting...\n" );
-    exit( EXIT_FAILURE );
+    io_class = WAVER_IOPRIO_IDLE;
   }
-
-  for( cnt = 0; cnt < 3; cnt++ )
+  else if( strcasecmp( arg, "be" ) == 0 )
+  {
+    io_class = WAVER_IOPRIO_BE;
+  }
+  else if( strncasecmp( arg, "be:", 3 ) == 0 )
+  {
+    val = try_strtol( arg + 3 );
+    if( val < 0 || val > 7 )
+    {
+      fprintf( stderr, "best effort level out of range, exiting ...\n" );
+      print_usage();
+      exit( EXIT_FAILURE );
+    }
+    io_class = WAVER_IOPRIO_BE;
+    io_level = ( uint8_t )val;
+  }
+  else
   {
-    msf[ cnt ] = try_strtol( tokens[ cnt ] );
+    fprintf( stderr, "unknown i/o class, exiting ...\n" );
+    print_usage();
+    exit( EXIT_FAILURE );
   }
+}
 
-  frames_total = ( uint32_t )(   msf[ 0 ] * 60 * FRAMES_PER_SEC
-                               + msf[ 1 ] * FRAMES_PER_SEC
-                               + msf[ 2 ] );
 
-  return frames_total;
+/* 3,7-9: single tracks and ranges of tracks */
+void parse_tracks( char* arg )
+{
+  char* save = NULL;
+  char* item = NULL;
+  char* dash = NULL;
+  int64_t first;
+  int64_t last;
+
+  for( item = strtok_r( arg, ",", &save ); item != NULL; item = strtok_r( NULL, ",", &save ) )
+  {
+    if( ( dash = strchr( item, '-' ) ) != NULL )
+    {
+      *( dash++ ) = '\0';
+    }
+    first = try_strtol( item );
+    last  = ( dash != NULL ) ? try_strtol( dash ) : first;
+    if( first < 0 || last > MAX_TRACKS || first > last )
+    {
+      fprintf( stderr, "invalid track list, exiting ...\n" );
+      print_usage();
+      exit( EXIT_FAILURE );
+    }
+    for( ; first <= last; first++ )
+    {
+      selection[ first ].on = 1;
+    }
+  }
 }
 
 
-void tokenize( char* str, const char* del, char** tokens, uint32_t exp_tokens )
+/* track:mm:ss:ff-mm:ss:ff, frames from INDEX 01 of the track */
+void parse_range( char* arg )
 {
-  uint32_t cnt = 0;
-  
-  *( tokens + cnt )  = strtok( str, del );
-  cnt++;
+  unsigned int track;
+  unsigned int msf[ 6 ];
+  int end = 0;
+  uint32_t from;
+  uint32_t to;
+
+  if( sscanf( arg, "%u:%u:%u:%u-%u:%u:%u%n", &track, &msf[ 0 ], &msf[ 1 ], &msf[ 2 ],
+              &msf[ 3 ], &msf[ 4 ], &msf[ 5 ], &end ) != 7 || *( arg + end ) != '\0' ||
+      track > MAX_TRACKS || msf[ 1 ] >= 60 || msf[ 2 ] >= FRAMES_PER_SEC ||
+      msf[ 4 ] >= 60 || msf[ 5 ] >= FRAMES_PER_SEC )
+  {
+    fprintf( stderr, "invalid range, exiting ...\n" );
+    print_usage();
+    exit( EXIT_FAILURE );
+  }
 
-  while( tokens != NULL && cnt < exp_tokens )
+  from = ( msf[ 0 ] * 60 + msf[ 1 ] ) * FRAMES_PER_SEC + msf[ 2 ];
+  to   = ( msf[ 3 ] * 60 + msf[ 4 ] ) * FRAMES_PER_SEC + msf[ 5 ];
+  if( from >= to )
   {
-    *( tokens + cnt ) = strtok( NULL, del );
-    cnt++;
+    fprintf( stderr, "empty range, exiting ...\n" );
+    print_usage();
+    exit( EXIT_FAILURE );
   }
+
+  selection[ track ].on   = 1;
+  selection[ track ].from = from;
+  selection[ track ].to   = to;
 }
 
 
@@ -314,626 +964,191 @@ int64_t try_strtol( char* str )
 }
 
 
-void swapb( char* container, uint32_t container_len )
-{
-  uint32_t i;
-  char tmp_byte;
-  if( ( container_len % 2 ) != 0 )
-  {
-    fprintf( stderr, "can't swap bytes. "
-                     "2 must be a divisor of the block size. " 
-                     "exiting ...\n" );
-    exit( EXIT_FAILURE );
-  }
-  
-  /* swap every pair of bytes in the container */
-  for( i = 0; i < container_len; i += 2 )
-  {
-    tmp_byte = *( container + i );
-    *( container + i ) = *( container + i + 1 );
-    *( container + i + 1 ) = tmp_byte;
-  }
-}
-
-
-void flush_fs_buffer( int fd )
-{
-  if( syncfs( fd ) != 0 )
-  {
-    fprintf( stderr, "Failed to commit buffer cache to disk, exiting ...\n" );
-    exit( EXIT_FAILURE );
-  }
-}
-
-
-track_t** create_track_metadata( uint8_t* track_cnt )
+/* the conversion itself is done by libwaver */
+int main( int argc, char* argv[] )
 {
-  uint16_t i;
-  
-  track_t** tracks = NULL;
-  track_t* cur_track = NULL;
-  track_t* prev_track = NULL;
-  
-  FILE* cue_fs = NULL;
-  
-  int bin_fd = (-1);
-
-  char** lines = NULL;
-  uint16_t lines_cnt = 0;
-  
-  char* cur_line = NULL;
-
-  char* newline_pos = NULL;
-  char* search_pos = NULL;
-  
-  cueentry_t cue_entries[ 128 ];
-
-  const char del[ 2 ] = " ";
-  char* tokens[ 3 ] = { NULL };
-  
-  uint8_t index_cnt = 0;
-
-  uint64_t last_bin_byte;
-
-  *track_cnt = 0;
-
-  if( ( cue_fs = fopen( cuefile, "r" ) ) == NULL )
-  {
-    fprintf( stderr, "Failed to open cuefile, exiting ...\n" );
-    exit( EXIT_FAILURE );
-  }
+  ttimer_t timer;
+  waver_ctx_t* ctx = NULL;
+  server_options_t server_options;
+  waver_input_t input;
+  waver_output_t output;
+  waver_calibration_t cal = { 0 };
+  waver_status_t status;
+  char cal_path[ PATH_LEN ];
+  int i;
 
-  /* ...::: parse the cue file :::... */
-  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
-  
-  /* we assume a cue file does not have more lines than MAX_LINES */
-  if( 
-      ( ( lines = ( char** )malloc( sizeof( char* ) * MAX_LINES ) ) == NULL ) ||
-      ( ( *( lines + 0 ) = ( char* )malloc( sizeof( char ) * LINE_LEN ) ) == NULL ) 
-    )
-  {
-    fprintf( stderr, "Memory allocation failure. Exiting ...\n" );
-    exit( EXIT_FAILURE );
-  }
-  lines_cnt++;
+  parse_arguments( argc, argv );
 
-  /* first of all read all lines of the cue file and store them in lines */
-  i = 0;
-  while( 
-         ( ( fgets( ( cur_line = *( lines + i ) ), ( LINE_LEN - 1 ), cue_fs ) ) != NULL ) &&
-         ( i < ( MAX_LINES - 1 ) )
-       )
+  if( bench )
   {
-    /* terminate line with a null byte */
-    *( cur_line + ( LINE_LEN - 1 ) ) = '\0';
-
-    /* remove '\n'-character in parsed line */
-    if( ( newline_pos = strchr( cur_line, '\n' ) ) != NULL )
-    {
-      *newline_pos = '\0';
-      newline_pos = NULL;
-    }
-
-
-    /* track was found */
-    if( ( search_pos = strcasestr( cur_line, "TRACK" ) ) != NULL )
+    payload_kernel_bench( stdout, &cal );
+    calibration_bench( stdout, &cal );
+    if( calibration_path( cal_path, PATH_LEN ) &&
+        calibration_save( &cal, cal_path ) == WAVER_OK )
     {
-      /* set the index count of previous track. */
-      if( *track_cnt > 0 )
-      {
-        cue_entries[ *track_cnt - 1 ].index_cnt = index_cnt;
-        index_cnt = 0;
-      }
-      
-      /* handle new track */
-      tokenize( search_pos, del, tokens, 3 );
-      strncpy( cue_entries[ *track_cnt ].title, tokens[ 0 ], 16 );
-      strncpy( cue_entries[ *track_cnt ].no, tokens[ 1 ], 8 );
-      strncpy( cue_entries[ *track_cnt ].mode, tokens[ 2 ], 16 );
-
-      memset( tokens, 0x00, sizeof( char* ) * 3 );
-      search_pos = NULL;
-      ( *track_cnt )++;
+      fprintf( stdout, "\ncalibration saved to %s\n", cal_path );
     }
-
-    /* index was found */
-    if( ( search_pos = strcasestr( cur_line, "INDEX" ) ) != NULL )
-    {
-      tokenize( search_pos, del, tokens, 3 );
-      cue_entries[ *track_cnt - 1 ].index_str[ index_cnt ] = tokens[ 2 ];
-      
-      memset( tokens, 0x00, sizeof( char* ) * 3 );
-      search_pos = NULL;
-      index_cnt++;
-      if( index_cnt > ( 64 - 1 ) )
-      {
-        fprintf( stderr, "Ooops. We ran out of space for index-entries. Exiting ...\n" );
-        exit( EXIT_FAILURE );
-      }
-    }
-    
-    /* allocate space for next line */
-    if( ( *( lines + ( i + 1 ) ) = ( char* )malloc( sizeof( char ) * LINE_LEN ) ) == NULL )
+    else
     {
-      fprintf( stderr, "Memory allocation failure. Exiting ...\n" );
-      exit( EXIT_FAILURE );
+      fprintf( stderr, "Failed to save the calibration\n" );
     }
-    lines_cnt++;
-
-    i++;
+    return EXIT_SUCCESS;
   }
 
-  /* set index count of the last track ... */
-  cue_entries[ *track_cnt - 1 ].index_cnt = index_cnt;
-  index_cnt = 0;
-
-  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
-  
-
-  if( fclose( cue_fs ) != 0 )
+  if( socketfile[ 0 ] != '\0' )
   {
-    fprintf( stderr, "Failed to close cuefile, exiting ...\n" );
-    exit( EXIT_FAILURE );
+    server_options.n_threads = n_threads;
+    server_options.adaptive  = adaptive;
+    server_options.runners   = runners;
+    server_options.verbose   = verbose;
+    return serve( socketfile, &server_options );
   }
-  cue_fs = NULL;
-  
-  /* ...::: set up the tracks metadata :::... */
-  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
-  
-  if( ( tracks = ( track_t** )malloc( sizeof( track_t* ) * ( *track_cnt ) ) ) == NULL )
+
+  startTTimer( timer );
+
+  if( waver_create( &ctx ) != WAVER_OK )
   {
     fprintf( stderr, "memory allocation failure, exiting ...\n" );
     exit( EXIT_FAILURE );
-  } 
+  }
 
-  for( i = 0; i < *track_cnt; i++ )
+  if( is_archive( binfile ) )
   {
-    if( ( *( tracks + i ) = ( track_t* )malloc( sizeof( track_t ) ) ) == NULL )
+    if( ( status = waver_input_compressed( &input, binfile ) ) != WAVER_OK )
     {
-      fprintf( stderr, "memory allocation failure, exiting ...\n" );
+      fprintf( stderr, "%s, exiting ...\n",
+               ( status == WAVER_ERR_ARG ) ?
+               "bin file is no zstd or xz archive, or waver is built without "
+               "HAVE_ZSTD / HAVE_LZMA" : "Failed to read bin archive" );
+      waver_destroy( ctx );
       exit( EXIT_FAILURE );
     }
-    
-    if( i > 0 )
-    {
-      prev_track = cur_track;
-      cur_track = NULL;
-    }
-
-    cur_track = *( tracks + i );
-    
-    cur_track->number = ( i + 1 );
-    
-    /* 
-     * we omit pregaps => last index is the startframe 
-     *                 => first index of next track is the endframe 
-     *
-     * to determine the endframe of the last track we calculate back 
-     * from the last byte in the binary data stream.
-     */
-    if( cue_entries[ i ].index_cnt > 1 )
-    {
-      cur_track->startframe = 
-        time_to_frames( cue_entries[ i ].index_str[ ( cue_entries[ i ].index_cnt - 1 ) ] );
-    }
-    else
-    {
-      cur_track->startframe = 
-        time_to_frames( cue_entries[ i ].index_str[ 0 ] );
-    }
-    cur_track->startbyte = cur_track->startframe * SECTOR_LEN;
-    
-    if( i > 0 )
-    {
-      prev_track->endframe  = time_to_frames( cue_entries[ i ].index_str[ 0 ] );
-      prev_track->endbyte   = prev_track->endframe * SECTOR_LEN;
-      prev_track->size_byte = prev_track->endbyte - prev_track->startbyte;
-    }
-
-    if( strcasestr( cue_entries[ i ].mode, MODE_AUDIO ) != NULL )
-    {
-      strncpy( cur_track->mode, cue_entries[ i ].mode, 16 );
-      cur_track->is_audio = 1;
-    }  
   }
-
-  
-  if( ( bin_fd = open( binfile, O_RDONLY | O_SYNC ) ) < 0 )
+  else if( waver_input_file( &input, binfile ) != WAVER_OK )
   {
-    fprintf( stderr, "Failed to open bin file to get the last byte, exiting, ...\n" );
+    fprintf( stderr, "Failed to open bin file, exiting ...\n" );
+    waver_destroy( ctx );
     exit( EXIT_FAILURE );
   }
+  waver_set_input( ctx, &input );
 
-  /* set endframe, endbyte and size_byte for the last track */
-  if( ( last_bin_byte = lseek( bin_fd, 0, SEEK_END ) ) == (-1) )
+  /* a dry run creates no output */
+  if( dry_run )
   {
-    fprintf( stderr, "Failed to seek last byte, exiting ...\n" );
-    exit( EXIT_FAILURE );
+    status = WAVER_OK;
   }
-
-  if( close( bin_fd ) != 0 )
+  else if( archive_fd >= 0 )
   {
-    fprintf( stderr, "Failed to close bin file for seeking last byte, exiting ...\n" );
-    exit( EXIT_FAILURE );
+    status = waver_output_container_fd( &output, archive_kind, archive_fd, base_name );
   }
-
-  cur_track->endframe  =  ( uint32_t )( last_bin_byte / SECTOR_LEN );
-  cur_track->endbyte   = last_bin_byte;
-  cur_track->size_byte = cur_track->endbyte - cur_track->startbyte;
-
-  
-  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
-
-
-  /* ...::: clean things up :::... */
-  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
-  
-  for( i = 0; i < lines_cnt; i++ )
+  else if( use_archive )
   {
-    free( *( lines + i ) );
-    *( lines + i ) = NULL;
+    status = waver_output_container( &output, archive_kind, archivefile, base_name );
   }
-  free( lines );
-  lines = NULL;
-  
-  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
-    
-  return tracks;
-}
-
-
-void release_track_metadata( track_t** tracks, uint8_t tracks_len )
-{
-  uint8_t i;
-
-  for( i = 0; i < tracks_len; i++ )
+  else if( mapped )
   {
-    free( *( tracks + i ) );
-    *( tracks + i ) = NULL;
+    status = waver_output_mapped( &output, base_name );
   }
-
-  free( tracks );
-  tracks = NULL;
-}
-
-
-void process_wav_header( int out_fd, track_t* track )
-{
-  uint32_t* uint32_ptr = NULL;
-  uint16_t* uint16_ptr = NULL;
-  char buf[ WAV_HEADER_LEN ] = { 0 };
-  uint32_t overall_file_size = WAV_HEADER_LEN + track->size_byte - 8;
-  int errsv;
-  int bytes_written;
-  
-  /* concatenate the 44 bytes of the WAV header */
-  /* **************************************************************** */
-  
-  /* 
-   * !!! KEEP IN MIND !!!
-   * we live in a little endian world (x86) ...
-   * verify header with e. g.: hexdump -C -n 44
-   * */
-  
-  /* 00 - 03   Marks the file as a riff file */
-  strncpy( ( buf + 0 ), "RIFF", 4 );     
-  
-  /* 04 - 07   Size of the overall file minus (-) 8 bytes in, bytes */
-  uint32_ptr = ( uint32_t* )&buf[ 4 ];
-  *uint32_ptr = overall_file_size;
-
-  /* 08 - 11   File Type Header */
-  strncpy( ( buf + 8 ), "WAVE", 4 );
-
-  /* 12 - 15   Format chunk marker. Includes trailing null (blank space) */
-  strncpy( ( buf + 12 ), "fmt ", 4 );
-
-  /* 16 - 19   Length of format data as listed above (00-15) */
-  uint32_ptr = ( uint32_t* )&buf[ 16 ];
-  *uint32_ptr = 16;
-
-  /* 20 - 21   Type of format (1 is PCM) - 2 byte integer */
-  uint16_ptr = ( uint16_t* )&buf[ 20 ];
-  *uint16_ptr = 1;
-  
-  /* 22 - 23   Number of Channels - 2 byte integer, 2 = stereo */
-  uint16_ptr = ( uint16_t* )&buf[ 22 ];
-  *uint16_ptr = 2;
-
-  /* 24 - 27   Sampling rate */
-  uint32_ptr = ( uint32_t* )&buf[ 24 ];
-  *uint32_ptr = SAMPLING_RATE;
-
-  /* 28 - 31   (Sample Rate * BitsPerSample * Channels) / 8 */
-  uint32_ptr = ( uint32_t* )&buf[ 28 ];
-  *uint32_ptr = ( SAMPLING_RATE * 
-                  BITS_PER_SAMPLE * 
-                  CHANNELS ) / 8;
-  
-  /* 32 - 33   Frame size = <Number of channels> * 
-                            ( ( <Bits/Sample (of one channel)> + 7 ) / 8 ) 
-               Caution: (Integer division!!) */
-  uint16_ptr = ( uint16_t* )&buf[ 32 ];
-  *uint16_ptr = ( CHANNELS * 
-                  ( uint16_t )( ( BITS_PER_SAMPLE + 7 ) / 8 ) );
-
-  /* 34 - 35   Bits per sample */
-  uint16_ptr = ( uint16_t* )&buf[ 34 ];
-  *uint16_ptr = BITS_PER_SAMPLE;
-  
-  /* 36 - 39   "data" chunk header. 
-               Marks the beginning of the data section */
-  strncpy( ( buf + 36 ), "data", 4 );
-  
-  /* 40 - 43   Size of the data section (payload size) */
-  uint32_ptr = ( uint32_t* )&buf[ 40 ];
-  *uint32_ptr = track->size_byte;
-
-  if( ( bytes_written = write( out_fd, buf, WAV_HEADER_LEN ) ) != WAV_HEADER_LEN )
+  else
   {
-    errsv = errno;
-    fprintf( stderr, "Failed to write wav header, " 
-             "bytes written: %d\n"
-             "errno: %s, exiting ...\n", bytes_written, strerror( errsv ) );
-    exit( EXIT_FAILURE );
+    status = waver_output_files( &output, base_name );
   }
-}
-
-
-void process_wav_payload( int in_fd, int out_fd, track_t* track )
-{
-  /* buffer on the heap to prevent stack overflows */
-  char* buf = NULL;
-  int bytes_read;
-  int bytes_written;
-  int errsv;
-  uint32_t cur_block_size = BLOCK_SIZE;
-  uint32_t pieces_count = 0;
-  uint32_t overlap_bytes = 0;
-  uint32_t i;
-
-  if( ( buf = ( char* )calloc( BLOCK_SIZE, sizeof( char ) ) ) == NULL )
-  {
-    fprintf( stderr, "Failed to allocate memory for buffer, exiting ...\n" );
+  if( status != WAVER_OK )
+  {
+    fprintf( stderr, "Failed to create output: %s, exiting ...\n",
+             waver_strerror( status ) );
+    waver_destroy( ctx );
     exit( EXIT_FAILURE );
   }
-  
-  /* **************************************************************** */
-  
-  pieces_count = ( uint32_t )( track->size_byte / BLOCK_SIZE );
-  overlap_bytes = track->size_byte % BLOCK_SIZE;
-  if( overlap_bytes > 0 )
+  if( !dry_run )
   {
-    pieces_count++;
+    waver_set_output( ctx, &output );
   }
-  
-  /* set file pointer on in file to start position */
-  if( lseek( in_fd, track->startbyte, SEEK_SET ) == (-1) )
+
+  if( waver_set_cue_file( ctx, cuefile ) != WAVER_OK )
   {
-    fprintf( stderr, "Failed to seek track start byte, exiting ...\n" );
+    fprintf( stderr, "Failed to read cue file, exiting ...\n" );
+    waver_destroy( ctx );
     exit( EXIT_FAILURE );
   }
 
-  /* read block by block and write to output file ... */
-  for( i = 0; i < pieces_count; i++ )
+  waver_set_threads( ctx, n_threads );
+  waver_set_adaptive( ctx, adaptive );
+  waver_set_swap( ctx, swap_bytes );
+  waver_set_format( ctx, output_format );
+  waver_set_log( ctx, stdout, verbose );
+  waver_set_subchannel( ctx, subchannel );
+  waver_set_gaps( ctx, gaps );
+  waver_set_offset( ctx, read_offset );
+  waver_set_sparse( ctx, sparse );
+  waver_set_reflink( ctx, reflink );
+  waver_set_preallocate( ctx, prealloc );
+  waver_set_sample_format( ctx, sample_format );
+  waver_set_loudness( ctx, loudness );
+  waver_set_throttle( ctx, read_limit, write_limit, iops_limit );
+  waver_set_priority( ctx, io_class, io_level, cpu_nice );
+
+  /* the bar takes the place of the worker messages */
+  if( !verbose && isatty( STDERR_FILENO ) )
   {
-    /* case for the last piece */
-    if( overlap_bytes > 0 && i == ( pieces_count - 1 ) )
-    {
-      cur_block_size = overlap_bytes;
-    }
-    
-    if( ( bytes_read = read( in_fd, buf, cur_block_size ) ) != cur_block_size )
-    {
-      errsv = errno;
-      fprintf( stderr, "Failed to read block of data, " 
-               "read bytes: %d\n"
-               "errno: %s, exiting ...\n", bytes_read, strerror( errsv ) );
-      exit( EXIT_FAILURE );
-    }
-    if( swap_bytes )
-    {
-      swapb( buf, cur_block_size );
-    }
-    if( ( bytes_written = write( out_fd, buf, cur_block_size ) ) != cur_block_size )
-    {
-      errsv = errno;
-      fprintf( stderr, "Failed to write block of data, " 
-               "bytes written: %d\n"
-               "errno: %s, exiting ...\n", bytes_written, strerror( errsv ) );
-      exit( EXIT_FAILURE );
-    }
+    waver_set_log( ctx, NULL, 0 );
+    waver_set_progress( ctx, stderr, status_fd );
   }
-  free( buf );
-  buf = NULL;
-}
-
-
-track_t* get_track_from_pool( void )
-{
-  track_t* track = NULL;
-  
-  if( track_pool.cur_top < track_pool.tracks_len )
+  else
   {
-    track = *( track_pool.tracks + track_pool.cur_top );
-    track_pool.cur_top++;
+    waver_set_progress( ctx, NULL, status_fd );
   }
-
-  return track;
-}
-
-
-/* thread function */
-/* 
- * writing to stdout or stderr is threadsafe, so for these operations
- * we don't need a mutex.
- */
-void* write_track( void* arg )
-{
-  uint32_t tid;
-  int bin_fd = (-1);
-  int out_fd = (-1);
-  
-  char wav_name[ PATH_LEN ] = { '\0' };
-  char track_no[ 3 ] = { '\0' };
-  track_t* track = NULL;
- 
-  tid = *( ( uint32_t* )arg );
-
-  fprintf( stdout, "started worker thread with id %02d ...\n", tid );
-  fflush( stdout );
-
-  /* critical section. get file descriptor for binary file */
-  /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
-  pthread_mutex_lock( &lock );
-  bin_fd = open( binfile, O_RDONLY | O_SYNC );
-  pthread_mutex_unlock( &lock );
-  /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
-
-  if( bin_fd < 0 )
-  {
-    fprintf( stderr, "Failed to open requested files, exiting ...\n" );
-    fflush( stderr );
+  if( waver_set_sample_rate( ctx, sample_rate ) != WAVER_OK )
+  {
+    fprintf( stderr, "%s, exiting ...\n", waver_error_message( ctx ) );
+    waver_destroy( ctx );
     exit( EXIT_FAILURE );
   }
-  
-  while( 1 )
-  {
-    /* critical section. get track from track pool */
-    /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
-    pthread_mutex_lock( &lock );
-    track = get_track_from_pool();
-    pthread_mutex_unlock( &lock );
-    /* **~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~**~** */
-    
-    /* if no more tracks in pool, we can terminate this thread by breaking this loop. */
-    if( track == NULL )
+  for( i = 0; i <= MAX_TRACKS; i++ )
+  {
+    if( selection[ i ].on && selection[ i ].to > 0 )
     {
-      break;
+      waver_select_range( ctx, ( uint8_t )i, selection[ i ].from, selection[ i ].to );
     }
-
-    strncat( wav_name, base_name, ( PATH_LEN - 7 ) );
-    strncat( wav_name, "_", 1 );
-    sprintf( track_no, "%02d", track->number );
-    strncat( wav_name, track_no, 2 );
-    strncat( wav_name, WAV_EXTENSION, 4 );
-    
-    out_fd = open( wav_name, 
-                   O_WRONLY | O_CREAT | O_TRUNC,
-                   S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
-    
-    if( out_fd < 0 )
+    else if( selection[ i ].on )
     {
-      fprintf( stderr, "Failed to open output wav file at %d, exiting ...\n", track->number );
-      fflush( stderr );
-      exit( EXIT_FAILURE );
+      waver_select_track( ctx, ( uint8_t )i );
     }
-    
-    process_wav_header( out_fd, track );
-    process_wav_payload( bin_fd, out_fd, track );
-    
-    /* flush file system buffer 
-     * to write down the processed track 
-     * to persistent device */
-    flush_fs_buffer( out_fd );
-    
-    if( close( out_fd ) != 0 )
-    {
-      fprintf( stderr, "Failed to close wav file fd at %d, exiting ...\n", track->number );
-      fflush( stderr );
-      exit( EXIT_FAILURE );
-    }
-    out_fd = (-1);
-    
-    memset( wav_name, '\0', PATH_LEN );
-    memset( track_no, '\0', 3 );
   }
-
-  if( close( bin_fd ) != 0 )
+  if( readahead_mib >= 0 )
   {
-    fprintf( stderr, "Failed to close bin file fd at tid %02d, exiting ...\n", tid );
-    fflush( stderr );
-    exit( EXIT_FAILURE );
+    waver_set_readahead( ctx, ( uint64_t )readahead_mib << 20 );
   }
-  fprintf( stdout, "thread with id %d has nothing more to do "
-                   "and will terminate now.\n", tid );
-  fflush( stdout );
-  pthread_exit( NULL );
-  
-}
-
-
-int main( int argc, char* argv[] )
-{
-  ttimer_t timer;
-  track_t** tracks = NULL;
-  uint8_t track_cnt = 0;
-  
-  pthread_t threads[ MAX_THREADS ];
-  
-  /* 
-   * to safely pass a unique tid to the pthread_create
-   * function. Better than boxing integer values into void pointers.
-   * with this array of integers we just can pass their addresses,
-   * without checking on which architecutre we are running.
-   * */
-  uint32_t tids[ MAX_THREADS ];
-  
-  int errsv;
-  int32_t i;
-  
-  parse_arguments( argc, argv );
-
-  startTTimer( timer );
-
-  tracks = create_track_metadata( &track_cnt );
-
-  track_pool.tracks     = tracks;
-  track_pool.tracks_len = track_cnt;
-  track_pool.cur_top    = 0;
-  
-  /* start and join threads, organize mutex, ...  */
-  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
-  
-  if( pthread_mutex_init( &lock, NULL ) != 0 )
+  if( raw_sectors )
   {
-    fprintf( stderr, "mutex init failed, exiting ...\n");
-    exit( EXIT_FAILURE );
+    waver_set_sector_layout( ctx, WAVER_SECTORS_RAW );
+  }
+  if( use_journal )
+  {
+    waver_set_journal( ctx, journalfile );
   }
 
-  for( i = 0; i < n_threads; i++ )
+  if( dry_run )
   {
-    tids[ i ] = i;
-    errsv = pthread_create( &threads[ i ], NULL, 
-                            write_track, ( void* )( &tids[ i ] ) );
-    
-    if( errsv != 0 )
+    if( !calibration_path( cal_path, PATH_LEN ) ||
+        calibration_load( &cal, cal_path ) != WAVER_OK )
     {
-      fprintf( stderr, "can't create thread. reason: [ %s ]\n", 
-               strerror( errsv ) );
-      exit( EXIT_FAILURE );
+      memset( &cal, 0, sizeof( waver_calibration_t ) );
     }
+    status = waver_plan( ctx, &cal, stdout );
   }
-  for( i = 0; i < n_threads; i++ )
+  else
   {
-    errsv = pthread_join( threads[ i ], NULL );
-    if( errsv != 0 )
-    {
-      fprintf( stderr, "can't join thread. reason: [ %s ]\n", 
-               strerror( errsv ) );
-      exit( EXIT_FAILURE );
-    }
+    status = waver_run( ctx );
   }
-
-  if( pthread_mutex_destroy( &lock ) != 0 )
+  if( status != WAVER_OK )
   {
-    fprintf( stderr, "mutex destroy failed, exiting ...\n");
+    fprintf( stderr, "%s, exiting ...\n", waver_error_message( ctx ) );
+    waver_destroy( ctx );
     exit( EXIT_FAILURE );
   }
 
-  /* :::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::: */
- 
-  release_track_metadata( tracks, track_cnt );
+  waver_destroy( ctx );
 
   stopTTimer( timer );
 
@@ -941,4 +1156,3 @@ int main( int argc, char* argv[] )
   
   return EXIT_SUCCESS;
 }
-
@@ -0,0 +1,283 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    bench.c
+# Purpose: micro benchmark of the
+#          payload and sample kernels
+#          against the generic path,
+#          run by make bench. every
+#          kernel is checked byte by
+#          byte against the generic
+#          path first, a mismatch
+#          fails the target.
+#
+#          then the readahead of the
+#          bin (fadvise along the track
+#          schedule) against none: runs
+#          of a scratch bin in the
+#          current directory with a
+#          cold page cache and outputs
+#          that drop the data, by
+#          workers and window. the
+#          results of a reference
+#          machine are kept in
+#          tests/bench_baseline.txt.
+#
+#==========================================
+*/
+
+#include "kernel.h"
+#include "mtimer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* "private" defines */
+#define BENCH_BIN            "waver_bench.bin"  /* scratch bin, current directory */
+#define BENCH_TRACKS         8
+#define BENCH_TRACK_SECTORS  12000              /* 27 MiB, 2:40 min */
+#define BENCH_CUE_LEN        1024
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static int make_bin( const char* path, uint64_t len );
+static void make_cue( char* text, size_t len );
+static void evict( const char* path );
+static int discard_open( void* handle, uint8_t track_no, const char* extension,
+                         uint8_t resume, void** stream );
+static int64_t discard_write( void* stream, const void* buf, uint64_t len, uint64_t offset );
+static int discard_sync( void* stream, uint8_t data_only );
+static int discard_close( void* stream );
+static double bench_run( const char* cue, int32_t threads, uint64_t window );
+static uint8_t readahead_bench( FILE* log );
+
+/* ****************************************************************** */
+
+
+/* audio of pseudo random samples, no zero blocks */
+static int make_bin( const char* path, uint64_t len )
+{
+  char* buf = NULL;
+  uint64_t done = 0;
+  uint32_t n;
+  uint32_t i;
+  int fd;
+
+  if( ( buf = ( char* )malloc( BLOCK_SIZE ) ) == NULL )
+  {
+    return (-1);
+  }
+  if( ( fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ) < 0 )
+  {
+    free( buf );
+    return (-1);
+  }
+
+  srand( 2 );
+  for( i = 0; i < BLOCK_SIZE; i++ )
+  {
+    *( buf + i ) = ( char )( rand() & 0xFF );
+  }
+  while( done < len )
+  {
+    n = ( ( len - done ) < BLOCK_SIZE ) ? ( uint32_t )( len - done ) : BLOCK_SIZE;
+    if( write( fd, buf, n ) != ( ssize_t )n )
+    {
+      break;
+    }
+    done += n;
+  }
+
+  free( buf );
+  if( fdatasync( fd ) != 0 || close( fd ) != 0 || done < len )
+  {
+    return (-1);
+  }
+
+  return 0;
+}
+
+
+static void make_cue( char* text, size_t len )
+{
+  uint32_t frames;
+  size_t pos;
+  uint8_t i;
+
+  pos = ( size_t )snprintf( text, len, "FILE \"%s\" BINARY\n", BENCH_BIN );
+  for( i = 0; i < BENCH_TRACKS && pos < len; i++ )
+  {
+    frames = ( uint32_t )i * BENCH_TRACK_SECTORS;
+    pos += ( size_t )snprintf( ( text + pos ), ( len - pos ),
+                               "  TRACK %02u AUDIO\n    INDEX 01 %02u:%02u:%02u\n",
+                               ( i + 1 ), frames / ( 60 * 75 ), ( frames / 75 ) % 60,
+                               frames % 75 );
+  }
+}
+
+
+/* the bin leaves the page cache, the next run reads the device */
+static void evict( const char* path )
+{
+  int fd;
+
+  if( ( fd = open( path, O_RDONLY ) ) >= 0 )
+  {
+    posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+    close( fd );
+  }
+}
+
+
+static int discard_open( void* handle, uint8_t track_no, const char* extension,
+                         uint8_t resume, void** stream )
+{
+  *stream = handle;
+
+  return 0;
+}
+
+
+static int64_t discard_write( void* stream, const void* buf, uint64_t len, uint64_t offset )
+{
+  return ( int64_t )len;
+}
+
+
+static int discard_sync( void* stream, uint8_t data_only )
+{
+  return 0;
+}
+
+
+static int discard_close( void* stream )
+{
+  return 0;
+}
+
+
+/* MB/s of a run of the scratch bin, 0 on errors */
+static double bench_run( const char* cue, int32_t threads, uint64_t window )
+{
+  waver_ctx_t* ctx = NULL;
+  waver_input_t input;
+  waver_output_t output;
+  waver_status_t status;
+  uint64_t done;
+  uint64_t total;
+  double elapsed;
+  ctimer_t timer;
+
+  memset( &output, 0, sizeof( waver_output_t ) );
+  output.handle = &output;
+  output.open   = discard_open;
+  output.write  = discard_write;
+  output.sync   = discard_sync;
+  output.close  = discard_close;
+
+  evict( BENCH_BIN );
+  if( waver_create( &ctx ) != WAVER_OK )
+  {
+    return 0.0;
+  }
+  if( waver_input_file( &input, BENCH_BIN ) != WAVER_OK )
+  {
+    waver_destroy( ctx );
+    return 0.0;
+  }
+  waver_set_input( ctx, &input );
+  waver_set_output( ctx, &output );
+  waver_set_cue_buffer( ctx, cue, strlen( cue ) );
+  waver_set_threads( ctx, threads );
+  waver_set_readahead( ctx, window );
+
+  initCTimer( timer, MONOTONIC );
+  startCTimer( timer );
+  status = waver_run( ctx );
+  stopCTimer( timer );
+  elapsed = getCTime( timer );
+  waver_progress( ctx, &done, &total );
+  waver_destroy( ctx );
+
+  return ( status == WAVER_OK && elapsed > 0.0 ) ? ( ( double )total / 1e6 ) / elapsed : 0.0;
+}
+
+
+/* runs with and without the readahead, returns 0 if one failed */
+static uint8_t readahead_bench( FILE* log )
+{
+  static const int32_t threads[] = { 1, 4, 8 };
+  static const uint64_t windows[] = { 0, READAHEAD_WINDOW, ( uint64_t )512 << 20 };
+  char cue[ BENCH_CUE_LEN ];
+  double rate;
+  uint8_t ok = 1;
+  uint8_t i;
+  uint8_t j;
+
+  if( make_bin( BENCH_BIN, ( uint64_t )BENCH_TRACKS * BENCH_TRACK_SECTORS * SECTOR_LEN ) != 0 )
+  {
+    fprintf( log, "Failed to create %s\n", BENCH_BIN );
+    unlink( BENCH_BIN );
+    return 0;
+  }
+  make_cue( cue, BENCH_CUE_LEN );
+
+  fprintf( log, "\nreadahead, %u tracks of %u sectors, cold cache\n",
+           BENCH_TRACKS, BENCH_TRACK_SECTORS );
+  fprintf( log, "workers   window MiB        MB/s\n" );
+  for( i = 0; i < ( sizeof( threads ) / sizeof( threads[ 0 ] ) ); i++ )
+  {
+    for( j = 0; j < ( sizeof( windows ) / sizeof( windows[ 0 ] ) ); j++ )
+    {
+      rate = bench_run( cue, threads[ i ], windows[ j ] );
+      fprintf( log, "%7d %12llu %11.1f%s\n", threads[ i ],
+               ( unsigned long long )( windows[ j ] >> 20 ), rate,
+               ( windows[ j ] == 0 ) ? "  (off)" : "" );
+      ok = ok && ( rate > 0.0 );
+    }
+  }
+
+  unlink( BENCH_BIN );
+
+  return ok;
+}
+
+
+int main( void )
+{
+  waver_calibration_t cal = { 0 };
+  uint32_t mismatches;
+
+  mismatches = payload_kernel_bench( stdout, &cal );
+  if( mismatches > 0 )
+  {
+    fprintf( stderr, "%u kernels differ from the generic path\n", mismatches );
+    return EXIT_FAILURE;
+  }
+
+  if( !readahead_bench( stdout ) )
+  {
+    fprintf( stderr, "a run of the readahead benchmark failed\n" );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,307 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    check_cue.c
+# Purpose: property test of the cue
+#          parser, run by make check.
+#
+#          random cue sheets (audio and
+#          data tracks, pregaps, cooked
+#          and raw sectors, a partial
+#          sector at the end) are
+#          planned with every gap
+#          policy. the layout must keep
+#          the invariants of layout.c
+#          and every range must be the
+#          one the policy defines.
+#
+#==========================================
+*/
+
+#include "layout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* "private" defines */
+#define CHECK_SHEETS       2000   /* random cue sheets per gap policy */
+#define CHECK_MAX_TRACKS   40
+#define CHECK_CUE_LEN      ( CHECK_MAX_TRACKS * 96 + 64 )
+#define CHECK_DATA_SUBSIZE 2048
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  uint8_t  is_audio;
+  uint32_t gapframe;    /* first index */
+  uint32_t startframe;  /* INDEX 01 */
+
+} sheet_track_t;
+
+
+typedef struct
+{
+
+  sheet_track_t tracks[ CHECK_MAX_TRACKS ];
+  uint8_t       tracks_len;
+  uint8_t       raw;          /* 3234 byte sectors */
+  uint32_t      frames;       /* whole sectors of the bin */
+  uint32_t      extra;        /* bytes of a partial sector at the end */
+  char          text[ CHECK_CUE_LEN ];
+
+} sheet_t;
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static uint32_t random_below( uint32_t n );
+static void print_msf( char* buf, size_t len, uint32_t frames );
+static void make_sheet( sheet_t* sheet );
+static int expect_tracks( const waver_ctx_t* ctx, const sheet_t* sheet, uint8_t gaps,
+                          char* msg );
+static int check_sheet( const sheet_t* sheet, uint8_t gaps );
+
+/* ****************************************************************** */
+
+
+static uint32_t random_below( uint32_t n )
+{
+  return ( uint32_t )( ( ( uint64_t )rand() * n ) / ( ( uint64_t )RAND_MAX + 1 ) );
+}
+
+
+static void print_msf( char* buf, size_t len, uint32_t frames )
+{
+  snprintf( buf, len, "%02u:%02u:%02u", frames / ( 60 * 75 ), ( frames / 75 ) % 60,
+            frames % 75 );
+}
+
+
+/*
+ * tracks of 1 .. 3000 sectors, a third with a pregap (INDEX 00),
+ * track 01 starts at the start of the bin. data tracks are mode 1
+ * or 2 of 2352 bytes, anywhere on the disc.
+ */
+static void make_sheet( sheet_t* sheet )
+{
+  static const char* data_modes[] = { "MODE1/2352", "MODE2/2352" };
+  sheet_track_t* track = NULL;
+  uint32_t frame = 0;
+  size_t pos;
+  char msf[ 16 ];
+  uint8_t i;
+
+  memset( sheet, 0, sizeof( sheet_t ) );
+  sheet->tracks_len = ( uint8_t )( 1 + random_below( CHECK_MAX_TRACKS ) );
+  sheet->raw = ( random_below( 4 ) == 0 );
+
+  pos = ( size_t )snprintf( sheet->text, CHECK_CUE_LEN, "FILE \"check.bin\" BINARY\r\n" );
+  for( i = 0; i < sheet->tracks_len; i++ )
+  {
+    track = &sheet->tracks[ i ];
+    track->is_audio = ( random_below( 5 ) != 0 );
+    track->gapframe = frame;
+    if( random_below( 3 ) == 0 )
+    {
+      frame += 1 + random_below( 300 );
+    }
+    track->startframe = frame;
+    frame += 1 + random_below( 3000 );
+
+    pos += ( size_t )snprintf( ( sheet->text + pos ), ( CHECK_CUE_LEN - pos ),
+                               "  TRACK %02u %s\n", ( i + 1 ),
+                               track->is_audio ? "AUDIO" :
+                               data_modes[ random_below( 2 ) ] );
+    if( track->gapframe < track->startframe )
+    {
+      print_msf( msf, sizeof( msf ), track->gapframe );
+      pos += ( size_t )snprintf( ( sheet->text + pos ), ( CHECK_CUE_LEN - pos ),
+                                 "    INDEX 00 %s\n", msf );
+    }
+    print_msf( msf, sizeof( msf ), track->startframe );
+    pos += ( size_t )snprintf( ( sheet->text + pos ), ( CHECK_CUE_LEN - pos ),
+                               "\tINDEX 01 %s\n", msf );
+  }
+
+  sheet->frames = frame;
+  sheet->extra = ( random_below( 4 ) == 0 ) ? ( 1 + random_below( SECTOR_LEN - 1 ) ) : 0;
+}
+
+
+/*
+ * the ranges of the gap policies (see apply_gaps in cue.c):
+ * omit:    INDEX 01 up to the first index of the next track
+ * append:  INDEX 01 up to INDEX 01 of the next audio track
+ * prepend: first index of an audio track behind audio
+ * htoa:    append, track 00 in front of a pregap of track 01
+ */
+static int expect_tracks( const waver_ctx_t* ctx, const sheet_t* sheet, uint8_t gaps,
+                          char* msg )
+{
+  const sheet_track_t* cur = NULL;
+  const sheet_track_t* next = NULL;
+  const track_t* track = NULL;
+  uint32_t sector = sheet->raw ? SECTOR_RAW_LEN : SECTOR_LEN;
+  uint64_t bin_len = ( uint64_t )sheet->frames * sector + sheet->extra;
+  uint64_t start;
+  uint64_t end;
+  uint8_t hidden;
+  uint8_t i;
+
+  hidden = ( gaps == WAVER_GAPS_HTOA && sheet->tracks[ 0 ].is_audio &&
+             sheet->tracks[ 0 ].gapframe < sheet->tracks[ 0 ].startframe );
+  if( ctx->tracks_len != sheet->tracks_len + hidden )
+  {
+    snprintf( msg, LAYOUT_MSG_LEN, "%u tracks, expected %u", ctx->tracks_len,
+              ( sheet->tracks_len + hidden ) );
+    return (-1);
+  }
+  if( hidden &&
+      ( ( *( ctx->tracks + 0 ) )->number != 0 ||
+        ( *( ctx->tracks + 0 ) )->startbyte != sheet->tracks[ 0 ].gapframe * sector ||
+        ( *( ctx->tracks + 0 ) )->endbyte != sheet->tracks[ 0 ].startframe * sector ) )
+  {
+    snprintf( msg, LAYOUT_MSG_LEN, "hidden track at %u .. %u",
+              ( *( ctx->tracks + 0 ) )->startbyte, ( *( ctx->tracks + 0 ) )->endbyte );
+    return (-1);
+  }
+
+  for( i = 0; i < sheet->tracks_len; i++ )
+  {
+    cur   = &sheet->tracks[ i ];
+    next  = ( ( i + 1 ) < sheet->tracks_len ) ? &sheet->tracks[ i + 1 ] : NULL;
+    track = *( ctx->tracks + i + hidden );
+
+    start = ( uint64_t )cur->startframe * sector;
+    if( gaps == WAVER_GAPS_PREPEND && cur->is_audio &&
+        ( i == 0 || sheet->tracks[ i - 1 ].is_audio ) )
+    {
+      start = ( uint64_t )cur->gapframe * sector;
+    }
+
+    if( next == NULL )
+    {
+      end = bin_len;
+    }
+    else if( cur->is_audio && next->is_audio &&
+             ( gaps == WAVER_GAPS_APPEND || gaps == WAVER_GAPS_HTOA ) )
+    {
+      end = ( uint64_t )next->startframe * sector;
+    }
+    else
+    {
+      end = ( uint64_t )next->gapframe * sector;
+    }
+
+    if( track->number != ( i + 1 ) || track->is_audio != cur->is_audio ||
+        track->startbyte != start || track->endbyte != end )
+    {
+      snprintf( msg, LAYOUT_MSG_LEN, "track %d at %u .. %u, expected track %u at "
+                "%llu .. %llu", track->number, track->startbyte, track->endbyte, ( i + 1 ),
+                ( unsigned long long )start, ( unsigned long long )end );
+      return (-1);
+    }
+    if( track->startbyte % sector != 0 || track->sector_len != sector ||
+        track->subsize != ( cur->is_audio ? SECTOR_LEN : CHECK_DATA_SUBSIZE ) )
+    {
+      snprintf( msg, LAYOUT_MSG_LEN, "track %d has sectors of %u bytes, %u of user data",
+                track->number, track->sector_len, track->subsize );
+      return (-1);
+    }
+  }
+
+  return layout_check( ctx, bin_len, msg );
+}
+
+
+/* plans the sheet with a policy, 0 if the layout is the expected one */
+static int check_sheet( const sheet_t* sheet, uint8_t gaps )
+{
+  static const waver_calibration_t cal = { 0 };
+  waver_ctx_t* ctx = NULL;
+  waver_input_t input;
+  waver_status_t status;
+  FILE* out = NULL;
+  uint64_t bin_len = ( uint64_t )sheet->frames *
+                     ( sheet->raw ? SECTOR_RAW_LEN : SECTOR_LEN ) + sheet->extra;
+  char msg[ LAYOUT_MSG_LEN ] = "";
+  int failed = (-1);
+
+  input.handle = &bin_len;
+  input.size   = layout_size;
+  input.read   = layout_read;
+  input.close  = NULL;
+
+  if( waver_create( &ctx ) != WAVER_OK || ( out = fopen( "/dev/null", "w" ) ) == NULL )
+  {
+    waver_destroy( ctx );
+    fprintf( stderr, "Failed to set up a plan\n" );
+    return (-1);
+  }
+  waver_set_input( ctx, &input );
+  waver_set_cue_buffer( ctx, sheet->text, strlen( sheet->text ) );
+  waver_set_gaps( ctx, gaps );
+  waver_set_sector_layout( ctx, sheet->raw ? WAVER_SECTORS_RAW : WAVER_SECTORS_COOKED );
+
+  if( ( status = waver_plan( ctx, &cal, out ) ) != WAVER_OK )
+  {
+    snprintf( msg, LAYOUT_MSG_LEN, "%s", waver_error_message( ctx ) );
+  }
+  else
+  {
+    failed = expect_tracks( ctx, sheet, gaps, msg );
+  }
+  if( failed )
+  {
+    fprintf( stderr, "gap policy %u, %llu bytes: %s\n%s\n", gaps,
+             ( unsigned long long )bin_len, msg, sheet->text );
+  }
+
+  fclose( out );
+  waver_destroy( ctx );
+
+  return failed;
+}
+
+
+int main( int argc, char* argv[] )
+{
+  sheet_t sheet;
+  uint32_t seed = ( argc > 1 ) ? ( uint32_t )strtoul( argv[ 1 ], NULL, 10 ) : 1;
+  uint32_t failures = 0;
+  uint32_t i;
+  uint8_t gaps;
+
+  srand( seed );
+  for( i = 0; i < CHECK_SHEETS && failures < 10; i++ )
+  {
+    make_sheet( &sheet );
+    for( gaps = WAVER_GAPS_OMIT; gaps <= WAVER_GAPS_HTOA; gaps++ )
+    {
+      failures += ( check_sheet( &sheet, gaps ) != 0 );
+    }
+  }
+
+  fprintf( stdout, "cue layout: %u random sheets, seed %u, %u failures\n", i, seed,
+           failures );
+
+  return ( failures == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
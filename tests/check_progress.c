@@ -0,0 +1,444 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    check_progress.c
+# Purpose: test of the progress
+#          counters, run by make check.
+#
+#          a scratch bin (audio and data
+#          tracks, a pregap, pieces that
+#          don't fill a track) is
+#          converted on the paths of a
+#          run: wav and flac, swapped,
+#          wider samples, several or
+#          adaptive workers (their
+#          controller follows the bytes
+#          done), throttled and with
+#          reflinks, which a memory
+#          output fakes by copying the
+#          extents. at the
+#          end every input byte must be
+#          counted once, in the totals,
+#          read while the run goes on
+#          (bar, server STATUS) and per
+#          track, and the last record of
+#          the status fd must say so.
+#
+#==========================================
+*/
+
+#include "libwaver.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* "private" defines */
+#define PROGRESS_SECTOR_LEN  2352
+#define PROGRESS_MAX_TRACKS  8
+#define PROGRESS_RECORD_LEN  4096
+#define PROGRESS_BIN_NAME    "/tmp/waver_progressXXXXXX"
+#define PROGRESS_POLL_US     1000
+
+/* the clone callback of a case */
+#define CLONE_NONE  0
+#define CLONE_COPY  1  /* the extents are copied, as a reflink */
+#define CLONE_FAIL  2  /* the device can't, the bytes are written */
+
+/* ****************************************************************** */
+
+
+typedef struct
+{
+
+  const char* name;
+  int32_t     threads;
+  uint8_t     swap;
+  uint8_t     format;
+  uint8_t     samples;
+  uint8_t     clone;
+  uint8_t     adaptive;
+  uint64_t    read_rate;  /* throttle, bytes per second */
+
+} run_case_t;
+
+
+/* reads the counters while a run goes on, as STATUS of the server */
+typedef struct
+{
+
+  const waver_ctx_t* ctx;
+  uint8_t            stop;
+  uint8_t            broken;
+  uint64_t           done;
+  uint64_t           total;
+
+} poller_t;
+
+/* ****************************************************************** */
+
+/* "private" function prototypes */
+static int copy_clone( void* stream, int fd, uint64_t len, uint64_t src_offset,
+                       uint64_t offset );
+static int fail_clone( void* stream, int fd, uint64_t len, uint64_t src_offset,
+                       uint64_t offset );
+static void* poll_progress( void* arg );
+static int make_bin( char* path, uint8_t** bin, uint64_t* bin_len );
+static int check_status_record( FILE* status, uint64_t total, char* msg, size_t len );
+static int check_counters( const waver_ctx_t* ctx, const run_case_t* rc,
+                           const waver_buffer_t* bufs, const uint8_t* bin,
+                           char* msg, size_t len );
+static int check_case( const run_case_t* rc, const char* path, const uint8_t* bin );
+
+/* ****************************************************************** */
+
+
+/*
+ * track 02 has a pregap and track 03 is data, so the payloads don't
+ * start block aligned in the bin. the lengths are no multiples of
+ * a piece.
+ */
+static const char* cue_text =
+  "FILE \"progress.bin\" BINARY\n"
+  "  TRACK 01 AUDIO\n"
+  "    INDEX 01 00:00:00\n"
+  "  TRACK 02 AUDIO\n"
+  "    INDEX 00 00:13:17\n"
+  "    INDEX 01 00:15:17\n"
+  "  TRACK 03 MODE1/2352\n"
+  "    INDEX 01 00:42:01\n"
+  "  TRACK 04 AUDIO\n"
+  "    INDEX 00 00:48:50\n"
+  "    INDEX 01 00:50:50\n";
+
+/* sectors of the bin, track 04 ends with it */
+static const uint32_t bin_sectors = 5123;
+
+static const run_case_t cases[] =
+{
+  /* name            threads swap format             samples            clone       adaptive read_rate */
+  { "wav",           1,      0,   WAVER_FORMAT_WAV,  WAVER_SAMPLES_S16, CLONE_NONE, 0, 0 },
+  { "wav, 4 workers", 4,     0,   WAVER_FORMAT_WAV,  WAVER_SAMPLES_S16, CLONE_NONE, 0, 0 },
+  { "swapped",       2,      1,   WAVER_FORMAT_WAV,  WAVER_SAMPLES_S16, CLONE_NONE, 0, 0 },
+  { "24 bit",        2,      0,   WAVER_FORMAT_WAV,  WAVER_SAMPLES_S24, CLONE_NONE, 0, 0 },
+  { "flac",          2,      0,   WAVER_FORMAT_FLAC, WAVER_SAMPLES_S16, CLONE_NONE, 0, 0 },
+  { "reflink",       1,      0,   WAVER_FORMAT_WAV,  WAVER_SAMPLES_S16, CLONE_COPY, 0, 0 },
+  { "reflink, 4 workers", 4, 0,   WAVER_FORMAT_WAV,  WAVER_SAMPLES_S16, CLONE_COPY, 0, 0 },
+  { "reflink failing", 2,    0,   WAVER_FORMAT_WAV,  WAVER_SAMPLES_S16, CLONE_FAIL, 0, 0 },
+  { "reflink, adaptive", 0,  0,   WAVER_FORMAT_WAV,  WAVER_SAMPLES_S16, CLONE_COPY, 1, 0 },
+  { "reflink, throttled", 2, 0,   WAVER_FORMAT_WAV,  WAVER_SAMPLES_S16, CLONE_COPY, 0,
+    ( 8 * 1024 * 1024 ) }
+};
+
+/* the memory output the clone callbacks write through */
+static waver_output_t memory_output;
+static uint32_t clones = 0;
+
+/* ****************************************************************** */
+
+
+static int copy_clone( void* stream, int fd, uint64_t len, uint64_t src_offset,
+                       uint64_t offset )
+{
+  void* buf = NULL;
+  int failed = (-1);
+
+  if( ( buf = malloc( len ) ) != NULL &&
+      pread( fd, buf, len, ( off_t )src_offset ) == ( ssize_t )len &&
+      memory_output.write( stream, buf, len, offset ) == ( int64_t )len )
+  {
+    __atomic_fetch_add( &clones, 1, __ATOMIC_RELAXED );
+    failed = 0;
+  }
+  free( buf );
+
+  return failed;
+}
+
+
+static int fail_clone( void* stream, int fd, uint64_t len, uint64_t src_offset,
+                       uint64_t offset )
+{
+  __atomic_fetch_add( &clones, 1, __ATOMIC_RELAXED );
+
+  return (-1);
+}
+
+
+/* the bytes done never go back and never pass the total */
+static void* poll_progress( void* arg )
+{
+  poller_t* poller = ( poller_t* )arg;
+  uint64_t done;
+  uint64_t total;
+
+  while( !__atomic_load_n( &poller->stop, __ATOMIC_ACQUIRE ) )
+  {
+    waver_progress( poller->ctx, &done, &total );
+    if( done < poller->done || ( total > 0 && done > total ) )
+    {
+      poller->broken = 1;
+    }
+    poller->done  = done;
+    poller->total = total;
+    usleep( PROGRESS_POLL_US );
+  }
+
+  return NULL;
+}
+
+
+/* random samples in a temporary file, also kept in memory */
+static int make_bin( char* path, uint8_t** bin, uint64_t* bin_len )
+{
+  uint64_t i;
+  int fd;
+
+  *bin_len = ( uint64_t )bin_sectors * PROGRESS_SECTOR_LEN;
+  if( ( *bin = ( uint8_t* )malloc( *bin_len ) ) == NULL )
+  {
+    return (-1);
+  }
+  srand( 1 );
+  for( i = 0; i < *bin_len; i++ )
+  {
+    *( *bin + i ) = ( uint8_t )rand();
+  }
+
+  if( ( fd = mkstemp( path ) ) < 0 )
+  {
+    return (-1);
+  }
+  if( write( fd, *bin, *bin_len ) != ( ssize_t )*bin_len )
+  {
+    close( fd );
+    unlink( path );
+    return (-1);
+  }
+  close( fd );
+
+  return 0;
+}
+
+
+/* the last json record: done, with every byte of the run */
+static int check_status_record( FILE* status, uint64_t total, char* msg, size_t len )
+{
+  char line[ PROGRESS_RECORD_LEN ];
+  char last[ PROGRESS_RECORD_LEN ] = "";
+  char state[ 16 ] = "";
+  unsigned long long done = 0;
+  unsigned long long all = 0;
+  double t;
+
+  rewind( status );
+  while( fgets( line, PROGRESS_RECORD_LEN, status ) != NULL )
+  {
+    memcpy( last, line, PROGRESS_RECORD_LEN );
+  }
+
+  if( sscanf( last, "{\"state\":\"%15[a-z]\",\"time\":%lf,\"done\":%llu,\"total\":%llu",
+              state, &t, &done, &all ) != 4 )
+  {
+    snprintf( msg, len, "no status record" );
+    return (-1);
+  }
+  if( strcmp( state, "done" ) != 0 || done != total || all != total )
+  {
+    snprintf( msg, len, "status record %s, %llu of %llu bytes", state, done, all );
+    return (-1);
+  }
+
+  return 0;
+}
+
+
+/* the counters after a run, the samples of 16 bit wav outputs */
+static int check_counters( const waver_ctx_t* ctx, const run_case_t* rc,
+                           const waver_buffer_t* bufs, const uint8_t* bin,
+                           char* msg, size_t len )
+{
+  waver_track_info_t info;
+  uint64_t done = 0;
+  uint64_t total = 0;
+  uint64_t ranges = 0;
+  uint64_t range;
+  uint8_t i;
+
+  for( i = 0; i < waver_track_count( ctx ); i++ )
+  {
+    waver_track_info( ctx, i, &info );
+    range = info.endbyte - info.startbyte;
+    ranges += range;
+    if( info.bytes_done != range )
+    {
+      snprintf( msg, len, "track %02u: %llu of %llu bytes done", info.number,
+                ( unsigned long long )info.bytes_done, ( unsigned long long )range );
+      return (-1);
+    }
+
+    /* 16 bit samples as in the bin end the wav, cloned or not */
+    if( info.is_audio && !rc->swap && rc->format == WAVER_FORMAT_WAV &&
+        rc->samples == WAVER_SAMPLES_S16 &&
+        ( ( bufs + i )->len < range ||
+          memcmp( ( ( bufs + i )->data + ( bufs + i )->len - range ),
+                  ( bin + info.startbyte ), range ) != 0 ) )
+    {
+      snprintf( msg, len, "track %02u: the samples differ from the bin", info.number );
+      return (-1);
+    }
+  }
+
+  waver_progress( ctx, &done, &total );
+  if( total != ranges || done != total )
+  {
+    snprintf( msg, len, "%llu of %llu bytes done, the tracks have %llu",
+              ( unsigned long long )done, ( unsigned long long )total,
+              ( unsigned long long )ranges );
+    return (-1);
+  }
+
+  /* a reflink case that never clones tests nothing */
+  if( rc->clone != CLONE_NONE && __atomic_load_n( &clones, __ATOMIC_RELAXED ) == 0 )
+  {
+    snprintf( msg, len, "no piece was cloned" );
+    return (-1);
+  }
+
+  return 0;
+}
+
+
+/* converts the bin, 0 if every byte was counted */
+static int check_case( const run_case_t* rc, const char* path, const uint8_t* bin )
+{
+  waver_buffer_t bufs[ PROGRESS_MAX_TRACKS ];
+  waver_ctx_t* ctx = NULL;
+  waver_input_t input;
+  waver_output_t output;
+  poller_t poller;
+  pthread_t poll_thread;
+  waver_status_t run_status;
+  FILE* status = NULL;
+  uint64_t done = 0;
+  uint64_t total = 0;
+  char msg[ 256 ] = "";
+  int failed = (-1);
+  uint8_t i;
+
+  memset( bufs, 0x00, sizeof( bufs ) );
+  memset( &poller, 0x00, sizeof( poller ) );
+  clones = 0;
+
+  if( waver_create( &ctx ) != WAVER_OK || ( status = tmpfile() ) == NULL ||
+      waver_input_file( &input, path ) != WAVER_OK ||
+      waver_output_memory( &memory_output, bufs, PROGRESS_MAX_TRACKS ) != WAVER_OK )
+  {
+    fprintf( stderr, "%s: Failed to set up a run\n", rc->name );
+    waver_destroy( ctx );
+    if( status != NULL )
+    {
+      fclose( status );
+    }
+    return (-1);
+  }
+  output = memory_output;
+  output.clone = ( rc->clone == CLONE_COPY ) ? copy_clone :
+                 ( rc->clone == CLONE_FAIL ) ? fail_clone : NULL;
+
+  waver_set_input( ctx, &input );
+  waver_set_output( ctx, &output );
+  waver_set_cue_buffer( ctx, cue_text, strlen( cue_text ) );
+  waver_set_threads( ctx, rc->threads );
+  waver_set_adaptive( ctx, rc->adaptive );
+  waver_set_throttle( ctx, rc->read_rate, 0, 0 );
+  waver_set_swap( ctx, rc->swap );
+  waver_set_format( ctx, rc->format );
+  waver_set_sample_format( ctx, rc->samples );
+  waver_set_reflink( ctx, ( rc->clone != CLONE_NONE ) );
+  waver_set_progress( ctx, NULL, fileno( status ) );
+
+  poller.ctx = ctx;
+  if( pthread_create( &poll_thread, NULL, poll_progress, &poller ) != 0 )
+  {
+    poller.stop = 1;
+  }
+  run_status = waver_run( ctx );
+  if( !poller.stop )
+  {
+    __atomic_store_n( &poller.stop, 1, __ATOMIC_RELEASE );
+    pthread_join( poll_thread, NULL );
+  }
+
+  if( run_status != WAVER_OK )
+  {
+    snprintf( msg, sizeof( msg ), "%s", waver_error_message( ctx ) );
+  }
+  else if( poller.broken )
+  {
+    snprintf( msg, sizeof( msg ), "the bytes done went back or passed the total" );
+  }
+  else if( check_counters( ctx, rc, bufs, bin, msg, sizeof( msg ) ) == 0 )
+  {
+    waver_progress( ctx, &done, &total );
+    failed = check_status_record( status, total, msg, sizeof( msg ) );
+  }
+  if( failed )
+  {
+    fprintf( stderr, "%s: %s\n", rc->name, msg );
+  }
+
+  waver_destroy( ctx );
+  fclose( status );
+  for( i = 0; i < PROGRESS_MAX_TRACKS; i++ )
+  {
+    free( bufs[ i ].data );
+  }
+
+  return failed;
+}
+
+
+int main( void )
+{
+  char path[] = PROGRESS_BIN_NAME;
+  uint8_t* bin = NULL;
+  uint64_t bin_len = 0;
+  uint32_t failures = 0;
+  uint32_t i;
+
+  if( make_bin( path, &bin, &bin_len ) != 0 )
+  {
+    fprintf( stderr, "Failed to create %s\n", path );
+    free( bin );
+    return EXIT_FAILURE;
+  }
+
+  for( i = 0; i < ( sizeof( cases ) / sizeof( run_case_t ) ); i++ )
+  {
+    failures += ( check_case( ( cases + i ), path, bin ) != 0 );
+  }
+
+  fprintf( stdout, "progress: %u runs, %u failures\n", i, failures );
+
+  unlink( path );
+  free( bin );
+
+  return ( failures == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,9 @@
+0 1 7056000
+FILE "a.bin" BINARY
+  TRACK 01 AUDIO
+    INDEX 01 00:00:00
+  TRACK 02 AUDIO
+    INDEX 00 00:10:00
+    INDEX 01 00:12:00
+  TRACK 03 AUDIO
+    INDEX 01 00:20:00
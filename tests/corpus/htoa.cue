@@ -0,0 +1,7 @@
+3 1 7056000
+FILE "a.bin" BINARY
+	TRACK 01 AUDIO
+		INDEX 00 00:00:00
+		INDEX 01 00:02:00
+	TRACK 02 AUDIO
+		INDEX 01 00:30:00
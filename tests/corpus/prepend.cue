@@ -0,0 +1,10 @@
+2 0 7057000
+FILE "a.bin" BINARY
+  TRACK 01 AUDIO
+    INDEX 01 00:00:00
+  TRACK 02 MODE2/2352
+    INDEX 00 00:14:00
+    INDEX 01 00:16:00
+  TRACK 03 AUDIO
+    INDEX 00 00:20:00
+    INDEX 01 00:21:10
@@ -0,0 +1,6 @@
+0 1 7056000 2 100 500
+FILE "a.bin" BINARY
+  TRACK 01 AUDIO
+    INDEX 01 00:00:00
+  TRACK 02 AUDIO
+    INDEX 01 00:12:00
@@ -0,0 +1,400 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    fuzz_cue.c
+# Purpose: fuzz target of the cue parser
+#          (tokenize, time_to_frames,
+#          create_track_metadata) and
+#          the track selection, for
+#          libFuzzer, AFL and the
+#          driver of make fuzz.
+#
+#          an input is a line of the
+#          setup of the plan and the
+#          cue sheet:
+#
+#            <gaps> <layout> <length>
+#            [<track> <from> <to>]
+#            FILE "x.bin" BINARY
+#              TRACK 01 AUDIO
+#            ...
+#
+#          gaps is the gap policy,
+#          layout the sector layout,
+#          length the bytes of the bin,
+#          the optional track or range
+#          (frames) is selected. a plan
+#          that succeeds must keep the
+#          invariants of layout.c, else
+#          the target aborts.
+#
+#          built with FUZZ_DRIVER it has
+#          its own main: files are run
+#          once (AFL: fuzz_cue @@),
+#          directories are the seeds of
+#          -runs=<n> mutations.
+#
+#==========================================
+*/
+
+#include "layout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef FUZZ_DRIVER
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+/* "private" defines */
+#define FUZZ_MAX_LEN    ( 64 * 1024 )   /* of an input */
+#define FUZZ_SETUP_LEN  128             /* of the setup line */
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+int LLVMFuzzerTestOneInput( const uint8_t* data, size_t size );
+
+/* ****************************************************************** */
+
+
+int LLVMFuzzerTestOneInput( const uint8_t* data, size_t size )
+{
+  static const waver_calibration_t cal = { 0 };
+  static FILE* out = NULL;
+  waver_ctx_t* ctx = NULL;
+  waver_input_t input;
+  char setup[ FUZZ_SETUP_LEN ];
+  char msg[ LAYOUT_MSG_LEN ];
+  const uint8_t* text = NULL;
+  unsigned int gaps;
+  unsigned int layout;
+  unsigned long long bin_len;
+  unsigned int track = 0;
+  unsigned int from = 0;
+  unsigned int to = 0;
+  uint64_t len;
+  size_t setup_len;
+  int fields;
+
+  if( size > FUZZ_MAX_LEN ||
+      ( text = ( const uint8_t* )memchr( data, '\n', size ) ) == NULL ||
+      ( setup_len = ( size_t )( text - data ) ) >= FUZZ_SETUP_LEN )
+  {
+    return 0;
+  }
+  memcpy( setup, data, setup_len );
+  setup[ setup_len ] = '\0';
+  text++;
+
+  if( ( fields = sscanf( setup, "%u %u %llu %u %u %u", &gaps, &layout, &bin_len,
+                        &track, &from, &to ) ) < 3 )
+  {
+    return 0;
+  }
+
+  if( out == NULL && ( out = fopen( "/dev/null", "w" ) ) == NULL )
+  {
+    abort();
+  }
+  if( waver_create( &ctx ) != WAVER_OK )
+  {
+    abort();
+  }
+
+  len = ( uint64_t )bin_len;
+  input.handle = &len;
+  input.size   = layout_size;
+  input.read   = layout_read;
+  input.close  = NULL;
+  waver_set_input( ctx, &input );
+  waver_set_cue_buffer( ctx, ( const char* )text, ( size - ( size_t )( text - data ) ) );
+  waver_set_gaps( ctx, ( uint8_t )( gaps % ( WAVER_GAPS_HTOA + 1 ) ) );
+  waver_set_sector_layout( ctx, ( uint8_t )( layout % ( WAVER_SECTORS_RAW + 1 ) ) );
+  if( fields == 4 )
+  {
+    waver_select_track( ctx, ( uint8_t )track );
+  }
+  else if( fields == 6 )
+  {
+    waver_select_range( ctx, ( uint8_t )track, from, to );
+  }
+
+  /* a selection leaves holes, the invariants hold for whole discs */
+  if( waver_plan( ctx, &cal, out ) == WAVER_OK && fields == 3 &&
+      layout_check( ctx, len, msg ) != 0 )
+  {
+    fprintf( stderr, "layout invariant broken: %s\n", msg );
+    abort();
+  }
+
+  waver_destroy( ctx );
+
+  return 0;
+}
+
+/* ****************************************************************** */
+
+#ifdef FUZZ_DRIVER
+
+typedef struct
+{
+
+  uint8_t* data;
+  size_t   len;
+
+} seed_t;
+
+
+/* "private" function prototypes */
+static uint32_t next_random( void );
+static uint8_t* read_file( const char* path, size_t* len );
+static size_t add_seeds( const char* dir, seed_t** seeds, size_t seeds_len );
+static size_t mutate( uint8_t* buf, size_t len, const seed_t* seeds, size_t seeds_len );
+
+/* tokens of cue sheets the mutations insert */
+static const char* dictionary[] =
+{
+  "TRACK ", "INDEX ", "AUDIO", "MODE1/2352", "MODE2/2352", "MODE1/2048", "MODE2/2336",
+  "FILE \"a.bin\" BINARY", "00", "01", "99", "100", ":", "59:74", "99:59:74", "\n", "\r\n",
+  "\t", " ", "PREGAP 00:02:00", "REM "
+};
+
+static uint32_t state = 1;
+
+
+/* xorshift, the runs repeat */
+static uint32_t next_random( void )
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+
+  return state;
+}
+
+
+static uint8_t* read_file( const char* path, size_t* len )
+{
+  FILE* in = NULL;
+  uint8_t* buf = NULL;
+
+  if( ( buf = ( uint8_t* )malloc( FUZZ_MAX_LEN ) ) == NULL ||
+      ( in = fopen( path, "rb" ) ) == NULL )
+  {
+    free( buf );
+    return NULL;
+  }
+  *len = fread( buf, 1, FUZZ_MAX_LEN, in );
+  fclose( in );
+
+  return buf;
+}
+
+
+/* the files of a directory, returns the number of seeds */
+static size_t add_seeds( const char* dir, seed_t** seeds, size_t seeds_len )
+{
+  DIR* d = NULL;
+  struct dirent* entry = NULL;
+  seed_t* grown = NULL;
+  char path[ PATH_LEN ];
+  uint8_t* data = NULL;
+  size_t len;
+
+  if( ( d = opendir( dir ) ) == NULL )
+  {
+    return seeds_len;
+  }
+  while( ( entry = readdir( d ) ) != NULL )
+  {
+    if( *entry->d_name == '.' )
+    {
+      continue;
+    }
+    snprintf( path, PATH_LEN, "%s/%s", dir, entry->d_name );
+    if( ( data = read_file( path, &len ) ) == NULL )
+    {
+      continue;
+    }
+    if( ( grown = ( seed_t* )realloc( *seeds, ( seeds_len + 1 ) * sizeof( seed_t ) ) ) == NULL )
+    {
+      free( data );
+      break;
+    }
+    *seeds = grown;
+    ( *seeds + seeds_len )->data = data;
+    ( *seeds + seeds_len )->len = len;
+    seeds_len++;
+  }
+  closedir( d );
+
+  return seeds_len;
+}
+
+
+/* a few byte, token and line mutations, buf holds FUZZ_MAX_LEN */
+static size_t mutate( uint8_t* buf, size_t len, const seed_t* seeds, size_t seeds_len )
+{
+  const seed_t* other = NULL;
+  const char* token = NULL;
+  uint32_t rounds = 1 + next_random() % 8;
+  size_t pos;
+  size_t n;
+
+  while( rounds-- > 0 )
+  {
+    pos = ( len > 0 ) ? ( next_random() % len ) : 0;
+    switch( next_random() % 6 )
+    {
+      case 0:  /* flip a bit */
+      {
+        if( len > 0 )
+        {
+          *( buf + pos ) ^= ( uint8_t )( 1 << ( next_random() % 8 ) );
+        }
+        break;
+      }
+      case 1:  /* a digit */
+      {
+        if( len > 0 )
+        {
+          *( buf + pos ) = ( uint8_t )( '0' + next_random() % 10 );
+        }
+        break;
+      }
+      case 2:  /* drop a range */
+      {
+        n = ( len > pos ) ? ( next_random() % ( len - pos ) ) % 64 : 0;
+        memmove( ( buf + pos ), ( buf + pos + n ), ( len - pos - n ) );
+        len -= n;
+        break;
+      }
+      case 3:  /* insert a token */
+      {
+        token = dictionary[ next_random() % ( sizeof( dictionary ) / sizeof( char* ) ) ];
+        n = strlen( token );
+        if( len + n < FUZZ_MAX_LEN )
+        {
+          memmove( ( buf + pos + n ), ( buf + pos ), ( len - pos ) );
+          memcpy( ( buf + pos ), token, n );
+          len += n;
+        }
+        break;
+      }
+      case 4:  /* duplicate a range, e. g. a track */
+      {
+        n = ( len > pos ) ? ( next_random() % ( len - pos ) ) % 256 : 0;
+        if( len + n < FUZZ_MAX_LEN )
+        {
+          memmove( ( buf + pos + n ), ( buf + pos ), ( len - pos ) );
+          len += n;
+        }
+        break;
+      }
+      default:  /* splice the tail of another seed */
+      {
+        other = seeds + ( next_random() % seeds_len );
+        n = ( other->len > 0 ) ? ( next_random() % other->len ) : 0;
+        if( pos + ( other->len - n ) < FUZZ_MAX_LEN )
+        {
+          memcpy( ( buf + pos ), ( other->data + n ), ( other->len - n ) );
+          len = pos + ( other->len - n );
+        }
+        break;
+      }
+    }
+  }
+
+  return len;
+}
+
+
+int main( int argc, char* argv[] )
+{
+  seed_t* seeds = NULL;
+  size_t seeds_len = 0;
+  uint8_t* buf = NULL;
+  size_t len;
+  unsigned long runs = 0;
+  unsigned long i;
+  struct stat st;
+  int files = 0;
+  int a;
+
+  for( a = 1; a < argc; a++ )
+  {
+    if( strncmp( argv[ a ], "-runs=", 6 ) == 0 )
+    {
+      runs = strtoul( ( argv[ a ] + 6 ), NULL, 10 );
+    }
+    else if( strncmp( argv[ a ], "-seed=", 6 ) == 0 )
+    {
+      state = ( uint32_t )strtoul( ( argv[ a ] + 6 ), NULL, 10 ) | 1;
+    }
+    else if( stat( argv[ a ], &st ) == 0 && S_ISDIR( st.st_mode ) )
+    {
+      seeds_len = add_seeds( argv[ a ], &seeds, seeds_len );
+    }
+    else if( ( buf = read_file( argv[ a ], &len ) ) != NULL )
+    {
+      LLVMFuzzerTestOneInput( buf, len );
+      free( buf );
+      files++;
+    }
+  }
+
+  if( seeds_len == 0 )
+  {
+    if( files == 0 )
+    {
+      fprintf( stderr, "usage: %s [-runs=<n>] [-seed=<n>] <seed dir> ... | <file> ...\n",
+               argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  /* the seeds as they are, then mutations of them */
+  for( i = 0; i < seeds_len; i++ )
+  {
+    LLVMFuzzerTestOneInput( ( seeds + i )->data, ( seeds + i )->len );
+  }
+  if( ( buf = ( uint8_t* )malloc( FUZZ_MAX_LEN ) ) == NULL )
+  {
+    return EXIT_FAILURE;
+  }
+  for( i = 0; i < runs; i++ )
+  {
+    memcpy( buf, ( seeds + ( i % seeds_len ) )->data, ( seeds + ( i % seeds_len ) )->len );
+    len = mutate( buf, ( seeds + ( i % seeds_len ) )->len, seeds, seeds_len );
+    LLVMFuzzerTestOneInput( buf, len );
+  }
+  fprintf( stdout, "cue fuzzer: %zu seeds, %lu mutations, no crash\n", seeds_len, runs );
+
+  for( i = 0; i < seeds_len; i++ )
+  {
+    free( ( seeds + i )->data );
+  }
+  free( seeds );
+  free( buf );
+
+  return EXIT_SUCCESS;
+}
+
+#endif /* FUZZ_DRIVER */
@@ -0,0 +1,138 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# ===================
+# File:    layout.c
+# Purpose: invariants of the track
+#          layout and an input that
+#          only has a size, for the
+#          tests of the cue parser
+#
+#==========================================
+*/
+
+#include "layout.h"
+
+#include <stdio.h>
+
+/* ****************************************************************** */
+
+
+/*
+ * the byte ranges after a successful parse: in order and without
+ * overlap, each one ends where the next one or its dropped pregap
+ * starts, together with the dropped pregaps they cover the bin up
+ * to its end. whole sectors but at the end of the bin, the bytes
+ * match the frames of the indexes, the payload is the user data of
+ * the range.
+ * returns 0, or -1 and the first violation in msg.
+ */
+int layout_check( const waver_ctx_t* ctx, uint64_t bin_len, char* msg )
+{
+  const track_t* track = NULL;
+  const track_t* next = NULL;
+  uint64_t covered = 0;
+  uint64_t dropped = 0;
+  uint64_t range;
+  uint8_t i;
+
+  if( ctx->tracks_len == 0 )
+  {
+    snprintf( msg, LAYOUT_MSG_LEN, "no tracks" );
+    return (-1);
+  }
+
+  /* the bytes in front of the first track are its dropped pregap */
+  dropped = ( *( ctx->tracks + 0 ) )->startbyte;
+
+  for( i = 0; i < ctx->tracks_len; i++ )
+  {
+    track = *( ctx->tracks + i );
+    next  = ( ( i + 1 ) < ctx->tracks_len ) ? *( ctx->tracks + ( i + 1 ) ) : NULL;
+    range = ( uint64_t )track->endbyte - track->startbyte;
+
+    if( track->startbyte > track->endbyte || track->endbyte > bin_len )
+    {
+      snprintf( msg, LAYOUT_MSG_LEN, "track %d has the range %u .. %u in %llu bytes",
+                track->number, track->startbyte, track->endbyte,
+                ( unsigned long long )bin_len );
+      return (-1);
+    }
+    if( next != NULL && track->endbyte > next->startbyte )
+    {
+      snprintf( msg, LAYOUT_MSG_LEN, "track %d overlaps track %d", track->number,
+                next->number );
+      return (-1);
+    }
+    if( next != NULL && track->endbyte != next->startbyte &&
+        track->endbyte != next->gapbyte )
+    {
+      snprintf( msg, LAYOUT_MSG_LEN, "a hole of %u bytes behind track %d",
+                ( next->startbyte - track->endbyte ), track->number );
+      return (-1);
+    }
+    if( track->sector_len == 0 || ( next != NULL && range % track->sector_len != 0 ) )
+    {
+      snprintf( msg, LAYOUT_MSG_LEN, "track %d is not sector aligned", track->number );
+      return (-1);
+    }
+    if( track->startframe < track->gapframe ||
+        track->startbyte != track->gapbyte + ( track->startframe - track->gapframe ) *
+                                             track->sector_len ||
+        ( next != NULL && range != ( uint64_t )( track->endframe - track->startframe ) *
+                                   track->sector_len ) )
+    {
+      snprintf( msg, LAYOUT_MSG_LEN, "track %d has bytes %u .. %u for frames %u .. %u",
+                track->number, track->startbyte, track->endbyte, track->startframe,
+                track->endframe );
+      return (-1);
+    }
+    if( track->size_byte != ( ( track->sector_len == track->subsize ) ? range :
+                              ( range / track->sector_len ) * track->subsize ) )
+    {
+      snprintf( msg, LAYOUT_MSG_LEN, "track %d has a payload of %u bytes in %llu",
+                track->number, track->size_byte, ( unsigned long long )range );
+      return (-1);
+    }
+
+    covered += range;
+    dropped += ( next != NULL ) ? ( uint64_t )( next->startbyte - track->endbyte ) : 0;
+  }
+
+  if( track->endbyte != bin_len || covered + dropped != bin_len )
+  {
+    snprintf( msg, LAYOUT_MSG_LEN, "%llu bytes in tracks and %llu in dropped pregaps "
+              "of %llu", ( unsigned long long )covered, ( unsigned long long )dropped,
+              ( unsigned long long )bin_len );
+    return (-1);
+  }
+
+  return 0;
+}
+
+
+/* handle is the length of the bin */
+int64_t layout_size( void* handle )
+{
+  return ( int64_t )*( const uint64_t* )handle;
+}
+
+
+/* nothing is read by a plan */
+int64_t layout_read( void* handle, void* buf, uint64_t len, uint64_t offset )
+{
+  return (-1);
+}
@@ -0,0 +1,50 @@
+/*
+#==========================================
+#
+#      ___           ___           ___
+#     /\__\         /\  \         /\__\
+#    /:/ _/_       /::\  \       /:/  /
+#   /:/ /\__\     /:/\:\  \     /:/  /
+#  /:/ /:/ _/_   /::\~\:\  \   /:/__/  ___
+# /:/_/:/ /\__\ /:/\:\ \:\__\  |:|  | /\__\
+# \:\/:/ /:/  / \/__\:\/:/  /  |:|  |/:/  /
+#  \::/_/:/  /       \::/  /   |:|__/:/  /
+#   \:\/:/  /        /:/  /     \::::/__/
+#    \::/  /        /:/  /       ~~~~
+#     \/__/         \/__/
+#
+# WAV creator
+# =========================================
+# File:      layout.h
+#
+# Purpose:   Invariants of the track
+#            layout, shared by the
+#            property test (check_cue.c)
+#            and the fuzzer (fuzz_cue.c).
+#
+#            They are checked on the
+#            tracks of the context, apart
+#            from the check of the parser
+#            itself.
+#
+#==========================================
+*/
+#ifndef LAYOUT_H_
+#define LAYOUT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "waver.h"
+
+#define LAYOUT_MSG_LEN  256
+
+/* ****************************************************************** */
+
+/* "public" function prototypes */
+int layout_check( const waver_ctx_t* ctx, uint64_t bin_len, char* msg );
+int64_t layout_size( void* handle );
+int64_t layout_read( void* handle, void* buf, uint64_t len, uint64_t offset );
+
+/* ****************************************************************** */
+#endif /* LAYOUT_H_ */